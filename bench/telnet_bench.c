@@ -0,0 +1,1049 @@
+/**
+ * @file telnet_bench.c
+ * @brief Telnet服务器负载测试工具
+ * @date liuliang 2026-01-25
+ *
+ * 通过本地回环打开N个并发Telnet会话，按指定负载回放：
+ *   type   - 逐字符输入并等待回显，再回车执行
+ *   paste  - 整行粘贴命令
+ *   cmds   - help/time/echo混合命令
+ *   churn  - 连接、等待提示符、quit、重连
+ * 输出每秒连接数、每秒命令数，以及回显/命令/连接延迟的p50/p99/p99.9，
+ * 可输出表格或JSON，用于比较事件循环改动前后的性能；
+ * -f N另外打开N个洪泛会话，尽可能快地粘贴命令并丢弃输出，不计入延迟，
+ * 用于观察大量输入的会话对其他会话延迟的影响；
+ * -a USER:PASS让所有会话先登录（用户名中的%d替换为会话编号），-l N另外打开N个登录会话，
+ * 反复连接、登录、quit，输出每秒登录数和登录延迟，用于观察登录风暴对其他会话延迟的影响；
+ * 服务器按来源IP限制同时校验的登录数，-s N把会话分散到N个回环源地址；
+ * -b（需要-a）另外打开一个登录后发送wall的会话和一个停在密码提示符的会话，
+ * 检查登录完成前的会话收不到广播和命令提示符，收到或广播未能发出时退出码为1
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#define BENCH_PROMPT "wktx:##>"           // 服务器提示符
+#define BENCH_LOGIN_PROMPT "login: "      // 用户名提示符
+#define BENCH_PASSWORD_PROMPT "Password: " // 密码提示符
+#define BENCH_WALL_TEXT "bench-broadcast"  // -b发送的广播内容
+#define BENCH_MAX_EVENTS 512
+#define BENCH_READ_SIZE 16384
+#define BENCH_FLOOD_SIZE 65536          // 洪泛会话循环发送的数据长度
+
+// Telnet命令
+#define IAC  255
+#define DONT 254
+#define DO   253
+#define WONT 252
+#define WILL 251
+#define SB   250
+#define SE   240
+#define OPT_ECHO 1
+#define OPT_SGA  3
+
+// 负载类型
+enum {
+    BENCH_TYPE = 0,
+    BENCH_PASTE,
+    BENCH_CMDS,
+    BENCH_CHURN
+};
+
+static const char *bench_workload_names[] = { "type", "paste", "cmds", "churn" };
+
+// 会话状态
+enum {
+    S_CONNECTING = 0,                   // 等待TCP连接建立
+    S_WAIT_BANNER,                      // 等待欢迎信息后的提示符
+    S_WAIT_LOGIN,                       // 等待用户名提示符
+    S_WAIT_PASSWORD,                    // 等待密码提示符
+    S_WAIT_AUTH,                        // 已发送密码，等待提示符；再次出现用户名提示符时重试
+    S_WAIT_ECHO,                        // 等待单个字符的回显
+    S_WAIT_PROMPT,                      // 等待命令执行后的提示符
+    S_WAIT_CLOSE,                       // quit后等待服务器关闭
+    S_IDLE,                             // 思考时间
+    S_FLOOD,                            // 洪泛会话：可写时就发送
+    S_PARKED                            // 停在密码提示符，不再输入
+};
+
+// -b检查中的会话角色
+enum {
+    W_NONE = 0,
+    W_SENDER,                           // 登录后发送一次wall
+    W_WATCHER                           // 停在密码提示符，统计收到的广播
+};
+
+// 单个会话
+typedef struct {
+    int fd;
+    int state;
+    uint64_t op_start;                  // 当前操作开始时间(ns)
+    uint64_t next_op;                   // 思考时间结束时间(ns)
+    int iac_state;                      // 接收方向的IAC解析状态
+    unsigned char iac_verb;
+    int prompt_match;                   // 提示符已匹配的长度
+    int login_match;                    // 用户名提示符已匹配的长度
+    int password_match;                 // 密码提示符已匹配的长度
+    const char *text;                   // 逐字符输入的文本
+    int text_pos;
+    char expect;                        // 等待回显的字符
+    unsigned int seed;                  // 每个会话独立的随机数种子
+    int flood;                          // 洪泛会话
+    size_t flood_pos;                   // 洪泛数据的发送位置
+    int login;                          // 登录会话：登录后立即quit并重连
+    uint64_t login_start;               // 发送用户名的时间(ns)
+    int wall;                           // -b检查中的角色(W_*)
+    int wall_match;                     // 广播内容已匹配的长度
+} bench_session_t;
+
+// 延迟样本（微秒）
+typedef struct {
+    uint32_t *v;
+    size_t n;
+    size_t cap;
+} bench_samples_t;
+
+// 运行参数
+typedef struct {
+    const char *host;
+    int port;
+    int sessions;
+    int duration;
+    int warmup;
+    int think_ms;
+    int workload;
+    int flooders;
+    int logins;
+    int sources;                        // 回环源地址个数，1表示不绑定
+    const char *user;                   // 登录用户名，NULL表示不登录
+    const char *password;
+    int wall_check;                     // -b：检查登录前的会话收不到广播
+    int json;
+} bench_config_t;
+
+// 运行结果
+typedef struct {
+    uint64_t connections;
+    uint64_t commands;
+    uint64_t keystrokes;
+    uint64_t errors;
+    uint64_t flood_bytes;
+    uint64_t logins;
+    uint64_t login_retries;             // 校验队列满或密码错误后重新登录的次数
+    int wall_sent;                      // -b的广播已发送
+    uint64_t prelogin_leaks;            // 登录前的会话收到的广播和命令提示符次数
+    bench_samples_t echo_lat;
+    bench_samples_t cmd_lat;
+    bench_samples_t conn_lat;
+    bench_samples_t login_lat;
+} bench_result_t;
+
+static bench_config_t cfg;
+static bench_result_t res;
+static struct sockaddr_in server_addr;
+static int epfd = -1;
+static uint64_t t_measure;              // 预热结束时间
+static volatile sig_atomic_t stop_flag = 0;
+static bench_session_t *wall_sender;    // 已登录、等待发送广播的会话
+static bench_session_t *wall_watcher;   // 已停在密码提示符的会话
+
+static char bench_flood_data[BENCH_FLOOD_SIZE];
+static const char *bench_type_text = "echo hello world";
+static const char *bench_cmd_lines[] = {
+    "help\r\n",
+    "time\r\n",
+    "echo the quick brown fox jumps over the lazy dog\r\n",
+};
+
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void on_signal(int sig)
+{
+    (void)sig;
+    stop_flag = 1;
+}
+
+static void samples_add(bench_samples_t *s, uint64_t ns)
+{
+    if (now_ns() < t_measure)
+    {
+        return;
+    }
+
+    if (s->n == s->cap)
+    {
+        size_t cap = s->cap ? s->cap * 2 : 4096;
+        uint32_t *v = (uint32_t *)realloc(s->v, cap * sizeof(uint32_t));
+        if (!v)
+        {
+            return;
+        }
+        s->v = v;
+        s->cap = cap;
+    }
+
+    s->v[s->n++] = (uint32_t)(ns / 1000 > UINT32_MAX ? UINT32_MAX : ns / 1000);
+}
+
+static int cmp_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static uint32_t samples_pct(const bench_samples_t *s, double p)
+{
+    size_t idx;
+
+    if (s->n == 0)
+    {
+        return 0;
+    }
+
+    idx = (size_t)(p / 100.0 * (double)(s->n - 1) + 0.5);
+    return s->v[idx];
+}
+
+static void send_all(bench_session_t *s, const char *data, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t n = send(s->fd, data, len, MSG_NOSIGNAL);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            // 负载很小，发送缓冲区满视为错误
+            res.errors++;
+            return;
+        }
+        data += n;
+        len -= (size_t)n;
+    }
+}
+
+// 开始一次新连接
+static void session_connect(bench_session_t *s, int index)
+{
+    struct epoll_event ev;
+    int one = 1;
+
+    s->fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (s->fd < 0)
+    {
+        perror("socket");
+        res.errors++;
+        return;
+    }
+    setsockopt(s->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    // 按会话编号绑定127.0.0.1起的源地址
+    if (cfg.sources > 1)
+    {
+        struct sockaddr_in local;
+
+        memset(&local, 0, sizeof(local));
+        local.sin_family = AF_INET;
+        local.sin_addr.s_addr = htonl(INADDR_LOOPBACK + (uint32_t)(index % cfg.sources));
+        if (bind(s->fd, (struct sockaddr *)&local, sizeof(local)) < 0)
+        {
+            perror("bind");
+            res.errors++;
+            close(s->fd);
+            s->fd = -1;
+            return;
+        }
+    }
+
+    s->state = S_CONNECTING;
+    s->iac_state = 0;
+    s->prompt_match = 0;
+    s->login_match = 0;
+    s->password_match = 0;
+    s->wall_match = 0;
+    s->op_start = now_ns();
+
+    if (connect(s->fd, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0 && errno != EINPROGRESS)
+    {
+        res.errors++;
+        close(s->fd);
+        s->fd = -1;
+        return;
+    }
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP;
+    ev.data.u32 = (uint32_t)index;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, s->fd, &ev);
+}
+
+static void session_close(bench_session_t *s)
+{
+    // 重连后重新登录或停到密码提示符
+    if (s == wall_sender)
+    {
+        wall_sender = NULL;
+    }
+    if (s == wall_watcher)
+    {
+        wall_watcher = NULL;
+    }
+
+    if (s->fd >= 0)
+    {
+        epoll_ctl(epfd, EPOLL_CTL_DEL, s->fd, NULL);
+        close(s->fd);
+        s->fd = -1;
+    }
+}
+
+// 洪泛会话发送到发送缓冲区满为止
+static void session_flood(bench_session_t *s)
+{
+    for (;;)
+    {
+        ssize_t n = send(s->fd, bench_flood_data + s->flood_pos, BENCH_FLOOD_SIZE - s->flood_pos,
+                         MSG_NOSIGNAL);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return;
+        }
+        if (now_ns() >= t_measure)
+        {
+            res.flood_bytes += (uint64_t)n;
+        }
+        s->flood_pos = (s->flood_pos + (size_t)n) % BENCH_FLOOD_SIZE;
+    }
+}
+
+// 发送用户名，%d替换为会话编号
+static void session_send_user(bench_session_t *s, int index)
+{
+    char line[256];
+    const char *pos = strstr(cfg.user, "%d");
+    int len;
+
+    if (pos)
+    {
+        len = snprintf(line, sizeof(line), "%.*s%d%s\r\n", (int)(pos - cfg.user), cfg.user, index, pos + 2);
+    }
+    else
+    {
+        len = snprintf(line, sizeof(line), "%s\r\n", cfg.user);
+    }
+
+    s->login_start = now_ns();
+    s->state = S_WAIT_PASSWORD;
+    send_all(s, line, (size_t)len < sizeof(line) ? (size_t)len : sizeof(line) - 1);
+}
+
+// 发送者已登录且观察者停在密码提示符后发送一次广播
+static void session_try_wall(void)
+{
+    static const char line[] = "wall " BENCH_WALL_TEXT "\r\n";
+
+    if (res.wall_sent || !wall_sender || !wall_watcher)
+    {
+        return;
+    }
+
+    res.wall_sent = 1;
+    send_all(wall_sender, line, sizeof(line) - 1);
+}
+
+// 开始下一个操作
+static void session_next_op(bench_session_t *s, int index)
+{
+    uint64_t now = now_ns();
+
+    if (stop_flag)
+    {
+        s->state = S_IDLE;
+        return;
+    }
+
+    if (cfg.think_ms > 0 && s->state != S_IDLE)
+    {
+        s->state = S_IDLE;
+        s->next_op = now + (uint64_t)cfg.think_ms * 1000000ull;
+        return;
+    }
+
+    s->op_start = now;
+
+    switch (cfg.workload)
+    {
+        case BENCH_TYPE:
+            s->text = bench_type_text;
+            s->text_pos = 0;
+            s->expect = s->text[0];
+            s->state = S_WAIT_ECHO;
+            send_all(s, &s->expect, 1);
+            res.keystrokes++;
+            break;
+
+        case BENCH_PASTE:
+        {
+            char line[128];
+            int len = snprintf(line, sizeof(line), "echo %064u\r\n", rand_r(&s->seed));
+            s->state = S_WAIT_PROMPT;
+            send_all(s, line, (size_t)len);
+            break;
+        }
+
+        case BENCH_CMDS:
+        {
+            const char *line = bench_cmd_lines[rand_r(&s->seed) % 3];
+            s->state = S_WAIT_PROMPT;
+            send_all(s, line, strlen(line));
+            break;
+        }
+
+        case BENCH_CHURN:
+            s->state = S_WAIT_CLOSE;
+            send_all(s, "quit\r\n", 6);
+            break;
+    }
+
+    (void)index;
+}
+
+// 回应服务器的选项协商：接受服务器回显和SGA，其余拒绝，模拟字符模式客户端
+static void session_negotiate(bench_session_t *s, unsigned char verb, unsigned char opt)
+{
+    unsigned char reply[3] = { IAC, 0, opt };
+
+    if (verb == WILL)
+    {
+        reply[1] = (opt == OPT_ECHO || opt == OPT_SGA) ? DO : DONT;
+    }
+    else if (verb == DO)
+    {
+        reply[1] = WONT;
+    }
+    else
+    {
+        return;
+    }
+
+    send_all(s, (const char *)reply, sizeof(reply));
+}
+
+// 逐字节匹配提示符，返回1表示完整匹配
+static int prompt_feed(const char *prompt, int *match, unsigned char c)
+{
+    if ((char)c == prompt[*match])
+    {
+        (*match)++;
+        if (prompt[*match] == '\0')
+        {
+            *match = 0;
+            return 1;
+        }
+        return 0;
+    }
+
+    *match = ((char)c == prompt[0]) ? 1 : 0;
+    return 0;
+}
+
+// 处理一个非命令数据字节，返回1表示当前操作完成，2表示登录未通过、需要重新登录
+static int session_data_byte(bench_session_t *s, unsigned char c)
+{
+    // 停在密码提示符的会话不应收到广播，也不应出现命令提示符
+    if (s->state == S_PARKED)
+    {
+        if (prompt_feed(BENCH_WALL_TEXT, &s->wall_match, c) || prompt_feed(BENCH_PROMPT, &s->prompt_match, c))
+        {
+            res.prelogin_leaks++;
+        }
+        return 0;
+    }
+
+    if (prompt_feed(BENCH_PROMPT, &s->prompt_match, c) &&
+        (s->state == S_WAIT_BANNER || s->state == S_WAIT_PROMPT || s->state == S_WAIT_AUTH))
+    {
+        return 1;
+    }
+
+    // 登录阶段的提示符，只在登录时匹配
+    if (cfg.user)
+    {
+        if (prompt_feed(BENCH_LOGIN_PROMPT, &s->login_match, c))
+        {
+            if (s->state == S_WAIT_LOGIN)
+            {
+                return 1;
+            }
+            if (s->state == S_WAIT_AUTH)
+            {
+                return 2;
+            }
+        }
+        if (prompt_feed(BENCH_PASSWORD_PROMPT, &s->password_match, c) && s->state == S_WAIT_PASSWORD)
+        {
+            return 1;
+        }
+    }
+
+    if (s->state == S_WAIT_ECHO && (char)c == s->expect)
+    {
+        return 1;
+    }
+
+    return 0;
+}
+
+// 会话可以开始工作：洪泛会话开始发送，登录会话quit后重连，其余开始第一个操作
+static void session_ready(bench_session_t *s, int index)
+{
+    if (s->flood)
+    {
+        struct epoll_event ev;
+
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP;
+        ev.data.u32 = (uint32_t)index;
+        epoll_ctl(epfd, EPOLL_CTL_MOD, s->fd, &ev);
+        s->state = S_FLOOD;
+        session_flood(s);
+        return;
+    }
+
+    if (s->login)
+    {
+        s->state = S_WAIT_CLOSE;
+        send_all(s, "quit\r\n", 6);
+        return;
+    }
+
+    if (s->wall == W_SENDER)
+    {
+        s->state = S_IDLE;
+        wall_sender = s;
+        session_try_wall();
+        return;
+    }
+
+    session_next_op(s, index);
+}
+
+// 当前操作完成后的状态转换
+static void session_op_done(bench_session_t *s, int index)
+{
+    uint64_t now = now_ns();
+
+    switch (s->state)
+    {
+        case S_WAIT_BANNER:
+            if (!s->flood && !s->wall)
+            {
+                samples_add(&res.conn_lat, now - s->op_start);
+                if (now >= t_measure)
+                {
+                    res.connections++;
+                }
+            }
+            session_ready(s, index);
+            break;
+
+        case S_WAIT_LOGIN:
+            // 连接延迟计到出现用户名提示符，之后是登录延迟
+            if (!s->flood && !s->wall)
+            {
+                samples_add(&res.conn_lat, now - s->op_start);
+                if (now >= t_measure)
+                {
+                    res.connections++;
+                }
+            }
+            session_send_user(s, index);
+            break;
+
+        case S_WAIT_PASSWORD:
+            if (s->wall == W_WATCHER)
+            {
+                s->state = S_PARKED;
+                s->prompt_match = 0;
+                wall_watcher = s;
+                session_try_wall();
+                break;
+            }
+            s->state = S_WAIT_AUTH;
+            send_all(s, cfg.password, strlen(cfg.password));
+            send_all(s, "\r\n", 2);
+            break;
+
+        case S_WAIT_AUTH:
+            if (!s->wall)
+            {
+                samples_add(&res.login_lat, now - s->login_start);
+                if (now >= t_measure)
+                {
+                    res.logins++;
+                }
+            }
+            session_ready(s, index);
+            break;
+
+        case S_WAIT_ECHO:
+            samples_add(&res.echo_lat, now - s->op_start);
+            s->text_pos++;
+            s->op_start = now;
+            if (s->text[s->text_pos] != '\0')
+            {
+                s->expect = s->text[s->text_pos];
+                send_all(s, &s->expect, 1);
+                res.keystrokes++;
+            }
+            else
+            {
+                // 整行输入完毕，回车执行
+                s->state = S_WAIT_PROMPT;
+                send_all(s, "\r\n", 2);
+            }
+            break;
+
+        case S_WAIT_PROMPT:
+            samples_add(&res.cmd_lat, now - s->op_start);
+            if (now >= t_measure)
+            {
+                res.commands++;
+            }
+            session_next_op(s, index);
+            break;
+
+        default:
+            break;
+    }
+}
+
+// 处理可读事件
+static void session_read(bench_session_t *s, int index)
+{
+    unsigned char buf[BENCH_READ_SIZE];
+
+    for (;;)
+    {
+        ssize_t n = recv(s->fd, buf, sizeof(buf), 0);
+
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            return;
+        }
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+
+        if (n <= 0)
+        {
+            // 连接关闭，churn负载下是正常结束
+            if (s->state != S_WAIT_CLOSE)
+            {
+                res.errors++;
+            }
+            session_close(s);
+            if (!stop_flag)
+            {
+                session_connect(s, index);
+            }
+            return;
+        }
+
+        for (ssize_t i = 0; i < n; i++)
+        {
+            unsigned char c = buf[i];
+
+            switch (s->iac_state)
+            {
+                case 0:
+                    if (c == IAC)
+                    {
+                        s->iac_state = 1;
+                    }
+                    else
+                    {
+                        int done = session_data_byte(s, c);
+                        if (done == 2)
+                        {
+                            // 校验队列满或密码错误，重新登录
+                            res.login_retries++;
+                            session_send_user(s, index);
+                        }
+                        else if (done)
+                        {
+                            session_op_done(s, index);
+                        }
+                    }
+                    break;
+                case 1:
+                    if (c == WILL || c == WONT || c == DO || c == DONT)
+                    {
+                        s->iac_verb = c;
+                        s->iac_state = 2;
+                    }
+                    else if (c == SB)
+                    {
+                        s->iac_state = 3;
+                    }
+                    else
+                    {
+                        s->iac_state = 0;
+                    }
+                    break;
+                case 2:
+                    session_negotiate(s, s->iac_verb, c);
+                    s->iac_state = 0;
+                    break;
+                case 3:
+                    if (c == IAC)
+                    {
+                        s->iac_state = 4;
+                    }
+                    break;
+                case 4:
+                    s->iac_state = (c == SE) ? 0 : 3;
+                    break;
+            }
+        }
+    }
+}
+
+static void print_latency_row(const char *name, bench_samples_t *s)
+{
+    printf("  %-10s %10zu %10u %10u %10u %10u\n", name, s->n,
+           samples_pct(s, 50), samples_pct(s, 99), samples_pct(s, 99.9),
+           s->n ? s->v[s->n - 1] : 0);
+}
+
+static void print_latency_json(const char *name, bench_samples_t *s, int last)
+{
+    printf("    \"%s\": {\"count\": %zu, \"p50\": %u, \"p99\": %u, \"p999\": %u, \"max\": %u}%s\n",
+           name, s->n, samples_pct(s, 50), samples_pct(s, 99), samples_pct(s, 99.9),
+           s->n ? s->v[s->n - 1] : 0, last ? "" : ",");
+}
+
+static void report(double seconds)
+{
+    qsort(res.echo_lat.v, res.echo_lat.n, sizeof(uint32_t), cmp_u32);
+    qsort(res.cmd_lat.v, res.cmd_lat.n, sizeof(uint32_t), cmp_u32);
+    qsort(res.conn_lat.v, res.conn_lat.n, sizeof(uint32_t), cmp_u32);
+    qsort(res.login_lat.v, res.login_lat.n, sizeof(uint32_t), cmp_u32);
+
+    if (cfg.json)
+    {
+        printf("{\n");
+        printf("  \"workload\": \"%s\",\n", bench_workload_names[cfg.workload]);
+        printf("  \"sessions\": %d,\n", cfg.sessions);
+        printf("  \"duration_s\": %.3f,\n", seconds);
+        printf("  \"connections\": %llu,\n", (unsigned long long)res.connections);
+        printf("  \"connections_per_sec\": %.1f,\n", res.connections / seconds);
+        printf("  \"commands\": %llu,\n", (unsigned long long)res.commands);
+        printf("  \"commands_per_sec\": %.1f,\n", res.commands / seconds);
+        printf("  \"keystrokes\": %llu,\n", (unsigned long long)res.keystrokes);
+        printf("  \"errors\": %llu,\n", (unsigned long long)res.errors);
+        printf("  \"flood_sessions\": %d,\n", cfg.flooders);
+        printf("  \"flood_bytes_per_sec\": %.1f,\n", res.flood_bytes / seconds);
+        printf("  \"login_sessions\": %d,\n", cfg.logins);
+        printf("  \"logins\": %llu,\n", (unsigned long long)res.logins);
+        printf("  \"logins_per_sec\": %.1f,\n", res.logins / seconds);
+        printf("  \"login_retries\": %llu,\n", (unsigned long long)res.login_retries);
+        if (cfg.wall_check)
+        {
+            printf("  \"wall_sent\": %d,\n", res.wall_sent);
+            printf("  \"prelogin_leaks\": %llu,\n", (unsigned long long)res.prelogin_leaks);
+        }
+        printf("  \"latency_us\": {\n");
+        print_latency_json("echo", &res.echo_lat, 0);
+        print_latency_json("command", &res.cmd_lat, 0);
+        print_latency_json("connect", &res.conn_lat, 0);
+        print_latency_json("login", &res.login_lat, 1);
+        printf("  }\n");
+        printf("}\n");
+        return;
+    }
+
+    printf("workload: %s, sessions: %d, duration: %.1f s\n",
+           bench_workload_names[cfg.workload], cfg.sessions, seconds);
+    printf("  connections/s: %.1f (%llu)\n", res.connections / seconds, (unsigned long long)res.connections);
+    printf("  commands/s:    %.1f (%llu)\n", res.commands / seconds, (unsigned long long)res.commands);
+    printf("  errors:        %llu\n", (unsigned long long)res.errors);
+    if (cfg.flooders > 0)
+    {
+        printf("  flood:         %d sessions, %.1f MB/s\n", cfg.flooders, res.flood_bytes / seconds / 1e6);
+    }
+    if (cfg.user)
+    {
+        printf("  logins/s:      %.1f (%llu, %d login sessions, %llu retries)\n", res.logins / seconds,
+               (unsigned long long)res.logins, cfg.logins, (unsigned long long)res.login_retries);
+    }
+    if (cfg.wall_check)
+    {
+        printf("  pre-login:     wall %s, %llu broadcasts/prompts leaked\n", res.wall_sent ? "sent" : "not sent",
+               (unsigned long long)res.prelogin_leaks);
+    }
+    printf("  %-10s %10s %10s %10s %10s %10s\n", "latency", "count", "p50(us)", "p99(us)", "p99.9(us)", "max(us)");
+    print_latency_row("echo", &res.echo_lat);
+    print_latency_row("command", &res.cmd_lat);
+    print_latency_row("connect", &res.conn_lat);
+    if (cfg.user)
+    {
+        print_latency_row("login", &res.login_lat);
+    }
+}
+
+static void usage(const char *prog)
+{
+    printf("Usage: %s [OPTIONS]\n", prog);
+    printf("\nOptions:\n");
+    printf("  -H HOST     Server address (default: 127.0.0.1)\n");
+    printf("  -p PORT     Server port (default: 9000)\n");
+    printf("  -n N        Concurrent sessions (default: 100)\n");
+    printf("  -d SECONDS  Measured duration (default: 10)\n");
+    printf("  -W SECONDS  Warmup before measuring (default: 1)\n");
+    printf("  -w NAME     Workload: type, paste, cmds, churn (default: cmds)\n");
+    printf("  -k MS       Think time between operations per session (default: 0)\n");
+    printf("  -f N        Extra sessions pasting commands as fast as possible (default: 0)\n");
+    printf("  -a USER:PW  Log every session in first; %%d in USER becomes the session number\n");
+    printf("  -l N        Extra sessions that connect, log in and quit in a loop (requires -a, default: 0)\n");
+    printf("  -b          Check that a session waiting at the password prompt gets no wall (requires -a)\n");
+    printf("  -s N        Spread sessions over N loopback source addresses from 127.0.0.1 (default: 1)\n");
+    printf("  -j          Print results as JSON\n");
+    printf("  -h          Show this help message\n");
+}
+
+int main(int argc, char *argv[])
+{
+    struct epoll_event events[BENCH_MAX_EVENTS];
+    bench_session_t *sessions;
+    struct rlimit rl;
+    uint64_t t_start, t_end;
+    int total;
+    int opt;
+
+    cfg.host = "127.0.0.1";
+    cfg.port = 9000;
+    cfg.sessions = 100;
+    cfg.duration = 10;
+    cfg.warmup = 1;
+    cfg.workload = BENCH_CMDS;
+    cfg.sources = 1;
+
+    while ((opt = getopt(argc, argv, "H:p:n:d:W:w:k:f:a:l:s:bjh")) != -1)
+    {
+        switch (opt)
+        {
+            case 'H': cfg.host = optarg; break;
+            case 'p': cfg.port = atoi(optarg); break;
+            case 'n': cfg.sessions = atoi(optarg); break;
+            case 'd': cfg.duration = atoi(optarg); break;
+            case 'W': cfg.warmup = atoi(optarg); break;
+            case 'k': cfg.think_ms = atoi(optarg); break;
+            case 'f': cfg.flooders = atoi(optarg); break;
+            case 'l': cfg.logins = atoi(optarg); break;
+            case 's': cfg.sources = atoi(optarg); break;
+            case 'b': cfg.wall_check = 1; break;
+            case 'a':
+            {
+                char *sep = strchr(optarg, ':');
+                if (!sep)
+                {
+                    fprintf(stderr, "Expected USER:PASS: %s\n", optarg);
+                    return 1;
+                }
+                *sep = '\0';
+                cfg.user = optarg;
+                cfg.password = sep + 1;
+                break;
+            }
+            case 'j': cfg.json = 1; break;
+            case 'w':
+                cfg.workload = -1;
+                for (int i = 0; i < (int)(sizeof(bench_workload_names) / sizeof(bench_workload_names[0])); i++)
+                {
+                    if (strcmp(optarg, bench_workload_names[i]) == 0)
+                    {
+                        cfg.workload = i;
+                    }
+                }
+                if (cfg.workload < 0)
+                {
+                    fprintf(stderr, "Unknown workload: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'h':
+                usage(argv[0]);
+                return 0;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (cfg.sessions <= 0 || cfg.flooders < 0 || cfg.logins < 0 || (cfg.logins > 0 && !cfg.user) ||
+        (cfg.wall_check && !cfg.user) || cfg.sources <= 0 ||
+        cfg.duration <= 0 || cfg.port <= 0 || cfg.port > 65535)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    memset(&server_addr, 0, sizeof(server_addr));
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_port = htons(cfg.port);
+    if (inet_pton(AF_INET, cfg.host, &server_addr.sin_addr) != 1)
+    {
+        fprintf(stderr, "Invalid address: %s\n", cfg.host);
+        return 1;
+    }
+
+    // 会话数较多时提高描述符上限
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max)
+    {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT, on_signal);
+
+    // 洪泛数据是一串完整的命令行
+    for (size_t off = 0; off < BENCH_FLOOD_SIZE; off += 64)
+    {
+        memcpy(bench_flood_data + off, "echo flood flood flood flood flood flood flood flood flood flo\r\n", 64);
+    }
+
+    // -b的发送者和观察者排在最后
+    total = cfg.sessions + cfg.flooders + cfg.logins + (cfg.wall_check ? 2 : 0);
+    epfd = epoll_create1(0);
+    sessions = (bench_session_t *)calloc(total, sizeof(bench_session_t));
+    if (epfd < 0 || !sessions)
+    {
+        perror("init");
+        return 1;
+    }
+
+    t_start = now_ns();
+    t_measure = t_start + (uint64_t)cfg.warmup * 1000000000ull;
+    t_end = t_measure + (uint64_t)cfg.duration * 1000000000ull;
+
+    for (int i = 0; i < total; i++)
+    {
+        int base = cfg.sessions + cfg.flooders + cfg.logins;
+
+        sessions[i].fd = -1;
+        sessions[i].seed = (unsigned int)i * 2654435761u;
+        sessions[i].flood = i >= cfg.sessions && i < cfg.sessions + cfg.flooders;
+        sessions[i].login = i >= cfg.sessions + cfg.flooders && i < base;
+        sessions[i].wall = i < base ? W_NONE : (i == base ? W_SENDER : W_WATCHER);
+        session_connect(&sessions[i], i);
+    }
+
+    while (!stop_flag)
+    {
+        uint64_t now = now_ns();
+        int timeout = cfg.think_ms > 0 ? 1 : 100;
+        int n;
+
+        if (now >= t_end)
+        {
+            break;
+        }
+
+        n = epoll_wait(epfd, events, BENCH_MAX_EVENTS, timeout);
+        for (int i = 0; i < n; i++)
+        {
+            int index = (int)events[i].data.u32;
+            bench_session_t *s = &sessions[index];
+
+            if (s->fd < 0)
+            {
+                continue;
+            }
+
+            if (s->state == S_CONNECTING)
+            {
+                int err = 0;
+                socklen_t len = sizeof(err);
+                struct epoll_event ev;
+
+                getsockopt(s->fd, SOL_SOCKET, SO_ERROR, &err, &len);
+                if (err != 0)
+                {
+                    res.errors++;
+                    session_close(s);
+                    session_connect(s, index);
+                    continue;
+                }
+
+                // 连接建立后只关注可读
+                memset(&ev, 0, sizeof(ev));
+                ev.events = EPOLLIN | EPOLLRDHUP;
+                ev.data.u32 = (uint32_t)index;
+                epoll_ctl(epfd, EPOLL_CTL_MOD, s->fd, &ev);
+                s->state = cfg.user ? S_WAIT_LOGIN : S_WAIT_BANNER;
+            }
+
+            if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+            {
+                session_read(s, index);
+            }
+            if (s->fd >= 0 && s->state == S_FLOOD && (events[i].events & EPOLLOUT))
+            {
+                session_flood(s);
+            }
+        }
+
+        // 思考时间结束的会话开始下一个操作
+        if (cfg.think_ms > 0)
+        {
+            now = now_ns();
+            for (int i = 0; i < cfg.sessions; i++)
+            {
+                if (sessions[i].fd >= 0 && sessions[i].state == S_IDLE && now >= sessions[i].next_op)
+                {
+                    session_next_op(&sessions[i], i);
+                }
+            }
+        }
+    }
+
+    report((double)(now_ns() - t_measure) / 1e9);
+
+    for (int i = 0; i < total; i++)
+    {
+        session_close(&sessions[i]);
+    }
+    free(sessions);
+    close(epfd);
+    return cfg.wall_check && (!res.wall_sent || res.prelogin_leaks > 0) ? 1 : 0;
+}
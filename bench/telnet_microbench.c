@@ -0,0 +1,586 @@
+/**
+ * @file telnet_microbench.c
+ * @brief Telnet协议解析和行编辑微基准
+ * @date liuliang 2026-01-25
+ *
+ * 不经过socket，在进程内直接驱动服务器的协议解析和行编辑：
+ *   parser - telnets_handle_commands，只运行协议状态机
+ *   line   - telnets_recv_process，协议解析、行编辑和命令执行，输出交给内存接收端
+ * 语料按固定种子生成，每种负载的字节分布固定：
+ *   text      - 纯可打印文本，接近最大行长度的长行
+ *   iac       - 高密度IAC：转义的0xFF、NOP和选项协商
+ *   subneg    - 长子协商，穿插少量命令行
+ *   backspace - 逐字输入，夹杂大量输错后退格
+ *   paste     - 粘贴的短命令脚本，回车换行密集
+ *   cmds      - help、time和echo交替，输出远多于输入
+ * -z启用MCCP2时会话协商压缩，输出字节数为压缩后的字节数，与不压缩的结果对比即为
+ * 压缩节省的带宽和花费的CPU；
+ * 每项先预热，再重复多次，输出中位数和最好一次的字节/秒、周期/字节，可输出表格或JSON
+ */
+
+#include "telnet_server.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define MB_HAVE_CYCLES 1
+#else
+#define MB_HAVE_CYCLES 0
+#endif
+
+#define MB_MAX_REPS 1000
+
+// 被测对象
+enum {
+    MB_PARSER = 0,
+    MB_LINE,
+    MB_TARGET_COUNT
+};
+
+static const char *mb_target_names[MB_TARGET_COUNT] = { "parser", "line" };
+
+// 语料
+typedef struct {
+    const char *name;
+    void (*gen)(char *buf, size_t size);
+} mb_corpus_t;
+
+typedef struct {
+    size_t size;                        // 每种语料的字节数
+    size_t chunk;                       // 每次交给解析器的字节数，模拟一次recv
+    int warmup;
+    int reps;
+    const char *corpus;                 // 只运行指定语料，NULL表示全部
+    const char *target;                 // 只运行指定对象，NULL表示全部
+    int compress_level;                 // MCCP2压缩级别，0表示不压缩
+    int compress_max;                   // 非0时使用限制内存模式
+    int json;
+} mb_config_t;
+
+// 一项测量结果
+typedef struct {
+    double ns[MB_MAX_REPS];
+    double cycles[MB_MAX_REPS];
+    size_t out_bytes;                   // 最后一次重复产生的输出字节数
+} mb_result_t;
+
+static mb_config_t cfg;
+static telnet_config_t server_config;
+static telnet_server_t *server;
+static int client_index;
+static uint64_t rng_state = 0x9e3779b97f4a7c15ull;
+static volatile unsigned char sink_touch;
+static int printed;
+
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static uint64_t now_cycles(void)
+{
+#if MB_HAVE_CYCLES
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+static uint32_t rng_next(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return (uint32_t)(rng_state >> 32);
+}
+
+static char rng_printable(void)
+{
+    static const char chars[] = "abcdefghijklmnopqrstuvwxyz ABCDEFGHIJKLMNOPQRSTUVWXYZ 0123456789 .,-_/:";
+    return chars[rng_next() % (sizeof(chars) - 1)];
+}
+
+// 追加数据，超出语料大小的部分丢弃
+static size_t put(char *buf, size_t size, size_t pos, const char *data, size_t len)
+{
+    if (pos + len > size)
+    {
+        return size;
+    }
+
+    memcpy(buf + pos, data, len);
+    return pos + len;
+}
+
+// 语料末尾补空格，保证协议状态机在语料边界回到普通状态
+static void pad(char *buf, size_t size, size_t pos)
+{
+    memset(buf + pos, ' ', size - pos);
+    if (size >= 2)
+    {
+        buf[size - 2] = '\r';
+        buf[size - 1] = '\n';
+    }
+}
+
+static void gen_text(char *buf, size_t size)
+{
+    size_t pos = 0;
+
+    while (pos < size)
+    {
+        char line[TELNET_LINE_MAX + 2];
+        size_t len = 5;
+
+        memcpy(line, "echo ", 5);
+        while (len < TELNET_LINE_MAX - 8)
+        {
+            line[len++] = rng_printable();
+        }
+        line[len++] = '\r';
+        line[len++] = '\n';
+
+        size_t next = put(buf, size, pos, line, len);
+        if (next == size)
+        {
+            break;
+        }
+        pos = next;
+    }
+
+    pad(buf, size, pos);
+}
+
+static void gen_iac(char *buf, size_t size)
+{
+    static const unsigned char seqs[][3] = {
+        { TELNET_IAC, TELNET_IAC, 0 },                  // 数据0xFF
+        { TELNET_IAC, 241, 0 },                         // NOP
+        { TELNET_IAC, 249, 0 },                         // GA
+        { TELNET_IAC, TELNET_DONT, TELNET_SGA },
+        { TELNET_IAC, TELNET_DO, TELNET_SGA },
+        { TELNET_IAC, TELNET_DO, 24 },                  // 不支持的选项
+        { TELNET_IAC, TELNET_WILL, TELNET_NAWS },
+    };
+    size_t pos = 0;
+
+    while (pos < size)
+    {
+        char line[256];
+        size_t len = 5;
+
+        memcpy(line, "echo ", 5);
+        while (len < 60)
+        {
+            if (rng_next() % 2)
+            {
+                const unsigned char *seq = seqs[rng_next() % (sizeof(seqs) / sizeof(seqs[0]))];
+                size_t n = seq[2] ? 3 : 2;
+                memcpy(line + len, seq, n);
+                len += n;
+            }
+            else
+            {
+                line[len++] = rng_printable();
+            }
+        }
+        line[len++] = '\r';
+        line[len++] = '\n';
+
+        size_t next = put(buf, size, pos, line, len);
+        if (next == size)
+        {
+            break;
+        }
+        pos = next;
+    }
+
+    pad(buf, size, pos);
+}
+
+static void gen_subneg(char *buf, size_t size)
+{
+    size_t pos = 0;
+    int n = 0;
+
+    while (pos < size)
+    {
+        char seq[600];
+        size_t len = 0;
+
+        if (++n % 4 == 0)
+        {
+            len = (size_t)snprintf(seq, sizeof(seq), "echo subneg %d\r\n", n);
+        }
+        else if (n % 2)
+        {
+            // 窗口大小，宽度含需要转义的0xFF
+            const unsigned char naws[] = { TELNET_IAC, TELNET_SB, TELNET_NAWS, 0, TELNET_IAC, TELNET_IAC, 0, 40,
+                                           TELNET_IAC, TELNET_SE };
+            memcpy(seq, naws, sizeof(naws));
+            len = sizeof(naws);
+        }
+        else
+        {
+            // 终端类型等长子协商，超过TELNET_SB_MAX的部分被丢弃
+            size_t body = 200 + rng_next() % 300;
+            seq[len++] = (char)TELNET_IAC;
+            seq[len++] = (char)TELNET_SB;
+            seq[len++] = 24;
+            seq[len++] = 0;
+            while (body--)
+            {
+                seq[len++] = rng_printable();
+            }
+            seq[len++] = (char)TELNET_IAC;
+            seq[len++] = (char)TELNET_SE;
+        }
+
+        size_t next = put(buf, size, pos, seq, len);
+        if (next == size)
+        {
+            break;
+        }
+        pos = next;
+    }
+
+    pad(buf, size, pos);
+}
+
+static void gen_backspace(char *buf, size_t size)
+{
+    size_t pos = 0;
+
+    while (pos < size)
+    {
+        char line[512];
+        size_t len = 5;
+        int typed = 0;
+
+        memcpy(line, "echo ", 5);
+        while (typed < 40)
+        {
+            // 三分之一的字符先输错，退格后重输
+            if (rng_next() % 3 == 0)
+            {
+                line[len++] = rng_printable();
+                line[len++] = (rng_next() % 2) ? 127 : 8;
+            }
+            line[len++] = rng_printable();
+            typed++;
+        }
+        line[len++] = '\r';
+        line[len++] = '\n';
+
+        size_t next = put(buf, size, pos, line, len);
+        if (next == size)
+        {
+            break;
+        }
+        pos = next;
+    }
+
+    pad(buf, size, pos);
+}
+
+static void gen_paste(char *buf, size_t size)
+{
+    static const char *lines[] = { "echo ok\r\n", "echo hello world\r\n", "\r\n", "echo a\n", "echo 1 2 3\r\n" };
+    size_t pos = 0;
+
+    while (pos < size)
+    {
+        const char *line = lines[rng_next() % (sizeof(lines) / sizeof(lines[0]))];
+        size_t next = put(buf, size, pos, line, strlen(line));
+        if (next == size)
+        {
+            break;
+        }
+        pos = next;
+    }
+
+    pad(buf, size, pos);
+}
+
+static void gen_cmds(char *buf, size_t size)
+{
+    static const char *lines[] = { "help\r\n", "time\r\n", "echo status ok\r\n", "echo build 42 passed\r\n" };
+    size_t pos = 0;
+
+    while (pos < size)
+    {
+        const char *line = lines[rng_next() % (sizeof(lines) / sizeof(lines[0]))];
+        size_t next = put(buf, size, pos, line, strlen(line));
+        if (next == size)
+        {
+            break;
+        }
+        pos = next;
+    }
+
+    pad(buf, size, pos);
+}
+
+static const mb_corpus_t mb_corpora[] = {
+    { "text",      gen_text },
+    { "iac",       gen_iac },
+    { "subneg",    gen_subneg },
+    { "backspace", gen_backspace },
+    { "paste",     gen_paste },
+    { "cmds",      gen_cmds },
+};
+
+// 内存接收端，只计数并读一个字节，防止输出被优化掉
+static void sink(void *arg, const char *data, size_t len)
+{
+    (void)arg;
+    if (len > 0)
+    {
+        sink_touch ^= (unsigned char)data[len - 1];
+    }
+}
+
+// 建立一个不绑定socket的会话，完成与普通客户端相同的选项协商
+static int session_open(void)
+{
+    static const unsigned char reply[] = { TELNET_IAC, TELNET_DO, TELNET_ECHO, TELNET_IAC, TELNET_DO, TELNET_SGA,
+                                           TELNET_IAC, TELNET_WILL, TELNET_NAWS, TELNET_IAC, TELNET_DO,
+                                           TELNET_COMPRESS2 };
+    // 不压缩时不应答COMPRESS2，服务器也不会提出
+    size_t reply_len = cfg.compress_level ? sizeof(reply) : sizeof(reply) - 3;
+    telnet_client_t *client = telnets_table_alloc(server, -1);
+
+    if (!client)
+    {
+        return -1;
+    }
+
+    client_index = client->slot;
+    client->cold->addr.sin_family = AF_INET;
+    client->cold->addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    client->cold->connected_at = get_current_time();
+    client->last_active = client->cold->connected_at;
+
+    telnets_option_start(client);
+    telnets_welcome(client);
+    telnets_send_prompt(client);
+    telnets_recv_process(server, client_index, (char *)reply, (int)reply_len);
+    telnets_flush_pending_sink(server, sink, NULL);
+    return 0;
+}
+
+// 把语料按块交给被测对象一遍，返回产生的输出字节数
+static size_t run_once(int target, char *data, size_t size)
+{
+    telnet_client_t *client = telnets_get_client(server, client_index);
+    size_t out = 0;
+
+    for (size_t off = 0; off < size; off += cfg.chunk)
+    {
+        size_t n = size - off < cfg.chunk ? size - off : cfg.chunk;
+
+        if (target == MB_PARSER)
+        {
+            telnets_handle_commands(client, data + off, (int)n);
+        }
+        else
+        {
+            telnets_recv_process(server, client_index, data + off, (int)n);
+        }
+        out += telnets_flush_pending_sink(server, sink, NULL);
+    }
+
+    return out;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static void measure(int target, char *data, mb_result_t *res)
+{
+    for (int i = 0; i < cfg.warmup; i++)
+    {
+        run_once(target, data, cfg.size);
+    }
+
+    for (int i = 0; i < cfg.reps; i++)
+    {
+        uint64_t c0 = now_cycles();
+        uint64_t t0 = now_ns();
+
+        res->out_bytes = run_once(target, data, cfg.size);
+        res->ns[i] = (double)(now_ns() - t0);
+        res->cycles[i] = (double)(now_cycles() - c0);
+    }
+
+    qsort(res->ns, cfg.reps, sizeof(double), cmp_double);
+    qsort(res->cycles, cfg.reps, sizeof(double), cmp_double);
+}
+
+static void report(const char *corpus, int target, const mb_result_t *res)
+{
+    double bytes = (double)cfg.size;
+    double median_ns = res->ns[cfg.reps / 2];
+    double best_ns = res->ns[0];
+    double mbps = bytes / median_ns * 1e9 / 1e6;
+    double best_mbps = bytes / best_ns * 1e9 / 1e6;
+    double cpb = res->cycles[cfg.reps / 2] / bytes;
+
+    if (cfg.json)
+    {
+        printf("%s    {\"corpus\": \"%s\", \"target\": \"%s\", \"bytes\": %zu, \"output_bytes\": %zu, "
+               "\"median_ns\": %.0f, \"best_ns\": %.0f, \"mb_per_sec\": %.1f, \"best_mb_per_sec\": %.1f, ",
+               printed ? ",\n" : "", corpus, mb_target_names[target], cfg.size, res->out_bytes,
+               median_ns, best_ns, mbps, best_mbps);
+        if (MB_HAVE_CYCLES)
+        {
+            printf("\"cycles_per_byte\": %.2f}", cpb);
+        }
+        else
+        {
+            printf("\"cycles_per_byte\": null}");
+        }
+    }
+    else
+    {
+        printf("  %-10s %-7s %12.1f %12.1f %10.2f %12zu\n", corpus, mb_target_names[target], mbps, best_mbps,
+               MB_HAVE_CYCLES ? cpb : 0.0, res->out_bytes);
+    }
+    printed = 1;
+}
+
+static void usage(const char *prog)
+{
+    printf("Usage: %s [OPTIONS]\n", prog);
+    printf("\nOptions:\n");
+    printf("  -s BYTES    Corpus size (default: 1048576)\n");
+    printf("  -k BYTES    Bytes handed to the parser per call, like one recv (default: 4096)\n");
+    printf("  -W N        Warmup passes (default: 3)\n");
+    printf("  -r N        Measured passes, up to %d (default: 10)\n", MB_MAX_REPS);
+    printf("  -c NAME     Corpus: text, iac, subneg, backspace, paste (default: all)\n");
+    printf("  -t NAME     Target: parser, line (default: both)\n");
+    printf("  -z LEVEL    Negotiate MCCP2 compression at zlib level 1-9 (default: off)\n");
+    printf("  -Z MAX      Use the memory-bounded compression mode\n");
+    printf("  -j          Print results as JSON\n");
+    printf("  -h          Show this help message\n");
+}
+
+int main(int argc, char *argv[])
+{
+    mb_result_t *res;
+    char *data;
+    int opt;
+
+    cfg.size = 1 << 20;
+    cfg.chunk = 4096;
+    cfg.warmup = 3;
+    cfg.reps = 10;
+
+    while ((opt = getopt(argc, argv, "s:k:W:r:c:t:z:Z:jh")) != -1)
+    {
+        switch (opt)
+        {
+            case 's': cfg.size = (size_t)atol(optarg); break;
+            case 'k': cfg.chunk = (size_t)atol(optarg); break;
+            case 'W': cfg.warmup = atoi(optarg); break;
+            case 'r': cfg.reps = atoi(optarg); break;
+            case 'c': cfg.corpus = optarg; break;
+            case 't': cfg.target = optarg; break;
+            case 'z': cfg.compress_level = atoi(optarg); break;
+            case 'Z': cfg.compress_max = atoi(optarg); break;
+            case 'j': cfg.json = 1; break;
+            case 'h':
+                usage(argv[0]);
+                return 0;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (cfg.compress_max > 0 && cfg.compress_level == 0)
+    {
+        cfg.compress_level = TELNET_MCCP_LEVEL;
+    }
+
+    if (cfg.size < 64 || cfg.chunk == 0 || cfg.warmup < 0 || cfg.reps <= 0 || cfg.reps > MB_MAX_REPS ||
+        cfg.compress_level < 0 || cfg.compress_level > 9 || cfg.compress_max < 0)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    // 与服务器相同的初始化，只是不监听、不启动事件循环
+    telnet_config_default(&server_config);
+    server_config.compress_level = cfg.compress_level;
+    server_config.compress_max = cfg.compress_max;
+    if (telnets_cmd_init() < 0 || telnets_resp_init(NULL) < 0)
+    {
+        fprintf(stderr, "Failed to initialize commands\n");
+        return 1;
+    }
+    telnets_cmd_freeze();
+    telnets_clock_update();
+
+    server = telnet_server_init(&server_config, 0);
+    data = (char *)malloc(cfg.size);
+    res = (mb_result_t *)malloc(sizeof(mb_result_t));
+    if (!server || !data || !res || session_open() < 0)
+    {
+        fprintf(stderr, "Failed to initialize\n");
+        return 1;
+    }
+
+    if (cfg.json)
+    {
+        printf("{\n  \"bytes\": %zu,\n  \"chunk\": %zu,\n  \"warmup\": %d,\n  \"reps\": %d,\n"
+               "  \"compress_level\": %d,\n  \"compress_bounded\": %s,\n  \"results\": [\n",
+               cfg.size, cfg.chunk, cfg.warmup, cfg.reps, cfg.compress_level, cfg.compress_max ? "true" : "false");
+    }
+    else
+    {
+        printf("corpus: %zu bytes, chunk: %zu, warmup: %d, reps: %d, compression: %d%s\n", cfg.size, cfg.chunk,
+               cfg.warmup, cfg.reps, cfg.compress_level, cfg.compress_max ? " (bounded)" : "");
+        printf("  %-10s %-7s %12s %12s %10s %12s\n", "corpus", "target", "MB/s", "best MB/s",
+               MB_HAVE_CYCLES ? "cyc/byte" : "-", "out bytes");
+    }
+
+    for (size_t i = 0; i < sizeof(mb_corpora) / sizeof(mb_corpora[0]); i++)
+    {
+        if (cfg.corpus && strcmp(cfg.corpus, mb_corpora[i].name) != 0)
+        {
+            continue;
+        }
+
+        mb_corpora[i].gen(data, cfg.size);
+
+        for (int t = 0; t < MB_TARGET_COUNT; t++)
+        {
+            if (cfg.target && strcmp(cfg.target, mb_target_names[t]) != 0)
+            {
+                continue;
+            }
+
+            measure(t, data, res);
+            report(mb_corpora[i].name, t, res);
+        }
+    }
+
+    if (cfg.json)
+    {
+        printf("\n  ]\n}\n");
+    }
+
+    telnet_server_destroy(server);
+    telnets_resp_free();
+    telnets_outchunk_cache_release();
+    free(data);
+    free(res);
+    return 0;
+}
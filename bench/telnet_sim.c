@@ -0,0 +1,458 @@
+/**
+ * @file telnet_sim.c
+ * @brief Telnet服务器会话模拟
+ * @date liuliang 2026-01-25
+ *
+ * 在一个进程中通过内存传输驱动大量虚拟会话，经过真实的事件循环、选项协商、
+ * 命令处理、广播和空闲超时，不受描述符和内核socket数量限制；时间使用模拟时钟，
+ * 空闲超时不需要真正等待。按阶段运行：
+ *   connect   - 建立全部会话，接受并发送欢迎信息
+ *   negotiate - 每个会话应答选项协商并发送窗口大小
+ *   commands  - 每个会话执行若干条echo命令
+ *   flood     - （-f N）前N个会话各粘贴大量命令，其余会话同时执行一条echo，
+ *               统计其余会话收到回应的延迟
+ *   broadcast - 一个会话发送wall，广播给所有会话
+ *   quit      - 一半会话发送quit
+ *   timeout   - 推进模拟时钟，其余会话空闲超时断开
+ * 输出每个阶段的耗时、事件循环轮数和模拟时间，可输出表格或JSON
+ */
+
+#define _GNU_SOURCE             // memmem
+#include "telnet_server.h"
+
+#define SIM_WALL_TEXT "sim-broadcast"
+#define SIM_PING_TEXT "sim-ping"
+#define SIM_FLOOD_BYTES (1 << 20)       // 每个洪泛会话粘贴的字节数
+
+// 一个虚拟会话
+typedef struct {
+    int conn;                           // 内存连接编号
+    uint64_t bytes;                     // 收到的输出字节数
+    uint8_t closed;                     // 服务器已关闭连接
+    uint8_t got_wall;                   // 收到了广播
+    uint8_t ping_pending;               // 等待echo的回应
+} sim_session_t;
+
+// 一个阶段的结果
+typedef struct {
+    const char *name;
+    double wall_ms;                     // 实际耗时
+    uint64_t sim_ms;                    // 模拟时钟推进的时间
+    uint64_t polls;                     // 事件循环轮数
+} sim_phase_t;
+
+typedef struct {
+    int sessions;
+    int commands;
+    int idle_timeout;
+    int flooders;
+    int json;
+} sim_config_t;
+
+static sim_config_t cfg;
+static telnet_master_t *master;
+static telnet_server_t *server;
+static sim_session_t *sessions;
+static int *by_conn;                    // 连接编号到会话的映射
+static int by_conn_size;
+static uint64_t polls;
+static uint64_t closed_count;
+static uint64_t wall_count;
+static sim_phase_t phases[8];
+static int nphases;
+static uint64_t ping_start;             // flood阶段开始时间(ns)
+static uint64_t *ping_ns;               // 各会话收到回应的延迟
+static int ping_count;
+
+
+static double now_ms(void)
+{
+    return (double)telnets_now_ns() / 1e6;
+}
+
+static void on_output(void *arg, int conn, const char *data, size_t len)
+{
+    sim_session_t *s;
+
+    (void)arg;
+    if (conn < 0 || conn >= by_conn_size || by_conn[conn] < 0)
+    {
+        return;
+    }
+
+    s = &sessions[by_conn[conn]];
+    if (!data)
+    {
+        s->closed = 1;
+        by_conn[conn] = -1;
+        closed_count++;
+        return;
+    }
+
+    s->bytes += len;
+    if (s->ping_pending && memmem(data, len, "Echo: " SIM_PING_TEXT, sizeof("Echo: " SIM_PING_TEXT) - 1))
+    {
+        s->ping_pending = 0;
+        ping_ns[ping_count++] = telnets_now_ns() - ping_start;
+    }
+    if (!s->got_wall && memmem(data, len, SIM_WALL_TEXT, sizeof(SIM_WALL_TEXT) - 1))
+    {
+        s->got_wall = 1;
+        wall_count++;
+    }
+}
+
+// 运行事件循环直到没有待处理的输入、输出和留到下一轮的会话
+static void settle(void)
+{
+    do
+    {
+        telnet_server_poll(server, 0);
+        polls++;
+    } while (telnets_mem_pending(server) || server->flush_count > 0 || server->ready_count > 0);
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static double ping_pct_ms(double p)
+{
+    if (ping_count == 0)
+    {
+        return 0.0;
+    }
+    return (double)ping_ns[(size_t)(p / 100.0 * (ping_count - 1) + 0.5)] / 1e6;
+}
+
+static void phase_begin(sim_phase_t *p, const char *name, double *t0, uint64_t *polls0, uint64_t *sim0)
+{
+    p->name = name;
+    *t0 = now_ms();
+    *polls0 = polls;
+    *sim0 = server->now_ms;
+}
+
+static void phase_end(sim_phase_t *p, double t0, uint64_t polls0, uint64_t sim0)
+{
+    p->wall_ms = now_ms() - t0;
+    p->polls = polls - polls0;
+    p->sim_ms = server->now_ms - sim0;
+    nphases++;
+}
+
+static void send_all(const char *data, size_t len, int stride, int offset)
+{
+    for (int i = offset; i < cfg.sessions; i += stride)
+    {
+        if (!sessions[i].closed)
+        {
+            telnets_mem_write(server, sessions[i].conn, data, len);
+        }
+    }
+}
+
+static int run(void)
+{
+    static const unsigned char negotiate[] = {
+        TELNET_IAC, TELNET_DO, TELNET_ECHO, TELNET_IAC, TELNET_DO, TELNET_SGA,
+        TELNET_IAC, TELNET_WILL, TELNET_NAWS,
+        TELNET_IAC, TELNET_SB, TELNET_NAWS, 0, 80, 0, 24, TELNET_IAC, TELNET_SE,
+    };
+    double t0;
+    uint64_t polls0, sim0;
+    sim_phase_t *p;
+
+    // 建立全部会话，按accept批量分多轮接受
+    p = &phases[nphases];
+    phase_begin(p, "connect", &t0, &polls0, &sim0);
+    for (int i = 0; i < cfg.sessions; i++)
+    {
+        struct sockaddr_in addr;
+
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(0x0a000000u | (uint32_t)(i + 1));
+        addr.sin_port = htons((uint16_t)(1024 + i % 60000));
+
+        sessions[i].conn = telnets_mem_connect(server, &addr);
+        if (sessions[i].conn < 0)
+        {
+            return -1;
+        }
+        if (sessions[i].conn >= by_conn_size)
+        {
+            int new_size = by_conn_size ? by_conn_size * 2 : 1024;
+            int *map;
+
+            while (new_size <= sessions[i].conn)
+            {
+                new_size *= 2;
+            }
+            map = (int *)realloc(by_conn, new_size * sizeof(int));
+            if (!map)
+            {
+                return -1;
+            }
+            for (int j = by_conn_size; j < new_size; j++)
+            {
+                map[j] = -1;
+            }
+            by_conn = map;
+            by_conn_size = new_size;
+        }
+        by_conn[sessions[i].conn] = i;
+    }
+    settle();
+    phase_end(p, t0, polls0, sim0);
+
+    p = &phases[nphases];
+    phase_begin(p, "negotiate", &t0, &polls0, &sim0);
+    send_all((const char *)negotiate, sizeof(negotiate), 1, 0);
+    settle();
+    phase_end(p, t0, polls0, sim0);
+
+    p = &phases[nphases];
+    phase_begin(p, "commands", &t0, &polls0, &sim0);
+    for (int c = 0; c < cfg.commands; c++)
+    {
+        char line[64];
+        int len = snprintf(line, sizeof(line), "echo command %d\r\n", c);
+
+        send_all(line, (size_t)len, 1, 0);
+        settle();
+    }
+    phase_end(p, t0, polls0, sim0);
+
+    // 洪泛会话的输入一次到达，其余会话的命令紧随其后
+    if (cfg.flooders > 0)
+    {
+        char *flood = (char *)malloc(SIM_FLOOD_BYTES);
+        const char ping[] = "echo " SIM_PING_TEXT "\r\n";
+
+        if (!flood)
+        {
+            return -1;
+        }
+        for (size_t off = 0; off < SIM_FLOOD_BYTES; off += 64)
+        {
+            memcpy(flood + off, "echo flood flood flood flood flood flood flood flood flood flo\r\n", 64);
+        }
+
+        p = &phases[nphases];
+        phase_begin(p, "flood", &t0, &polls0, &sim0);
+        for (int i = 0; i < cfg.sessions; i++)
+        {
+            if (i < cfg.flooders)
+            {
+                telnets_mem_write(server, sessions[i].conn, flood, SIM_FLOOD_BYTES);
+            }
+            else
+            {
+                sessions[i].ping_pending = 1;
+                telnets_mem_write(server, sessions[i].conn, ping, sizeof(ping) - 1);
+            }
+        }
+        ping_start = telnets_now_ns();
+        settle();
+        phase_end(p, t0, polls0, sim0);
+        free(flood);
+        qsort(ping_ns, ping_count, sizeof(uint64_t), cmp_u64);
+    }
+
+    p = &phases[nphases];
+    phase_begin(p, "broadcast", &t0, &polls0, &sim0);
+    telnets_mem_write(server, sessions[0].conn, "wall " SIM_WALL_TEXT "\r\n", sizeof("wall " SIM_WALL_TEXT "\r\n") - 1);
+    settle();
+    // 广播经收件栈投递，再跑一轮确保已发出
+    settle();
+    phase_end(p, t0, polls0, sim0);
+
+    p = &phases[nphases];
+    phase_begin(p, "quit", &t0, &polls0, &sim0);
+    send_all("quit\r\n", 6, 2, 0);
+    settle();
+    phase_end(p, t0, polls0, sim0);
+
+    // 推进模拟时钟到下一个定时器，直到剩余会话全部超时
+    p = &phases[nphases];
+    phase_begin(p, "timeout", &t0, &polls0, &sim0);
+    while (server->client_count > 0)
+    {
+        int wait = telnets_timer_next_timeout(&server->timers, server->now_ms);
+
+        if (wait < 0)
+        {
+            break;
+        }
+        telnets_sim_clock_advance(server, wait > 0 ? (uint64_t)wait : TELNET_TW_TICK_MS);
+        settle();
+    }
+    phase_end(p, t0, polls0, sim0);
+
+    return 0;
+}
+
+static void report(void)
+{
+    const telnet_metrics_t *m = &server->metrics;
+    uint64_t bytes = 0;
+    uint64_t commands = 0;
+
+    for (int i = 0; i < cfg.sessions; i++)
+    {
+        bytes += sessions[i].bytes;
+    }
+    for (int i = 0; i < telnets_cmd_count(); i++)
+    {
+        commands += m->commands[i];
+    }
+
+    if (cfg.json)
+    {
+        printf("{\n");
+        printf("  \"sessions\": %d,\n", cfg.sessions);
+        printf("  \"accepted\": %llu,\n", (unsigned long long)m->accepts);
+        printf("  \"commands\": %llu,\n", (unsigned long long)commands);
+        printf("  \"broadcast_received\": %llu,\n", (unsigned long long)wall_count);
+        printf("  \"timeouts\": %llu,\n", (unsigned long long)m->timeouts);
+        printf("  \"closed\": %llu,\n", (unsigned long long)closed_count);
+        printf("  \"output_bytes\": %llu,\n", (unsigned long long)bytes);
+        if (cfg.flooders > 0)
+        {
+            printf("  \"flooders\": %d,\n", cfg.flooders);
+            printf("  \"ping_ms\": {\"count\": %d, \"p50\": %.2f, \"p99\": %.2f, \"max\": %.2f},\n",
+                   ping_count, ping_pct_ms(50), ping_pct_ms(99), ping_pct_ms(100));
+        }
+        printf("  \"phases\": [\n");
+        for (int i = 0; i < nphases; i++)
+        {
+            printf("    {\"name\": \"%s\", \"wall_ms\": %.1f, \"sim_ms\": %llu, \"polls\": %llu}%s\n",
+                   phases[i].name, phases[i].wall_ms, (unsigned long long)phases[i].sim_ms,
+                   (unsigned long long)phases[i].polls, i + 1 < nphases ? "," : "");
+        }
+        printf("  ]\n}\n");
+        return;
+    }
+
+    printf("sessions: %d, accepted: %llu, commands: %llu, broadcast received: %llu, timeouts: %llu, closed: %llu\n",
+           cfg.sessions, (unsigned long long)m->accepts, (unsigned long long)commands,
+           (unsigned long long)wall_count, (unsigned long long)m->timeouts, (unsigned long long)closed_count);
+    printf("output bytes: %llu\n", (unsigned long long)bytes);
+    if (cfg.flooders > 0)
+    {
+        printf("echo during flood (%d flooders): %d replies, p50 %.2f ms, p99 %.2f ms, max %.2f ms\n",
+               cfg.flooders, ping_count, ping_pct_ms(50), ping_pct_ms(99), ping_pct_ms(100));
+    }
+    printf("  %-10s %12s %12s %10s\n", "phase", "wall(ms)", "sim(ms)", "polls");
+    for (int i = 0; i < nphases; i++)
+    {
+        printf("  %-10s %12.1f %12llu %10llu\n", phases[i].name, phases[i].wall_ms,
+               (unsigned long long)phases[i].sim_ms, (unsigned long long)phases[i].polls);
+    }
+}
+
+static void usage(const char *prog)
+{
+    printf("Usage: %s [OPTIONS]\n", prog);
+    printf("\nOptions:\n");
+    printf("  -n N        Virtual sessions (default: 100000)\n");
+    printf("  -c N        Commands per session (default: 3)\n");
+    printf("  -i SECONDS  Idle timeout (default: %d)\n", TELNET_IDLE_TIMEOUT);
+    printf("  -f N        Sessions pasting %d KB of commands during the flood phase (default: 0)\n",
+           SIM_FLOOD_BYTES >> 10);
+    printf("  -j          Print results as JSON\n");
+    printf("  -h          Show this help message\n");
+}
+
+int main(int argc, char *argv[])
+{
+    telnet_config_t config;
+    int opt;
+    int ret;
+
+    cfg.sessions = 100000;
+    cfg.commands = 3;
+    cfg.idle_timeout = TELNET_IDLE_TIMEOUT;
+
+    while ((opt = getopt(argc, argv, "n:c:i:f:jh")) != -1)
+    {
+        switch (opt)
+        {
+            case 'n': cfg.sessions = atoi(optarg); break;
+            case 'c': cfg.commands = atoi(optarg); break;
+            case 'i': cfg.idle_timeout = atoi(optarg); break;
+            case 'f': cfg.flooders = atoi(optarg); break;
+            case 'j': cfg.json = 1; break;
+            case 'h':
+                usage(argv[0]);
+                return 0;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (cfg.sessions <= 0 || cfg.commands < 0 || cfg.idle_timeout <= 0 || cfg.flooders < 0 ||
+        cfg.flooders >= cfg.sessions)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    // 单工作线程，命令在事件循环中执行，连接走内存传输
+    telnet_config_default(&config);
+    config.threads = 1;
+    config.max_clients = cfg.sessions;
+    config.idle_timeout = cfg.idle_timeout;
+    config.pool_threads = 0;
+    config.transport = TELNET_TRANSPORT_MEM;
+    config.log_level = TELNET_LOG_WARN;
+
+    sessions = (sim_session_t *)calloc(cfg.sessions, sizeof(sim_session_t));
+    ping_ns = (uint64_t *)calloc(cfg.sessions, sizeof(uint64_t));
+    if (!sessions || !ping_ns || telnets_log_init(config.log_level, NULL) < 0 || telnets_cmd_init() < 0)
+    {
+        fprintf(stderr, "Failed to initialize\n");
+        return 1;
+    }
+
+    master = telnet_master_init(&config);
+    if (!master)
+    {
+        fprintf(stderr, "Failed to create server\n");
+        telnets_log_shutdown();
+        return 1;
+    }
+    server = master->workers[0];
+
+    telnets_cmd_freeze();
+    if (telnets_resp_init(NULL) < 0 || telnets_mem_attach(server, on_output, NULL) < 0 ||
+        telnet_server_listen(server) < 0)
+    {
+        fprintf(stderr, "Failed to start server\n");
+        telnet_master_destroy(master);
+        telnets_log_shutdown();
+        return 1;
+    }
+
+    server->now_ms = telnets_now_ms();
+    telnets_sim_clock_start(server);
+
+    ret = run();
+    if (ret < 0)
+    {
+        fprintf(stderr, "Simulation failed\n");
+    }
+    report();
+
+    telnet_master_destroy(master);
+    telnets_log_shutdown();
+    free(sessions);
+    free(ping_ns);
+    free(by_conn);
+    return ret < 0 ? 1 : 0;
+}
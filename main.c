@@ -5,10 +5,43 @@ void print_usage(const char *program_name) {
     printf("Usage: %s [OPTIONS]\n", program_name);
     printf("\nOptions:\n");
     printf("  -p PORT     Port to listen on (default: 23)\n");
+    printf("  -t N        Number of worker reactor threads (default: %d)\n", TELNET_DEFAULT_THREADS);
+    printf("  -c MAX      Maximum number of clients (default: %d)\n", TELNET_MAX_CLIENTS);
+    printf("  -i SECONDS  Idle timeout in seconds (default: %d)\n", TELNET_IDLE_TIMEOUT);
+    printf("  -H BYTES    Output queue high-water mark per client (default: %d)\n", TELNET_OUTQ_HIGH_WATER);
+    printf("  -M BYTES    Maximum input line length, up to %d (default: %d)\n", TELNET_LINE_MAX_LIMIT,
+           TELNET_LINE_MAX);
+    printf("  -b N        Listen backlog (default: %d)\n", TELNET_LISTEN_BACKLOG);
+    printf("  -r N[:B]    Limit new connections per source IP to N/s, burst B (default: off, B=%d)\n",
+           TELNET_ACCEPT_BURST);
+    printf("  -I N[:B]    Limit input per session to N bytes/s, burst B (default: off, B=N)\n");
+    printf("  -Q N[:B]    Limit commands per session to N/s, burst B (default: off, B=N)\n");
+    printf("  -w N        Command pool threads for slow commands, 0 runs them inline (default: %d)\n",
+           TELNET_POOL_THREADS);
+    printf("  -B POLICY   Broadcasts to a backlogged client: drop, truncate, disconnect (default: drop)\n");
+    printf("  -R FILE     Load welcome/help/prompt/unknown responses from FILE\n");
+    printf("  -A FILE     Require login; FILE has user:hash lines (crypt hashes, e.g. openssl passwd -6)\n");
+    printf("  -V N[:TTL]  Password verifier threads and credential cache TTL in seconds, 0 disables the cache\n");
+    printf("              (default: %d:%d); each worker has its own cache, so a login only hits it\n",
+           TELNET_AUTH_THREADS, TELNET_AUTH_CACHE_TTL);
+    printf("              on the worker that verified it before\n");
+    printf("  -m PORT     Serve Prometheus metrics on 127.0.0.1:PORT (default: off)\n");
+    printf("  -z LEVEL    Offer MCCP2 output compression at zlib level 1-9 (default: off)\n");
+    printf("  -Z MAX      Memory-bounded compression: small windows, at most MAX sessions compressing\n");
+    printf("  -S PORT     Also accept Telnet over TLS on PORT (requires -C)\n");
+    printf("  -C FILE     TLS certificate chain (PEM)\n");
+    printf("  -K FILE     TLS private key (PEM, default: the certificate file)\n");
+    printf("  -U FD       Take over listeners and sessions from a running server (used by hot restart)\n");
+    printf("  -u          Use io_uring for accept/recv/send (falls back to epoll)\n");
+    printf("  -L          Use level-triggered epoll instead of edge-triggered\n");
+    printf("  -l LEVEL    Log level: debug, info, warn, error (default: info)\n");
+    printf("  -o TARGET   Log to stderr, syslog or a file path (default: stderr)\n");
     printf("  -h          Show this help message\n");
     printf("\nExamples:\n");
     printf("  %s -p 2323     # Start server on port 2323\n", program_name);
+    printf("  %s -t 4        # Start 4 reactors sharing the port\n", program_name);
     printf("  %s             # Start server on default port 23\n", program_name);
+    printf("\nSend SIGUSR2 to restart into a new binary without dropping sessions.\n");
 }
 
 //./telnet_server -p 8899
@@ -16,19 +49,191 @@ void print_usage(const char *program_name) {
 
 
 int main(int argc, char *argv[]) {
-    int port = TELNET_DEFAULT_PORT;
+    telnet_config_t config;
     int opt;
     
+    telnet_config_default(&config);
+    config.argv = argv;
+    
     // 解析命令行参数
-    while ((opt = getopt(argc, argv, "p:h")) != -1) {
+    while ((opt = getopt(argc, argv, "p:t:c:i:H:M:b:r:I:Q:w:B:R:A:V:m:z:Z:S:C:K:U:uLl:o:h")) != -1) {
         switch (opt) {
             case 'p':
-                port = atoi(optarg);
-                if (port <= 0 || port > 65535) {
+                config.port = atoi(optarg);
+                if (config.port <= 0 || config.port > 65535) {
                     fprintf(stderr, "Invalid port number: %s\n", optarg);
                     return 1;
                 }
                 break;
+            case 't':
+                config.threads = atoi(optarg);
+                if (config.threads <= 0 || config.threads > TELNET_MAX_THREADS) {
+                    fprintf(stderr, "Invalid thread count: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'c':
+                config.max_clients = atoi(optarg);
+                if (config.max_clients <= 0) {
+                    fprintf(stderr, "Invalid max clients: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'i':
+                config.idle_timeout = atoi(optarg);
+                if (config.idle_timeout <= 0) {
+                    fprintf(stderr, "Invalid idle timeout: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'H':
+                config.high_water = atoi(optarg);
+                if (config.high_water <= 0) {
+                    fprintf(stderr, "Invalid high-water mark: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'M':
+                config.line_max = atoi(optarg);
+                if (config.line_max < 16 || config.line_max > TELNET_LINE_MAX_LIMIT) {
+                    fprintf(stderr, "Invalid line length: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'b':
+                config.backlog = atoi(optarg);
+                if (config.backlog <= 0) {
+                    fprintf(stderr, "Invalid backlog: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'r': {
+                char *end;
+                config.accept_rate = (int)strtol(optarg, &end, 10);
+                if (*end == ':') {
+                    config.accept_burst = (int)strtol(end + 1, &end, 10);
+                }
+                if (*end != '\0' || config.accept_rate <= 0 || config.accept_burst <= 0) {
+                    fprintf(stderr, "Invalid rate limit: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            }
+            case 'I':
+            case 'Q': {
+                char *end;
+                int rate = (int)strtol(optarg, &end, 10);
+                int burst = rate;
+                if (*end == ':') {
+                    burst = (int)strtol(end + 1, &end, 10);
+                }
+                if (*end != '\0' || rate <= 0 || burst <= 0) {
+                    fprintf(stderr, "Invalid session rate limit: %s\n", optarg);
+                    return 1;
+                }
+                if (opt == 'I') {
+                    config.input_rate = rate;
+                    config.input_burst = burst;
+                }
+                else {
+                    config.cmd_rate = rate;
+                    config.cmd_burst = burst;
+                }
+                break;
+            }
+            case 'w':
+                config.pool_threads = atoi(optarg);
+                if (config.pool_threads < 0 || config.pool_threads > TELNET_POOL_MAX_THREADS) {
+                    fprintf(stderr, "Invalid pool thread count: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'B':
+                config.bcast_policy = telnets_broadcast_parse_policy(optarg);
+                if (config.bcast_policy < 0) {
+                    fprintf(stderr, "Invalid broadcast policy: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'R':
+                config.resp_file = optarg;
+                break;
+            case 'A':
+                config.auth_file = optarg;
+                break;
+            case 'V': {
+                char *end;
+                config.auth_threads = (int)strtol(optarg, &end, 10);
+                if (*end == ':') {
+                    config.auth_cache_ttl = (int)strtol(end + 1, &end, 10);
+                }
+                if (*end != '\0' || config.auth_threads <= 0 || config.auth_threads > TELNET_AUTH_MAX_THREADS ||
+                    config.auth_cache_ttl < 0) {
+                    fprintf(stderr, "Invalid password verifier setting: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            }
+            case 'm':
+                config.metrics_port = atoi(optarg);
+                if (config.metrics_port <= 0 || config.metrics_port > 65535) {
+                    fprintf(stderr, "Invalid metrics port: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'z':
+                config.compress_level = atoi(optarg);
+                if (config.compress_level < 1 || config.compress_level > 9) {
+                    fprintf(stderr, "Invalid compression level: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'Z':
+                config.compress_max = atoi(optarg);
+                if (config.compress_max <= 0) {
+                    fprintf(stderr, "Invalid compression session limit: %s\n", optarg);
+                    return 1;
+                }
+                if (config.compress_level == 0) {
+                    config.compress_level = TELNET_MCCP_LEVEL;
+                }
+                break;
+            case 'S':
+                config.tls_port = atoi(optarg);
+                if (config.tls_port <= 0 || config.tls_port > 65535) {
+                    fprintf(stderr, "Invalid TLS port: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'C':
+                config.tls_cert = optarg;
+                break;
+            case 'K':
+                config.tls_key = optarg;
+                break;
+            case 'U':
+                config.upgrade_fd = atoi(optarg);
+                if (config.upgrade_fd < 0) {
+                    fprintf(stderr, "Invalid handoff descriptor: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'u':
+                config.io_backend = TELNET_IO_URING;
+                break;
+            case 'L':
+                config.edge_triggered = 0;
+                break;
+            case 'l':
+                config.log_level = telnets_log_parse_level(optarg);
+                if (config.log_level < 0) {
+                    fprintf(stderr, "Invalid log level: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'o':
+                config.log_target = optarg;
+                break;
             case 'h':
                 print_usage(argv[0]);
                 return 0;
@@ -38,29 +243,59 @@ int main(int argc, char *argv[]) {
         }
     }
     
-    printf("Starting Telnet server on port %d...\n", port);
+    if (config.tls_port > 0 && !config.tls_cert) {
+        fprintf(stderr, "TLS port requires a certificate (-C)\n");
+        return 1;
+    }
+    
+    // 每个工作线程至少分到一个连接
+    if (config.threads > config.max_clients) {
+        config.threads = config.max_clients;
+    }
+    
+    printf("Starting Telnet server on port %d...\n", config.port);
     printf("Press Ctrl+C to stop the server.\n\n");
     
+    // 启动日志线程，之后事件循环中的日志只写入线程本地的环
+    if (telnets_log_init(config.log_level, config.log_target) < 0)
+    {
+        fprintf(stderr, "Failed to start logger\n");
+        return 1;
+    }
+    
+    // 注册内置命令，其他模块的命令也在此之后、启动之前注册
+    if (telnets_cmd_init() < 0)
+    {
+        fprintf(stderr, "Failed to register commands\n");
+        telnets_log_shutdown();
+        return 1;
+    }
+    
     // telnet服务器初始化
-    telnet_server_t *server = telnet_server_init(port);
-    if (!server)
+    telnet_master_t *master = telnet_master_init(&config);
+    if (!master)
     {
         fprintf(stderr, "Failed to create server\n");
+        telnets_log_shutdown();
         return 1;
     }
     
     // 启动服务器
-    if (telnet_server_start(server) < 0) 
+    if (telnet_master_start(master) < 0) 
     {
         fprintf(stderr, "Failed to start server\n");
-        telnet_server_destroy(server);
+        telnet_master_destroy(master);
+        telnets_log_shutdown();
         return 1;
     }
     
+    // 等待终止信号
+    telnet_master_wait(master);
+    
     // 清理
-    telnet_server_stop(server);
-    telnet_server_destroy(server);
+    telnet_master_destroy(master);
+    telnets_log_shutdown();
     
     printf("\nServer stopped.\n");
     return 0;
-}
\ No newline at end of file
+}
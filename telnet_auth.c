@@ -0,0 +1,919 @@
+/**
+ * @file telnet_auth.c
+ * @brief Telnet服务器登录认证
+ * @date liuliang 2026-01-25
+ *
+ * 本文件包含登录阶段、密码表和密码校验线程池
+ * 指定密码文件后，连接先输入用户名和密码，登录成功才进入命令提示符；
+ * 密码文件每行"用户名:哈希"，哈希为crypt格式的加盐慢哈希（如openssl passwd -6生成的SHA-512），
+ * 启动时读入并按用户名排序，之后只读；
+ * 慢哈希在校验线程池中计算，线程降低调度优先级，队列有界，满时提示稍后重试，登录风暴不占用事件循环；
+ * 校验期间会话按等待命令处理(cmd_pending)，之后的输入缓存，完成后按序处理；
+ * 每个工作线程缓存最近校验通过的凭据摘要，有效期内再次登录不再计算慢哈希；
+ * 按来源IP限制登录失败次数：每次尝试提交时先按失败扣除，通过后退还，并发的猜测同样受限，
+ * 超过后直接拒绝，不再交给校验线程池；同一IP的连接按源端口分散到各工作线程，限速表由所有工作线程共享，加锁访问；
+ * 用户不存在时同样计算一次慢哈希，响应时间不泄露用户是否存在；
+ * 登录完成前行缓冲区和预输入缓冲区换级或归还缓冲池前清零，密码不留在复用的缓冲区中；
+ * 登录过程中的用户名和失败次数从缓冲池借用，登录完成后只保留指向密码表中用户名的指针，
+ * 两者都按槽位索引，未启用认证时不占用会话内存
+ */
+
+#define _GNU_SOURCE             // explicit_bzero
+#include "telnet_server.h"
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <openssl/crypto.h>
+#include <openssl/rand.h>
+#include <openssl/sha.h>
+
+#define TELNET_AUTH_PASS_MAX 128        // 密码最大长度，SHA-crypt的耗时随密码长度增长
+#define TELNET_AUTH_HASH_MAX 256        // 密码文件中哈希的最大长度
+#define TELNET_AUTH_SECRET 32           // 凭据摘要密钥长度
+
+// 密码表中的一个用户
+typedef struct {
+    char name[TELNET_AUTH_NAME_MAX];
+    char *hash;                     // crypt格式的哈希，包含算法、参数和盐
+} telnet_auth_user_t;
+
+// 登录过程状态，从工作线程的缓冲池借用
+typedef struct telnet_auth_login {
+    uint8_t cls;                    // 缓冲区级别
+    uint8_t failures;               // 本连接登录失败的次数
+    char username[TELNET_AUTH_NAME_MAX]; // 输入的用户名，输入密码和校验期间为待校验的用户名
+} telnet_auth_login_t;
+
+// 校验任务
+typedef struct telnet_auth_job {
+    struct telnet_auth_job *next;   // 等待队列或完成栈中的下一个任务
+    telnet_server_t *server;        // 发出请求的工作线程
+    const telnet_auth_user_t *user; // 要校验的用户，NULL表示用户不存在
+    int slot;                       // 客户端槽位
+    uint32_t generation;            // 客户端槽位代数，完成时客户端已断开则丢弃结果
+    uint32_t addr;                  // 来源IP，提交时已扣除一次失败次数，通过后退还
+    int ok;                         // 校验结果
+    uint64_t start_ns;              // 提交时间
+    unsigned char digest[SHA256_DIGEST_LENGTH]; // 凭据摘要，通过后写入缓存
+    int len;                        // 密码长度
+    char password[];                // 密码副本，校验后清零
+} telnet_auth_job_t;
+
+typedef struct telnet_auth {
+    telnet_auth_user_t *users;      // 按用户名排序
+    int nusers;
+    const char *dummy;              // 用户不存在时对照计算的哈希
+    unsigned char secret[TELNET_AUTH_SECRET]; // 凭据摘要密钥，每次启动随机生成
+    pthread_t threads[TELNET_AUTH_MAX_THREADS];
+    int nthreads;                   // 已启动的线程数
+    pthread_mutex_t lock;           // 保护等待队列
+    pthread_cond_t cond;            // 有新任务或需要退出
+    telnet_auth_job_t *head;        // 等待队列头
+    telnet_auth_job_t *tail;        // 等待队列尾
+    int queued;                     // 等待中的任务数
+    int stopping;                   // 线程池正在停止
+    struct telnet_ratelimit *fails; // 来源IP的登录失败限速表，所有工作线程共享
+    pthread_mutex_t fails_lock;     // 保护登录失败限速表
+} telnet_auth_t;
+
+// 凭据缓存项
+typedef struct {
+    unsigned char digest[SHA256_DIGEST_LENGTH]; // 凭据摘要
+    uint64_t expires_ms;            // 过期时间，0表示空闲
+} telnet_auth_entry_t;
+
+typedef struct telnet_auth_cache {
+    telnet_auth_entry_t entries[TELNET_AUTH_CACHE_SIZE];
+} telnet_auth_cache_t;
+
+
+static int telnets_auth_user_cmp(const void *a, const void *b)
+{
+    return strcmp(((const telnet_auth_user_t *)a)->name, ((const telnet_auth_user_t *)b)->name);
+}
+
+// 解析密码文件的一行，空行和#开头的注释跳过，返回1表示读到一个用户
+static int telnets_auth_parse(char *line, telnet_auth_user_t *user, const char *path, int lineno)
+{
+    char *sep;
+    size_t len = strcspn(line, "\r\n");
+
+    line[len] = '\0';
+    if (len == 0 || line[0] == '#')
+    {
+        return 0;
+    }
+
+    sep = strchr(line, ':');
+    if (!sep || sep == line || sep - line >= TELNET_AUTH_NAME_MAX)
+    {
+        telnets_log_msg(TELNET_LOG_ERROR, "%s:%d: expected user:hash", path, lineno);
+        return -1;
+    }
+
+    // 只接受crypt格式的哈希，明文密码视为错误；字段之后的内容（如shadow格式的其他字段）忽略
+    *sep++ = '\0';
+    sep[strcspn(sep, ":")] = '\0';
+    if (sep[0] != '$' || strlen(sep) >= TELNET_AUTH_HASH_MAX)
+    {
+        telnets_log_msg(TELNET_LOG_ERROR, "%s:%d: password must be a crypt hash such as $6$...", path, lineno);
+        return -1;
+    }
+
+    strcpy(user->name, line);
+    user->hash = strdup(sep);
+    if (!user->hash)
+    {
+        telnets_log_errno("Failed to allocate password table");
+        return -1;
+    }
+    return 1;
+}
+
+// 读入密码文件，文件有误时同步返回
+int telnets_auth_load(telnet_master_t *master)
+{
+    const char *path = master->config.auth_file;
+    telnet_auth_t *auth;
+    char line[TELNET_AUTH_NAME_MAX + TELNET_AUTH_HASH_MAX + 64];
+    int cap = 0;
+    int lineno = 0;
+    int ret = 0;
+    FILE *fp;
+
+    fp = fopen(path, "r");
+    if (!fp)
+    {
+        telnets_log_msg(TELNET_LOG_ERROR, "Failed to open password file %s: %s", path, strerror(errno));
+        return -1;
+    }
+
+    auth = (telnet_auth_t *)calloc(1, sizeof(telnet_auth_t));
+    if (!auth)
+    {
+        telnets_log_errno("Failed to allocate password table");
+        fclose(fp);
+        return -1;
+    }
+    master->auth = auth;
+
+    while (ret == 0 && fgets(line, sizeof(line), fp))
+    {
+        telnet_auth_user_t user;
+        int n;
+
+        lineno++;
+        n = telnets_auth_parse(line, &user, path, lineno);
+        if (n < 0)
+        {
+            ret = -1;
+        }
+        if (n <= 0)
+        {
+            continue;
+        }
+
+        if (auth->nusers == cap)
+        {
+            int new_cap = cap ? cap * 2 : TELNET_TABLE_INIT_SIZE;
+            telnet_auth_user_t *p = (telnet_auth_user_t *)realloc(auth->users, new_cap * sizeof(telnet_auth_user_t));
+            if (!p)
+            {
+                telnets_log_errno("Failed to allocate password table");
+                free(user.hash);
+                ret = -1;
+                continue;
+            }
+            auth->users = p;
+            cap = new_cap;
+        }
+        auth->users[auth->nusers++] = user;
+    }
+    fclose(fp);
+
+    if (ret == 0 && auth->nusers == 0)
+    {
+        telnets_log_msg(TELNET_LOG_ERROR, "Password file %s has no users", path);
+        ret = -1;
+    }
+    if (ret == 0)
+    {
+        auth->fails = telnets_ratelimit_create(TELNET_AUTH_FAIL_BURST, TELNET_AUTH_FAIL_PERIOD * 1000,
+                                               TELNET_AUTH_FAIL_BURST);
+        if (!auth->fails)
+        {
+            ret = -1;
+        }
+    }
+    if (ret == 0 && RAND_bytes(auth->secret, sizeof(auth->secret)) != 1)
+    {
+        telnets_log_msg(TELNET_LOG_ERROR, "Failed to generate credential cache key");
+        ret = -1;
+    }
+    if (ret < 0)
+    {
+        telnets_auth_free(master);
+        return -1;
+    }
+
+    qsort(auth->users, auth->nusers, sizeof(telnet_auth_user_t), telnets_auth_user_cmp);
+    for (int i = 1; i < auth->nusers; i++)
+    {
+        if (strcmp(auth->users[i - 1].name, auth->users[i].name) == 0)
+        {
+            telnets_log_msg(TELNET_LOG_WARN, "Duplicate user %s in %s", auth->users[i].name, path);
+        }
+    }
+
+    // 不存在的用户对照第一个用户的哈希计算，耗时与真实用户相同
+    auth->dummy = auth->users[0].hash;
+    pthread_mutex_init(&auth->lock, NULL);
+    pthread_cond_init(&auth->cond, NULL);
+    pthread_mutex_init(&auth->fails_lock, NULL);
+    telnets_log_msg(TELNET_LOG_INFO, "Loaded %d user(s) from %s", auth->nusers, path);
+    return 0;
+}
+
+// 释放密码表，须在校验线程池停止之后调用
+void telnets_auth_free(telnet_master_t *master)
+{
+    telnet_auth_t *auth = master->auth;
+
+    if (!auth)
+    {
+        return;
+    }
+
+    for (int i = 0; i < auth->nusers; i++)
+    {
+        free(auth->users[i].hash);
+    }
+    free(auth->users);
+    if (auth->dummy)
+    {
+        pthread_cond_destroy(&auth->cond);
+        pthread_mutex_destroy(&auth->lock);
+        pthread_mutex_destroy(&auth->fails_lock);
+    }
+    free(auth->fails);
+    explicit_bzero(auth->secret, sizeof(auth->secret));
+    free(auth);
+    master->auth = NULL;
+}
+
+// 把完成的任务压入工作线程的完成栈，栈原来为空时唤醒工作线程
+static void telnets_auth_post(telnet_auth_job_t *job)
+{
+    telnet_server_t *server = job->server;
+    telnet_auth_job_t *head = __atomic_load_n(&server->auth_done, __ATOMIC_RELAXED);
+
+    do
+    {
+        job->next = head;
+    } while (!__atomic_compare_exchange_n(&server->auth_done, &head, job, 1,
+                                          __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+
+    if (!head)
+    {
+        telnets_event_wake(server);
+    }
+}
+
+// 校验线程入口
+static void *telnets_auth_main(void *arg)
+{
+    telnet_auth_t *auth = (telnet_auth_t *)arg;
+    struct crypt_data *data = (struct crypt_data *)calloc(1, sizeof(struct crypt_data));
+
+    // 登录风暴时事件循环线程优先，失败不影响校验
+    setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), TELNET_AUTH_NICE);
+
+    for (;;)
+    {
+        telnet_auth_job_t *job;
+        const char *hash;
+        const char *result;
+
+        pthread_mutex_lock(&auth->lock);
+        while (!auth->head && !auth->stopping)
+        {
+            pthread_cond_wait(&auth->cond, &auth->lock);
+        }
+        if (auth->stopping)
+        {
+            pthread_mutex_unlock(&auth->lock);
+            break;
+        }
+        job = auth->head;
+        auth->head = job->next;
+        if (!auth->head)
+        {
+            auth->tail = NULL;
+        }
+        auth->queued--;
+        pthread_mutex_unlock(&auth->lock);
+
+        hash = job->user ? job->user->hash : auth->dummy;
+        result = data ? crypt_r(job->password, hash, data) : NULL;
+        job->ok = job->user && result && strlen(result) == strlen(hash) &&
+                  CRYPTO_memcmp(result, hash, strlen(hash)) == 0;
+        explicit_bzero(job->password, job->len);
+
+        telnets_auth_post(job);
+    }
+
+    if (data)
+    {
+        explicit_bzero(data, sizeof(struct crypt_data));
+        free(data);
+    }
+    return NULL;
+}
+
+// 启动校验线程池，须在工作线程启动之前调用
+int telnets_auth_start(telnet_master_t *master)
+{
+    telnet_auth_t *auth = master->auth;
+
+    if (!auth)
+    {
+        return 0;
+    }
+
+    for (int i = 0; i < master->config.auth_threads; i++)
+    {
+        int ret = pthread_create(&auth->threads[i], NULL, telnets_auth_main, auth);
+        if (ret != 0)
+        {
+            telnets_log_error("Failed to create password verifier thread", ret);
+            telnets_auth_stop(master);
+            return -1;
+        }
+        auth->nthreads++;
+    }
+
+    return 0;
+}
+
+// 停止校验线程池，须在工作线程退出之后、服务器实例销毁之前调用
+void telnets_auth_stop(telnet_master_t *master)
+{
+    telnet_auth_t *auth = master->auth;
+
+    if (!auth)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&auth->lock);
+    auth->stopping = 1;
+    pthread_cond_broadcast(&auth->cond);
+    pthread_mutex_unlock(&auth->lock);
+
+    for (int i = 0; i < auth->nthreads; i++)
+    {
+        pthread_join(auth->threads[i], NULL);
+    }
+    auth->nthreads = 0;
+
+    // 未校验的任务直接丢弃
+    while (auth->head)
+    {
+        telnet_auth_job_t *job = auth->head;
+        auth->head = job->next;
+        explicit_bzero(job->password, job->len);
+        free(job);
+    }
+    auth->tail = NULL;
+    auth->queued = 0;
+}
+
+// 启用认证时创建凭据缓存和按槽位索引的登录状态表
+int telnets_auth_init(telnet_server_t *server)
+{
+    const telnet_config_t *config = server->config;
+
+    if (!config->auth_file)
+    {
+        return 0;
+    }
+
+    server->auth_login = (telnet_auth_login_t **)calloc(server->capacity, sizeof(telnet_auth_login_t *));
+    server->auth_user = (const char **)calloc(server->capacity, sizeof(const char *));
+    if (!server->auth_login || !server->auth_user)
+    {
+        telnets_log_errno("Failed to allocate login table");
+        telnets_auth_destroy(server);
+        return -1;
+    }
+
+    if (config->auth_cache_ttl > 0)
+    {
+        server->auth_cache = (telnet_auth_cache_t *)calloc(1, sizeof(telnet_auth_cache_t));
+        if (!server->auth_cache)
+        {
+            telnets_log_errno("Failed to allocate credential cache");
+            telnets_auth_destroy(server);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void telnets_auth_destroy(telnet_server_t *server)
+{
+    if (server->auth_cache)
+    {
+        explicit_bzero(server->auth_cache, sizeof(telnet_auth_cache_t));
+    }
+    free(server->auth_cache);
+    free(server->auth_login);
+    free(server->auth_user);
+    server->auth_cache = NULL;
+    server->auth_login = NULL;
+    server->auth_user = NULL;
+}
+
+// 需要登录：不经过主控直接创建的服务器实例（模拟、微基准）不启用
+int telnets_auth_enabled(const telnet_server_t *server)
+{
+    return server->master && server->master->auth;
+}
+
+// 按用户名查找，不存在时返回NULL
+static const telnet_auth_user_t *telnets_auth_find(const telnet_auth_t *auth, const char *name)
+{
+    telnet_auth_user_t key;
+
+    strcpy(key.name, name);
+    return (const telnet_auth_user_t *)bsearch(&key, auth->users, auth->nusers, sizeof(telnet_auth_user_t),
+                                               telnets_auth_user_cmp);
+}
+
+// 新会话进入登录阶段，借用登录状态；未启用认证时直接视为已登录
+int telnets_auth_begin(telnet_server_t *server, telnet_client_t *client)
+{
+    telnet_auth_login_t *login;
+    uint8_t cls;
+
+    client->cold->authenticated = TELNET_AUTH_OK;
+    if (!telnets_auth_enabled(server) || !server->auth_login)
+    {
+        return 0;
+    }
+
+    login = (telnet_auth_login_t *)telnets_buf_alloc(server, sizeof(telnet_auth_login_t), &cls);
+    if (!login)
+    {
+        telnets_log_msg(TELNET_LOG_ERROR, "Failed to allocate login state");
+        return -1;
+    }
+    login->cls = cls;
+    login->failures = 0;
+    login->username[0] = '\0';
+    server->auth_login[client->slot] = login;
+    client->cold->authenticated = TELNET_AUTH_USER;
+    return 0;
+}
+
+// 归还登录状态，登录完成或会话结束时调用
+static void telnets_auth_end(telnet_server_t *server, telnet_client_t *client)
+{
+    telnet_auth_login_t *login;
+
+    if (!server->auth_login)
+    {
+        return;
+    }
+
+    login = server->auth_login[client->slot];
+    if (login)
+    {
+        telnets_buf_free(server, (char *)login, login->cls);
+        server->auth_login[client->slot] = NULL;
+    }
+}
+
+// 会话结束时归还登录状态，清除已登录的用户名
+void telnets_auth_release(telnet_server_t *server, telnet_client_t *client)
+{
+    telnets_auth_end(server, client);
+    if (server->auth_user)
+    {
+        __atomic_store_n(&server->auth_user[client->slot], NULL, __ATOMIC_RELEASE);
+    }
+}
+
+// 已登录的用户名，未登录或未启用认证时返回NULL；其他线程持表锁读取，指向的密码表在工作线程退出后才释放
+const char *telnets_auth_user(const telnet_server_t *server, const telnet_client_t *client)
+{
+    if (!server->auth_user)
+    {
+        return NULL;
+    }
+    return __atomic_load_n(&server->auth_user[client->slot], __ATOMIC_ACQUIRE);
+}
+
+// 热重启：取出会话的登录失败次数和用户名（登录中为输入的用户名，已登录为登录的用户名）
+void telnets_auth_save(const telnet_server_t *server, const telnet_client_t *client,
+                       uint8_t *failures, char *username)
+{
+    const telnet_auth_login_t *login = server->auth_login ? server->auth_login[client->slot] : NULL;
+    const char *user = telnets_auth_user(server, client);
+
+    *failures = login ? login->failures : 0;
+    username[0] = '\0';
+    if (login)
+    {
+        memcpy(username, login->username, TELNET_AUTH_NAME_MAX);
+    }
+    else if (user)
+    {
+        strcpy(username, user);
+    }
+}
+
+// 热重启：按旧进程的登录状态恢复会话，会话已由telnets_add_client进入登录阶段
+void telnets_auth_restore(telnet_server_t *server, telnet_client_t *client, int state,
+                          int failures, const char *username)
+{
+    telnet_auth_login_t *login = server->auth_login ? server->auth_login[client->slot] : NULL;
+    char name[TELNET_AUTH_NAME_MAX];
+
+    if (!login)
+    {
+        return;
+    }
+
+    memcpy(name, username, TELNET_AUTH_NAME_MAX);
+    name[TELNET_AUTH_NAME_MAX - 1] = '\0';
+
+    if (state == TELNET_AUTH_OK)
+    {
+        // 新进程的密码表中已没有该用户时仍保持登录，只是不再显示用户名
+        const telnet_auth_user_t *user = telnets_auth_find(server->master->auth, name);
+
+        telnets_auth_end(server, client);
+        __atomic_store_n(&server->auth_user[client->slot], user ? user->name : NULL, __ATOMIC_RELEASE);
+        client->cold->authenticated = TELNET_AUTH_OK;
+        return;
+    }
+
+    login->failures = (uint8_t)failures;
+    strcpy(login->username, name);
+    client->cold->authenticated = (uint8_t)state;
+}
+
+// 按登录状态发送用户名或密码提示符
+void telnets_auth_prompt(telnet_client_t *client)
+{
+    const telnet_resp_t *prompt;
+
+    switch (client->cold->authenticated)
+    {
+        case TELNET_AUTH_USER:
+            prompt = telnets_resp_get(TELNET_RESP_LOGIN);
+            break;
+        case TELNET_AUTH_PASS:
+            prompt = telnets_resp_get(TELNET_RESP_PASSWORD);
+            break;
+        default:
+            return;
+    }
+
+    telnets_output(client, prompt->data, prompt->len);
+}
+
+// 凭据摘要：密钥、用户名、密码和当前哈希一起计算，密码文件中的哈希变化后旧的缓存不再匹配
+static void telnets_auth_digest(const telnet_auth_t *auth, const telnet_auth_user_t *user,
+                                const char *password, int len, unsigned char *digest)
+{
+    unsigned char buf[TELNET_AUTH_SECRET + TELNET_AUTH_NAME_MAX + TELNET_AUTH_PASS_MAX + TELNET_AUTH_HASH_MAX];
+    size_t name_len = strlen(user->name) + 1;
+    size_t hash_len = strlen(user->hash);
+    size_t n = 0;
+
+    memcpy(buf + n, auth->secret, TELNET_AUTH_SECRET);
+    n += TELNET_AUTH_SECRET;
+    memcpy(buf + n, user->name, name_len);
+    n += name_len;
+    memcpy(buf + n, password, len);
+    n += len;
+    memcpy(buf + n, user->hash, hash_len);
+    n += hash_len;
+
+    SHA256(buf, n, digest);
+    explicit_bzero(buf, n);
+}
+
+// 查找有效期内的缓存项
+static int telnets_auth_cache_find(telnet_server_t *server, const unsigned char *digest)
+{
+    telnet_auth_cache_t *cache = server->auth_cache;
+    uint32_t hash;
+
+    memcpy(&hash, digest, sizeof(hash));
+    for (int i = 0; i < TELNET_AUTH_CACHE_PROBE; i++)
+    {
+        telnet_auth_entry_t *e = &cache->entries[(hash + i) & (TELNET_AUTH_CACHE_SIZE - 1)];
+
+        if (e->expires_ms > server->now_ms && CRYPTO_memcmp(e->digest, digest, SHA256_DIGEST_LENGTH) == 0)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// 记录校验通过的凭据，探测范围内没有空闲或过期的项时替换最早过期的一项
+static void telnets_auth_cache_add(telnet_server_t *server, const unsigned char *digest)
+{
+    telnet_auth_cache_t *cache = server->auth_cache;
+    telnet_auth_entry_t *victim = NULL;
+    uint32_t hash;
+
+    memcpy(&hash, digest, sizeof(hash));
+    for (int i = 0; i < TELNET_AUTH_CACHE_PROBE; i++)
+    {
+        telnet_auth_entry_t *e = &cache->entries[(hash + i) & (TELNET_AUTH_CACHE_SIZE - 1)];
+
+        if (memcmp(e->digest, digest, SHA256_DIGEST_LENGTH) == 0 || e->expires_ms <= server->now_ms)
+        {
+            victim = e;
+            break;
+        }
+        if (!victim || e->expires_ms < victim->expires_ms)
+        {
+            victim = e;
+        }
+    }
+
+    memcpy(victim->digest, digest, SHA256_DIGEST_LENGTH);
+    victim->expires_ms = server->now_ms + (uint64_t)server->config->auth_cache_ttl * 1000;
+}
+
+// 登录结果：成功进入命令提示符，失败回到用户名提示，失败次数过多时标记关闭；user为通过校验的用户
+static void telnets_auth_result(telnet_server_t *server, telnet_client_t *client, const telnet_auth_user_t *user,
+                                int ok)
+{
+    telnet_client_cold_t *cold = client->cold;
+    telnet_auth_login_t *login = server->auth_login[client->slot];
+
+    if (ok)
+    {
+        // 登录状态归还缓冲池，之后只保留密码表中的用户名，其他线程列出客户端时读取
+        cold->authenticated = TELNET_AUTH_OK;
+        telnets_auth_end(server, client);
+        __atomic_store_n(&server->auth_user[client->slot], user->name, __ATOMIC_RELEASE);
+        TELNET_METRIC_ADD(server->metrics.auth_logins, 1);
+        telnets_log_write(TELNET_LOG_INFO, TELNET_EV_LOGIN, &cold->addr, client->slot, 0, user->name);
+        telnets_printf(client, "Welcome, %s.\r\n", user->name);
+        telnets_send_prompt(client);
+        return;
+    }
+
+    TELNET_METRIC_ADD(server->metrics.auth_failures, 1);
+    telnets_log_write(TELNET_LOG_WARN, TELNET_EV_LOGIN_FAILED, &cold->addr, client->slot, 0, login->username);
+
+    telnets_output_str(client, "Login incorrect\r\n");
+    cold->authenticated = TELNET_AUTH_USER;
+    login->username[0] = '\0';
+    if (++login->failures >= TELNET_AUTH_MAX_TRIES)
+    {
+        telnets_output_str(client, "Too many failed logins.\r\n");
+        client->closed = 1;
+        return;
+    }
+    telnets_auth_prompt(client);
+}
+
+// 提交校验任务，成功后客户端进入等待状态，队列已满时返回-1
+static int telnets_auth_submit(telnet_server_t *server, telnet_client_t *client, const telnet_auth_user_t *user,
+                               const char *password, int len, const unsigned char *digest)
+{
+    telnet_auth_t *auth = server->master->auth;
+    telnet_auth_job_t *job;
+
+    job = (telnet_auth_job_t *)malloc(sizeof(telnet_auth_job_t) + len + 1);
+    if (!job)
+    {
+        telnets_log_errno("Failed to allocate login job");
+        return -1;
+    }
+
+    job->next = NULL;
+    job->server = server;
+    job->user = user;
+    job->slot = client->slot;
+    job->generation = client->generation;
+    job->addr = client->cold->addr.sin_addr.s_addr;
+    job->ok = 0;
+    job->start_ns = telnets_now_ns();
+    memcpy(job->digest, digest, SHA256_DIGEST_LENGTH);
+    job->len = len;
+    memcpy(job->password, password, len);
+    job->password[len] = '\0';
+
+    pthread_mutex_lock(&auth->lock);
+    if (auth->queued >= TELNET_AUTH_QUEUE || auth->stopping || auth->nthreads == 0)
+    {
+        pthread_mutex_unlock(&auth->lock);
+        explicit_bzero(job->password, len);
+        free(job);
+        return -1;
+    }
+    if (auth->tail)
+    {
+        auth->tail->next = job;
+    }
+    else
+    {
+        auth->head = job;
+    }
+    auth->tail = job;
+    auth->queued++;
+    pthread_cond_signal(&auth->cond);
+    pthread_mutex_unlock(&auth->lock);
+
+    client->cold->authenticated = TELNET_AUTH_VERIFY;
+    client->cmd_pending = 1;
+    return 0;
+}
+
+// 按失败扣除来源IP的一次登录次数，已用完时返回0；
+// 时间在锁内读取，各工作线程缓存的时钟先后不一，不能让令牌桶的时间倒退
+static int telnets_auth_take_fail(telnet_server_t *server, uint32_t addr)
+{
+    telnet_auth_t *auth = server->master->auth;
+    int ret;
+
+    pthread_mutex_lock(&auth->fails_lock);
+    ret = telnets_ratelimit_take(auth->fails, addr, telnets_now_ms());
+    pthread_mutex_unlock(&auth->fails_lock);
+    return ret;
+}
+
+// 退还提交时扣除的失败次数
+static void telnets_auth_refund(telnet_server_t *server, uint32_t addr)
+{
+    telnet_auth_t *auth = server->master->auth;
+
+    if (addr != 0)
+    {
+        pthread_mutex_lock(&auth->fails_lock);
+        telnets_ratelimit_refund(auth->fails, addr, telnets_now_ms());
+        pthread_mutex_unlock(&auth->fails_lock);
+    }
+}
+
+// 处理输入的密码
+static void telnets_auth_password(telnet_server_t *server, telnet_client_t *client, const char *password, int len)
+{
+    telnet_auth_t *auth = server->master->auth;
+    telnet_client_cold_t *cold = client->cold;
+    const telnet_auth_user_t *user;
+    unsigned char digest[SHA256_DIGEST_LENGTH];
+    uint32_t addr = cold->addr.sin_addr.s_addr;
+
+    // 每次尝试先按失败扣除一次，通过后退还；同时校验中的尝试也计入，
+    // 从一个IP并发提交大量猜测时同样受限。失败次数过多时直接拒绝，不计算慢哈希
+    if (addr != 0 && !telnets_auth_take_fail(server, addr))
+    {
+        TELNET_METRIC_ADD(server->metrics.auth_blocked, 1);
+        telnets_output_str(client, "Too many failed logins, try again later.\r\n");
+        client->closed = 1;
+        return;
+    }
+
+    // 超长的密码不可能正确，不交给校验线程
+    if (len > TELNET_AUTH_PASS_MAX)
+    {
+        telnets_auth_result(server, client, NULL, 0);
+        return;
+    }
+
+    memset(digest, 0, sizeof(digest));
+    user = telnets_auth_find(auth, server->auth_login[client->slot]->username);
+    if (user && server->auth_cache)
+    {
+        telnets_auth_digest(auth, user, password, len, digest);
+        if (telnets_auth_cache_find(server, digest))
+        {
+            TELNET_METRIC_ADD(server->metrics.auth_cached, 1);
+            telnets_auth_refund(server, addr);
+            telnets_auth_result(server, client, user, 1);
+            return;
+        }
+    }
+
+    if (telnets_auth_submit(server, client, user, password, len, digest) < 0)
+    {
+        TELNET_METRIC_ADD(server->metrics.auth_busy, 1);
+        telnets_auth_refund(server, addr);
+        telnets_output_str(client, "Server busy, please try again.\r\n");
+        cold->authenticated = TELNET_AUTH_USER;
+        telnets_auth_prompt(client);
+    }
+}
+
+// 登录完成前输入的一行：用户名或密码；行缓冲区由调用方整块清零后归还
+void telnets_auth_line(telnet_server_t *server, telnet_client_t *client, char *line, int len)
+{
+    telnet_client_cold_t *cold = client->cold;
+
+    if (cold->authenticated == TELNET_AUTH_USER)
+    {
+        // 过长的用户名不可能存在，按空用户名继续询问密码，不提示用户名错误
+        telnet_auth_login_t *login = server->auth_login[client->slot];
+        int n = len < TELNET_AUTH_NAME_MAX ? len : 0;
+
+        memcpy(login->username, line, n);
+        login->username[n] = '\0';
+        cold->authenticated = TELNET_AUTH_PASS;
+        telnets_auth_prompt(client);
+        return;
+    }
+
+    if (cold->authenticated == TELNET_AUTH_PASS)
+    {
+        telnets_auth_password(server, client, line, len);
+    }
+}
+
+// 取出完成栈中的全部任务，按完成顺序排列
+static telnet_auth_job_t *telnets_auth_take(telnet_server_t *server)
+{
+    telnet_auth_job_t *list;
+    telnet_auth_job_t *ordered = NULL;
+
+    if (!__atomic_load_n(&server->auth_done, __ATOMIC_RELAXED))
+    {
+        return NULL;
+    }
+
+    list = __atomic_exchange_n(&server->auth_done, NULL, __ATOMIC_ACQUIRE);
+    while (list)
+    {
+        telnet_auth_job_t *next = list->next;
+        list->next = ordered;
+        ordered = list;
+        list = next;
+    }
+
+    return ordered;
+}
+
+// 事件循环中处理校验结果，再按序处理等待期间缓存的输入
+void telnets_auth_complete(telnet_server_t *server)
+{
+    telnet_auth_job_t *job = telnets_auth_take(server);
+
+    while (job)
+    {
+        telnet_auth_job_t *next = job->next;
+        telnet_client_t *client = telnets_lookup_token(server, TELNET_TOKEN(job->slot, job->generation));
+
+        telnets_hist_record(&server->metrics.auth_ns, telnets_now_ns() - job->start_ns);
+        if (job->ok)
+        {
+            telnets_auth_refund(server, job->addr);
+        }
+
+        if (client)
+        {
+            client->cmd_pending = 0;
+            if (job->ok && server->auth_cache)
+            {
+                telnets_auth_cache_add(server, job->digest);
+            }
+            telnets_auth_result(server, client, job->user, job->ok);
+
+            if (client->closed)
+            {
+                telnets_remove_client(server, job->slot);
+            }
+            else
+            {
+                telnets_sched_begin(server);
+                telnets_recv_typeahead(server, job->slot);
+                telnets_sched_end(server);
+            }
+        }
+
+        explicit_bzero(job->digest, sizeof(job->digest));
+        free(job);
+        job = next;
+    }
+}
+
+// 销毁服务器实例前丢弃未处理的校验结果
+void telnets_auth_discard(telnet_server_t *server)
+{
+    telnet_auth_job_t *job = telnets_auth_take(server);
+
+    while (job)
+    {
+        telnet_auth_job_t *next = job->next;
+        free(job);
+        job = next;
+    }
+}
@@ -0,0 +1,211 @@
+/**
+ * @file telnet_broadcast.c
+ * @brief Telnet服务器广播
+ * @date liuliang 2026-01-25
+ *
+ * 本文件包含向所有客户端广播消息的实现
+ * 消息只构造一次，放入共享缓冲区，每个工作线程收到一份投递通知（无锁栈 + eventfd唤醒），
+ * 在自己的事件循环中遍历客户端表，给每个客户端的输出队列挂一个引用块，不拷贝消息内容；
+ * 输出积压超过高水位的客户端按其广播策略丢弃、截断或断开
+ */
+
+#include "telnet_server.h"
+#include <strings.h>
+
+// 投递给一个工作线程的广播
+typedef struct telnet_bcast {
+    struct telnet_bcast *next;      // 收件栈中的下一项
+    telnet_shared_t *shared;        // 消息内容，本通知持有一个引用
+} telnet_bcast_t;
+
+static const char *telnet_bcast_policy_names[] = { "drop", "truncate", "disconnect" };
+
+static const char telnet_bcast_truncated[] = "\r\n[message truncated]\r\n";
+
+
+int telnets_broadcast_parse_policy(const char *name)
+{
+    for (int i = 0; i < (int)(sizeof(telnet_bcast_policy_names) / sizeof(telnet_bcast_policy_names[0])); i++)
+    {
+        if (strcasecmp(name, telnet_bcast_policy_names[i]) == 0)
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+const char *telnets_broadcast_policy_name(int policy)
+{
+    if (policy < 0 || policy > TELNET_BCAST_DISCONNECT)
+    {
+        return "?";
+    }
+
+    return telnet_bcast_policy_names[policy];
+}
+
+// 向所有工作线程的所有客户端广播，可在任意线程调用
+int telnets_broadcast(telnet_master_t *master, const char *data, size_t len)
+{
+    telnet_shared_t *shared = telnets_shared_create(data, len);
+    int ret = 0;
+
+    if (!shared)
+    {
+        return -1;
+    }
+
+    for (int i = 0; i < master->nworkers; i++)
+    {
+        telnet_server_t *server = master->workers[i];
+        telnet_bcast_t *bcast = (telnet_bcast_t *)malloc(sizeof(telnet_bcast_t));
+        telnet_bcast_t *head;
+
+        if (!bcast)
+        {
+            telnets_log_errno("Failed to allocate broadcast");
+            ret = -1;
+            continue;
+        }
+
+        telnets_shared_ref(shared, 1);
+        bcast->shared = shared;
+
+        head = __atomic_load_n(&server->bcast_inbox, __ATOMIC_RELAXED);
+        do
+        {
+            bcast->next = head;
+        } while (!__atomic_compare_exchange_n(&server->bcast_inbox, &head, bcast, 1,
+                                              __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+
+        // 收件栈原来非空时工作线程已被唤醒过
+        if (!head)
+        {
+            telnets_event_wake(server);
+        }
+    }
+
+    telnets_shared_unref(shared);
+    return ret;
+}
+
+// 取出收件栈中的全部广播，按发送顺序排列
+static telnet_bcast_t *telnets_broadcast_take(telnet_server_t *server)
+{
+    telnet_bcast_t *list;
+    telnet_bcast_t *ordered = NULL;
+
+    if (!__atomic_load_n(&server->bcast_inbox, __ATOMIC_RELAXED))
+    {
+        return NULL;
+    }
+
+    list = __atomic_exchange_n(&server->bcast_inbox, NULL, __ATOMIC_ACQUIRE);
+    while (list)
+    {
+        telnet_bcast_t *next = list->next;
+        list->next = ordered;
+        ordered = list;
+        list = next;
+    }
+
+    return ordered;
+}
+
+// 把一条广播挂到本工作线程的所有客户端
+static void telnets_broadcast_fanout(telnet_server_t *server, telnet_shared_t *shared)
+{
+    size_t high_water = (size_t)server->config->high_water;
+    uint32_t reserved = (uint32_t)server->client_count;
+    uint32_t used = 0;
+
+    // 一次原子操作为所有客户端预留引用，断开客户端释放引用时不会提前回收
+    telnets_shared_ref(shared, reserved);
+
+    for (int i = 0; i < server->capacity && used < reserved; i++)
+    {
+        telnet_client_t *client = telnets_get_client(server, i);
+        uint32_t len = shared->len;
+
+        // 登录完成前的会话不接收广播，广播末尾的命令提示符也不会出现在登录阶段
+        if (!client || client->closed || client->cold->authenticated != TELNET_AUTH_OK)
+        {
+            continue;
+        }
+
+        if (client->outq.bytes + len > high_water)
+        {
+            if (client->bcast_policy == TELNET_BCAST_DISCONNECT)
+            {
+                TELNET_METRIC_ADD(server->metrics.bcast_disconnects, 1);
+                telnets_log_write(TELNET_LOG_WARN, TELNET_EV_DISCONNECT, &client->cold->addr, i, 0,
+                                  "too slow for broadcast");
+                telnets_remove_client(server, i);
+                continue;
+            }
+
+            if (client->bcast_policy == TELNET_BCAST_DROP)
+            {
+                TELNET_METRIC_ADD(server->metrics.bcast_dropped, 1);
+                continue;
+            }
+
+            // 只追加开头一段，积压客户端至少能看到消息头
+            if (len > TELNET_BCAST_TRUNCATE_LEN)
+            {
+                TELNET_METRIC_ADD(server->metrics.bcast_truncated, 1);
+                len = TELNET_BCAST_TRUNCATE_LEN;
+            }
+        }
+
+        if (telnets_output_shared(client, shared, len) < 0)
+        {
+            continue;
+        }
+        used++;
+
+        if (len < shared->len)
+        {
+            telnets_output(client, telnet_bcast_truncated, sizeof(telnet_bcast_truncated) - 1);
+        }
+    }
+
+    // 归还未用到的预留引用，投递通知仍持有一个引用，这里不会减到0
+    if (used < reserved)
+    {
+        __atomic_fetch_sub(&shared->refs, reserved - used, __ATOMIC_RELAXED);
+    }
+}
+
+// 事件循环中投递收到的广播，之后由本轮的集中发送发出
+void telnets_broadcast_deliver(telnet_server_t *server)
+{
+    telnet_bcast_t *bcast = telnets_broadcast_take(server);
+
+    while (bcast)
+    {
+        telnet_bcast_t *next = bcast->next;
+
+        TELNET_METRIC_ADD(server->metrics.broadcasts, 1);
+        telnets_broadcast_fanout(server, bcast->shared);
+        telnets_shared_unref(bcast->shared);
+        free(bcast);
+        bcast = next;
+    }
+}
+
+// 销毁服务器实例前丢弃未投递的广播
+void telnets_broadcast_discard(telnet_server_t *server)
+{
+    telnet_bcast_t *bcast = telnets_broadcast_take(server);
+
+    while (bcast)
+    {
+        telnet_bcast_t *next = bcast->next;
+        telnets_shared_unref(bcast->shared);
+        free(bcast);
+        bcast = next;
+    }
+}
@@ -0,0 +1,145 @@
+/**
+ * @file telnet_buf.c
+ * @brief Telnet服务器分级缓冲池
+ * @date liuliang 2026-01-25
+ *
+ * 本文件包含会话缓冲区的分级缓冲池
+ * 行缓冲区、子协商缓冲区和预输入缓冲区只在使用期间从所属工作线程的缓冲池借用，
+ * 按64、256、1K、4K、16K、64K分级，归还后留在该级的空闲链表中复用；
+ * 每级缓存的字节数有上限，超出部分交还系统；缓冲池只由所属工作线程访问，不加锁；
+ * 登录阶段的输入可能含密码，这类缓冲区换级或归还前先清零
+ */
+
+#define _GNU_SOURCE             // explicit_bzero
+#include "telnet_server.h"
+
+
+// 能容纳size字节的最小级别，超过最大一级返回-1
+static int telnets_buf_class(size_t size)
+{
+    for (int cls = 0; cls < TELNET_BUF_CLASSES; cls++)
+    {
+        if (size <= TELNET_BUF_SIZE(cls))
+        {
+            return cls;
+        }
+    }
+
+    return -1;
+}
+
+// 借用至少size字节的缓冲区，级别写入*cls，内容未初始化
+char *telnets_buf_alloc(telnet_server_t *server, size_t size, uint8_t *cls)
+{
+    telnet_bufpool_t *pool = &server->bufpool;
+    int c = telnets_buf_class(size);
+    char *buf;
+
+    if (c < 0)
+    {
+        return NULL;
+    }
+
+    buf = (char *)pool->free[c];
+    if (buf)
+    {
+        pool->free[c] = *(void **)buf;
+        pool->cached[c]--;
+    }
+    else
+    {
+        buf = (char *)malloc(TELNET_BUF_SIZE(c));
+        if (!buf)
+        {
+            telnets_log_errno("Failed to allocate session buffer");
+            return NULL;
+        }
+    }
+
+    TELNET_METRIC_ADD(server->metrics.buf_bytes, TELNET_BUF_SIZE(c));
+    *cls = (uint8_t)c;
+    return buf;
+}
+
+// 把缓冲区换成能容纳size字节的更大一级，保留前used字节；buf为NULL时直接借用
+// wipe非0时旧缓冲区归还前整块清零；失败时原缓冲区不变，返回NULL
+char *telnets_buf_grow(telnet_server_t *server, char *buf, uint8_t *cls, size_t used, size_t size, int wipe)
+{
+    uint8_t new_cls;
+    char *new_buf;
+
+    if (!buf)
+    {
+        return telnets_buf_alloc(server, size, cls);
+    }
+
+    if (size <= TELNET_BUF_SIZE(*cls))
+    {
+        return buf;
+    }
+
+    new_buf = telnets_buf_alloc(server, size, &new_cls);
+    if (!new_buf)
+    {
+        return NULL;
+    }
+
+    memcpy(new_buf, buf, used);
+    if (wipe)
+    {
+        explicit_bzero(buf, TELNET_BUF_SIZE(*cls));
+    }
+    telnets_buf_free(server, buf, *cls);
+    *cls = new_cls;
+    return new_buf;
+}
+
+// 归还缓冲区，该级缓存已满时交还系统
+void telnets_buf_free(telnet_server_t *server, char *buf, uint8_t cls)
+{
+    telnet_bufpool_t *pool = &server->bufpool;
+
+    if (!buf)
+    {
+        return;
+    }
+
+    TELNET_METRIC_ADD(server->metrics.buf_bytes, -(int64_t)TELNET_BUF_SIZE(cls));
+
+    if ((size_t)pool->cached[cls] * TELNET_BUF_SIZE(cls) >= TELNET_BUF_CACHE_BYTES)
+    {
+        free(buf);
+        return;
+    }
+
+    *(void **)buf = pool->free[cls];
+    pool->free[cls] = buf;
+    pool->cached[cls]++;
+}
+
+// 归还可能含密码的缓冲区，先整块清零；退格删除的字节仍在有效长度之外，不能只清有效部分
+void telnets_buf_wipe(telnet_server_t *server, char *buf, uint8_t cls)
+{
+    if (buf)
+    {
+        explicit_bzero(buf, TELNET_BUF_SIZE(cls));
+    }
+    telnets_buf_free(server, buf, cls);
+}
+
+// 释放缓冲池中缓存的全部空闲缓冲区
+void telnets_buf_pool_destroy(telnet_server_t *server)
+{
+    telnet_bufpool_t *pool = &server->bufpool;
+
+    for (int cls = 0; cls < TELNET_BUF_CLASSES; cls++)
+    {
+        while (pool->free[cls])
+        {
+            void *next = *(void **)pool->free[cls];
+            free(pool->free[cls]);
+            pool->free[cls] = next;
+        }
+        pool->cached[cls] = 0;
+    }
+}
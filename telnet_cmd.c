@@ -0,0 +1,675 @@
+/**
+ * @file telnet_cmd.c
+ * @brief Telnet服务器命令分发
+ * @date liuliang 2026-01-25
+ *
+ * 本文件包含命令注册表、命令行解析和内置命令
+ * 命令在启动工作线程前注册，之后注册表只读，各工作线程无锁查找；
+ * 命令名按不区分大小写的哈希查找，参数是指向行缓冲区的切片，不做拷贝；
+ * 标记为TELNET_CMD_OFFLOAD的命令交给命令线程池执行，输出写入任务自己的队列
+ */
+
+#include "telnet_server.h"
+#include <netdb.h>
+
+
+// 注册表
+static telnet_cmd_t telnet_cmds[TELNET_CMD_MAX];
+static int telnet_cmd_count = 0;
+static short telnet_cmd_hash[TELNET_CMD_HASH_SIZE]; // 命令索引，-1表示空
+static int telnet_cmd_frozen = 0;
+
+
+// 不区分大小写的FNV-1a哈希
+static uint32_t telnets_cmd_hash_name(const char *name, int len)
+{
+    uint32_t h = 2166136261u;
+
+    for (int i = 0; i < len; i++)
+    {
+        h ^= (unsigned char)tolower((unsigned char)name[i]);
+        h *= 16777619u;
+    }
+
+    return h;
+}
+
+// 不区分大小写比较切片和命令名
+static int telnets_cmd_name_equal(const char *name, const char *str, int len)
+{
+    for (int i = 0; i < len; i++)
+    {
+        if (name[i] == '\0' || tolower((unsigned char)str[i]) != name[i])
+        {
+            return 0;
+        }
+    }
+
+    return name[len] == '\0';
+}
+
+// 注册命令，返回命令编号，失败返回-1
+int telnets_cmd_register(const telnet_cmd_t *cmd)
+{
+    int len;
+    uint32_t pos;
+
+    if (telnet_cmd_frozen)
+    {
+        telnets_log_msg(TELNET_LOG_ERROR, "Command '%s' registered after startup", cmd->name);
+        return -1;
+    }
+
+    if (telnet_cmd_count == 0)
+    {
+        memset(telnet_cmd_hash, 0xff, sizeof(telnet_cmd_hash));
+    }
+
+    len = (int)strlen(cmd->name);
+    if (len == 0 || len >= TELNET_CMD_NAME_MAX || telnet_cmd_count >= TELNET_CMD_MAX)
+    {
+        telnets_log_msg(TELNET_LOG_ERROR, "Cannot register command '%s'", cmd->name);
+        return -1;
+    }
+
+    if (telnets_cmd_lookup(cmd->name, len) != NULL)
+    {
+        telnets_log_msg(TELNET_LOG_ERROR, "Command '%s' already registered", cmd->name);
+        return -1;
+    }
+
+    // 线性探测，表大小是命令上限的两倍，不会填满
+    pos = telnets_cmd_hash_name(cmd->name, len) & (TELNET_CMD_HASH_SIZE - 1);
+    while (telnet_cmd_hash[pos] >= 0)
+    {
+        pos = (pos + 1) & (TELNET_CMD_HASH_SIZE - 1);
+    }
+
+    telnet_cmds[telnet_cmd_count] = *cmd;
+    telnet_cmds[telnet_cmd_count].id = telnet_cmd_count;
+    telnet_cmd_hash[pos] = (short)telnet_cmd_count;
+
+    return telnet_cmd_count++;
+}
+
+// 注册一组命令，遇到name为NULL的项结束
+int telnets_cmd_register_table(const telnet_cmd_t *cmds)
+{
+    for (; cmds->name; cmds++)
+    {
+        if (telnets_cmd_register(cmds) < 0)
+        {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+// 启动工作线程前调用，之后不再允许注册
+void telnets_cmd_freeze(void)
+{
+    telnet_cmd_frozen = 1;
+}
+
+// 按名字查找命令
+const telnet_cmd_t *telnets_cmd_lookup(const char *name, int len)
+{
+    uint32_t pos;
+
+    if (telnet_cmd_count == 0 || len <= 0 || len >= TELNET_CMD_NAME_MAX)
+    {
+        return NULL;
+    }
+
+    pos = telnets_cmd_hash_name(name, len) & (TELNET_CMD_HASH_SIZE - 1);
+    while (telnet_cmd_hash[pos] >= 0)
+    {
+        const telnet_cmd_t *cmd = &telnet_cmds[telnet_cmd_hash[pos]];
+        if (telnets_cmd_name_equal(cmd->name, name, len))
+        {
+            return cmd;
+        }
+        pos = (pos + 1) & (TELNET_CMD_HASH_SIZE - 1);
+    }
+
+    return NULL;
+}
+
+// 已注册命令数量
+int telnets_cmd_count(void)
+{
+    return telnet_cmd_count;
+}
+
+// 按编号获取命令
+const telnet_cmd_t *telnets_cmd_get(int id)
+{
+    if (id < 0 || id >= telnet_cmd_count)
+    {
+        return NULL;
+    }
+
+    return &telnet_cmds[id];
+}
+
+// 把命令行切分为命令名和参数切片
+void telnets_cmd_parse(const char *line, int len, telnet_args_t *args)
+{
+    int i = 0;
+
+    memset(args, 0, sizeof(telnet_args_t));
+
+    while (i < len && isspace((unsigned char)line[i]))
+    {
+        i++;
+    }
+
+    args->name.ptr = line + i;
+    while (i < len && !isspace((unsigned char)line[i]))
+    {
+        i++;
+    }
+    args->name.len = (int)(line + i - args->name.ptr);
+
+    while (i < len && isspace((unsigned char)line[i]))
+    {
+        i++;
+    }
+
+    // rest保留命令名之后的原始内容
+    args->rest.ptr = line + i;
+    args->rest.len = len - i;
+
+    while (i < len && args->argc < TELNET_CMD_MAX_ARGS)
+    {
+        telnet_slice_t *arg = &args->argv[args->argc++];
+
+        arg->ptr = line + i;
+        while (i < len && !isspace((unsigned char)line[i]))
+        {
+            i++;
+        }
+        arg->len = (int)(line + i - arg->ptr);
+
+        while (i < len && isspace((unsigned char)line[i]))
+        {
+            i++;
+        }
+    }
+}
+
+// 命令输出
+int telnets_cmd_write(telnet_cmd_ctx_t *ctx, const char *data, size_t len)
+{
+    if (ctx->sink)
+    {
+        return telnets_outq_append(ctx->sink, data, len);
+    }
+
+    return telnets_output(ctx->client, data, len);
+}
+
+int telnets_cmd_puts(telnet_cmd_ctx_t *ctx, const char *str)
+{
+    return telnets_cmd_write(ctx, str, strlen(str));
+}
+
+int telnets_cmd_printf(telnet_cmd_ctx_t *ctx, const char *fmt, ...)
+{
+    char buf[TELNET_BUFFER_SIZE + 256];
+    va_list ap;
+    int len;
+
+    va_start(ap, fmt);
+    len = vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+
+    if (len < 0)
+    {
+        return -1;
+    }
+
+    if (len >= (int)sizeof(buf))
+    {
+        len = sizeof(buf) - 1;
+    }
+
+    return telnets_cmd_write(ctx, buf, len);
+}
+
+
+// 处理客户端命令
+void telnets_command_proc(telnet_server_t *server, telnet_client_t *client, const char *line, int len)
+{
+    telnet_cmd_ctx_t ctx;
+    telnet_args_t args;
+    const telnet_cmd_t *cmd;
+    uint64_t start;
+
+    telnets_cmd_parse(line, len, &args);
+    if (args.name.len == 0)
+    {
+        return;
+    }
+
+    ctx.server = server;
+    ctx.client = client;
+    ctx.sink = NULL;
+    ctx.slot = client->slot;
+
+    cmd = telnets_cmd_lookup(args.name.ptr, args.name.len);
+    if (!cmd)
+    {
+        const telnet_resp_t *hint = telnets_resp_get(TELNET_RESP_UNKNOWN);
+
+        TELNET_METRIC_ADD(server->metrics.unknown_commands, 1);
+        telnets_cmd_puts(&ctx, "\r\nUnknown command: ");
+        telnets_cmd_write(&ctx, args.name.ptr, args.name.len);
+        telnets_cmd_puts(&ctx, "\r\n");
+        telnets_cmd_write(&ctx, hint->data, hint->len);
+        return;
+    }
+
+    TELNET_METRIC_ADD(server->metrics.commands[cmd->id], 1);
+
+    // 慢命令交给线程池，耗时在完成时记录；线程池未启用时在此执行
+    if ((cmd->flags & TELNET_CMD_OFFLOAD) && server->master && server->master->pool)
+    {
+        if (telnets_pool_submit(server, client, cmd, line, len) == 0)
+        {
+            TELNET_METRIC_ADD(server->metrics.offloaded, 1);
+        }
+        else
+        {
+            TELNET_METRIC_ADD(server->metrics.offload_rejects, 1);
+            telnets_cmd_puts(&ctx, "\r\nServer busy, please try again.\r\n");
+        }
+        return;
+    }
+
+    start = telnets_now_ns();
+    cmd->handler(&ctx, &args);
+    telnets_hist_record(&server->metrics.cmd_ns, telnets_now_ns() - start);
+}
+
+
+// 内置命令
+
+// 按注册顺序列出命令，启动时生成一次，之后help直接发送
+int telnets_cmd_help_text(telnet_outq_t *out)
+{
+    telnet_cmd_ctx_t ctx = { NULL, NULL, out, -1 };
+
+    if (telnets_cmd_puts(&ctx, "\r\nAvailable commands:\r\n") < 0)
+    {
+        return -1;
+    }
+
+    for (int i = 0; i < telnet_cmd_count; i++)
+    {
+        const telnet_cmd_t *cmd = &telnet_cmds[i];
+        if (cmd->flags & TELNET_CMD_HIDDEN)
+        {
+            continue;
+        }
+        if (telnets_cmd_printf(&ctx, "  %-8s - %s\r\n", cmd->usage ? cmd->usage : cmd->name, cmd->help) < 0)
+        {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+// help: 发送启动时生成的命令列表
+static void telnets_cmd_help(telnet_cmd_ctx_t *ctx, const telnet_args_t *args)
+{
+    const telnet_resp_t *help = telnets_resp_get(TELNET_RESP_HELP);
+
+    (void)args;
+    telnets_cmd_write(ctx, help->data, help->len);
+}
+
+// time: 显示当前时间，同一秒内复用已格式化的输出
+static void telnets_cmd_time(telnet_cmd_ctx_t *ctx, const telnet_args_t *args)
+{
+    const telnet_timecache_t *tc = telnets_resp_time(ctx->server);
+
+    (void)args;
+    telnets_cmd_write(ctx, tc->time_resp, tc->time_resp_len);
+}
+
+// echo: 原样返回参数
+static void telnets_cmd_echo(telnet_cmd_ctx_t *ctx, const telnet_args_t *args)
+{
+    if (args->rest.len > 0)
+    {
+        telnets_cmd_puts(ctx, "\r\nEcho: ");
+        telnets_cmd_write(ctx, args->rest.ptr, args->rest.len);
+        telnets_cmd_puts(ctx, "\r\n");
+    }
+    else
+    {
+        telnets_cmd_puts(ctx, "\r\nUsage: echo <message>\r\n");
+    }
+}
+
+// clear: 发送ANSI清屏序列
+static void telnets_cmd_clear(telnet_cmd_ctx_t *ctx, const telnet_args_t *args)
+{
+    (void)args;
+    telnets_cmd_puts(ctx, "\033[2J\033[H");
+}
+
+// quit/exit: 断开连接
+static void telnets_cmd_quit(telnet_cmd_ctx_t *ctx, const telnet_args_t *args)
+{
+    (void)args;
+    telnets_cmd_puts(ctx, "\r\nGoodbye!\r\n");
+
+    // 客户端将在本次输入处理结束时被移除
+    ctx->client->closed = 1;
+}
+
+// wall: 向所有客户端广播消息，消息只构造一次
+static void telnets_cmd_wall(telnet_cmd_ctx_t *ctx, const telnet_args_t *args)
+{
+    telnet_client_t *client = ctx->client;
+    const telnet_resp_t *prompt = telnets_resp_get(TELNET_RESP_PROMPT);
+    char *msg;
+    char ip[INET_ADDRSTRLEN];
+    size_t size;
+    int len;
+
+    if (args->rest.len == 0)
+    {
+        telnets_cmd_puts(ctx, "\r\nUsage: wall <message>\r\n");
+        return;
+    }
+
+    // 提示符可能来自响应文件，长度不固定
+    size = TELNET_WALL_MAX + 128 + prompt->len;
+    msg = (char *)malloc(size);
+    if (!msg)
+    {
+        telnets_cmd_puts(ctx, "\r\nBroadcast failed.\r\n");
+        return;
+    }
+
+    inet_ntop(AF_INET, &client->cold->addr.sin_addr, ip, sizeof(ip));
+
+    // 接收方的提示符被消息打断，随消息重新发送
+    len = snprintf(msg, size, "\r\n\007Broadcast message from %s:%d (%s):\r\n%.*s\r\n",
+                   ip, ntohs(client->cold->addr.sin_port), telnets_resp_time(ctx->server)->clock,
+                   args->rest.len < TELNET_WALL_MAX ? args->rest.len : TELNET_WALL_MAX, args->rest.ptr);
+    memcpy(msg + len, prompt->data, prompt->len);
+    len += (int)prompt->len;
+
+    if (telnets_broadcast(ctx->server->master, msg, (size_t)len) < 0)
+    {
+        telnets_cmd_puts(ctx, "\r\nBroadcast failed.\r\n");
+    }
+    free(msg);
+}
+
+// wallmode: 查看或设置本连接输出积压时如何处理广播
+static void telnets_cmd_wallmode(telnet_cmd_ctx_t *ctx, const telnet_args_t *args)
+{
+    char name[16];
+    int policy;
+
+    if (args->argc == 0)
+    {
+        telnets_cmd_printf(ctx, "\r\nBroadcast policy: %s\r\n",
+                           telnets_broadcast_policy_name(ctx->client->bcast_policy));
+        return;
+    }
+
+    policy = -1;
+    if (args->argc == 1 && args->argv[0].len < (int)sizeof(name))
+    {
+        memcpy(name, args->argv[0].ptr, args->argv[0].len);
+        name[args->argv[0].len] = '\0';
+        policy = telnets_broadcast_parse_policy(name);
+    }
+
+    if (policy < 0)
+    {
+        telnets_cmd_puts(ctx, "\r\nUsage: wallmode [drop|truncate|disconnect]\r\n");
+        return;
+    }
+
+    ctx->client->bcast_policy = policy;
+    telnets_cmd_printf(ctx, "\r\nBroadcast policy: %s\r\n", telnets_broadcast_policy_name(policy));
+}
+
+// clients: 列出所有工作线程的客户端，在线程池中执行
+static void telnets_cmd_clients(telnet_cmd_ctx_t *ctx, const telnet_args_t *args)
+{
+    telnet_master_t *master = ctx->server->master;
+    telnet_client_info_t *infos;
+    time_t now = get_current_time();
+    int total = 0;
+    int count = 0;
+
+    (void)args;
+
+    // 按当前在线数分配，之后新连接的客户端不在本次列表中
+    for (int i = 0; i < master->nworkers; i++)
+    {
+        total += __atomic_load_n(&master->workers[i]->client_count, __ATOMIC_RELAXED);
+    }
+
+    infos = (telnet_client_info_t *)malloc((total + 1) * sizeof(telnet_client_info_t));
+    if (!infos)
+    {
+        telnets_cmd_puts(ctx, "\r\nOut of memory.\r\n");
+        return;
+    }
+
+    for (int i = 0; i < master->nworkers && count < total; i++)
+    {
+        count += telnets_table_snapshot(master->workers[i], infos + count, total - count);
+    }
+
+    telnets_cmd_printf(ctx, "\r\nConnected clients: %d\r\n", count);
+    telnets_cmd_puts(ctx, "  Worker  Slot  Address                User             Connected      Idle\r\n");
+    for (int i = 0; i < count; i++)
+    {
+        const telnet_client_info_t *info = &infos[i];
+        char ip[INET_ADDRSTRLEN];
+        char addr[INET_ADDRSTRLEN + 8];
+        int self = info->worker == ctx->server->worker_id && info->slot == ctx->slot;
+
+        inet_ntop(AF_INET, &info->addr.sin_addr, ip, sizeof(ip));
+        snprintf(addr, sizeof(addr), "%s:%d", ip, ntohs(info->addr.sin_port));
+        telnets_cmd_printf(ctx, "%c %6d %5d  %-21s %-16.16s %8lds %8lds\r\n",
+                           self ? '*' : ' ', info->worker, info->slot, addr,
+                           info->username[0] ? info->username : "-",
+                           (long)(now - info->connected_at), (long)(now - info->last_active));
+    }
+
+    free(infos);
+}
+
+// lookup: 解析主机名或反查IP地址，在线程池中执行
+static void telnets_cmd_resolve(telnet_cmd_ctx_t *ctx, const telnet_args_t *args)
+{
+    struct addrinfo hints;
+    struct addrinfo *res;
+    char host[256];
+    int ret;
+
+    if (args->argc != 1 || args->argv[0].len >= (int)sizeof(host))
+    {
+        telnets_cmd_puts(ctx, "\r\nUsage: lookup <host|ip>\r\n");
+        return;
+    }
+
+    memcpy(host, args->argv[0].ptr, args->argv[0].len);
+    host[args->argv[0].len] = '\0';
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    ret = getaddrinfo(host, NULL, &hints, &res);
+    if (ret != 0)
+    {
+        telnets_cmd_printf(ctx, "\r\n%s: %s\r\n", host, gai_strerror(ret));
+        return;
+    }
+
+    telnets_cmd_printf(ctx, "\r\n%s:\r\n", host);
+    for (struct addrinfo *ai = res; ai; ai = ai->ai_next)
+    {
+        char ip[INET6_ADDRSTRLEN];
+        char name[NI_MAXHOST];
+
+        if (getnameinfo(ai->ai_addr, ai->ai_addrlen, ip, sizeof(ip), NULL, 0, NI_NUMERICHOST) != 0)
+        {
+            continue;
+        }
+        if (getnameinfo(ai->ai_addr, ai->ai_addrlen, name, sizeof(name), NULL, 0, NI_NAMEREQD) != 0)
+        {
+            strcpy(name, "-");
+        }
+        telnets_cmd_printf(ctx, "  %-39s %s\r\n", ip, name);
+    }
+
+    freeaddrinfo(res);
+}
+
+// stats: 显示本连接和服务器的统计
+static void telnets_cmd_stats(telnet_cmd_ctx_t *ctx, const telnet_args_t *args)
+{
+    telnet_client_t *client = ctx->client;
+    telnet_master_t *master = ctx->server->master;
+    time_t now = get_current_time();
+    char ip[INET_ADDRSTRLEN];
+    const char *user = telnets_auth_user(ctx->server, client);
+    telnet_metrics_t *m;
+    int clients;
+
+    (void)args;
+
+    inet_ntop(AF_INET, &client->cold->addr.sin_addr, ip, sizeof(ip));
+    telnets_cmd_printf(ctx,
+                       "\r\nClient statistics:\r\n"
+                       "  IP: %s\r\n"
+                       "  Port: %d\r\n"
+                       "  Connected for: %ld seconds\r\n"
+                       "  Idle for: %ld seconds\r\n",
+                       ip,
+                       ntohs(client->cold->addr.sin_port),
+                       (long)(now - client->cold->connected_at),
+                       (long)(now - client->last_active));
+    if (client->cold->win_width && client->cold->win_height)
+    {
+        telnets_cmd_printf(ctx, "  Window: %ux%u\r\n", client->cold->win_width, client->cold->win_height);
+    }
+    if (user)
+    {
+        telnets_cmd_printf(ctx, "  User: %s\r\n", user);
+    }
+
+    m = ctx->server->stats_merged;
+    clients = telnets_metrics_collect(master, m);
+
+    telnets_cmd_printf(ctx,
+                       "\r\nServer statistics (%d worker%s):\r\n"
+                       "  Clients: %d / %d, %d bytes/session + %llu buffer bytes in use\r\n"
+                       "  Accepted: %llu, rejected (full/rate): %llu/%llu, accept pauses: %llu, timed out: %llu\r\n"
+                       "  Bytes in: %llu, bytes out: %llu\r\n"
+                       "  Compressing: %llu sessions, %llu state bytes, %llu -> %llu bytes, refused: %llu\r\n"
+                       "  TLS handshakes: %llu, resumed: %llu, failed: %llu, kTLS: %llu\r\n"
+                       "  Scheduling: deferred %llu, throttled %llu\r\n"
+                       "  Logins: %llu (%llu cached), failed: %llu, busy: %llu, blocked: %llu, verify p50/p99: %llu/%llu us\r\n"
+                       "  Loop iterations: %llu, syscalls/iteration: %.2f\r\n"
+                       "  Loop time p50/p99/p99.9: %llu/%llu/%llu us\r\n"
+                       "  Command time p50/p99/p99.9: %llu/%llu/%llu us\r\n"
+                       "  Offloaded commands: %llu, rejected (pool busy): %llu\r\n"
+                       "  Broadcasts: %llu, dropped/truncated/disconnected: %llu/%llu/%llu\r\n"
+                       "  Log records dropped: %llu\r\n",
+                       master->nworkers, master->nworkers > 1 ? "s" : "",
+                       clients, master->config.max_clients,
+                       (int)(sizeof(telnet_client_t) + sizeof(telnet_client_cold_t)),
+                       (unsigned long long)m->buf_bytes,
+                       (unsigned long long)m->accepts,
+                       (unsigned long long)m->rejects_full,
+                       (unsigned long long)m->rejects_rate,
+                       (unsigned long long)m->accept_pauses,
+                       (unsigned long long)m->timeouts,
+                       (unsigned long long)m->bytes_in,
+                       (unsigned long long)m->bytes_out,
+                       (unsigned long long)m->compress_sessions,
+                       (unsigned long long)m->compress_bytes,
+                       (unsigned long long)m->compress_in,
+                       (unsigned long long)m->compress_out,
+                       (unsigned long long)m->compress_refused,
+                       (unsigned long long)m->tls_handshakes,
+                       (unsigned long long)m->tls_resumed,
+                       (unsigned long long)m->tls_failures,
+                       (unsigned long long)m->tls_ktls,
+                       (unsigned long long)m->sched_deferred,
+                       (unsigned long long)m->sched_throttled,
+                       (unsigned long long)m->auth_logins,
+                       (unsigned long long)m->auth_cached,
+                       (unsigned long long)m->auth_failures,
+                       (unsigned long long)m->auth_busy,
+                       (unsigned long long)m->auth_blocked,
+                       (unsigned long long)telnets_hist_percentile(&m->auth_ns, 50) / 1000,
+                       (unsigned long long)telnets_hist_percentile(&m->auth_ns, 99) / 1000,
+                       (unsigned long long)m->loops,
+                       m->loops ? (double)m->syscalls / (double)m->loops : 0.0,
+                       (unsigned long long)telnets_hist_percentile(&m->loop_ns, 50) / 1000,
+                       (unsigned long long)telnets_hist_percentile(&m->loop_ns, 99) / 1000,
+                       (unsigned long long)telnets_hist_percentile(&m->loop_ns, 99.9) / 1000,
+                       (unsigned long long)telnets_hist_percentile(&m->cmd_ns, 50) / 1000,
+                       (unsigned long long)telnets_hist_percentile(&m->cmd_ns, 99) / 1000,
+                       (unsigned long long)telnets_hist_percentile(&m->cmd_ns, 99.9) / 1000,
+                       (unsigned long long)m->offloaded,
+                       (unsigned long long)m->offload_rejects,
+                       (unsigned long long)m->broadcasts,
+                       (unsigned long long)m->bcast_dropped,
+                       (unsigned long long)m->bcast_truncated,
+                       (unsigned long long)m->bcast_disconnects,
+                       (unsigned long long)telnets_log_dropped());
+
+    telnets_cmd_puts(ctx, "  Commands:");
+    for (int i = 0; i < telnet_cmd_count; i++)
+    {
+        if (m->commands[i])
+        {
+            telnets_cmd_printf(ctx, " %s=%llu", telnet_cmds[i].name, (unsigned long long)m->commands[i]);
+        }
+    }
+    if (m->unknown_commands)
+    {
+        telnets_cmd_printf(ctx, " (unknown)=%llu", (unsigned long long)m->unknown_commands);
+    }
+    telnets_cmd_puts(ctx, "\r\n");
+}
+
+static const telnet_cmd_t telnet_builtin_cmds[] = {
+    { "help",    NULL,         "Show this help message",   telnets_cmd_help,    0, 0 },
+    { "time",    NULL,         "Show current time",        telnets_cmd_time,    0, 0 },
+    { "echo",    "echo <msg>", "Echo back the message",    telnets_cmd_echo,    0, 0 },
+    { "clear",   NULL,         "Clear the screen",         telnets_cmd_clear,   0, 0 },
+    { "quit",    NULL,         "Disconnect",               telnets_cmd_quit,    0, 0 },
+    { "exit",    NULL,         "Disconnect",               telnets_cmd_quit,    TELNET_CMD_HIDDEN, 0 },
+    { "clients", NULL,         "Show connected clients",   telnets_cmd_clients, TELNET_CMD_OFFLOAD, 0 },
+    { "lookup",  "lookup <host>", "Resolve a host name or address", telnets_cmd_resolve, TELNET_CMD_OFFLOAD, 0 },
+    { "stats",   NULL,         "Show server statistics",   telnets_cmd_stats,   0, 0 },
+    { "wall",    "wall <msg>", "Send a message to everyone", telnets_cmd_wall,  0, 0 },
+    { "wallmode", "wallmode [drop|truncate|disconnect]", "Set how broadcasts are handled when output is backlogged",
+      telnets_cmd_wallmode, 0, 0 },
+    { NULL,      NULL,         NULL,                       NULL,                0, 0 },
+};
+
+// 注册内置命令
+int telnets_cmd_init(void)
+{
+    return telnets_cmd_register_table(telnet_builtin_cmds);
+}
@@ -0,0 +1,193 @@
+/**
+ * @file telnet_event.c
+ * @brief Telnet服务器事件处理
+ * @date liuliang 2026-01-25
+ *
+ * 本文件包含基于epoll的事件注册与注销
+ * 每个socket只在连接建立时注册一次，断开时注销；
+ * 使用io_uring后端时转交telnet_uring.c处理
+ */
+
+#include "telnet_server.h"
+
+
+// 创建事件后端及唤醒用的eventfd，请求io_uring但内核不支持时回退到epoll
+int telnets_event_init(telnet_server_t *server)
+{
+    struct epoll_event ev;
+
+    server->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (server->wake_fd < 0)
+    {
+        telnets_log_errno("eventfd failed");
+        return -1;
+    }
+
+    // io_uring后端自己提交收发请求，无法经过TLS传输层
+    if (server->config->io_backend == TELNET_IO_URING && server->config->tls_port > 0)
+    {
+        telnets_log_msg(TELNET_LOG_WARN, "io_uring does not support the TLS listener, using epoll");
+    }
+    else if (server->config->io_backend == TELNET_IO_URING)
+    {
+        if (telnets_uring_init(server) == 0)
+        {
+            server->io_backend = TELNET_IO_URING;
+            return 0;
+        }
+        telnets_log_msg(TELNET_LOG_WARN, "io_uring unavailable, falling back to epoll");
+    }
+    server->io_backend = TELNET_IO_EPOLL;
+
+    server->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (server->epoll_fd < 0)
+    {
+        telnets_log_errno("epoll_create1 failed");
+        telnets_event_close(server);
+        return -1;
+    }
+
+    // 唤醒事件使用水平触发，由事件循环读空计数
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.u64 = TELNET_WAKE_TOKEN;
+    if (epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, server->wake_fd, &ev) < 0)
+    {
+        telnets_log_errno("epoll_ctl ADD wake_fd failed");
+        telnets_event_close(server);
+        return -1;
+    }
+
+    return 0;
+}
+
+// 从其他线程唤醒事件循环
+void telnets_event_wake(telnet_server_t *server)
+{
+    uint64_t one = 1;
+
+    if (server->wake_fd >= 0)
+    {
+        if (write(server->wake_fd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+        {
+            telnets_log_errno("eventfd write failed");
+        }
+    }
+}
+
+// 注册socket读事件
+int telnets_event_add(telnet_server_t *server, int sockfd, uint64_t token)
+{
+    struct epoll_event ev;
+
+    if (server->io_backend == TELNET_IO_URING)
+    {
+        return telnets_uring_add(server, sockfd, token);
+    }
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN | EPOLLRDHUP;
+    if (server->edge_triggered)
+    {
+        ev.events |= EPOLLET;
+    }
+    ev.data.u64 = token;
+
+    TELNET_METRIC_ADD(server->metrics.syscalls, 1);
+    if (epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, sockfd, &ev) < 0)
+    {
+        telnets_log_errno("epoll_ctl ADD failed");
+        return -1;
+    }
+
+    return 0;
+}
+
+// 修改客户端关注的事件，events不含EPOLLET，由模式决定
+int telnets_event_mod(telnet_server_t *server, telnet_client_t *client, uint32_t events)
+{
+    struct epoll_event ev;
+
+    if (client->events == events)
+    {
+        return 0;
+    }
+
+    if (TELNET_TRANSPORT(client)->watch)
+    {
+        return TELNET_TRANSPORT(client)->watch(server, client, events);
+    }
+
+    if (server->io_backend == TELNET_IO_URING)
+    {
+        return telnets_uring_mod(server, client, events);
+    }
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = events;
+    if (server->edge_triggered)
+    {
+        ev.events |= EPOLLET;
+    }
+    ev.data.u64 = TELNET_TOKEN(client->slot, client->generation);
+
+    TELNET_METRIC_ADD(server->metrics.syscalls, 1);
+    if (epoll_ctl(server->epoll_fd, EPOLL_CTL_MOD, client->sockfd, &ev) < 0)
+    {
+        telnets_log_errno("epoll_ctl MOD failed");
+        return -1;
+    }
+
+    client->events = events;
+    return 0;
+}
+
+// 注销socket事件
+void telnets_event_del(telnet_server_t *server, int sockfd)
+{
+    if (server->io_backend == TELNET_IO_URING)
+    {
+        if (sockfd == server->listen_sockfd)
+        {
+            telnets_uring_del_accept(server);
+            return;
+        }
+
+        telnet_client_t *client = telnets_get_client(server, telnets_find_client_index(server, sockfd));
+        if (client)
+        {
+            telnets_uring_del(server, client);
+        }
+        return;
+    }
+
+    if (server->epoll_fd < 0)
+    {
+        return;
+    }
+
+    // 关闭前显式注销，避免fd被dup时残留事件
+    TELNET_METRIC_ADD(server->metrics.syscalls, 1);
+    if (epoll_ctl(server->epoll_fd, EPOLL_CTL_DEL, sockfd, NULL) < 0 && errno != ENOENT)
+    {
+        telnets_log_errno("epoll_ctl DEL failed");
+    }
+}
+
+// 关闭事件后端
+void telnets_event_close(telnet_server_t *server)
+{
+    telnets_uring_destroy(server);
+
+    if (server->wake_fd >= 0)
+    {
+        close(server->wake_fd);
+        server->wake_fd = -1;
+    }
+
+    if (server->epoll_fd >= 0)
+    {
+        close(server->epoll_fd);
+        server->epoll_fd = -1;
+    }
+}
@@ -0,0 +1,147 @@
+/**
+ * @file telnet_limit.c
+ * @brief Telnet服务器连接速率限制
+ * @date liuliang 2026-01-25
+ *
+ * 本文件包含按来源IP的令牌桶限速，用于新连接和登录失败次数
+ * 每张表是固定大小的开放寻址表，本身不加锁：新连接限速表每个工作线程一张，
+ * 登录失败限速表所有工作线程共享，由调用方加锁；
+ * 令牌桶已经补满的表项与不存在等价，可以直接复用，无需定期清理；
+ * 探测范围内没有可复用表项时淘汰最久未使用的一项
+ */
+
+#include "telnet_server.h"
+
+// 单个来源IP的令牌桶
+typedef struct {
+    uint32_t addr;                  // 来源地址（网络字节序），0表示空闲
+    uint32_t tokens;                // 剩余令牌（千分之一个）
+    uint64_t stamp_ms;              // 上次补充令牌的时间
+} telnet_bucket_t;
+
+typedef struct telnet_ratelimit {
+    telnet_bucket_t buckets[TELNET_RATELIMIT_SIZE];
+    uint32_t rate;                  // 每个周期补充的令牌数
+    uint32_t period_ms;             // 补充周期（毫秒）
+    uint32_t burst;                 // 令牌桶容量（千分之一个）
+    uint64_t full_ms;               // 从空桶补满所需时间
+} telnet_ratelimit_t;
+
+
+// 创建限速表：每period_ms毫秒补充rate个令牌，最多burst个
+telnet_ratelimit_t *telnets_ratelimit_create(uint32_t rate, uint32_t period_ms, uint32_t burst)
+{
+    telnet_ratelimit_t *rl = (telnet_ratelimit_t *)calloc(1, sizeof(telnet_ratelimit_t));
+    if (!rl)
+    {
+        telnets_log_errno("Failed to allocate rate limit table");
+        return NULL;
+    }
+
+    rl->rate = rate;
+    rl->period_ms = period_ms;
+    rl->burst = burst * 1000;
+    rl->full_ms = ((uint64_t)burst * period_ms + rate - 1) / rate;
+    return rl;
+}
+
+// 创建新连接限速表，未配置速率时不创建
+int telnets_ratelimit_init(telnet_server_t *server)
+{
+    if (server->config->accept_rate <= 0)
+    {
+        return 0;
+    }
+
+    server->ratelimit = telnets_ratelimit_create((uint32_t)server->config->accept_rate, 1000,
+                                                 (uint32_t)server->config->accept_burst);
+    return server->ratelimit ? 0 : -1;
+}
+
+void telnets_ratelimit_free(telnet_server_t *server)
+{
+    free(server->ratelimit);
+    server->ratelimit = NULL;
+}
+
+// 查找来源IP的令牌桶，不存在时取一个可复用的表项
+static telnet_bucket_t *telnets_ratelimit_bucket(telnet_ratelimit_t *rl, uint32_t addr, uint64_t now_ms)
+{
+    uint32_t hash = (addr * 2654435761u) >> (32 - TELNET_RATELIMIT_BITS);
+    telnet_bucket_t *reuse = NULL;
+    telnet_bucket_t *oldest = NULL;
+
+    for (int i = 0; i < TELNET_RATELIMIT_PROBE; i++)
+    {
+        telnet_bucket_t *b = &rl->buckets[(hash + i) & (TELNET_RATELIMIT_SIZE - 1)];
+
+        if (b->addr == addr)
+        {
+            return b;
+        }
+        if (!reuse && (b->addr == 0 || now_ms - b->stamp_ms >= rl->full_ms))
+        {
+            reuse = b;
+        }
+        if (!oldest || b->stamp_ms < oldest->stamp_ms)
+        {
+            oldest = b;
+        }
+    }
+
+    if (!reuse)
+    {
+        reuse = oldest;
+    }
+
+    reuse->addr = addr;
+    reuse->tokens = rl->burst;
+    reuse->stamp_ms = now_ms;
+    return reuse;
+}
+
+// 按经过的时间补充来源IP的令牌
+static telnet_bucket_t *telnets_ratelimit_refill(telnet_ratelimit_t *rl, uint32_t addr, uint64_t now_ms)
+{
+    telnet_bucket_t *b = telnets_ratelimit_bucket(rl, addr, now_ms);
+
+    // 经过的毫秒数乘以每毫秒的令牌数即为千分之一令牌数
+    uint64_t refill = (now_ms - b->stamp_ms) * rl->rate * 1000 / rl->period_ms;
+    b->tokens = refill >= rl->burst - b->tokens ? rl->burst : b->tokens + (uint32_t)refill;
+    b->stamp_ms = now_ms;
+    return b;
+}
+
+// 来源IP是否还有令牌，有则消耗一个并返回1
+int telnets_ratelimit_take(telnet_ratelimit_t *rl, uint32_t addr, uint64_t now_ms)
+{
+    telnet_bucket_t *b = telnets_ratelimit_refill(rl, addr, now_ms);
+
+    if (b->tokens < 1000)
+    {
+        return 0;
+    }
+
+    b->tokens -= 1000;
+    return 1;
+}
+
+// 退还一个令牌，预先扣除的操作最终不计数时调用
+void telnets_ratelimit_refund(telnet_ratelimit_t *rl, uint32_t addr, uint64_t now_ms)
+{
+    telnet_bucket_t *b = telnets_ratelimit_refill(rl, addr, now_ms);
+
+    b->tokens = rl->burst - b->tokens > 1000 ? b->tokens + 1000 : rl->burst;
+}
+
+// 新连接的来源IP是否还有令牌，有则消耗一个并返回1
+int telnets_ratelimit_allow(telnet_server_t *server, const struct sockaddr_in *addr)
+{
+    // 未配置限速，或地址未知（io_uring下getpeername失败）时不限制
+    if (!server->ratelimit || addr->sin_addr.s_addr == 0)
+    {
+        return 1;
+    }
+
+    return telnets_ratelimit_take(server->ratelimit, addr->sin_addr.s_addr, server->now_ms);
+}
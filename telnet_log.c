@@ -0,0 +1,674 @@
+/**
+ * @file telnet_log.c
+ * @brief Telnet服务器异步日志
+ * @date liuliang 2026-01-25
+ *
+ * 本文件包含无锁的异步日志实现
+ * 每个线程第一次写日志时分配自己的单生产者单消费者环，之后只写入定长的二进制记录，
+ * 不做格式化、不做系统调用，环满时丢弃并计数，不会阻塞事件循环；
+ * 后台线程定期取出所有环中的记录，格式化后批量写到stderr、文件或syslog；
+ * 后台线程空闲时阻塞在eventfd上，只有它标记了等待时生产者才写eventfd唤醒，有记录期间生产者不做系统调用；
+ * 同一线程同一种事件每秒超过TELNET_LOG_RATE_BURST条时只计数，窗口结束后由后台线程输出汇总，
+ * 线程在新窗口再次写同种事件时若汇总尚未输出则自己写入；停止时输出剩余的计数
+ */
+
+#include "telnet_server.h"
+#include <strings.h>
+#include <syslog.h>
+#include <poll.h>
+
+// 单线程的日志环
+typedef struct {
+    telnet_log_rec_t recs[TELNET_LOG_RING_SIZE];
+    uint64_t head;                  // 消费者位置，只由后台线程写
+    uint64_t tail;                  // 生产者位置，只由所属线程写
+    uint64_t dropped;               // 环满丢弃的记录数
+    uint64_t rl_window[TELNET_EV_COUNT];    // 限流窗口（秒），后台线程据此判断窗口是否结束
+    uint32_t rl_count[TELNET_EV_COUNT];     // 窗口内已记录条数
+    uint32_t rl_suppressed[TELNET_EV_COUNT]; // 被限流尚未汇总的条数，由所属线程或后台线程原子取走
+    int worker;                     // 所属工作线程编号，-1表示其他线程
+} telnet_log_ring_t;
+
+static telnet_log_ring_t *telnet_log_rings[TELNET_LOG_MAX_RINGS];
+static int telnet_log_ring_count = 0;
+static pthread_mutex_t telnet_log_register_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static __thread telnet_log_ring_t *telnet_log_tls = NULL;
+static __thread int telnet_log_worker = -1;
+
+static int telnet_log_level = TELNET_LOG_INFO;
+static int telnet_log_fd = STDERR_FILENO;
+static int telnet_log_syslog = 0;
+static volatile int telnet_log_running = 0;
+static pthread_t telnet_log_thread;
+static int telnet_log_wake_fd = -1;         // 唤醒空闲的后台线程
+static int telnet_log_sleeping = 0;         // 后台线程准备阻塞等待，生产者写入后需要唤醒
+static uint64_t telnet_log_overflow = 0;    // 线程数超过上限无法分配环时丢弃的记录数
+
+static const char *telnet_log_level_names[] = { "DEBUG", "INFO", "WARN", "ERROR" };
+static const char *telnet_log_event_names[TELNET_EV_COUNT] = {
+    [TELNET_EV_MESSAGE]    = "message",
+    [TELNET_EV_CONNECT]    = "connect",
+    [TELNET_EV_DISCONNECT] = "disconnect",
+    [TELNET_EV_TIMEOUT]    = "timeout",
+    [TELNET_EV_REJECT]     = "reject",
+    [TELNET_EV_ERROR]      = "error",
+    [TELNET_EV_LOGIN]      = "login",
+    [TELNET_EV_LOGIN_FAILED] = "login_failed",
+    [TELNET_EV_SUPPRESSED] = "suppressed",
+};
+
+
+// 级别名转换为级别，无效时返回-1
+int telnets_log_parse_level(const char *name)
+{
+    for (int i = 0; i < (int)(sizeof(telnet_log_level_names) / sizeof(telnet_log_level_names[0])); i++)
+    {
+        if (strcasecmp(name, telnet_log_level_names[i]) == 0)
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+// 当前线程所属的工作线程编号，记录在之后的每条日志中
+void telnets_log_set_worker(int worker_id)
+{
+    telnet_log_worker = worker_id;
+    if (telnet_log_tls)
+    {
+        telnet_log_tls->worker = worker_id;
+    }
+}
+
+int telnets_log_enabled(int level)
+{
+    return level >= telnet_log_level;
+}
+
+// 取当前线程的日志环，第一次调用时分配并登记
+static telnet_log_ring_t *telnets_log_ring(void)
+{
+    telnet_log_ring_t *ring = telnet_log_tls;
+
+    if (ring)
+    {
+        return ring;
+    }
+
+    ring = (telnet_log_ring_t *)calloc(1, sizeof(telnet_log_ring_t));
+    if (!ring)
+    {
+        return NULL;
+    }
+    ring->worker = telnet_log_worker;
+
+    pthread_mutex_lock(&telnet_log_register_lock);
+    if (telnet_log_ring_count >= TELNET_LOG_MAX_RINGS)
+    {
+        pthread_mutex_unlock(&telnet_log_register_lock);
+        free(ring);
+        return NULL;
+    }
+    telnet_log_rings[telnet_log_ring_count] = ring;
+    __atomic_store_n(&telnet_log_ring_count, telnet_log_ring_count + 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&telnet_log_register_lock);
+
+    telnet_log_tls = ring;
+    return ring;
+}
+
+// 后台线程在等待时唤醒它，只有第一个发现的线程写eventfd
+static void telnets_log_wake(void)
+{
+    uint64_t one = 1;
+    ssize_t n;
+
+    // 与后台线程的"先标记等待再检查环"配对：记录已写入后再读标记
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (!__atomic_load_n(&telnet_log_sleeping, __ATOMIC_RELAXED) ||
+        !__atomic_exchange_n(&telnet_log_sleeping, 0, __ATOMIC_ACQ_REL))
+    {
+        return;
+    }
+
+    n = write(telnet_log_wake_fd, &one, sizeof(one));
+    (void)n;
+}
+
+// 写入一条记录，环满时丢弃
+static void telnets_log_push(telnet_log_ring_t *ring, const telnet_log_rec_t *rec)
+{
+    uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+
+    if (ring->tail - head >= TELNET_LOG_RING_SIZE)
+    {
+        TELNET_METRIC_ADD(ring->dropped, 1);
+        return;
+    }
+
+    ring->recs[ring->tail & (TELNET_LOG_RING_SIZE - 1)] = *rec;
+    __atomic_store_n(&ring->tail, ring->tail + 1, __ATOMIC_RELEASE);
+    telnets_log_wake();
+}
+
+// 限流：每种事件每秒最多TELNET_LOG_RATE_BURST条，返回0表示丢弃
+static int telnets_log_admit(telnet_log_ring_t *ring, const telnet_log_rec_t *rec)
+{
+    uint64_t window = rec->ts_ns / 1000000000ull;
+    int event = rec->event;
+
+    if (ring->rl_window[event] != window)
+    {
+        // 新窗口，后台线程尚未取走上一窗口的计数时先输出汇总
+        uint32_t suppressed = __atomic_exchange_n(&ring->rl_suppressed[event], 0, __ATOMIC_RELAXED);
+
+        if (suppressed > 0)
+        {
+            telnet_log_rec_t summary;
+
+            memset(&summary, 0, sizeof(summary));
+            summary.ts_ns = rec->ts_ns;
+            summary.level = TELNET_LOG_WARN;
+            summary.event = TELNET_EV_SUPPRESSED;
+            summary.worker = (int16_t)ring->worker;
+            summary.slot = event;
+            summary.arg = suppressed;
+            telnets_log_push(ring, &summary);
+        }
+
+        __atomic_store_n(&ring->rl_window[event], window, __ATOMIC_RELAXED);
+        ring->rl_count[event] = 0;
+    }
+
+    if (ring->rl_count[event] >= TELNET_LOG_RATE_BURST)
+    {
+        // 窗口内第一条被限流的记录唤醒后台线程，让它在窗口结束时输出汇总
+        if (__atomic_fetch_add(&ring->rl_suppressed[event], 1, __ATOMIC_RELAXED) == 0)
+        {
+            telnets_log_wake();
+        }
+        return 0;
+    }
+
+    ring->rl_count[event]++;
+    return 1;
+}
+
+// 格式化一条记录，返回长度
+static int telnets_log_format(const telnet_log_rec_t *rec, char *buf, size_t size, int with_time)
+{
+    char ip[INET_ADDRSTRLEN] = "-";
+    char errbuf[128];
+    int n = 0;
+
+    if (with_time)
+    {
+        time_t sec = (time_t)(rec->ts_ns / 1000000000ull);
+        struct tm tm_info;
+
+        localtime_r(&sec, &tm_info);
+        n += (int)strftime(buf, size, "%Y-%m-%d %H:%M:%S", &tm_info);
+        n += snprintf(buf + n, size - n, ".%03d ", (int)(rec->ts_ns / 1000000ull % 1000));
+    }
+
+    n += snprintf(buf + n, size - n, "%-5s ", telnet_log_level_names[rec->level]);
+    if (rec->worker >= 0)
+    {
+        n += snprintf(buf + n, size - n, "[w%d] ", rec->worker);
+    }
+    else
+    {
+        n += snprintf(buf + n, size - n, "[main] ");
+    }
+
+    if (rec->addr || rec->port)
+    {
+        struct in_addr in;
+        in.s_addr = rec->addr;
+        inet_ntop(AF_INET, &in, ip, sizeof(ip));
+    }
+
+    switch (rec->event)
+    {
+        case TELNET_EV_CONNECT:
+            n += snprintf(buf + n, size - n, "client connected %s:%u (slot %d)", ip, rec->port, rec->slot);
+            break;
+        case TELNET_EV_DISCONNECT:
+            n += snprintf(buf + n, size - n, "client disconnected %s:%u (slot %d)", ip, rec->port, rec->slot);
+            break;
+        case TELNET_EV_TIMEOUT:
+            n += snprintf(buf + n, size - n, "client timed out %s:%u (slot %d)", ip, rec->port, rec->slot);
+            break;
+        case TELNET_EV_REJECT:
+            n += snprintf(buf + n, size - n, "rejected %s:%u", ip, rec->port);
+            break;
+        case TELNET_EV_LOGIN:
+            n += snprintf(buf + n, size - n, "client logged in %s:%u (slot %d)", ip, rec->port, rec->slot);
+            break;
+        case TELNET_EV_LOGIN_FAILED:
+            n += snprintf(buf + n, size - n, "login failed %s:%u (slot %d)", ip, rec->port, rec->slot);
+            break;
+        case TELNET_EV_ERROR:
+            if (strerror_r((int)rec->arg, errbuf, sizeof(errbuf)) != 0)
+            {
+                snprintf(errbuf, sizeof(errbuf), "error %d", (int)rec->arg);
+            }
+            n += snprintf(buf + n, size - n, "%s: %s", rec->text, errbuf);
+            break;
+        case TELNET_EV_SUPPRESSED:
+            n += snprintf(buf + n, size - n, "suppressed %lld repeated '%s' records",
+                          (long long)rec->arg,
+                          rec->slot >= 0 && rec->slot < TELNET_EV_COUNT ? telnet_log_event_names[rec->slot] : "?");
+            break;
+        default:
+            n += snprintf(buf + n, size - n, "%s", rec->text);
+            break;
+    }
+
+    // 消息附带的原因
+    if (rec->event != TELNET_EV_MESSAGE && rec->event != TELNET_EV_ERROR && rec->text[0])
+    {
+        n += snprintf(buf + n, size - n, ": %s", rec->text);
+    }
+
+    if (n >= (int)size - 1)
+    {
+        n = (int)size - 2;
+    }
+    buf[n++] = '\n';
+    buf[n] = '\0';
+    return n;
+}
+
+static void telnets_log_write_all(const char *data, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t n = write(telnet_log_fd, data, len);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return;
+        }
+        data += n;
+        len -= (size_t)n;
+    }
+}
+
+static const int telnet_log_syslog_prio[] = { LOG_DEBUG, LOG_INFO, LOG_WARNING, LOG_ERR };
+
+// 输出一条记录，后台线程未运行时由调用线程直接输出
+static void telnets_log_emit(const telnet_log_rec_t *rec, char *batch, size_t *batch_len, size_t batch_size)
+{
+    char line[TELNET_LOG_TEXT_MAX + 256];
+    int len;
+
+    if (telnet_log_syslog)
+    {
+        len = telnets_log_format(rec, line, sizeof(line), 0);
+        line[len - 1] = '\0';
+        syslog(telnet_log_syslog_prio[rec->level], "%s", line);
+        return;
+    }
+
+    len = telnets_log_format(rec, line, sizeof(line), 1);
+    if (!batch)
+    {
+        telnets_log_write_all(line, len);
+        return;
+    }
+
+    if (*batch_len + len > batch_size)
+    {
+        telnets_log_write_all(batch, *batch_len);
+        *batch_len = 0;
+    }
+    memcpy(batch + *batch_len, line, len);
+    *batch_len += len;
+}
+
+// 记录一条日志
+void telnets_log_write(int level, int event, const struct sockaddr_in *addr, int slot, int64_t arg, const char *text)
+{
+    telnet_log_ring_t *ring;
+    telnet_log_rec_t rec;
+    struct timespec ts;
+
+    if (level < telnet_log_level)
+    {
+        return;
+    }
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+
+    rec.ts_ns = (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+    rec.level = (uint8_t)level;
+    rec.event = (uint8_t)event;
+    rec.worker = (int16_t)telnet_log_worker;
+    rec.slot = slot;
+    rec.addr = addr ? addr->sin_addr.s_addr : 0;
+    rec.port = addr ? ntohs(addr->sin_port) : 0;
+    rec.arg = arg;
+    rec.text[0] = '\0';
+    if (text)
+    {
+        size_t len = strlen(text);
+        if (len >= TELNET_LOG_TEXT_MAX)
+        {
+            len = TELNET_LOG_TEXT_MAX - 1;
+        }
+        memcpy(rec.text, text, len);
+        rec.text[len] = '\0';
+    }
+
+    if (!__atomic_load_n(&telnet_log_running, __ATOMIC_ACQUIRE))
+    {
+        // 启动前和停止后同步输出
+        telnets_log_emit(&rec, NULL, NULL, 0);
+        return;
+    }
+
+    ring = telnets_log_ring();
+    if (!ring)
+    {
+        __atomic_fetch_add(&telnet_log_overflow, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    if (telnets_log_admit(ring, &rec))
+    {
+        telnets_log_push(ring, &rec);
+    }
+}
+
+// 记录文本消息，格式化在调用线程完成，不要在每个连接都会经过的路径上使用
+void telnets_log_msg(int level, const char *fmt, ...)
+{
+    char text[TELNET_LOG_TEXT_MAX];
+    va_list ap;
+
+    if (level < telnet_log_level)
+    {
+        return;
+    }
+
+    va_start(ap, fmt);
+    vsnprintf(text, sizeof(text), fmt, ap);
+    va_end(ap);
+
+    telnets_log_write(level, TELNET_EV_MESSAGE, NULL, -1, 0, text);
+}
+
+// 记录系统调用错误，错误描述由后台线程生成
+void telnets_log_error(const char *what, int err)
+{
+    telnets_log_write(TELNET_LOG_ERROR, TELNET_EV_ERROR, NULL, -1, err, what);
+}
+
+// 替代perror
+void telnets_log_errno(const char *what)
+{
+    telnets_log_error(what, errno);
+}
+
+// 所有线程丢弃的记录数
+uint64_t telnets_log_dropped(void)
+{
+    int count = __atomic_load_n(&telnet_log_ring_count, __ATOMIC_ACQUIRE);
+    uint64_t dropped = __atomic_load_n(&telnet_log_overflow, __ATOMIC_RELAXED);
+
+    for (int i = 0; i < count; i++)
+    {
+        dropped += TELNET_METRIC_READ(telnet_log_rings[i]->dropped);
+    }
+
+    return dropped;
+}
+
+// 输出环中已结束窗口的限流汇总，final非0时不论窗口是否结束全部输出
+static int telnets_log_summarize(telnet_log_ring_t *ring, uint64_t now_ns, int final,
+                                 char *batch, size_t *batch_len, size_t batch_size)
+{
+    uint64_t window = now_ns / 1000000000ull;
+    int total = 0;
+
+    for (int event = 0; event < TELNET_EV_COUNT; event++)
+    {
+        telnet_log_rec_t summary;
+        uint32_t suppressed;
+
+        if (__atomic_load_n(&ring->rl_suppressed[event], __ATOMIC_RELAXED) == 0)
+        {
+            continue;
+        }
+        if (!final && __atomic_load_n(&ring->rl_window[event], __ATOMIC_RELAXED) >= window)
+        {
+            continue;
+        }
+
+        // 所属线程可能同时在新窗口取走计数，以交换结果为准
+        suppressed = __atomic_exchange_n(&ring->rl_suppressed[event], 0, __ATOMIC_RELAXED);
+        if (suppressed == 0)
+        {
+            continue;
+        }
+
+        memset(&summary, 0, sizeof(summary));
+        summary.ts_ns = now_ns;
+        summary.level = TELNET_LOG_WARN;
+        summary.event = TELNET_EV_SUPPRESSED;
+        summary.worker = (int16_t)ring->worker;
+        summary.slot = event;
+        summary.arg = suppressed;
+        telnets_log_emit(&summary, batch, batch_len, batch_size);
+        total++;
+    }
+
+    return total;
+}
+
+// 取出所有环中的记录并输出，返回处理的记录数；final非0时输出全部剩余的限流计数
+static int telnets_log_drain(int final)
+{
+    static char batch[TELNET_LOG_BATCH_SIZE];
+    size_t batch_len = 0;
+    int count = __atomic_load_n(&telnet_log_ring_count, __ATOMIC_ACQUIRE);
+    int total = 0;
+    struct timespec ts;
+    uint64_t now_ns;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    now_ns = (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+
+    for (int i = 0; i < count; i++)
+    {
+        telnet_log_ring_t *ring = telnet_log_rings[i];
+        uint64_t head = ring->head;
+        uint64_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+
+        for (; head != tail; head++)
+        {
+            telnets_log_emit(&ring->recs[head & (TELNET_LOG_RING_SIZE - 1)], batch, &batch_len, sizeof(batch));
+            total++;
+        }
+
+        __atomic_store_n(&ring->head, head, __ATOMIC_RELEASE);
+
+        total += telnets_log_summarize(ring, now_ns, final, batch, &batch_len, sizeof(batch));
+    }
+
+    if (batch_len > 0)
+    {
+        telnets_log_write_all(batch, batch_len);
+    }
+
+    return total;
+}
+
+// 空闲时的等待时间：有尚未汇总的限流计数时等到下一秒窗口结束，否则一直等到被唤醒
+static int telnets_log_idle_timeout(void)
+{
+    int count = __atomic_load_n(&telnet_log_ring_count, __ATOMIC_ACQUIRE);
+    struct timespec ts;
+
+    for (int i = 0; i < count; i++)
+    {
+        for (int event = 0; event < TELNET_EV_COUNT; event++)
+        {
+            if (__atomic_load_n(&telnet_log_rings[i]->rl_suppressed[event], __ATOMIC_RELAXED) > 0)
+            {
+                clock_gettime(CLOCK_REALTIME, &ts);
+                return (int)(1000 - ts.tv_nsec / 1000000L);
+            }
+        }
+    }
+
+    return -1;
+}
+
+// 后台线程入口
+static void *telnets_log_main(void *arg)
+{
+    struct timespec interval = { 0, TELNET_LOG_FLUSH_MS * 1000000L };
+    struct pollfd pfd = { .fd = telnet_log_wake_fd, .events = POLLIN };
+    uint64_t value;
+    ssize_t n;
+
+    (void)arg;
+
+    while (__atomic_load_n(&telnet_log_running, __ATOMIC_ACQUIRE))
+    {
+        // 有记录时继续取，没有时隔一段时间再取，记录持续到来时批量输出
+        if (telnets_log_drain(0) > 0)
+        {
+            continue;
+        }
+        nanosleep(&interval, NULL);
+        if (telnets_log_drain(0) > 0)
+        {
+            continue;
+        }
+
+        // 仍然空闲：先标记等待再检查一次，之后写入的记录一定会唤醒本线程
+        __atomic_store_n(&telnet_log_sleeping, 1, __ATOMIC_SEQ_CST);
+        if (telnets_log_drain(0) == 0 && __atomic_load_n(&telnet_log_running, __ATOMIC_ACQUIRE))
+        {
+            poll(&pfd, 1, telnets_log_idle_timeout());
+        }
+        __atomic_store_n(&telnet_log_sleeping, 0, __ATOMIC_RELAXED);
+
+        // 超时醒来时eventfd为空，读取失败可以忽略
+        n = read(telnet_log_wake_fd, &value, sizeof(value));
+        (void)n;
+    }
+
+    return NULL;
+}
+
+// 初始化日志，target为NULL或"stderr"、"syslog"、文件路径
+int telnets_log_init(int level, const char *target)
+{
+    sigset_t set;
+    sigset_t old_set;
+    int ret;
+
+    telnet_log_level = level;
+
+    if (target && strcmp(target, "syslog") == 0)
+    {
+        openlog("telnet_server", LOG_PID | LOG_NDELAY, LOG_DAEMON);
+        telnet_log_syslog = 1;
+    }
+    else if (target && strcmp(target, "stderr") != 0)
+    {
+        telnet_log_fd = open(target, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (telnet_log_fd < 0)
+        {
+            telnet_log_fd = STDERR_FILENO;
+            telnets_log_errno(target);
+            return -1;
+        }
+    }
+
+    telnet_log_wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (telnet_log_wake_fd < 0)
+    {
+        telnets_log_errno("Failed to create log eventfd");
+        return -1;
+    }
+
+    // 后台线程不处理终止和热重启信号，否则主线程不在sigwait中时SIGUSR2会投递到这里并终止进程
+    sigemptyset(&set);
+    sigaddset(&set, SIGINT);
+    sigaddset(&set, SIGTERM);
+    sigaddset(&set, SIGUSR2);
+    pthread_sigmask(SIG_BLOCK, &set, &old_set);
+
+    __atomic_store_n(&telnet_log_running, 1, __ATOMIC_RELEASE);
+    ret = pthread_create(&telnet_log_thread, NULL, telnets_log_main, NULL);
+    pthread_sigmask(SIG_SETMASK, &old_set, NULL);
+
+    if (ret != 0)
+    {
+        __atomic_store_n(&telnet_log_running, 0, __ATOMIC_RELEASE);
+        close(telnet_log_wake_fd);
+        telnet_log_wake_fd = -1;
+        telnets_log_error("Failed to create log thread", ret);
+        return -1;
+    }
+
+    return 0;
+}
+
+// 停止后台线程，输出剩余记录
+void telnets_log_shutdown(void)
+{
+    uint64_t dropped;
+    uint64_t one = 1;
+    ssize_t wake;
+
+    if (!__atomic_load_n(&telnet_log_running, __ATOMIC_ACQUIRE))
+    {
+        return;
+    }
+
+    __atomic_store_n(&telnet_log_running, 0, __ATOMIC_RELEASE);
+    wake = write(telnet_log_wake_fd, &one, sizeof(one));
+    (void)wake;
+    pthread_join(telnet_log_thread, NULL);
+    close(telnet_log_wake_fd);
+    telnet_log_wake_fd = -1;
+
+    // 后台线程已退出，由本线程取出剩余记录和限流计数
+    telnets_log_drain(1);
+
+    dropped = telnets_log_dropped();
+    if (dropped > 0)
+    {
+        telnets_log_msg(TELNET_LOG_WARN, "%llu log records dropped", (unsigned long long)dropped);
+    }
+
+    for (int i = 0; i < telnet_log_ring_count; i++)
+    {
+        free(telnet_log_rings[i]);
+        telnet_log_rings[i] = NULL;
+    }
+    telnet_log_ring_count = 0;
+
+    if (telnet_log_syslog)
+    {
+        closelog();
+        telnet_log_syslog = 0;
+    }
+    else if (telnet_log_fd != STDERR_FILENO)
+    {
+        close(telnet_log_fd);
+        telnet_log_fd = STDERR_FILENO;
+    }
+}
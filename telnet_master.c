@@ -0,0 +1,273 @@
+/**
+ * @file telnet_master.c
+ * @brief Telnet服务器主控
+ * @date liuliang 2026-01-25
+ *
+ * 本文件包含多reactor模式的主控实现
+ * 每个工作线程拥有独立的监听socket(SO_REUSEPORT)、客户端表和定时器，
+ * 主控只负责创建、停止和回收工作线程，不参与数据处理
+ */
+
+#include "telnet_server.h"
+
+
+// 填充默认配置
+void telnet_config_default(telnet_config_t *config)
+{
+    memset(config, 0, sizeof(telnet_config_t));
+    config->port = TELNET_DEFAULT_PORT;
+    config->threads = TELNET_DEFAULT_THREADS;
+    config->max_clients = TELNET_MAX_CLIENTS;
+    config->idle_timeout = TELNET_IDLE_TIMEOUT;
+    config->high_water = TELNET_OUTQ_HIGH_WATER;
+    config->line_max = TELNET_LINE_MAX;
+    config->edge_triggered = 1;
+    config->backlog = TELNET_LISTEN_BACKLOG;
+    config->accept_burst = TELNET_ACCEPT_BURST;
+    config->pool_threads = TELNET_POOL_THREADS;
+    config->auth_threads = TELNET_AUTH_THREADS;
+    config->auth_cache_ttl = TELNET_AUTH_CACHE_TTL;
+    config->bcast_policy = TELNET_BCAST_DROP;
+    config->log_level = TELNET_LOG_INFO;
+    config->upgrade_fd = -1;
+}
+
+// 工作线程入口
+static void *telnet_worker_main(void *arg)
+{
+    telnet_server_t *server = (telnet_server_t *)arg;
+
+    telnets_log_set_worker(server->worker_id);
+    if (telnet_server_start(server) < 0)
+    {
+        telnets_log_msg(TELNET_LOG_ERROR, "Worker exited with error");
+    }
+
+    telnets_outchunk_cache_release();
+    return NULL;
+}
+
+// 创建主控实例及所有工作线程的服务器实例
+telnet_master_t *telnet_master_init(const telnet_config_t *config)
+{
+    telnet_master_t *master = (telnet_master_t *)malloc(sizeof(telnet_master_t));
+    if (!master)
+    {
+        telnets_log_errno("Failed to allocate master memory");
+        return NULL;
+    }
+
+    memset(master, 0, sizeof(telnet_master_t));
+    memcpy(&master->config, config, sizeof(telnet_config_t));
+    master->nworkers = config->threads;
+    master->metrics_fd = -1;
+    pthread_mutex_init(&master->upgrade_lock, NULL);
+    pthread_cond_init(&master->upgrade_cond, NULL);
+
+    // 在启动工作线程前选定输入扫描实现
+    telnets_scan_init();
+
+    master->workers = (telnet_server_t **)calloc(master->nworkers, sizeof(telnet_server_t *));
+    master->threads = (pthread_t *)calloc(master->nworkers, sizeof(pthread_t));
+    if (!master->workers || !master->threads)
+    {
+        telnets_log_errno("Failed to allocate worker table");
+        telnet_master_destroy(master);
+        return NULL;
+    }
+
+    for (int i = 0; i < master->nworkers; i++)
+    {
+        master->workers[i] = telnet_server_init(&master->config, i);
+        if (!master->workers[i])
+        {
+            telnet_master_destroy(master);
+            return NULL;
+        }
+        master->workers[i]->master = master;
+    }
+
+    return master;
+}
+
+// 绑定所有监听socket并启动工作线程
+int telnet_master_start(telnet_master_t *master)
+{
+    sigset_t set;
+    sigset_t old_set;
+
+    // 证书和私钥有误时同步返回
+    if (master->config.tls_port > 0 && telnets_tls_start(master) < 0)
+    {
+        return -1;
+    }
+
+    // 密码文件有误时同步返回；热重启接收的会话需要知道是否启用认证，在此之前读入
+    if (master->config.auth_file && telnets_auth_load(master) < 0)
+    {
+        return -1;
+    }
+
+    // 工作线程启动后命令注册表只读
+    telnets_cmd_freeze();
+
+    // 命令注册完成后生成固定响应，响应文件有误时同步返回
+    if (telnets_resp_init(master->config.resp_file) < 0)
+    {
+        return -1;
+    }
+
+    // 热重启时从旧进程接收监听socket和会话，此前的初始化都不影响旧进程服务
+    if (master->config.upgrade_fd >= 0)
+    {
+        if (telnets_upgrade_receive(master) < 0)
+        {
+            return -1;
+        }
+    }
+    else
+    {
+        // 先在主线程完成绑定，端口被占用等错误可以同步返回
+        for (int i = 0; i < master->nworkers; i++)
+        {
+            if (telnet_server_listen(master->workers[i]) < 0)
+            {
+                return -1;
+            }
+        }
+    }
+
+    // 对端关闭后发送数据不应终止进程
+    signal(SIGPIPE, SIG_IGN);
+
+    // 工作线程屏蔽终止和热重启信号，统一由主线程在telnet_master_wait中处理
+    sigemptyset(&set);
+    sigaddset(&set, SIGINT);
+    sigaddset(&set, SIGTERM);
+    sigaddset(&set, SIGUSR2);
+    pthread_sigmask(SIG_BLOCK, &set, &old_set);
+
+    // 命令线程池先于工作线程启动，工作线程读取master->pool时无需同步
+    if (telnets_pool_start(master) < 0)
+    {
+        pthread_sigmask(SIG_SETMASK, &old_set, NULL);
+        return -1;
+    }
+
+    // 密码校验线程池同样先于工作线程启动
+    if (telnets_auth_start(master) < 0)
+    {
+        telnets_pool_stop(master);
+        pthread_sigmask(SIG_SETMASK, &old_set, NULL);
+        return -1;
+    }
+
+    for (int i = 0; i < master->nworkers; i++)
+    {
+        int ret = pthread_create(&master->threads[i], NULL, telnet_worker_main, master->workers[i]);
+        if (ret != 0)
+        {
+            telnets_log_error("Failed to create worker", ret);
+            break;
+        }
+        master->started++;
+    }
+
+    // 指标端口线程同样屏蔽终止信号
+    if (master->started == master->nworkers && telnets_metrics_start(master) < 0)
+    {
+        telnet_master_stop(master);
+        pthread_sigmask(SIG_SETMASK, &old_set, NULL);
+        return -1;
+    }
+
+    if (master->started < master->nworkers)
+    {
+        telnet_master_stop(master);
+        pthread_sigmask(SIG_SETMASK, &old_set, NULL);
+        return -1;
+    }
+
+    telnets_log_msg(TELNET_LOG_INFO, "Started %d worker thread(s) on port %d", master->nworkers, master->config.port);
+    return 0;
+}
+
+// 等待终止信号，收到后停止并回收所有工作线程；
+// SIGUSR2把会话交给新启动的进程后退出，交接失败时继续服务
+void telnet_master_wait(telnet_master_t *master)
+{
+    sigset_t set;
+    int sig;
+
+    sigemptyset(&set);
+    sigaddset(&set, SIGINT);
+    sigaddset(&set, SIGTERM);
+    sigaddset(&set, SIGUSR2);
+
+    while (sigwait(&set, &sig) == 0)
+    {
+        if (sig == SIGUSR2)
+        {
+            telnets_log_msg(TELNET_LOG_INFO, "Received SIGUSR2, handing off to a new process...");
+            if (telnets_upgrade_start(master) < 0)
+            {
+                telnets_log_msg(TELNET_LOG_WARN, "Hot restart failed, still serving");
+                continue;
+            }
+            break;
+        }
+
+        telnets_log_msg(TELNET_LOG_INFO, "Received signal %d, stopping workers...", sig);
+        break;
+    }
+
+    telnet_master_stop(master);
+}
+
+// 通知所有工作线程退出并等待结束
+void telnet_master_stop(telnet_master_t *master)
+{
+    telnets_metrics_stop(master);
+
+    for (int i = 0; i < master->started; i++)
+    {
+        telnet_server_stop(master->workers[i]);
+    }
+
+    for (int i = 0; i < master->started; i++)
+    {
+        pthread_join(master->threads[i], NULL);
+    }
+    master->started = 0;
+
+    // 线程池的任务完成后会访问工作线程的服务器实例，在其销毁前停止
+    telnets_pool_stop(master);
+    telnets_auth_stop(master);
+}
+
+// 销毁主控及所有工作线程资源
+void telnet_master_destroy(telnet_master_t *master)
+{
+    if (!master)
+        return;
+
+    if (master->workers)
+    {
+        for (int i = 0; i < master->nworkers; i++)
+        {
+            telnet_server_destroy(master->workers[i]);
+        }
+        free(master->workers);
+    }
+
+    free(master->threads);
+    telnets_tls_free(master);
+    telnets_auth_free(master);
+    pthread_cond_destroy(&master->upgrade_cond);
+    pthread_mutex_destroy(&master->upgrade_lock);
+    free(master);
+    telnets_resp_free();
+
+    // 销毁客户端时释放的输出块缓存在主线程
+    telnets_outchunk_cache_release();
+}
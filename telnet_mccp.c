@@ -0,0 +1,302 @@
+/**
+ * @file telnet_mccp.c
+ * @brief Telnet服务器MCCP2输出压缩
+ * @date liuliang 2026-01-25
+ *
+ * 本文件包含MUD Client Compression Protocol v2(选项86)的实现
+ * 连接建立时服务器发送WILL COMPRESS2，客户端回答DO后服务器发送 IAC SB COMPRESS2 IAC SE，
+ * 之后发往该客户端的所有数据都经过一个zlib流；输出追加到队列时就送入压缩流(Z_NO_FLUSH)，
+ * 每批输出发送前同步刷新一次(Z_SYNC_FLUSH)，输出队列中始终是压缩后的字节，
+ * 发送、高水位和广播积压判断都按实际发出的字节计算；
+ * 压缩流只在压缩期间存在，内存按工作线程统计；限制内存模式使用小窗口，
+ * 并限制同时压缩的会话数，达到上限的会话按不压缩处理
+ */
+
+#include "telnet_server.h"
+
+// zlib分配的内存前加一个头记录大小，保持16字节对齐
+#define TELNET_MCCP_HDR 16
+
+
+// zlib内存分配，计入本工作线程的压缩状态字节数
+static voidpf telnets_mccp_alloc(voidpf opaque, uInt items, uInt size)
+{
+    telnet_server_t *server = (telnet_server_t *)opaque;
+    size_t bytes = (size_t)items * size;
+    char *p = (char *)malloc(TELNET_MCCP_HDR + bytes);
+
+    if (!p)
+    {
+        return Z_NULL;
+    }
+
+    *(size_t *)p = bytes;
+    TELNET_METRIC_ADD(server->metrics.compress_bytes, bytes);
+    return p + TELNET_MCCP_HDR;
+}
+
+static void telnets_mccp_free(voidpf opaque, voidpf ptr)
+{
+    telnet_server_t *server = (telnet_server_t *)opaque;
+    char *p = (char *)ptr - TELNET_MCCP_HDR;
+
+    TELNET_METRIC_ADD(server->metrics.compress_bytes, -(int64_t)*(size_t *)p);
+    free(p);
+}
+
+// 启用压缩时创建按槽位索引的压缩流表
+int telnets_mccp_init(telnet_server_t *server)
+{
+    const telnet_config_t *config = server->config;
+
+    if (config->compress_level <= 0)
+    {
+        return 0;
+    }
+
+    server->mccp = (z_stream **)calloc(server->capacity, sizeof(z_stream *));
+    if (!server->mccp)
+    {
+        telnets_log_errno("Failed to allocate compression table");
+        return -1;
+    }
+
+    // 会话上限与客户端数一样平均分配到各工作线程
+    server->mccp_max = server->max_clients;
+    if (config->compress_max > 0)
+    {
+        server->mccp_max = (config->compress_max + config->threads - 1) / config->threads;
+    }
+    return 0;
+}
+
+void telnets_mccp_destroy(telnet_server_t *server)
+{
+    free(server->mccp);
+    server->mccp = NULL;
+}
+
+// 发送 IAC <verb> COMPRESS2
+static void telnets_mccp_send(telnet_client_t *client, unsigned char verb)
+{
+    char cmd[3];
+
+    cmd[0] = (char)TELNET_IAC;
+    cmd[1] = (char)verb;
+    cmd[2] = (char)TELNET_COMPRESS2;
+    telnets_output(client, cmd, sizeof(cmd));
+}
+
+// 还能为一个会话开始压缩
+static int telnets_mccp_available(const telnet_server_t *server)
+{
+    return server->mccp && server->mccp_count < server->mccp_max;
+}
+
+// 创建压缩流并发送压缩开始标记，标记本身不压缩
+static int telnets_mccp_start(telnet_client_t *client)
+{
+    telnet_server_t *server = client->server;
+    const telnet_config_t *config = server->config;
+    int small = config->compress_max > 0;
+    z_stream *zs;
+
+    if (!telnets_mccp_available(server))
+    {
+        TELNET_METRIC_ADD(server->metrics.compress_refused, 1);
+        return -1;
+    }
+
+    zs = (z_stream *)telnets_mccp_alloc(server, 1, sizeof(z_stream));
+    if (!zs)
+    {
+        telnets_log_errno("Failed to allocate compression stream");
+        return -1;
+    }
+
+    memset(zs, 0, sizeof(z_stream));
+    zs->zalloc = telnets_mccp_alloc;
+    zs->zfree = telnets_mccp_free;
+    zs->opaque = server;
+    if (deflateInit2(zs, config->compress_level, Z_DEFLATED,
+                     small ? TELNET_MCCP_SMALL_WBITS : TELNET_MCCP_WBITS,
+                     small ? TELNET_MCCP_SMALL_MEMLEVEL : TELNET_MCCP_MEMLEVEL, Z_DEFAULT_STRATEGY) != Z_OK)
+    {
+        telnets_log_msg(TELNET_LOG_WARN, "Failed to initialize compression stream");
+        telnets_mccp_free(server, zs);
+        return -1;
+    }
+
+    {
+        const char sb[5] = { (char)TELNET_IAC, (char)TELNET_SB, (char)TELNET_COMPRESS2,
+                             (char)TELNET_IAC, (char)TELNET_SE };
+        telnets_output(client, sb, sizeof(sb));
+    }
+
+    server->mccp[client->slot] = zs;
+    server->mccp_count++;
+    client->compress = TELNET_MCCP_ON;
+    TELNET_METRIC_ADD(server->metrics.compress_sessions, 1);
+    return 0;
+}
+
+// 结束压缩，finish为1时先结束压缩流，客户端解压到流结束后恢复读取未压缩数据；
+// 会话关闭时不必结束压缩流
+void telnets_mccp_end(telnet_client_t *client, int finish)
+{
+    telnet_server_t *server = client->server;
+    z_stream *zs;
+
+    if (client->compress != TELNET_MCCP_ON)
+    {
+        client->compress = TELNET_MCCP_OFF;
+        return;
+    }
+
+    zs = server->mccp[client->slot];
+    if (finish)
+    {
+        unsigned char out[TELNET_OUTCHUNK_SIZE];
+        int ret;
+
+        zs->next_in = Z_NULL;
+        zs->avail_in = 0;
+        do
+        {
+            zs->next_out = out;
+            zs->avail_out = sizeof(out);
+            ret = deflate(zs, Z_FINISH);
+            telnets_outq_append(&client->outq, (const char *)out, sizeof(out) - zs->avail_out);
+        } while (ret == Z_OK);
+    }
+
+    deflateEnd(zs);
+    telnets_mccp_free(server, zs);
+    server->mccp[client->slot] = NULL;
+    server->mccp_count--;
+    client->compress = TELNET_MCCP_OFF;
+    TELNET_METRIC_ADD(server->metrics.compress_sessions, -1);
+}
+
+// 热重启后恢复压缩：旧进程已结束压缩流，选项仍处于启用状态，重新开始一个压缩流
+void telnets_mccp_resume(telnet_client_t *client)
+{
+    if (telnets_mccp_start(client) < 0)
+    {
+        client->compress = TELNET_MCCP_OFF;
+        telnets_mccp_send(client, TELNET_WONT);
+    }
+}
+
+// 连接建立后提出压缩，未启用或已达上限时不提出
+void telnets_mccp_offer(telnet_client_t *client)
+{
+    client->compress = TELNET_MCCP_OFF;
+    if (telnets_mccp_available(client->server))
+    {
+        client->compress = TELNET_MCCP_OFFERED;
+        telnets_mccp_send(client, TELNET_WILL);
+    }
+}
+
+// 处理客户端对COMPRESS2的 WILL/WONT/DO/DONT
+// 只有服务器一侧可以启用，状态只有三种，不会形成协商循环，不必经过Q方法
+void telnets_mccp_recv(telnet_client_t *client, unsigned char verb)
+{
+    switch (verb)
+    {
+        case TELNET_DO:
+            if (client->compress == TELNET_MCCP_ON)
+            {
+                break;
+            }
+            if (client->compress == TELNET_MCCP_OFF)
+            {
+                // 客户端主动要求压缩，按提出压缩处理
+                if (!telnets_mccp_available(client->server))
+                {
+                    telnets_mccp_send(client, TELNET_WONT);
+                    break;
+                }
+                telnets_mccp_send(client, TELNET_WILL);
+            }
+            if (telnets_mccp_start(client) < 0)
+            {
+                client->compress = TELNET_MCCP_OFF;
+                telnets_mccp_send(client, TELNET_WONT);
+            }
+            break;
+
+        case TELNET_DONT:
+            if (client->compress == TELNET_MCCP_ON)
+            {
+                telnets_mccp_end(client, 1);
+                telnets_mccp_send(client, TELNET_WONT);
+            }
+            client->compress = TELNET_MCCP_OFF;
+            break;
+
+        case TELNET_WILL:
+            // 客户端到服务器方向不压缩
+            telnets_mccp_send(client, TELNET_DONT);
+            break;
+
+        default:
+            break;
+    }
+}
+
+// 协商超时：不理会选项的客户端不压缩
+void telnets_mccp_timeout(telnet_client_t *client)
+{
+    if (client->compress == TELNET_MCCP_OFFERED)
+    {
+        client->compress = TELNET_MCCP_OFF;
+    }
+}
+
+// 把数据送入压缩流，产生的压缩数据追加到输出队列
+static int telnets_mccp_deflate(telnet_client_t *client, const char *data, size_t len, int flush)
+{
+    telnet_server_t *server = client->server;
+    z_stream *zs = server->mccp[client->slot];
+    unsigned char out[TELNET_OUTCHUNK_SIZE];
+    size_t before = client->outq.bytes;
+
+    zs->next_in = (Bytef *)data;
+    zs->avail_in = (uInt)len;
+    do
+    {
+        size_t n;
+
+        zs->next_out = out;
+        zs->avail_out = sizeof(out);
+        // 没有新数据时同步刷新返回Z_BUF_ERROR，不输出任何内容
+        if (deflate(zs, flush) == Z_STREAM_ERROR)
+        {
+            return -1;
+        }
+
+        n = sizeof(out) - zs->avail_out;
+        if (n > 0 && telnets_outq_append(&client->outq, (const char *)out, n) < 0)
+        {
+            return -1;
+        }
+    } while (zs->avail_out == 0);
+
+    TELNET_METRIC_ADD(server->metrics.compress_in, len);
+    TELNET_METRIC_ADD(server->metrics.compress_out, client->outq.bytes - before);
+    return 0;
+}
+
+// 压缩输出，不立即刷新
+int telnets_mccp_write(telnet_client_t *client, const char *data, size_t len)
+{
+    return telnets_mccp_deflate(client, data, len, Z_NO_FLUSH);
+}
+
+// 同步刷新压缩流，发送前每批调用一次
+int telnets_mccp_flush(telnet_client_t *client)
+{
+    return telnets_mccp_deflate(client, NULL, 0, Z_SYNC_FLUSH);
+}
@@ -0,0 +1,444 @@
+/**
+ * @file telnet_mem.c
+ * @brief Telnet服务器内存传输
+ * @date liuliang 2026-01-25
+ *
+ * 本文件包含进程内的内存传输，用于在一个进程中模拟大量会话
+ * 驱动程序用telnets_mem_connect建立连接、telnets_mem_write写入输入，服务器的输出和关闭
+ * 通过回调交给驱动程序；连接不占用描述符，不经过内核，会话照常走事件循环、命令处理和定时器；
+ * 有输入的连接放在就绪列表中，由telnet_server_poll在每轮事件循环中处理
+ */
+
+#include "telnet_server.h"
+
+#define TELNET_MEM_INIT_CONNS 1024
+
+// 一个内存连接，编号即会话的描述符
+typedef struct {
+    char *in;                       // 待服务器读取的输入，读完后释放
+    uint32_t in_len;                // 输入长度
+    uint32_t in_off;                // 已读取的偏移
+    uint32_t events;                // 服务器关注的事件
+    int next_free;                  // 空闲时为空闲链表中的下一个连接
+    uint8_t open;                   // 连接存在（等待接受或已接受）
+    uint8_t accepted;               // 已被服务器接受
+    uint8_t queued;                 // 已在就绪列表中
+    uint8_t peer_closed;            // 驱动程序已关闭，输入读完后读到EOF
+    struct sockaddr_in addr;        // 模拟的对端地址
+} telnet_mem_conn_t;
+
+typedef struct telnet_memnet {
+    telnet_mem_conn_t *conns;       // 连接表，按需扩大
+    int cap;                        // 连接表容量
+    int free_head;                  // 空闲连接链表头，-1表示无
+    int *backlog;                   // 等待接受的连接，按连接顺序
+    int backlog_head;               // 下一个被接受的位置
+    int backlog_len;                // 队列末尾位置
+    int backlog_cap;
+    int *ready;                     // 有输入或EOF待读取的连接
+    int ready_len;
+    int ready_cap;
+    telnet_mem_output_fn output;    // 输出回调
+    void *arg;                      // 回调参数
+} telnet_memnet_t;
+
+
+static int telnets_mem_grow(int **list, int *cap, int need)
+{
+    int new_cap = *cap ? *cap : 256;
+    int *p;
+
+    if (need <= *cap)
+    {
+        return 0;
+    }
+
+    while (new_cap < need)
+    {
+        new_cap *= 2;
+    }
+
+    p = (int *)realloc(*list, new_cap * sizeof(int));
+    if (!p)
+    {
+        telnets_log_errno("Failed to grow memory transport list");
+        return -1;
+    }
+
+    *list = p;
+    *cap = new_cap;
+    return 0;
+}
+
+static telnet_mem_conn_t *telnets_mem_conn(telnet_server_t *server, int conn)
+{
+    telnet_memnet_t *mn = server->memnet;
+
+    if (!mn || conn < 0 || conn >= mn->cap || !mn->conns[conn].open)
+    {
+        return NULL;
+    }
+
+    return &mn->conns[conn];
+}
+
+// 连接有输入或EOF且服务器关注读事件时放入就绪列表
+static void telnets_mem_queue(telnet_memnet_t *mn, int conn)
+{
+    telnet_mem_conn_t *c = &mn->conns[conn];
+
+    if (c->queued || !c->accepted || !(c->events & EPOLLIN))
+    {
+        return;
+    }
+
+    if (c->in_off == c->in_len && !c->peer_closed)
+    {
+        return;
+    }
+
+    if (telnets_mem_grow(&mn->ready, &mn->ready_cap, mn->ready_len + 1) < 0)
+    {
+        return;
+    }
+
+    mn->ready[mn->ready_len++] = conn;
+    c->queued = 1;
+}
+
+// 为服务器创建内存连接表，之后服务器从内存传输接受连接
+int telnets_mem_attach(telnet_server_t *server, telnet_mem_output_fn output, void *arg)
+{
+    telnet_memnet_t *mn = (telnet_memnet_t *)calloc(1, sizeof(telnet_memnet_t));
+
+    if (!mn)
+    {
+        telnets_log_errno("Failed to allocate memory transport");
+        return -1;
+    }
+
+    mn->free_head = -1;
+    mn->output = output;
+    mn->arg = arg;
+    server->memnet = mn;
+    server->transport = TELNET_TRANSPORT_MEM;
+    return 0;
+}
+
+void telnets_mem_detach(telnet_server_t *server)
+{
+    telnet_memnet_t *mn = server->memnet;
+
+    if (!mn)
+    {
+        return;
+    }
+
+    for (int i = 0; i < mn->cap; i++)
+    {
+        free(mn->conns[i].in);
+    }
+    free(mn->conns);
+    free(mn->backlog);
+    free(mn->ready);
+    free(mn);
+    server->memnet = NULL;
+}
+
+// 建立一个连接，由下一轮事件循环接受，返回连接编号
+int telnets_mem_connect(telnet_server_t *server, const struct sockaddr_in *addr)
+{
+    telnet_memnet_t *mn = server->memnet;
+    telnet_mem_conn_t *c;
+    int conn;
+
+    if (!mn || telnets_mem_grow(&mn->backlog, &mn->backlog_cap, mn->backlog_len + 1) < 0)
+    {
+        return -1;
+    }
+
+    if (mn->free_head < 0)
+    {
+        int new_cap = mn->cap ? mn->cap * 2 : TELNET_MEM_INIT_CONNS;
+        telnet_mem_conn_t *conns = (telnet_mem_conn_t *)realloc(mn->conns, new_cap * sizeof(telnet_mem_conn_t));
+
+        if (!conns)
+        {
+            telnets_log_errno("Failed to grow memory transport");
+            return -1;
+        }
+
+        memset(conns + mn->cap, 0, (new_cap - mn->cap) * sizeof(telnet_mem_conn_t));
+        for (int i = new_cap - 1; i >= mn->cap; i--)
+        {
+            conns[i].next_free = mn->free_head;
+            mn->free_head = i;
+        }
+        mn->conns = conns;
+        mn->cap = new_cap;
+    }
+
+    conn = mn->free_head;
+    c = &mn->conns[conn];
+    mn->free_head = c->next_free;
+
+    memset(c, 0, sizeof(telnet_mem_conn_t));
+    c->open = 1;
+    c->next_free = -1;
+    memcpy(&c->addr, addr, sizeof(struct sockaddr_in));
+
+    mn->backlog[mn->backlog_len++] = conn;
+    return conn;
+}
+
+// 写入客户端输入，返回0成功
+int telnets_mem_write(telnet_server_t *server, int conn, const char *data, size_t len)
+{
+    telnet_mem_conn_t *c = telnets_mem_conn(server, conn);
+    size_t pending;
+    char *in;
+
+    if (!c || c->peer_closed)
+    {
+        return -1;
+    }
+
+    // 未读完的输入移到开头再追加
+    pending = c->in_len - c->in_off;
+    in = (char *)malloc(pending + len);
+    if (!in)
+    {
+        telnets_log_errno("Failed to allocate memory transport input");
+        return -1;
+    }
+
+    if (pending > 0)
+    {
+        memcpy(in, c->in + c->in_off, pending);
+    }
+    memcpy(in + pending, data, len);
+    free(c->in);
+    c->in = in;
+    c->in_off = 0;
+    c->in_len = (uint32_t)(pending + len);
+
+    telnets_mem_queue(server->memnet, conn);
+    return 0;
+}
+
+// 客户端关闭连接，服务器读完剩余输入后读到EOF
+void telnets_mem_shutdown(telnet_server_t *server, int conn)
+{
+    telnet_mem_conn_t *c = telnets_mem_conn(server, conn);
+
+    if (c)
+    {
+        c->peer_closed = 1;
+        telnets_mem_queue(server->memnet, conn);
+    }
+}
+
+// 有等待接受的连接或待读取的输入，事件循环不应等待
+int telnets_mem_pending(const telnet_server_t *server)
+{
+    const telnet_memnet_t *mn = server->memnet;
+
+    return mn && (mn->ready_len > 0 || (mn->backlog_head < mn->backlog_len && !server->accept_paused));
+}
+
+// 事件循环中接受新连接并处理就绪连接的输入
+void telnets_mem_dispatch(telnet_server_t *server)
+{
+    telnet_memnet_t *mn = server->memnet;
+    int *ready;
+    int count;
+
+    if (!mn)
+    {
+        return;
+    }
+
+    if (mn->backlog_head < mn->backlog_len && !server->accept_paused)
+    {
+        telnets_handle_new_connection(server);
+    }
+
+    if (mn->ready_len == 0)
+    {
+        return;
+    }
+
+    // 处理期间产生的就绪连接留到下一轮
+    ready = mn->ready;
+    count = mn->ready_len;
+    mn->ready = NULL;
+    mn->ready_len = 0;
+    mn->ready_cap = 0;
+
+    for (int i = 0; i < count; i++)
+    {
+        int conn = ready[i];
+        telnet_mem_conn_t *c = &mn->conns[conn];
+        telnet_client_t *client;
+
+        c->queued = 0;
+        client = telnets_get_client(server, telnets_find_client_index(server, conn));
+        if (!c->open || !client || client->read_paused)
+        {
+            continue;
+        }
+
+        telnets_recv_data_proc(server, client->slot);
+
+        // 水平触发每次只读一次，剩余输入下一轮继续
+        if (c->open && c->accepted)
+        {
+            telnets_mem_queue(mn, conn);
+        }
+    }
+
+    free(ready);
+}
+
+// 接受等待队列中的下一个连接
+static int telnets_mem_accept(telnet_server_t *server, struct sockaddr_in *addr)
+{
+    telnet_memnet_t *mn = server->memnet;
+
+    while (mn && mn->backlog_head < mn->backlog_len)
+    {
+        int conn = mn->backlog[mn->backlog_head++];
+        telnet_mem_conn_t *c = &mn->conns[conn];
+
+        if (mn->backlog_head == mn->backlog_len)
+        {
+            mn->backlog_head = 0;
+            mn->backlog_len = 0;
+        }
+
+        if (!c->open)
+        {
+            continue;
+        }
+
+        c->accepted = 1;
+        memcpy(addr, &c->addr, sizeof(struct sockaddr_in));
+        return conn;
+    }
+
+    errno = EAGAIN;
+    return -1;
+}
+
+static ssize_t telnets_mem_read(telnet_server_t *server, int fd, void *buf, size_t len)
+{
+    telnet_mem_conn_t *c = telnets_mem_conn(server, fd);
+    size_t n;
+
+    if (!c)
+    {
+        errno = EBADF;
+        return -1;
+    }
+
+    if (c->in_off == c->in_len)
+    {
+        if (c->peer_closed)
+        {
+            return 0;
+        }
+        errno = EAGAIN;
+        return -1;
+    }
+
+    n = c->in_len - c->in_off;
+    if (n > len)
+    {
+        n = len;
+    }
+    memcpy(buf, c->in + c->in_off, n);
+    c->in_off += (uint32_t)n;
+
+    // 读完即释放，空闲连接不占用输入缓冲区
+    if (c->in_off == c->in_len)
+    {
+        free(c->in);
+        c->in = NULL;
+        c->in_off = 0;
+        c->in_len = 0;
+    }
+
+    return (ssize_t)n;
+}
+
+// 输出直接交给回调，总是全部写入
+static ssize_t telnets_mem_writev(telnet_server_t *server, int fd, const struct iovec *iov, int iovcnt)
+{
+    telnet_memnet_t *mn = server->memnet;
+    ssize_t total = 0;
+
+    if (!telnets_mem_conn(server, fd))
+    {
+        errno = EBADF;
+        return -1;
+    }
+
+    for (int i = 0; i < iovcnt; i++)
+    {
+        if (mn->output)
+        {
+            mn->output(mn->arg, fd, (const char *)iov[i].iov_base, iov[i].iov_len);
+        }
+        total += (ssize_t)iov[i].iov_len;
+    }
+
+    return total;
+}
+
+static int telnets_mem_watch(telnet_server_t *server, telnet_client_t *client, uint32_t events)
+{
+    telnet_mem_conn_t *c = telnets_mem_conn(server, client->sockfd);
+
+    if (!c)
+    {
+        return -1;
+    }
+
+    c->events = events;
+    client->events = events;
+    telnets_mem_queue(server->memnet, client->sockfd);
+    return 0;
+}
+
+static void telnets_mem_close(telnet_server_t *server, int fd)
+{
+    telnet_memnet_t *mn = server->memnet;
+    telnet_mem_conn_t *c = telnets_mem_conn(server, fd);
+
+    if (!c)
+    {
+        return;
+    }
+
+    if (mn->output)
+    {
+        mn->output(mn->arg, fd, NULL, 0);
+    }
+
+    // 就绪列表中的旧项按open判断，编号复用后最多多读一次
+    free(c->in);
+    c->in = NULL;
+    c->open = 0;
+    c->accepted = 0;
+    c->next_free = mn->free_head;
+    mn->free_head = fd;
+}
+
+const telnet_transport_t telnet_transport_mem = {
+    "mem",
+    telnets_mem_accept,
+    telnets_mem_read,
+    telnets_mem_writev,
+    telnets_mem_watch,
+    telnets_mem_close,
+};
@@ -0,0 +1,504 @@
+/**
+ * @file telnet_metrics.c
+ * @brief Telnet服务器运行指标
+ * @date liuliang 2026-01-25
+ *
+ * 本文件包含指标直方图、跨工作线程的指标合并和Prometheus文本格式输出
+ * 每个工作线程只写自己的计数器，不加锁；读取方(stats命令、指标端口线程)
+ * 逐个工作线程读取后相加，读到的是各计数器近似同一时刻的值；
+ * 指标端口只监听127.0.0.1，由单独的线程阻塞处理，不占用事件循环
+ */
+
+#define _GNU_SOURCE             // accept4
+#include "telnet_server.h"
+
+
+// 计算值所在的桶
+static int telnets_hist_index(uint64_t value)
+{
+    int shift;
+    int sub;
+    int index;
+
+    if (value < (1ull << TELNET_HIST_MIN_SHIFT))
+    {
+        return 0;
+    }
+
+    shift = 63 - __builtin_clzll(value);
+    sub = (int)((value >> (shift - TELNET_HIST_SUB_BITS)) & ((1 << TELNET_HIST_SUB_BITS) - 1));
+    index = ((shift - TELNET_HIST_MIN_SHIFT) << TELNET_HIST_SUB_BITS) + sub + 1;
+
+    return index < TELNET_HIST_BUCKETS ? index : TELNET_HIST_BUCKETS - 1;
+}
+
+// 记录一个样本，只能由所属工作线程调用
+void telnets_hist_record(telnet_hist_t *hist, uint64_t value)
+{
+    int index = telnets_hist_index(value);
+
+    TELNET_METRIC_ADD(hist->buckets[index], 1);
+    TELNET_METRIC_ADD(hist->count, 1);
+    TELNET_METRIC_ADD(hist->sum, value);
+}
+
+// 桶的上界（不含），最后一个桶没有上界
+uint64_t telnets_hist_bucket_upper(int index)
+{
+    int shift;
+    int sub;
+
+    if (index <= 0)
+    {
+        return 1ull << TELNET_HIST_MIN_SHIFT;
+    }
+
+    if (index >= TELNET_HIST_BUCKETS - 1)
+    {
+        return UINT64_MAX;
+    }
+
+    shift = ((index - 1) >> TELNET_HIST_SUB_BITS) + TELNET_HIST_MIN_SHIFT;
+    sub = (index - 1) & ((1 << TELNET_HIST_SUB_BITS) - 1);
+
+    return (1ull << shift) + ((uint64_t)(sub + 1) << (shift - TELNET_HIST_SUB_BITS));
+}
+
+// 估算百分位数，返回所在桶的上界
+uint64_t telnets_hist_percentile(const telnet_hist_t *hist, double pct)
+{
+    uint64_t rank;
+    uint64_t seen = 0;
+
+    if (hist->count == 0)
+    {
+        return 0;
+    }
+
+    rank = (uint64_t)(pct / 100.0 * (double)hist->count + 0.5);
+    if (rank < 1)
+    {
+        rank = 1;
+    }
+
+    for (int i = 0; i < TELNET_HIST_BUCKETS; i++)
+    {
+        seen += hist->buckets[i];
+        if (seen >= rank)
+        {
+            return telnets_hist_bucket_upper(i);
+        }
+    }
+
+    return telnets_hist_bucket_upper(TELNET_HIST_BUCKETS - 1);
+}
+
+static void telnets_hist_merge(telnet_hist_t *dst, const telnet_hist_t *src)
+{
+    for (int i = 0; i < TELNET_HIST_BUCKETS; i++)
+    {
+        dst->buckets[i] += TELNET_METRIC_READ(src->buckets[i]);
+    }
+    dst->count += TELNET_METRIC_READ(src->count);
+    dst->sum += TELNET_METRIC_READ(src->sum);
+}
+
+// 合并所有工作线程的指标，返回当前客户端总数
+int telnets_metrics_collect(telnet_master_t *master, telnet_metrics_t *out)
+{
+    int clients = 0;
+
+    memset(out, 0, sizeof(telnet_metrics_t));
+
+    for (int i = 0; i < master->nworkers; i++)
+    {
+        telnet_server_t *server = master->workers[i];
+        telnet_metrics_t *m = &server->metrics;
+
+        out->accepts += TELNET_METRIC_READ(m->accepts);
+        out->rejects_full += TELNET_METRIC_READ(m->rejects_full);
+        out->rejects_rate += TELNET_METRIC_READ(m->rejects_rate);
+        out->accept_pauses += TELNET_METRIC_READ(m->accept_pauses);
+        out->timeouts += TELNET_METRIC_READ(m->timeouts);
+        out->bytes_in += TELNET_METRIC_READ(m->bytes_in);
+        out->bytes_out += TELNET_METRIC_READ(m->bytes_out);
+        out->syscalls += TELNET_METRIC_READ(m->syscalls);
+        out->loops += TELNET_METRIC_READ(m->loops);
+        out->unknown_commands += TELNET_METRIC_READ(m->unknown_commands);
+        out->offloaded += TELNET_METRIC_READ(m->offloaded);
+        out->offload_rejects += TELNET_METRIC_READ(m->offload_rejects);
+        out->broadcasts += TELNET_METRIC_READ(m->broadcasts);
+        out->bcast_dropped += TELNET_METRIC_READ(m->bcast_dropped);
+        out->bcast_truncated += TELNET_METRIC_READ(m->bcast_truncated);
+        out->bcast_disconnects += TELNET_METRIC_READ(m->bcast_disconnects);
+        out->buf_bytes += TELNET_METRIC_READ(m->buf_bytes);
+        out->compress_sessions += TELNET_METRIC_READ(m->compress_sessions);
+        out->compress_bytes += TELNET_METRIC_READ(m->compress_bytes);
+        out->compress_in += TELNET_METRIC_READ(m->compress_in);
+        out->compress_out += TELNET_METRIC_READ(m->compress_out);
+        out->compress_refused += TELNET_METRIC_READ(m->compress_refused);
+        out->tls_handshakes += TELNET_METRIC_READ(m->tls_handshakes);
+        out->tls_resumed += TELNET_METRIC_READ(m->tls_resumed);
+        out->tls_failures += TELNET_METRIC_READ(m->tls_failures);
+        out->tls_ktls += TELNET_METRIC_READ(m->tls_ktls);
+        out->sched_deferred += TELNET_METRIC_READ(m->sched_deferred);
+        out->sched_throttled += TELNET_METRIC_READ(m->sched_throttled);
+        out->auth_logins += TELNET_METRIC_READ(m->auth_logins);
+        out->auth_cached += TELNET_METRIC_READ(m->auth_cached);
+        out->auth_failures += TELNET_METRIC_READ(m->auth_failures);
+        out->auth_busy += TELNET_METRIC_READ(m->auth_busy);
+        out->auth_blocked += TELNET_METRIC_READ(m->auth_blocked);
+        for (int c = 0; c < TELNET_CMD_MAX; c++)
+        {
+            out->commands[c] += TELNET_METRIC_READ(m->commands[c]);
+        }
+        telnets_hist_merge(&out->loop_ns, &m->loop_ns);
+        telnets_hist_merge(&out->cmd_ns, &m->cmd_ns);
+        telnets_hist_merge(&out->auth_ns, &m->auth_ns);
+
+        clients += __atomic_load_n(&server->client_count, __ATOMIC_RELAXED);
+    }
+
+    return clients;
+}
+
+
+// 指标文本缓冲区
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+    int failed;
+} telnet_metrics_buf_t;
+
+__attribute__((format(printf, 2, 3)))
+static void telnets_metrics_appendf(telnet_metrics_buf_t *buf, const char *fmt, ...)
+{
+    va_list ap;
+    int n;
+
+    if (buf->failed)
+    {
+        return;
+    }
+
+    for (;;)
+    {
+        size_t room = buf->cap - buf->len;
+
+        va_start(ap, fmt);
+        n = vsnprintf(buf->data ? buf->data + buf->len : NULL, room, fmt, ap);
+        va_end(ap);
+
+        if (n < 0)
+        {
+            buf->failed = 1;
+            return;
+        }
+
+        if ((size_t)n < room)
+        {
+            buf->len += n;
+            return;
+        }
+
+        size_t cap = buf->cap ? buf->cap * 2 : 8192;
+        while (cap - buf->len <= (size_t)n)
+        {
+            cap *= 2;
+        }
+
+        char *data = (char *)realloc(buf->data, cap);
+        if (!data)
+        {
+            buf->failed = 1;
+            return;
+        }
+        buf->data = data;
+        buf->cap = cap;
+    }
+}
+
+static void telnets_metrics_counter(telnet_metrics_buf_t *buf, const char *name,
+                                    const char *help, uint64_t value)
+{
+    telnets_metrics_appendf(buf, "# HELP %s %s\n# TYPE %s counter\n%s %llu\n",
+                            name, help, name, name, (unsigned long long)value);
+}
+
+// 直方图按秒输出，只输出到最后一个非空桶为止，后面的桶与+Inf相同
+static void telnets_metrics_histogram(telnet_metrics_buf_t *buf, const char *name,
+                                      const char *help, const telnet_hist_t *hist)
+{
+    uint64_t cumulative = 0;
+    int last = 0;
+
+    for (int i = 0; i < TELNET_HIST_BUCKETS - 1; i++)
+    {
+        if (hist->buckets[i])
+        {
+            last = i;
+        }
+    }
+
+    telnets_metrics_appendf(buf, "# HELP %s %s\n# TYPE %s histogram\n", name, help, name);
+    for (int i = 0; i <= last; i++)
+    {
+        cumulative += hist->buckets[i];
+        telnets_metrics_appendf(buf, "%s_bucket{le=\"%.9g\"} %llu\n", name,
+                                (double)telnets_hist_bucket_upper(i) / 1e9,
+                                (unsigned long long)cumulative);
+    }
+    telnets_metrics_appendf(buf, "%s_bucket{le=\"+Inf\"} %llu\n", name, (unsigned long long)hist->count);
+    telnets_metrics_appendf(buf, "%s_sum %.9f\n", name, (double)hist->sum / 1e9);
+    telnets_metrics_appendf(buf, "%s_count %llu\n", name, (unsigned long long)hist->count);
+}
+
+// 生成Prometheus文本格式的指标，*out由调用方free
+int telnets_metrics_format(telnet_master_t *master, char **out, size_t *out_len)
+{
+    telnet_metrics_buf_t buf;
+    telnet_metrics_t *m;
+    int clients;
+
+    m = (telnet_metrics_t *)malloc(sizeof(telnet_metrics_t));
+    if (!m)
+    {
+        return -1;
+    }
+
+    memset(&buf, 0, sizeof(buf));
+    clients = telnets_metrics_collect(master, m);
+
+    telnets_metrics_appendf(&buf, "# HELP telnet_workers Number of reactor threads.\n"
+                                  "# TYPE telnet_workers gauge\ntelnet_workers %d\n", master->nworkers);
+    telnets_metrics_appendf(&buf, "# HELP telnet_clients Connected clients.\n"
+                                  "# TYPE telnet_clients gauge\ntelnet_clients %d\n", clients);
+    telnets_metrics_appendf(&buf, "# HELP telnet_clients_max Configured client limit.\n"
+                                  "# TYPE telnet_clients_max gauge\ntelnet_clients_max %d\n",
+                            master->config.max_clients);
+    telnets_metrics_appendf(&buf, "# HELP telnet_session_buffer_bytes Line, subnegotiation and type-ahead buffer bytes in use.\n"
+                                  "# TYPE telnet_session_buffer_bytes gauge\ntelnet_session_buffer_bytes %llu\n",
+                            (unsigned long long)m->buf_bytes);
+    telnets_metrics_appendf(&buf, "# HELP telnet_compress_sessions Sessions with MCCP2 compression active.\n"
+                                  "# TYPE telnet_compress_sessions gauge\ntelnet_compress_sessions %llu\n",
+                            (unsigned long long)m->compress_sessions);
+    telnets_metrics_appendf(&buf, "# HELP telnet_compress_state_bytes Memory held by compression streams.\n"
+                                  "# TYPE telnet_compress_state_bytes gauge\ntelnet_compress_state_bytes %llu\n",
+                            (unsigned long long)m->compress_bytes);
+    telnets_metrics_counter(&buf, "telnet_accepts_total", "Accepted connections.", m->accepts);
+    telnets_metrics_counter(&buf, "telnet_rejects_full_total",
+                            "Connections rejected because the client table was full.", m->rejects_full);
+    telnets_metrics_counter(&buf, "telnet_rejects_rate_total",
+                            "Connections rejected by the per-source-IP rate limit.", m->rejects_rate);
+    telnets_metrics_counter(&buf, "telnet_accept_pauses_total",
+                            "Times a worker stopped accepting because it was at capacity.", m->accept_pauses);
+    telnets_metrics_counter(&buf, "telnet_timeouts_total", "Clients disconnected by idle timeout.", m->timeouts);
+    telnets_metrics_counter(&buf, "telnet_received_bytes_total", "Bytes received from clients.", m->bytes_in);
+    telnets_metrics_counter(&buf, "telnet_sent_bytes_total", "Bytes sent to clients.", m->bytes_out);
+    telnets_metrics_counter(&buf, "telnet_compress_input_bytes_total",
+                            "Output bytes fed to compression streams.", m->compress_in);
+    telnets_metrics_counter(&buf, "telnet_compress_output_bytes_total",
+                            "Compressed bytes produced.", m->compress_out);
+    telnets_metrics_counter(&buf, "telnet_compress_refused_total",
+                            "Compression requests refused at the session cap.", m->compress_refused);
+    telnets_metrics_counter(&buf, "telnet_tls_handshakes_total", "Completed TLS handshakes.", m->tls_handshakes);
+    telnets_metrics_counter(&buf, "telnet_tls_resumed_total",
+                            "TLS handshakes that resumed an earlier session.", m->tls_resumed);
+    telnets_metrics_counter(&buf, "telnet_tls_failures_total", "Failed TLS handshakes.", m->tls_failures);
+    telnets_metrics_counter(&buf, "telnet_tls_ktls_total",
+                            "TLS sessions whose sends were offloaded to kernel TLS.", m->tls_ktls);
+    telnets_metrics_counter(&buf, "telnet_sched_deferred_total",
+                            "Times a session used up its per-iteration budget and was queued.", m->sched_deferred);
+    telnets_metrics_counter(&buf, "telnet_sched_throttled_total",
+                            "Times a session's reads were paused by its input or command rate limit.",
+                            m->sched_throttled);
+    telnets_metrics_counter(&buf, "telnet_auth_logins_total", "Successful logins.", m->auth_logins);
+    telnets_metrics_counter(&buf, "telnet_auth_cache_hits_total",
+                            "Logins accepted from the credential cache without hashing.", m->auth_cached);
+    telnets_metrics_counter(&buf, "telnet_auth_failures_total", "Failed logins.", m->auth_failures);
+    telnets_metrics_counter(&buf, "telnet_auth_busy_total",
+                            "Logins refused because the password verifier queue was full.", m->auth_busy);
+    telnets_metrics_counter(&buf, "telnet_auth_blocked_total",
+                            "Logins refused because the source IP had too many failures.", m->auth_blocked);
+    telnets_metrics_counter(&buf, "telnet_syscalls_total", "System calls made by the event loops.", m->syscalls);
+    telnets_metrics_counter(&buf, "telnet_loop_iterations_total", "Event loop iterations.", m->loops);
+
+    telnets_metrics_appendf(&buf, "# HELP telnet_commands_total Commands executed by name.\n"
+                                  "# TYPE telnet_commands_total counter\n");
+    for (int i = 0; i < telnets_cmd_count(); i++)
+    {
+        telnets_metrics_appendf(&buf, "telnet_commands_total{command=\"%s\"} %llu\n",
+                                telnets_cmd_get(i)->name, (unsigned long long)m->commands[i]);
+    }
+    telnets_metrics_counter(&buf, "telnet_unknown_commands_total", "Unknown commands.", m->unknown_commands);
+    telnets_metrics_counter(&buf, "telnet_offloaded_commands_total",
+                            "Commands executed on the command pool.", m->offloaded);
+    telnets_metrics_counter(&buf, "telnet_offload_rejects_total",
+                            "Commands rejected because the command pool queue was full.", m->offload_rejects);
+    telnets_metrics_counter(&buf, "telnet_broadcasts_total",
+                            "Broadcast messages fanned out, counted once per worker.", m->broadcasts);
+    telnets_metrics_counter(&buf, "telnet_broadcast_dropped_total",
+                            "Broadcast copies dropped for backlogged clients.", m->bcast_dropped);
+    telnets_metrics_counter(&buf, "telnet_broadcast_truncated_total",
+                            "Broadcast copies truncated for backlogged clients.", m->bcast_truncated);
+    telnets_metrics_counter(&buf, "telnet_broadcast_disconnects_total",
+                            "Clients disconnected for falling behind a broadcast.", m->bcast_disconnects);
+    telnets_metrics_counter(&buf, "telnet_log_dropped_total", "Log records dropped because a log ring was full.",
+                            telnets_log_dropped());
+
+    telnets_metrics_histogram(&buf, "telnet_loop_duration_seconds",
+                              "Time spent handling one event loop iteration.", &m->loop_ns);
+    telnets_metrics_histogram(&buf, "telnet_command_duration_seconds",
+                              "Time spent in command handlers.", &m->cmd_ns);
+    telnets_metrics_histogram(&buf, "telnet_auth_verify_duration_seconds",
+                              "Time from submitting a password to its verdict, including queueing.", &m->auth_ns);
+
+    free(m);
+
+    if (buf.failed)
+    {
+        free(buf.data);
+        return -1;
+    }
+
+    *out = buf.data;
+    *out_len = buf.len;
+    return 0;
+}
+
+
+// 处理一次指标请求，不解析请求内容，任何请求都返回全部指标
+static void telnets_metrics_serve(telnet_master_t *master, int fd)
+{
+    struct timeval tv = { 1, 0 };
+    char request[1024];
+    char header[256];
+    char *body = NULL;
+    size_t body_len = 0;
+    int header_len;
+
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+    if (recv(fd, request, sizeof(request), 0) <= 0)
+    {
+        return;
+    }
+
+    if (telnets_metrics_format(master, &body, &body_len) < 0)
+    {
+        const char *error = "HTTP/1.0 500 Internal Server Error\r\nContent-Length: 0\r\n\r\n";
+        send(fd, error, strlen(error), MSG_NOSIGNAL);
+        return;
+    }
+
+    header_len = snprintf(header, sizeof(header),
+                          "HTTP/1.0 200 OK\r\n"
+                          "Content-Type: text/plain; version=0.0.4\r\n"
+                          "Content-Length: %zu\r\n"
+                          "Connection: close\r\n\r\n", body_len);
+
+    if (send(fd, header, header_len, MSG_NOSIGNAL | MSG_MORE) == header_len)
+    {
+        send(fd, body, body_len, MSG_NOSIGNAL);
+    }
+
+    free(body);
+}
+
+// 指标端口线程入口
+static void *telnets_metrics_main(void *arg)
+{
+    telnet_master_t *master = (telnet_master_t *)arg;
+
+    for (;;)
+    {
+        int fd = accept4(master->metrics_fd, NULL, NULL, SOCK_CLOEXEC);
+        if (fd < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+            {
+                continue;
+            }
+            // 停止时监听socket被shutdown，accept返回错误后退出
+            break;
+        }
+
+        telnets_metrics_serve(master, fd);
+        close(fd);
+    }
+
+    return NULL;
+}
+
+// 绑定指标端口并启动线程，未配置端口时直接返回
+int telnets_metrics_start(telnet_master_t *master)
+{
+    struct sockaddr_in addr;
+    int opt = 1;
+    int ret;
+
+    if (master->config.metrics_port <= 0)
+    {
+        return 0;
+    }
+
+    master->metrics_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (master->metrics_fd < 0)
+    {
+        telnets_log_errno("Metrics socket creation failed");
+        return -1;
+    }
+
+    setsockopt(master->metrics_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+    // 只允许本机访问
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(master->config.metrics_port);
+
+    if (bind(master->metrics_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(master->metrics_fd, TELNET_METRICS_BACKLOG) < 0)
+    {
+        telnets_log_errno("Metrics bind failed");
+        close(master->metrics_fd);
+        master->metrics_fd = -1;
+        return -1;
+    }
+
+    ret = pthread_create(&master->metrics_thread, NULL, telnets_metrics_main, master);
+    if (ret != 0)
+    {
+        telnets_log_error("Failed to create metrics thread", ret);
+        close(master->metrics_fd);
+        master->metrics_fd = -1;
+        return -1;
+    }
+    master->metrics_started = 1;
+
+    telnets_log_msg(TELNET_LOG_INFO, "Metrics available at http://127.0.0.1:%d/metrics", master->config.metrics_port);
+    return 0;
+}
+
+// 停止指标端口线程
+void telnets_metrics_stop(telnet_master_t *master)
+{
+    if (master->metrics_fd < 0)
+    {
+        return;
+    }
+
+    // 唤醒阻塞在accept中的线程
+    shutdown(master->metrics_fd, SHUT_RDWR);
+
+    if (master->metrics_started)
+    {
+        pthread_join(master->metrics_thread, NULL);
+        master->metrics_started = 0;
+    }
+
+    close(master->metrics_fd);
+    master->metrics_fd = -1;
+}
@@ -0,0 +1,360 @@
+/**
+ * @file telnet_option.c
+ * @brief Telnet选项协商
+ * @date liuliang 2026-01-25
+ *
+ * 本文件包含按RFC 1143 Q方法实现的选项协商
+ * 每个选项分别记录本端(us)和对端(him)的状态及排队请求，避免协商循环；
+ * 支持的选项：ECHO、SGA由服务器控制，NAWS获取窗口大小，
+ * LINEMODE(RFC 1184)让支持的客户端在本地编辑并整行发送，
+ * COMPRESS2(MCCP2)压缩发往客户端的输出，见telnet_mccp.c
+ */
+
+#include "telnet_server.h"
+
+
+// 选项协商策略：本端是否愿意启用、是否接受对端启用
+typedef struct {
+    unsigned char code;             // 选项编码
+    unsigned char local_ok;         // 本端可以WILL
+    unsigned char remote_ok;        // 接受对端WILL
+} telnet_opt_policy_t;
+
+static const telnet_opt_policy_t telnet_opt_policy[TELNET_OPT_COUNT] = {
+    [TELNET_OPT_ECHO]     = { TELNET_ECHO,     1, 0 },
+    [TELNET_OPT_SGA]      = { TELNET_SGA,      1, 1 },
+    [TELNET_OPT_NAWS]     = { TELNET_NAWS,     0, 1 },
+    [TELNET_OPT_LINEMODE] = { TELNET_LINEMODE, 0, 1 },
+};
+
+
+// 选项编码转换为内部索引，不支持的选项返回-1
+static int telnets_option_index(unsigned char code)
+{
+    switch (code)
+    {
+        case TELNET_ECHO:     return TELNET_OPT_ECHO;
+        case TELNET_SGA:      return TELNET_OPT_SGA;
+        case TELNET_NAWS:     return TELNET_OPT_NAWS;
+        case TELNET_LINEMODE: return TELNET_OPT_LINEMODE;
+        default:              return -1;
+    }
+}
+
+// 发送 IAC <verb> <option>
+static void telnets_option_send(telnet_client_t *client, unsigned char verb, unsigned char code)
+{
+    char cmd[3];
+
+    cmd[0] = (char)TELNET_IAC;
+    cmd[1] = (char)verb;
+    cmd[2] = (char)code;
+    telnets_output(client, cmd, sizeof(cmd));
+}
+
+// 发送LINEMODE MODE子协商
+static void telnets_linemode_send_mode(telnet_client_t *client, unsigned char mode)
+{
+    char sb[7];
+
+    sb[0] = (char)TELNET_IAC;
+    sb[1] = (char)TELNET_SB;
+    sb[2] = (char)TELNET_LINEMODE;
+    sb[3] = (char)TELNET_LM_MODE;
+    sb[4] = (char)mode;
+    sb[5] = (char)TELNET_IAC;
+    sb[6] = (char)TELNET_SE;
+    telnets_output(client, sb, sizeof(sb));
+}
+
+// 选项状态变化后的处理
+static void telnets_option_changed(telnet_client_t *client, int index, int remote, int enabled)
+{
+    if (!remote || index != TELNET_OPT_LINEMODE)
+    {
+        return;
+    }
+
+    if (enabled)
+    {
+        // 客户端支持LINEMODE，要求其本地编辑，服务器不再逐字符回显
+        telnets_linemode_send_mode(client, TELNET_LM_MODE_EDIT | TELNET_LM_MODE_TRAPSIG);
+    }
+    else if (client->linemode_edit)
+    {
+        // 退出本地编辑，恢复服务器回显
+        client->linemode_edit = 0;
+        telnets_option_enable(client, TELNET_ECHO, 0);
+    }
+}
+
+// 请求启用选项，remote为1表示请求对端启用(DO)，0表示本端启用(WILL)
+void telnets_option_enable(telnet_client_t *client, unsigned char code, int remote)
+{
+    int index = telnets_option_index(code);
+    unsigned char *state;
+    unsigned char *queue;
+
+    if (index < 0)
+    {
+        return;
+    }
+
+    state = remote ? &client->opts[index].him : &client->opts[index].us;
+    queue = remote ? &client->opts[index].himq : &client->opts[index].usq;
+
+    switch (*state)
+    {
+        case TELNET_Q_NO:
+            *state = TELNET_Q_WANTYES;
+            telnets_option_send(client, remote ? TELNET_DO : TELNET_WILL, code);
+            break;
+        case TELNET_Q_WANTNO:
+            // 对端还未确认上一次的关闭请求，排队等确认后再启用
+            *queue = TELNET_Q_OPPOSITE;
+            break;
+        case TELNET_Q_WANTYES:
+            *queue = TELNET_Q_EMPTY;
+            break;
+        default:
+            break;
+    }
+}
+
+// 请求关闭选项
+void telnets_option_disable(telnet_client_t *client, unsigned char code, int remote)
+{
+    int index = telnets_option_index(code);
+    unsigned char *state;
+    unsigned char *queue;
+
+    if (index < 0)
+    {
+        return;
+    }
+
+    state = remote ? &client->opts[index].him : &client->opts[index].us;
+    queue = remote ? &client->opts[index].himq : &client->opts[index].usq;
+
+    switch (*state)
+    {
+        case TELNET_Q_YES:
+            *state = TELNET_Q_WANTNO;
+            telnets_option_send(client, remote ? TELNET_DONT : TELNET_WONT, code);
+            break;
+        case TELNET_Q_WANTYES:
+            *queue = TELNET_Q_OPPOSITE;
+            break;
+        case TELNET_Q_WANTNO:
+            *queue = TELNET_Q_EMPTY;
+            break;
+        default:
+            break;
+    }
+}
+
+// 处理对端发来的 WILL/WONT/DO/DONT
+void telnets_option_recv(telnet_client_t *client, unsigned char verb, unsigned char code)
+{
+    int index = telnets_option_index(code);
+    int remote = (verb == TELNET_WILL || verb == TELNET_WONT);
+    int positive = (verb == TELNET_WILL || verb == TELNET_DO);
+    unsigned char accept_verb = remote ? TELNET_DO : TELNET_WILL;
+    unsigned char refuse_verb = remote ? TELNET_DONT : TELNET_WONT;
+    unsigned char *state;
+    unsigned char *queue;
+    int allowed;
+
+    // COMPRESS2只能由服务器启用，单独处理
+    if (code == TELNET_COMPRESS2)
+    {
+        telnets_mccp_recv(client, verb);
+        return;
+    }
+
+    // 不支持的选项：拒绝启用请求，关闭请求无需应答
+    if (index < 0)
+    {
+        if (positive)
+        {
+            telnets_option_send(client, refuse_verb, code);
+        }
+        return;
+    }
+
+    state = remote ? &client->opts[index].him : &client->opts[index].us;
+    queue = remote ? &client->opts[index].himq : &client->opts[index].usq;
+    allowed = remote ? telnet_opt_policy[index].remote_ok : telnet_opt_policy[index].local_ok;
+
+    if (positive)
+    {
+        switch (*state)
+        {
+            case TELNET_Q_NO:
+                if (allowed)
+                {
+                    *state = TELNET_Q_YES;
+                    telnets_option_send(client, accept_verb, code);
+                    telnets_option_changed(client, index, remote, 1);
+                }
+                else
+                {
+                    telnets_option_send(client, refuse_verb, code);
+                }
+                break;
+            case TELNET_Q_WANTNO:
+                // 对端违反协议用启用回答了关闭请求
+                if (*queue == TELNET_Q_EMPTY)
+                {
+                    *state = TELNET_Q_NO;
+                }
+                else
+                {
+                    *state = TELNET_Q_YES;
+                    *queue = TELNET_Q_EMPTY;
+                    telnets_option_changed(client, index, remote, 1);
+                }
+                break;
+            case TELNET_Q_WANTYES:
+                if (*queue == TELNET_Q_EMPTY)
+                {
+                    *state = TELNET_Q_YES;
+                    telnets_option_changed(client, index, remote, 1);
+                }
+                else
+                {
+                    *state = TELNET_Q_WANTNO;
+                    *queue = TELNET_Q_EMPTY;
+                    telnets_option_send(client, refuse_verb, code);
+                }
+                break;
+            default:
+                break;
+        }
+    }
+    else
+    {
+        switch (*state)
+        {
+            case TELNET_Q_YES:
+                *state = TELNET_Q_NO;
+                telnets_option_send(client, refuse_verb, code);
+                telnets_option_changed(client, index, remote, 0);
+                break;
+            case TELNET_Q_WANTNO:
+                if (*queue == TELNET_Q_EMPTY)
+                {
+                    *state = TELNET_Q_NO;
+                    telnets_option_changed(client, index, remote, 0);
+                }
+                else
+                {
+                    *state = TELNET_Q_WANTYES;
+                    *queue = TELNET_Q_EMPTY;
+                    telnets_option_send(client, accept_verb, code);
+                }
+                break;
+            case TELNET_Q_WANTYES:
+                *state = TELNET_Q_NO;
+                *queue = TELNET_Q_EMPTY;
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+// 处理子协商内容，data不含 IAC SB 和 IAC SE
+void telnets_option_subneg(telnet_client_t *client, const unsigned char *data, int len)
+{
+    if (len < 1)
+    {
+        return;
+    }
+
+    switch (data[0])
+    {
+        case TELNET_NAWS:
+            // 窗口大小：宽、高各两个字节，网络字节序
+            if (len >= 5)
+            {
+                client->cold->win_width = (unsigned short)((data[1] << 8) | data[2]);
+                client->cold->win_height = (unsigned short)((data[3] << 8) | data[4]);
+            }
+            break;
+
+        case TELNET_LINEMODE:
+            // 只处理客户端对MODE的确认，SLC、FORWARDMASK使用客户端默认值
+            if (len >= 3 && data[1] == TELNET_LM_MODE && (data[2] & TELNET_LM_MODE_ACK))
+            {
+                int edit = (data[2] & TELNET_LM_MODE_EDIT) != 0;
+
+                if (edit && !client->linemode_edit)
+                {
+                    // 客户端本地编辑并回显，服务器关闭ECHO
+                    client->linemode_edit = 1;
+                    telnets_option_disable(client, TELNET_ECHO, 0);
+                }
+                else if (!edit && client->linemode_edit)
+                {
+                    client->linemode_edit = 0;
+                    telnets_option_enable(client, TELNET_ECHO, 0);
+                }
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+// 连接建立后发起协商
+void telnets_option_start(telnet_client_t *client)
+{
+    for (int i = 0; i < TELNET_OPT_COUNT; i++)
+    {
+        client->opts[i].us = TELNET_Q_NO;
+        client->opts[i].usq = TELNET_Q_EMPTY;
+        client->opts[i].him = TELNET_Q_NO;
+        client->opts[i].himq = TELNET_Q_EMPTY;
+    }
+
+    telnets_option_enable(client, TELNET_ECHO, 0);
+    telnets_option_enable(client, TELNET_SGA, 0);
+    telnets_option_enable(client, TELNET_NAWS, 1);
+    telnets_option_enable(client, TELNET_LINEMODE, 1);
+    telnets_mccp_offer(client);
+}
+
+// 协商超时：对端未应答的请求不再等待
+void telnets_option_timeout(telnet_client_t *client)
+{
+    for (int i = 0; i < TELNET_OPT_COUNT; i++)
+    {
+        // 不理会协商的原始TCP客户端按旧行为处理：服务器回显、字符模式
+        if (client->opts[i].us == TELNET_Q_WANTYES)
+        {
+            client->opts[i].us = TELNET_Q_YES;
+        }
+        else if (client->opts[i].us == TELNET_Q_WANTNO)
+        {
+            client->opts[i].us = TELNET_Q_NO;
+        }
+
+        if (client->opts[i].him == TELNET_Q_WANTYES || client->opts[i].him == TELNET_Q_WANTNO)
+        {
+            client->opts[i].him = TELNET_Q_NO;
+        }
+
+        client->opts[i].usq = TELNET_Q_EMPTY;
+        client->opts[i].himq = TELNET_Q_EMPTY;
+    }
+
+    telnets_mccp_timeout(client);
+}
+
+// 服务器是否需要回显输入
+int telnets_option_server_echo(const telnet_client_t *client)
+{
+    return client->opts[TELNET_OPT_ECHO].us != TELNET_Q_NO && !client->linemode_edit;
+}
@@ -0,0 +1,552 @@
+/**
+ * @file telnet_output.c
+ * @brief Telnet服务器输出队列
+ * @date liuliang 2026-01-25
+ *
+ * 本文件包含客户端输出队列的实现
+ * 处理一批输入期间产生的回显、提示符和命令响应先追加到队列，
+ * 在事件循环本轮结束时用一次writev发出；内核缓冲区满时才关注可写事件，
+ * 队列超过高水位时暂停读取该客户端，直到队列发空；
+ * 广播等多个客户端相同的内容放在共享缓冲区中，队列块只保存引用；
+ * 启用MCCP2压缩的客户端，追加的数据先经过压缩流，队列中保存压缩后的字节；
+ * 标准大小的队列块和引用共享缓冲区的块头释放后留在线程本地的空闲链表中，
+ * 连接和断开时的输出、向大量会话投递广播都不调用系统分配器
+ */
+
+#include "telnet_server.h"
+
+// 线程本地的空闲块链表，只缓存容量为TELNET_OUTCHUNK_SIZE的块
+static __thread telnet_outchunk_t *telnet_chunk_cache = NULL;
+static __thread int telnet_chunk_cached = 0;
+
+// 线程本地的空闲引用块链表，块不带数据区
+static __thread telnet_outchunk_t *telnet_ref_cache = NULL;
+static __thread int telnet_ref_cached = 0;
+
+
+// 释放队列中的所有块
+void telnets_outq_clear(telnet_outq_t *outq)
+{
+    telnet_outchunk_t *chunk = outq->head;
+
+    while (chunk)
+    {
+        telnet_outchunk_t *next = chunk->next;
+        telnets_outchunk_free(chunk);
+        chunk = next;
+    }
+
+    outq->head = NULL;
+    outq->tail = NULL;
+    outq->bytes = 0;
+}
+
+// 分配队列块，标准大小的块和引用块（cap为0）优先从空闲链表取
+static telnet_outchunk_t *telnets_outchunk_alloc(uint32_t cap)
+{
+    telnet_outchunk_t *chunk;
+
+    if (cap == TELNET_OUTCHUNK_SIZE && telnet_chunk_cache)
+    {
+        chunk = telnet_chunk_cache;
+        telnet_chunk_cache = chunk->next;
+        telnet_chunk_cached--;
+    }
+    else if (cap == 0 && telnet_ref_cache)
+    {
+        chunk = telnet_ref_cache;
+        telnet_ref_cache = chunk->next;
+        telnet_ref_cached--;
+    }
+    else
+    {
+        chunk = (telnet_outchunk_t *)malloc(sizeof(telnet_outchunk_t) + cap);
+        if (!chunk)
+        {
+            return NULL;
+        }
+    }
+
+    chunk->next = NULL;
+    chunk->off = 0;
+    chunk->len = 0;
+    chunk->cap = cap;
+    chunk->shared = NULL;
+    return chunk;
+}
+
+// 释放队列块，引用共享缓冲区的块同时释放引用
+void telnets_outchunk_free(telnet_outchunk_t *chunk)
+{
+    if (chunk->shared)
+    {
+        telnets_shared_unref(chunk->shared);
+        if (telnet_ref_cached < TELNET_OUTREF_CACHE)
+        {
+            chunk->next = telnet_ref_cache;
+            telnet_ref_cache = chunk;
+            telnet_ref_cached++;
+            return;
+        }
+    }
+    else if (chunk->cap == TELNET_OUTCHUNK_SIZE && telnet_chunk_cached < TELNET_OUTCHUNK_CACHE)
+    {
+        chunk->next = telnet_chunk_cache;
+        telnet_chunk_cache = chunk;
+        telnet_chunk_cached++;
+        return;
+    }
+    free(chunk);
+}
+
+// 线程退出前释放本线程缓存的空闲块
+void telnets_outchunk_cache_release(void)
+{
+    while (telnet_chunk_cache)
+    {
+        telnet_outchunk_t *next = telnet_chunk_cache->next;
+        free(telnet_chunk_cache);
+        telnet_chunk_cache = next;
+    }
+    telnet_chunk_cached = 0;
+
+    while (telnet_ref_cache)
+    {
+        telnet_outchunk_t *next = telnet_ref_cache->next;
+        free(telnet_ref_cache);
+        telnet_ref_cache = next;
+    }
+    telnet_ref_cached = 0;
+}
+
+// 创建共享缓冲区，引用计数为1，归创建者所有
+telnet_shared_t *telnets_shared_create(const char *data, size_t len)
+{
+    telnet_shared_t *shared = (telnet_shared_t *)malloc(sizeof(telnet_shared_t) + len);
+    if (!shared)
+    {
+        telnets_log_errno("Failed to allocate shared buffer");
+        return NULL;
+    }
+
+    shared->refs = 1;
+    shared->len = (uint32_t)len;
+    memcpy(shared->data, data, len);
+    return shared;
+}
+
+// 增加n个引用
+void telnets_shared_ref(telnet_shared_t *shared, uint32_t n)
+{
+    __atomic_fetch_add(&shared->refs, n, __ATOMIC_RELAXED);
+}
+
+// 释放一个引用，最后一个引用释放时回收
+void telnets_shared_unref(telnet_shared_t *shared)
+{
+    if (__atomic_sub_fetch(&shared->refs, 1, __ATOMIC_ACQ_REL) == 0)
+    {
+        free(shared);
+    }
+}
+
+// 把客户端加入本轮待发送列表
+static int telnets_schedule_flush(telnet_client_t *client)
+{
+    telnet_server_t *server = client->server;
+
+    if (client->flush_queued)
+    {
+        return 0;
+    }
+
+    if (server->flush_count == server->flush_cap)
+    {
+        int new_cap = server->flush_cap ? server->flush_cap * 2 : TELNET_TABLE_INIT_SIZE;
+        uint64_t *list = (uint64_t *)realloc(server->flush_list, new_cap * sizeof(uint64_t));
+        if (!list)
+        {
+            telnets_log_errno("Failed to grow flush list");
+            return -1;
+        }
+        server->flush_list = list;
+        server->flush_cap = new_cap;
+    }
+
+    server->flush_list[server->flush_count++] = TELNET_TOKEN(client->slot, client->generation);
+    client->flush_queued = 1;
+    return 0;
+}
+
+// 追加数据到输出队列，不涉及客户端，可在命令线程池中使用
+int telnets_outq_append(telnet_outq_t *outq, const char *data, size_t len)
+{
+    if (len == 0)
+    {
+        return 0;
+    }
+
+    outq->bytes += len;
+
+    while (len > 0)
+    {
+        telnet_outchunk_t *tail = outq->tail;
+        size_t n;
+
+        if (!tail || tail->shared || tail->len == tail->cap)
+        {
+            // 大块输出单独分配，避免拆成很多小块
+            uint32_t cap = len > TELNET_OUTCHUNK_SIZE ? (uint32_t)len : TELNET_OUTCHUNK_SIZE;
+            tail = telnets_outchunk_alloc(cap);
+            if (!tail)
+            {
+                telnets_log_errno("Failed to allocate output chunk");
+                outq->bytes -= len;
+                return -1;
+            }
+
+            if (outq->tail)
+            {
+                outq->tail->next = tail;
+            }
+            else
+            {
+                outq->head = tail;
+            }
+            outq->tail = tail;
+        }
+
+        n = tail->cap - tail->len;
+        if (n > len)
+        {
+            n = len;
+        }
+
+        memcpy(tail->data + tail->len, data, n);
+        tail->len += n;
+        data += n;
+        len -= n;
+    }
+
+    return 0;
+}
+
+// 追加输出数据，不立即发送
+int telnets_output(telnet_client_t *client, const char *data, size_t len)
+{
+    int ret;
+
+    if (len == 0)
+    {
+        return 0;
+    }
+
+    if (client->compress == TELNET_MCCP_ON)
+    {
+        ret = telnets_mccp_write(client, data, len);
+    }
+    else
+    {
+        ret = telnets_outq_append(&client->outq, data, len);
+    }
+
+    if (ret < 0)
+    {
+        return -1;
+    }
+
+    return telnets_schedule_flush(client);
+}
+
+// 追加共享缓冲区的前len字节，不拷贝数据；调用者须已为本块持有一个引用
+int telnets_output_shared(telnet_client_t *client, telnet_shared_t *shared, uint32_t len)
+{
+    telnet_outq_t *outq = &client->outq;
+    telnet_outchunk_t *chunk;
+
+    // 先加入待发送列表再消耗引用，返回-1时引用一定仍归调用者；
+    // 之后追加失败只会多发送一次空队列
+    if (telnets_schedule_flush(client) < 0)
+    {
+        return -1;
+    }
+
+    // 压缩的客户端无法共享数据，压缩后释放引用
+    if (client->compress == TELNET_MCCP_ON)
+    {
+        if (telnets_mccp_write(client, shared->data, len) < 0)
+        {
+            return -1;
+        }
+        telnets_shared_unref(shared);
+        return 0;
+    }
+
+    chunk = telnets_outchunk_alloc(0);
+    if (!chunk)
+    {
+        telnets_log_errno("Failed to allocate output chunk");
+        return -1;
+    }
+
+    chunk->len = len;
+    chunk->shared = shared;
+
+    if (outq->tail)
+    {
+        outq->tail->next = chunk;
+    }
+    else
+    {
+        outq->head = chunk;
+    }
+    outq->tail = chunk;
+    outq->bytes += len;
+
+    return 0;
+}
+
+// 把另一个队列的块整体移到客户端输出队列末尾，不拷贝数据
+int telnets_output_splice(telnet_client_t *client, telnet_outq_t *src)
+{
+    telnet_outq_t *outq = &client->outq;
+
+    if (!src->head)
+    {
+        return 0;
+    }
+
+    if (client->compress == TELNET_MCCP_ON)
+    {
+        int ret = 0;
+
+        for (telnet_outchunk_t *chunk = src->head; chunk && ret == 0; chunk = chunk->next)
+        {
+            ret = telnets_mccp_write(client, TELNET_CHUNK_DATA(chunk) + chunk->off, chunk->len - chunk->off);
+        }
+        telnets_outq_clear(src);
+        return ret < 0 ? -1 : telnets_schedule_flush(client);
+    }
+
+    if (outq->tail)
+    {
+        outq->tail->next = src->head;
+    }
+    else
+    {
+        outq->head = src->head;
+    }
+    outq->tail = src->tail;
+    outq->bytes += src->bytes;
+
+    src->head = NULL;
+    src->tail = NULL;
+    src->bytes = 0;
+
+    return telnets_schedule_flush(client);
+}
+
+// 追加字符串
+int telnets_output_str(telnet_client_t *client, const char *str)
+{
+    return telnets_output(client, str, strlen(str));
+}
+
+// 格式化输出
+int telnets_printf(telnet_client_t *client, const char *fmt, ...)
+{
+    char buf[TELNET_BUFFER_SIZE + 256];
+    va_list ap;
+    int len;
+
+    va_start(ap, fmt);
+    len = vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+
+    if (len < 0)
+    {
+        return -1;
+    }
+
+    if (len >= (int)sizeof(buf))
+    {
+        len = sizeof(buf) - 1;
+    }
+
+    return telnets_output(client, buf, len);
+}
+
+// 丢弃已发送的n字节
+static void telnets_outq_consume(telnet_outq_t *outq, size_t n)
+{
+    outq->bytes -= n;
+
+    while (n > 0 && outq->head)
+    {
+        telnet_outchunk_t *chunk = outq->head;
+        size_t avail = chunk->len - chunk->off;
+
+        if (n < avail)
+        {
+            chunk->off += n;
+            return;
+        }
+
+        n -= avail;
+        outq->head = chunk->next;
+        if (!outq->head)
+        {
+            outq->tail = NULL;
+        }
+        telnets_outchunk_free(chunk);
+    }
+}
+
+// 用传输层的writev发送输出队列，直到发空或内核缓冲区满
+static int telnets_flush_writev(telnet_server_t *server, telnet_client_t *client)
+{
+    telnet_outq_t *outq = &client->outq;
+
+    while (outq->head)
+    {
+        struct iovec iov[TELNET_OUTQ_IOV_MAX];
+        telnet_outchunk_t *chunk = outq->head;
+        size_t total = 0;
+        int iovcnt = 0;
+        ssize_t n;
+
+        for (; chunk && iovcnt < TELNET_OUTQ_IOV_MAX; chunk = chunk->next)
+        {
+            iov[iovcnt].iov_base = TELNET_CHUNK_DATA(chunk) + chunk->off;
+            iov[iovcnt].iov_len = chunk->len - chunk->off;
+            total += iov[iovcnt].iov_len;
+            iovcnt++;
+        }
+
+        n = TELNET_TRANSPORT(client)->writev(server, client->sockfd, iov, iovcnt);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                break;
+            }
+            return -1;
+        }
+
+        TELNET_METRIC_ADD(server->metrics.bytes_out, n);
+        telnets_outq_consume(outq, (size_t)n);
+
+        // 只写入一部分说明内核缓冲区已满
+        if ((size_t)n < total)
+        {
+            break;
+        }
+    }
+
+    return 0;
+}
+
+// 发送客户端输出队列，返回-1表示连接出错
+// io_uring后端提交发送请求后立即返回，发送中的字节在完成前仍计入队列长度
+int telnets_flush_client(telnet_server_t *server, telnet_client_t *client)
+{
+    telnet_outq_t *outq = &client->outq;
+    uint32_t events;
+    int ret;
+
+    // 压缩流每批输出同步刷新一次，客户端收到的压缩块可以立即解压
+    if (client->compress == TELNET_MCCP_ON && telnets_mccp_flush(client) < 0)
+    {
+        return -1;
+    }
+
+    if (server->io_backend == TELNET_IO_URING)
+    {
+        ret = telnets_uring_send(server, client);
+    }
+    else
+    {
+        ret = telnets_flush_writev(server, client);
+    }
+
+    if (ret < 0)
+    {
+        return -1;
+    }
+
+    // 超过高水位或缓存的预输入过多时暂停读取，发空后恢复
+    if (outq->bytes >= (size_t)server->config->high_water || client->typeahead_len >= TELNET_TYPEAHEAD_MAX)
+    {
+        client->read_paused |= TELNET_PAUSE_OUTPUT;
+    }
+    else if (outq->bytes == 0)
+    {
+        client->read_paused &= ~TELNET_PAUSE_OUTPUT;
+    }
+
+    // 只有还有积压时才关注可写事件；留在就绪队列中的会话仍关注可读事件
+    events = (client->read_paused & TELNET_PAUSE_UNWATCH) ? 0 : (EPOLLIN | EPOLLRDHUP);
+    if (outq->head)
+    {
+        events |= EPOLLOUT;
+    }
+
+    return telnets_event_mod(server, client, events);
+}
+
+// 发送本轮所有有输出的客户端
+void telnets_flush_pending(telnet_server_t *server)
+{
+    for (int i = 0; i < server->flush_count; i++)
+    {
+        telnet_client_t *client = telnets_lookup_token(server, server->flush_list[i]);
+        if (!client)
+        {
+            // 客户端已在本轮被移除
+            continue;
+        }
+
+        client->flush_queued = 0;
+        if (telnets_flush_client(server, client) < 0)
+        {
+            telnets_log_errno("Send error");
+            telnets_remove_client(server, client->slot);
+        }
+    }
+
+    server->flush_count = 0;
+}
+
+// 把本轮所有有输出的客户端的输出交给内存接收端，不经过socket，返回交出的字节数
+size_t telnets_flush_pending_sink(telnet_server_t *server, telnet_sink_fn sink, void *arg)
+{
+    size_t total = 0;
+
+    for (int i = 0; i < server->flush_count; i++)
+    {
+        telnet_client_t *client = telnets_lookup_token(server, server->flush_list[i]);
+        if (!client)
+        {
+            continue;
+        }
+
+        client->flush_queued = 0;
+        if (client->compress == TELNET_MCCP_ON)
+        {
+            telnets_mccp_flush(client);
+        }
+        for (telnet_outchunk_t *chunk = client->outq.head; chunk; chunk = chunk->next)
+        {
+            sink(arg, TELNET_CHUNK_DATA(chunk) + chunk->off, chunk->len - chunk->off);
+        }
+        total += client->outq.bytes;
+        telnets_outq_consume(&client->outq, client->outq.bytes);
+    }
+
+    server->flush_count = 0;
+    return total;
+}
@@ -0,0 +1,300 @@
+/**
+ * @file telnet_pool.c
+ * @brief Telnet服务器命令线程池
+ * @date liuliang 2026-01-25
+ *
+ * 本文件包含标记为TELNET_CMD_OFFLOAD的命令的执行
+ * 工作线程把命令行复制到任务中放入有界队列，线程池执行处理函数，输出写入任务自己的队列；
+ * 完成的任务压入所属工作线程的无锁栈，栈由空变非空时通过eventfd唤醒工作线程；
+ * 工作线程在事件循环中取出全部任务，把输出整块挂到客户端输出队列，再处理期间缓存的输入
+ */
+
+#include "telnet_server.h"
+
+// 命令任务
+typedef struct telnet_job {
+    struct telnet_job *next;        // 等待队列或完成栈中的下一个任务
+    telnet_server_t *server;        // 发出命令的工作线程
+    const telnet_cmd_t *cmd;        // 要执行的命令
+    int slot;                       // 客户端槽位
+    uint32_t generation;            // 客户端槽位代数，完成时客户端已断开则丢弃输出
+    telnet_outq_t out;              // 命令输出
+    uint64_t run_ns;                // 处理函数耗时
+    int len;                        // 命令行长度
+    char line[];                    // 命令行副本
+} telnet_job_t;
+
+typedef struct telnet_pool {
+    pthread_t threads[TELNET_POOL_MAX_THREADS];
+    int nthreads;                   // 已启动的线程数
+    pthread_mutex_t lock;           // 保护等待队列
+    pthread_cond_t cond;            // 有新任务或需要退出
+    telnet_job_t *head;             // 等待队列头
+    telnet_job_t *tail;             // 等待队列尾
+    int queued;                     // 等待中的任务数
+    int stopping;                   // 线程池正在停止
+} telnet_pool_t;
+
+
+// 把完成的任务压入工作线程的完成栈，栈原来为空时唤醒工作线程
+static void telnets_pool_post(telnet_job_t *job)
+{
+    telnet_server_t *server = job->server;
+    telnet_job_t *head = __atomic_load_n(&server->pool_done, __ATOMIC_RELAXED);
+
+    do
+    {
+        job->next = head;
+    } while (!__atomic_compare_exchange_n(&server->pool_done, &head, job, 1,
+                                          __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+
+    // 栈非空说明之前的任务已经唤醒过，工作线程取栈时会一并取走
+    if (!head)
+    {
+        telnets_event_wake(server);
+    }
+}
+
+// 线程池线程入口
+static void *telnets_pool_main(void *arg)
+{
+    telnet_pool_t *pool = (telnet_pool_t *)arg;
+
+    for (;;)
+    {
+        telnet_cmd_ctx_t ctx;
+        telnet_args_t args;
+        telnet_job_t *job;
+        uint64_t start;
+
+        pthread_mutex_lock(&pool->lock);
+        while (!pool->head && !pool->stopping)
+        {
+            pthread_cond_wait(&pool->cond, &pool->lock);
+        }
+        if (pool->stopping)
+        {
+            pthread_mutex_unlock(&pool->lock);
+            break;
+        }
+        job = pool->head;
+        pool->head = job->next;
+        if (!pool->head)
+        {
+            pool->tail = NULL;
+        }
+        pool->queued--;
+        pthread_mutex_unlock(&pool->lock);
+
+        // 参数切片指向任务中的命令行副本
+        telnets_cmd_parse(job->line, job->len, &args);
+
+        ctx.server = job->server;
+        ctx.client = NULL;
+        ctx.sink = &job->out;
+        ctx.slot = job->slot;
+
+        start = telnets_now_ns();
+        job->cmd->handler(&ctx, &args);
+        job->run_ns = telnets_now_ns() - start;
+
+        telnets_pool_post(job);
+    }
+
+    telnets_outchunk_cache_release();
+    return NULL;
+}
+
+// 启动命令线程池，未配置线程数时不启动，命令都在事件循环中执行
+int telnets_pool_start(telnet_master_t *master)
+{
+    telnet_pool_t *pool;
+    int threads = master->config.pool_threads;
+
+    if (threads <= 0)
+    {
+        return 0;
+    }
+
+    pool = (telnet_pool_t *)calloc(1, sizeof(telnet_pool_t));
+    if (!pool)
+    {
+        telnets_log_errno("Failed to allocate command pool");
+        return -1;
+    }
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->cond, NULL);
+    master->pool = pool;
+
+    for (int i = 0; i < threads; i++)
+    {
+        int ret = pthread_create(&pool->threads[i], NULL, telnets_pool_main, pool);
+        if (ret != 0)
+        {
+            telnets_log_error("Failed to create command pool thread", ret);
+            telnets_pool_stop(master);
+            return -1;
+        }
+        pool->nthreads++;
+    }
+
+    return 0;
+}
+
+// 停止线程池，须在工作线程退出之后、服务器实例销毁之前调用
+void telnets_pool_stop(telnet_master_t *master)
+{
+    telnet_pool_t *pool = master->pool;
+
+    if (!pool)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->stopping = 1;
+    pthread_cond_broadcast(&pool->cond);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 0; i < pool->nthreads; i++)
+    {
+        pthread_join(pool->threads[i], NULL);
+    }
+
+    // 未执行的任务直接丢弃
+    while (pool->head)
+    {
+        telnet_job_t *job = pool->head;
+        pool->head = job->next;
+        free(job);
+    }
+
+    pthread_cond_destroy(&pool->cond);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool);
+    master->pool = NULL;
+}
+
+// 提交命令，成功后客户端进入等待状态，队列已满或线程池未启用时返回-1
+int telnets_pool_submit(telnet_server_t *server, telnet_client_t *client, const telnet_cmd_t *cmd,
+                        const char *line, int len)
+{
+    telnet_pool_t *pool = server->master ? server->master->pool : NULL;
+    telnet_job_t *job;
+
+    if (!pool)
+    {
+        return -1;
+    }
+
+    job = (telnet_job_t *)malloc(sizeof(telnet_job_t) + len + 1);
+    if (!job)
+    {
+        telnets_log_errno("Failed to allocate command job");
+        return -1;
+    }
+
+    job->next = NULL;
+    job->server = server;
+    job->cmd = cmd;
+    job->slot = client->slot;
+    job->generation = client->generation;
+    job->out.head = NULL;
+    job->out.tail = NULL;
+    job->out.bytes = 0;
+    job->run_ns = 0;
+    job->len = len;
+    memcpy(job->line, line, len);
+    job->line[len] = '\0';
+
+    pthread_mutex_lock(&pool->lock);
+    if (pool->queued >= TELNET_POOL_QUEUE || pool->stopping)
+    {
+        pthread_mutex_unlock(&pool->lock);
+        free(job);
+        return -1;
+    }
+    if (pool->tail)
+    {
+        pool->tail->next = job;
+    }
+    else
+    {
+        pool->head = job;
+    }
+    pool->tail = job;
+    pool->queued++;
+    pthread_cond_signal(&pool->cond);
+    pthread_mutex_unlock(&pool->lock);
+
+    client->cmd_pending = 1;
+    return 0;
+}
+
+// 取出完成栈中的全部任务，按完成顺序排列
+static telnet_job_t *telnets_pool_take(telnet_server_t *server)
+{
+    telnet_job_t *list;
+    telnet_job_t *ordered = NULL;
+
+    if (!__atomic_load_n(&server->pool_done, __ATOMIC_RELAXED))
+    {
+        return NULL;
+    }
+
+    list = __atomic_exchange_n(&server->pool_done, NULL, __ATOMIC_ACQUIRE);
+    while (list)
+    {
+        telnet_job_t *next = list->next;
+        list->next = ordered;
+        ordered = list;
+        list = next;
+    }
+
+    return ordered;
+}
+
+// 事件循环中处理完成的命令：输出交给客户端，再按序处理等待期间缓存的输入
+void telnets_pool_complete(telnet_server_t *server)
+{
+    telnet_job_t *job = telnets_pool_take(server);
+
+    while (job)
+    {
+        telnet_job_t *next = job->next;
+        telnet_client_t *client = telnets_lookup_token(server, TELNET_TOKEN(job->slot, job->generation));
+
+        telnets_hist_record(&server->metrics.cmd_ns, job->run_ns);
+
+        if (client)
+        {
+            telnets_output_splice(client, &job->out);
+            client->cmd_pending = 0;
+            telnets_sched_begin(server);
+            telnets_recv_typeahead(server, job->slot);
+            telnets_sched_end(server);
+        }
+        else
+        {
+            telnets_outq_clear(&job->out);
+        }
+
+        free(job);
+        job = next;
+    }
+}
+
+// 销毁服务器实例前丢弃未处理的完成任务
+void telnets_pool_discard(telnet_server_t *server)
+{
+    telnet_job_t *job = telnets_pool_take(server);
+
+    while (job)
+    {
+        telnet_job_t *next = job->next;
+        telnets_outq_clear(&job->out);
+        free(job);
+        job = next;
+    }
+}
@@ -15,14 +15,14 @@ int set_tcp_nonblocking(int sockfd)
     int flags = fcntl(sockfd, F_GETFL, 0);
     if (flags == -1) 
     {
-        perror("fcntl F_GETFL");
+        telnets_log_errno("fcntl F_GETFL");
         return -1;
     }
     
     flags |= O_NONBLOCK;
     if (fcntl(sockfd, F_SETFL, flags) == -1) 
     {
-        perror("fcntl F_SETFL");
+        telnets_log_errno("fcntl F_SETFL");
         return -1;
     }
     
@@ -30,144 +30,351 @@ int set_tcp_nonblocking(int sockfd)
 }
 
 
-// 处理新客户端连接
-void telnets_handle_new_connection(telnet_server_t *server) 
+// 连接数已满时停止关注监听socket，新连接留在内核监听队列中，
+// 不再逐个accept后立即关闭
+static void telnets_accept_pause(telnet_server_t *server) 
+{
+    if (server->accept_paused) 
+    {
+        return;
+    }
+    
+    if (server->listen_sockfd >= 0) 
+    {
+        telnets_event_del(server, server->listen_sockfd);
+    }
+    if (server->tls_listen_sockfd >= 0) 
+    {
+        telnets_event_del(server, server->tls_listen_sockfd);
+    }
+    server->accept_paused = 1;
+    server->accept_pending = 0;
+    TELNET_METRIC_ADD(server->metrics.accept_pauses, 1);
+    telnets_log_msg(TELNET_LOG_WARN, "Max clients reached (%d), pausing accept", server->max_clients);
+}
+
+
+// 有空闲槽位后重新关注监听socket，边缘触发下注册时会报告已在队列中的连接
+static void telnets_accept_resume(telnet_server_t *server) 
+{
+    if (!server->accept_paused || !server->running) 
+    {
+        return;
+    }
+    
+    // 内存传输没有监听socket，由telnets_mem_dispatch检查暂停标志
+    if (server->listen_sockfd >= 0 && telnets_event_add(server, server->listen_sockfd, TELNET_LISTEN_TOKEN) < 0) 
+    {
+        return;
+    }
+    if (server->tls_listen_sockfd >= 0) 
+    {
+        telnets_event_add(server, server->tls_listen_sockfd, TELNET_TLS_LISTEN_TOKEN);
+    }
+    server->accept_paused = 0;
+    telnets_log_msg(TELNET_LOG_INFO, "Accept resumed");
+}
+
+
+// 从transport对应的监听socket接受一个新连接，返回0表示已处理，-1表示没有更多待接受的连接
+static int telnets_accept_one(telnet_server_t *server, int transport) 
 {
     struct sockaddr_in client_addr;
-    socklen_t addr_len = sizeof(client_addr);
     int new_sockfd;
     
-    // 接受新连接
-    new_sockfd = accept(server->listen_sockfd, (struct sockaddr *)&client_addr, &addr_len);
+    new_sockfd = telnet_transports[transport]->accept(server, &client_addr);
     if (new_sockfd < 0) 
     {
-        perror("Accept failed");
-        return;
+        // 连接在accept前被对端重置，继续接受下一个
+        if (errno == ECONNABORTED) 
+        {
+            return 0;
+        }
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) 
+        {
+            telnets_log_errno("Accept failed");
+        }
+        return -1;
     }
+    
+    telnets_accept_client(server, new_sockfd, &client_addr, transport);
+    return 0;
+}
 
-    // 设置客户端 socket 为非阻塞模式
-    if (set_tcp_nonblocking(new_sockfd) < 0) 
+
+// 接纳一个已接受的非阻塞连接，epoll和io_uring后端共用，返回槽位索引，拒绝时返回-1
+int telnets_accept_client(telnet_server_t *server, int sockfd, struct sockaddr_in *addr, int transport_id) 
+{
+    const telnet_transport_t *transport = telnet_transports[transport_id];
+    
+    // 连接数已满时直接拒绝
+    if (server->client_count >= server->max_clients) 
     {
-        perror("Failed to set non-blocking on client socket");
-        close(new_sockfd);
-        return;
+        telnets_log_write(TELNET_LOG_WARN, TELNET_EV_REJECT, addr, -1, 0, "max clients reached");
+        TELNET_METRIC_ADD(server->metrics.rejects_full, 1);
+        transport->close(server, sockfd);
+        telnets_accept_pause(server);
+        return -1;
     }
     
-    // 查找可用的客户端槽位
-    int client_index = telnets_find_available_slot(server);
-    if (client_index < 0) 
+    // 同一来源IP连接过快时拒绝
+    if (!telnets_ratelimit_allow(server, addr)) 
     {
-        printf("Max clients reached. Rejecting connection from %s\n", 
-               inet_ntoa(client_addr.sin_addr));
-        close(new_sockfd);
-        return;
+        telnets_log_write(TELNET_LOG_WARN, TELNET_EV_REJECT, addr, -1, 0, "rate limited");
+        TELNET_METRIC_ADD(server->metrics.rejects_rate, 1);
+        transport->close(server, sockfd);
+        return -1;
     }
     
     // 添加新客户端
-    if (telnets_add_client(server, new_sockfd, &client_addr) < 0) 
+    int client_index = telnets_add_client(server, sockfd, addr, transport_id);
+    if (client_index < 0) 
     {
-        close(new_sockfd);
-        return;
+        transport->close(server, sockfd);
+        return -1;
+    }
+    
+    TELNET_METRIC_ADD(server->metrics.accepts, 1);
+    
+    telnets_log_write(TELNET_LOG_INFO, TELNET_EV_CONNECT, addr, client_index, 0, NULL);
+    
+    // 达到上限后停止接受，其余连接留在监听队列中等待空闲槽位
+    if (server->client_count >= server->max_clients) 
+    {
+        telnets_accept_pause(server);
     }
     
-    printf("New client connected: %s:%d (slot %d)\n",
-           inet_ntoa(client_addr.sin_addr),
-           ntohs(client_addr.sin_port),
-           client_index);
+    // TLS会话在握手完成后由传输层开始
+    if (transport_id != TELNET_TRANSPORT_TLS) 
+    {
+        telnets_session_start(server, telnets_get_client(server, client_index));
+    }
+    return client_index;
+}
+
+
+// 开始Telnet会话：发起选项协商，等待应答期间按服务器回显处理，并发送欢迎消息
+void telnets_session_start(telnet_server_t *server, telnet_client_t *client) 
+{
+    telnets_option_start(client);
+    telnets_timer_arm(&server->timers, &client->timers[TELNET_TIMER_NEGOTIATION], server->now_ms,
+                      TELNET_NEGOTIATION_TIMEOUT * 1000);
     
-    // 发送欢迎消息
-    telnets_welcome(new_sockfd);
-    telnets_send_prompt(new_sockfd);
+    telnets_welcome(client);
+    telnets_send_prompt(client);
 }
 
 
-// 添加新客户端
-int telnets_add_client(telnet_server_t *server, int sockfd, struct sockaddr_in *addr) 
+// 一直accept直到EAGAIN，每轮最多TELNET_ACCEPT_BATCH个，避免连接风暴期间已有会话得不到处理
+static void telnets_accept_batch(telnet_server_t *server, int transport) 
 {
-    int index = telnets_find_available_slot(server);
-    if (index < 0) {
-        return -1;
+    int accepted = 0;
+    
+    while (!server->accept_paused && telnets_accept_one(server, transport) == 0) 
+    {
+        if (++accepted >= TELNET_ACCEPT_BATCH) 
+        {
+            // 边缘触发不会再次通知，由事件循环在下一轮继续
+            server->accept_pending = server->edge_triggered;
+            break;
+        }
     }
+}
+
+
+// 处理新客户端连接
+void telnets_handle_new_connection(telnet_server_t *server) 
+{
+    telnets_accept_batch(server, server->transport);
+}
+
+
+// 处理TLS监听端口的新连接
+void telnets_handle_tls_connection(telnet_server_t *server) 
+{
+    telnets_accept_batch(server, TELNET_TRANSPORT_TLS);
+}
+
+
+// 空闲超时秒数，登录完成前使用较短的超时，未登录的连接不会长期占用槽位
+int telnets_idle_timeout(const telnet_server_t *server, const telnet_client_t *client) 
+{
+    int idle_timeout = server->config->idle_timeout;
     
-    // 分配客户端结构
-    telnet_client_t *client = (telnet_client_t *)malloc(sizeof(telnet_client_t));
+    if (client->cold->authenticated != TELNET_AUTH_OK && idle_timeout > TELNET_AUTH_TIMEOUT) 
+    {
+        return TELNET_AUTH_TIMEOUT;
+    }
+    return idle_timeout;
+}
+
+
+// 添加新客户端，返回槽位索引
+int telnets_add_client(telnet_server_t *server, int sockfd, struct sockaddr_in *addr, int transport) 
+{
+    // 从预分配的客户端表取结构，热数据已重置
+    telnet_client_t *client = telnets_table_alloc(server, sockfd);
     if (!client) {
-        perror("Failed to allocate client memory");
         return -1;
     }
+    int index = client->slot;
     
-    // 初始化客户端结构
-    memset(client, 0, sizeof(telnet_client_t));
-    client->sockfd = sockfd;
-    memcpy(&client->addr, addr, sizeof(struct sockaddr_in));
-    client->last_active = get_current_time();
-    client->authenticated = 0;
-    client->telnet_state = 0;
-    memset(client->username, 0, sizeof(client->username));
-    memset(client->buffer, 0, sizeof(client->buffer));
-    client->buffer_len = 0;
+    // 冷数据只填写需要初值的字段，缓冲区指针在归还时已清空
+    telnet_client_cold_t *cold = client->cold;
+    memcpy(&cold->addr, addr, sizeof(struct sockaddr_in));
+    cold->connected_at = get_current_time();
+    cold->win_width = 0;
+    cold->win_height = 0;
+    client->bcast_policy = (uint8_t)server->config->bcast_policy;
+    client->transport = (uint8_t)transport;
+    client->last_active = cold->connected_at;
+    telnets_sched_reset(client);
     
-    // 保存到服务器
-    server->clients[index] = client;
+    // 启用认证时先进入登录阶段
+    if (telnets_auth_begin(server, client) < 0) {
+        telnets_table_free(server, index);
+        return -1;
+    }
     
-    // 更新最大描述符
-    if (sockfd > server->max_fd) {
-        server->max_fd = sockfd;
+    // 注册到epoll，之后无需每轮重新添加；不经过事件后端的传输层自己记录关注的事件
+    if (TELNET_TRANSPORT(client)->watch) {
+        if (TELNET_TRANSPORT(client)->watch(server, client, EPOLLIN | EPOLLRDHUP) < 0) {
+            telnets_auth_release(server, client);
+            telnets_table_free(server, index);
+            return -1;
+        }
+    }
+    else if (telnets_event_add(server, sockfd, TELNET_TOKEN(index, client->generation)) < 0) {
+        telnets_auth_release(server, client);
+        telnets_table_free(server, index);
+        return -1;
     }
+    client->events = EPOLLIN | EPOLLRDHUP;
     
-    return 0;
+    // 启动空闲定时器，之后的活动只更新last_active，到期时再检查
+    telnets_timer_arm(&server->timers, &client->timers[TELNET_TIMER_IDLE], server->now_ms,
+                      (uint64_t)telnets_idle_timeout(server, client) * 1000);
+    
+    return index;
+}
+
+
+// 归还会话借用的缓冲区
+void telnets_session_release(telnet_server_t *server, telnet_client_t *client) 
+{
+    telnets_line_release(client);
+    telnets_sb_release(client);
+    if (client->cold->authenticated != TELNET_AUTH_OK)
+    {
+        telnets_buf_wipe(server, client->cold->typeahead, client->cold->typeahead_class);
+    }
+    else
+    {
+        telnets_buf_free(server, client->cold->typeahead, client->cold->typeahead_class);
+    }
+    client->cold->typeahead = NULL;
+    client->typeahead_len = 0;
+    telnets_auth_release(server, client);
+    telnets_mccp_end(client, 0);
 }
 
 
 // 移除客户端
 void telnets_remove_client(telnet_server_t *server, int client_index) 
 {
-    if (client_index < 0 || client_index >= server->max_clients) 
-    {
+    telnet_client_t *client = telnets_get_client(server, client_index);
+    if (!client) {
         return;
     }
     
-    telnet_client_t *client = server->clients[client_index];
-    if (!client) {
+    telnets_log_write(TELNET_LOG_INFO, TELNET_EV_DISCONNECT, &client->cold->addr, client_index, 0, NULL);
+    
+    // 取消所有定时器
+    for (int i = 0; i < TELNET_TIMER_MAX; i++) 
+    {
+        telnets_timer_cancel(&server->timers, &client->timers[i]);
+    }
+    
+    // 尽力发出剩余输出（告别、超时消息等），压缩的输出可能还在压缩流中
+    if (client->outq.head || client->compress == TELNET_MCCP_ON) 
+    {
+        telnets_flush_client(server, client);
+    }
+    
+    // 从事件后端注销并关闭连接，io_uring还有发送中的请求时由请求发完后关闭
+    if (!TELNET_TRANSPORT(client)->watch) 
+    {
+        telnets_event_del(server, client->sockfd);
+    }
+    if (!telnets_uring_defer_close(server, client)) 
+    {
+        TELNET_TRANSPORT(client)->close(server, client->sockfd);
+    }
+    
+    // 归还槽位，客户端结构留在表中复用
+    telnets_table_free(server, client_index);
+    telnets_outq_clear(&client->outq);
+    telnets_session_release(server, client);
+    
+    if (server->accept_paused && server->client_count < server->max_clients) 
+    {
+        telnets_accept_resume(server);
+    }
+}
+
+
+// 空闲定时器到期处理
+static void telnets_idle_expired(telnet_server_t *server, telnet_client_t *client) 
+{
+    int idle_timeout = telnets_idle_timeout(server, client);
+    
+    // 期间有过活动则按剩余时间重新启动，活动路径无需操作定时器
+    if (!is_telnet_client_timeout(client, idle_timeout)) 
+    {
+        time_t remaining = client->last_active + idle_timeout - get_current_time();
+        telnets_timer_arm(&server->timers, &client->timers[TELNET_TIMER_IDLE], server->now_ms,
+                          (uint64_t)remaining * 1000);
         return;
     }
     
-    printf("Client disconnected: %s:%d (slot %d)\n",
-           inet_ntoa(client->addr.sin_addr),
-           ntohs(client->addr.sin_port),
-           client_index);
+    telnets_log_write(TELNET_LOG_INFO, TELNET_EV_TIMEOUT, &client->cold->addr, client->slot, 0, NULL);
+    
+    TELNET_METRIC_ADD(server->metrics.timeouts, 1);
     
-    // 关闭socket
-    close(client->sockfd);
+    // 发送超时消息
+    const char *timeout_msg = "\r\nConnection timed out due to inactivity.\r\n";
+    telnets_output_str(client, timeout_msg);
     
-    // 释放内存
-    free(client);
-    server->clients[client_index] = NULL;
+    // 移除客户端
+    telnets_remove_client(server, client->slot);
 }
 
 
-// 清理超时客户端
-void telnets_cleanup_clients(telnet_server_t *server) 
+// 定时器到期回调
+static void telnets_timer_expired(telnet_timer_t *timer, void *arg) 
 {
-    for (int i = 0; i < server->max_clients; i++) 
-    {
-        if (server->clients[i] != NULL) {
-            if (is_telnet_client_timeout(server->clients[i])) 
-            {
-                printf("Client %s:%d timed out (slot %d)\n",
-                       inet_ntoa(server->clients[i]->addr.sin_addr),
-                       ntohs(server->clients[i]->addr.sin_port),
-                       i);
-                
-                // 发送超时消息
-                const char *timeout_msg = "\r\nConnection timed out due to inactivity.\r\n";
-                send(server->clients[i]->sockfd, timeout_msg, strlen(timeout_msg), 0);
-                
-                // 移除客户端
-                telnets_remove_client(server, i);
-            }
-        }
+    telnet_server_t *server = (telnet_server_t *)arg;
+    telnet_client_t *client = (telnet_client_t *)timer->data;
+    
+    switch (timer->type) 
+    {
+        case TELNET_TIMER_IDLE:
+            telnets_idle_expired(server, client);
+            break;
+        case TELNET_TIMER_NEGOTIATION:
+            telnets_option_timeout(client);
+            break;
+        case TELNET_TIMER_THROTTLE:
+            telnets_sched_throttle_expired(server);
+            break;
+        default:
+            break;
     }
 }
 
 
+// 清理超时客户端，只处理到期的定时器
+void telnets_cleanup_clients(telnet_server_t *server) 
+{
+    telnets_timer_advance(&server->timers, server->now_ms, telnets_timer_expired, server);
+}
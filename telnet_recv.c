@@ -10,101 +10,164 @@
 
 
 
-// 处理客户端命令
-void telnets_command_proc(telnet_client_t *client, const char *command) 
+// 追加一个子协商字节，超过TELNET_SB_MAX的部分丢弃
+static void telnets_sb_put(telnet_client_t *client, unsigned char c)
 {
-    char cmd[128];
-    char arg[TELNET_BUFFER_SIZE];
-    
-    // 解析命令和参数
-    int parsed = sscanf(command, "%s %[^\n]", cmd, arg);
-    
-    if (parsed == 0) {
-        return;
+    telnet_client_cold_t *cold = client->cold;
+
+    if (!cold->sb_buf)
+    {
+        cold->sb_buf = (unsigned char *)telnets_buf_alloc(client->server, TELNET_SB_MAX, &cold->sb_class);
+        if (!cold->sb_buf)
+        {
+            return;
+        }
     }
-    
-    // 转换为小写以便比较
-    for (int i = 0; cmd[i]; i++) 
+
+    if (cold->sb_len < TELNET_SB_MAX)
     {
-        cmd[i] = tolower(cmd[i]);
+        cold->sb_buf[cold->sb_len++] = c;
     }
-    
-    // 处理命令
-    if (strcmp(cmd, "help") == 0) 
+}
+
+// 归还子协商缓冲区
+void telnets_sb_release(telnet_client_t *client)
+{
+    telnet_client_cold_t *cold = client->cold;
+
+    if (cold->sb_buf)
     {
-        const char *help_msg = 
-            "\r\nAvailable commands:\r\n"
-            "  help     - Show this help message\r\n"
-            "  time     - Show current time\r\n"
-            "  echo <msg> - Echo back the message\r\n"
-            "  clear    - Clear the screen\r\n"
-            "  quit     - Disconnect\r\n"
-            "  clients  - Show connected clients\r\n"
-            "  stats    - Show server statistics\r\n";
-        send(client->sockfd, help_msg, strlen(help_msg), 0);
+        telnets_buf_free(client->server, (char *)cold->sb_buf, cold->sb_class);
+        cold->sb_buf = NULL;
+        cold->sb_len = 0;
     }
-    else if (strcmp(cmd, "time") == 0) 
+}
+
+// 登录完成前的输入可能含密码，所在缓冲区换级或归还前清零
+static int telnets_input_secret(const telnet_client_t *client)
+{
+    return client->cold->authenticated != TELNET_AUTH_OK;
+}
+
+// 保证行缓冲区能容纳size字节
+static int telnets_line_reserve(telnet_client_t *client, size_t size)
+{
+    telnet_client_cold_t *cold = client->cold;
+    char *buf = telnets_buf_grow(client->server, cold->line, &cold->line_class, client->buffer_len, size,
+                                 telnets_input_secret(client));
+
+    if (!buf)
     {
-        time_t now = time(NULL);
-        struct tm *tm_info = localtime(&now);
-        char time_str[64];
-        strftime(time_str, sizeof(time_str), "%Y-%m-%d %H:%M:%S", tm_info);
-        
-        char response[128];
-        snprintf(response, sizeof(response), "\r\nCurrent time: %s\r\n", time_str);
-        send(client->sockfd, response, strlen(response), 0);
+        return -1;
     }
-    else if (strcmp(cmd, "echo") == 0) 
+
+    cold->line = buf;
+    return 0;
+}
+
+// 归还行缓冲区，wipe非0时先清零
+static void telnets_line_free(telnet_client_t *client, int wipe)
+{
+    telnet_client_cold_t *cold = client->cold;
+
+    if (cold->line)
     {
-        if (strlen(arg) > 0) {
-            char response[TELNET_BUFFER_SIZE + 64];
-            snprintf(response, sizeof(response), "\r\nEcho: %s\r\n", arg);
-            send(client->sockfd, response, strlen(response), 0);
-        } else {
-            const char *error_msg = "\r\nUsage: echo <message>\r\n";
-            send(client->sockfd, error_msg, strlen(error_msg), 0);
+        if (wipe)
+        {
+            telnets_buf_wipe(client->server, cold->line, cold->line_class);
         }
+        else
+        {
+            telnets_buf_free(client->server, cold->line, cold->line_class);
+        }
+        cold->line = NULL;
     }
-    else if (strcmp(cmd, "clear") == 0) {
-        // 发送ANSI清屏序列
-        const char *clear_screen = "\033[2J\033[H";
-        send(client->sockfd, clear_screen, strlen(clear_screen), 0);
-    }
-    else if (strcmp(cmd, "quit") == 0 || strcmp(cmd, "exit") == 0) {
-        const char *bye_msg = "\r\nGoodbye!\r\n";
-        send(client->sockfd, bye_msg, strlen(bye_msg), 0);
+    client->buffer_len = 0;
+}
 
-        // 客户端将在下次循环中被移除
-        //telnets_remove_client(telnet_server_t *server, int client_index) 
-        client->closed = 1;
+// 归还行缓冲区，没有未完成的行时不占用缓冲区
+void telnets_line_release(telnet_client_t *client)
+{
+    telnets_line_free(client, telnets_input_secret(client));
+}
 
+// 处理一个字节的Telnet协议状态，返回1表示该字节是普通数据，0表示属于命令序列
+int telnets_telnet_byte(telnet_client_t *client, unsigned char c) 
+{
+    switch (client->telnet_state) 
+    {
+        case 0:  // 正常状态
+            if (c == TELNET_IAC) 
+            {
+                client->telnet_state = 1;  // 进入命令状态
+                return 0;
+            }
+            return 1;
+            
+        case 1:  // 接收到IAC
+            if (c == TELNET_WILL || c == TELNET_WONT || 
+                c == TELNET_DO || c == TELNET_DONT) 
+            {
+                client->telnet_verb = c;
+                client->telnet_state = 2;  // 需要读取选项
+            } 
+            else if (c == TELNET_SB) 
+            {
+                // 子协商缓冲区在收到第一个字节时借用
+                client->cold->sb_len = 0;
+                client->telnet_state = 3;  // 子协商开始
+            } 
+            else if (c == TELNET_IAC) 
+            {
+                // 双IAC，表示数据0xFF
+                client->telnet_state = 0;
+                return 1;
+            } 
+            else 
+            {
+                client->telnet_state = 0;  // 其他命令，返回正常状态
+            }
+            return 0;
+            
+        case 2:  // 读取选项
+            client->telnet_state = 0;
+            telnets_option_recv(client, client->telnet_verb, c);
+            return 0;
+            
+        case 3:  // 子协商
+            if (c == TELNET_IAC) 
+            {
+                client->telnet_state = 4;  // 可能子协商结束
+            }
+            else 
+            {
+                telnets_sb_put(client, c);
+            }
+            return 0;
+            
+        case 4:  // 子协商中的IAC
+            if (c == TELNET_SE) 
+            {
+                client->telnet_state = 0;  // 子协商结束
+                if (client->cold->sb_buf) 
+                {
+                    telnets_option_subneg(client, client->cold->sb_buf, client->cold->sb_len);
+                    telnets_sb_release(client);
+                }
+            } 
+            else if (c == TELNET_IAC)
+            {
+                client->telnet_state = 3;  // 双IAC，继续子协商
+                telnets_sb_put(client, c);
+            } 
+            else 
+            {
+                client->telnet_state = 3;  // 其他情况
+            }
+            return 0;
     }
-    else if (strcmp(cmd, "clients") == 0) {
-        // 这里可以添加显示连接客户端的功能
-        const char *msg = "\r\nClient list functionality not implemented yet.\r\n";
-        send(client->sockfd, msg, strlen(msg), 0);
-    }
-    else if (strcmp(cmd, "stats") == 0) {
-        time_t uptime = get_current_time() - client->last_active;
-        char response[256];
-        snprintf(response, sizeof(response), 
-                "\r\nClient statistics:\r\n"
-                "  IP: %s\r\n"
-                "  Port: %d\r\n"
-                "  Connected for: %ld seconds\r\n",
-                inet_ntoa(client->addr.sin_addr),
-                ntohs(client->addr.sin_port),
-                uptime);
-        send(client->sockfd, response, strlen(response), 0);
-    }
-    else {
-        char response[256];
-        snprintf(response, sizeof(response), "\r\nUnknown command: %s\r\n", cmd);
-        send(client->sockfd, response, strlen(response), 0);
-        
-        const char *help_hint = "Type 'help' for available commands.\r\n";
-        send(client->sockfd, help_hint, strlen(help_hint), 0);
-    }
+    
+    return 0;
 }
 
 
@@ -114,120 +177,95 @@ void telnets_handle_commands(telnet_client_t *client, const char *data, int len)
 {
     for (int i = 0; i < len; i++) 
     {
-        unsigned char c = data[i];
-        
-        switch (client->telnet_state) 
-        {
-            case 0:  // 正常状态
-                if (c == TELNET_IAC) 
-                {
-                    client->telnet_state = 1;  // 进入命令状态
-                }
-                break;
-                
-            case 1:  // 接收到IAC
-                if (c == TELNET_WILL || c == TELNET_WONT || 
-                    c == TELNET_DO || c == TELNET_DONT) 
-                {
-                    client->telnet_state = 2;  // 需要读取选项
-                } 
-                else if (c == TELNET_SB) 
-                {
-                    client->telnet_state = 3;  // 子协商开始
-                } 
-                else if (c == TELNET_IAC) 
-                {
-                    // 双IAC，表示数据0xFF
-                    client->telnet_state = 0;
-                } 
-                else 
-                {
-                    client->telnet_state = 0;  // 其他命令，返回正常状态
-                }
-                break;
-                
-            case 2:  // 读取选项
-                // 这里可以添加选项处理逻辑
-                client->telnet_state = 0;
-                break;
-                
-            case 3:  // 子协商
-                if (c == TELNET_IAC) 
-                {
-                    client->telnet_state = 4;  // 可能子协商结束
-                }
-                break;
-                
-            case 4:  // 子协商中的IAC
-                if (c == TELNET_SE) 
-                {
-                    client->telnet_state = 0;  // 子协商结束
-                } 
-                else if (c == TELNET_IAC)
-                {
-                    client->telnet_state = 3;  // 双IAC，继续子协商
-                } 
-                else 
-                {
-                    client->telnet_state = 3;  // 其他情况
-                }
-                break;
-        }
+        telnets_telnet_byte(client, (unsigned char)data[i]);
     }
 }
 
 
 
-// 处理客户端数据
-void telnets_recv_data_proc(telnet_server_t *server, int client_index) 
+// 缓存命令执行期间收到的输入，超过上限后由暂停读取限制继续增长
+static int telnets_typeahead_save(telnet_client_t *client, const char *data, size_t len)
 {
-    telnet_client_t *client = server->clients[client_index];
-    if (!client) 
+    char *buf;
+
+    if (len == 0)
     {
-        return;
+        return 0;
     }
-    
-    char buffer[TELNET_BUFFER_SIZE];
-    memset(buffer, 0, sizeof(buffer));
-    
-    // 接收数据
-    int bytes_received = recv(client->sockfd, buffer, sizeof(buffer) - 1, 0);
-    
-    if (bytes_received <= 0) 
+
+    buf = telnets_buf_grow(client->server, client->cold->typeahead, &client->cold->typeahead_class,
+                           client->typeahead_len, client->typeahead_len + len, telnets_input_secret(client));
+    if (!buf)
     {
-        // 连接关闭或错误
-        if (bytes_received == 0) 
-        {
-            printf("Client %s:%d disconnected (slot %d)\n",
-                   inet_ntoa(client->addr.sin_addr),
-                   ntohs(client->addr.sin_port),
-                   client_index);
-        } 
-        else 
-        {
-            perror("Recv error");
-        }
-        
-        telnets_remove_client(server, client_index);
-        return;
+        telnets_log_msg(TELNET_LOG_ERROR, "Type-ahead buffer full, input dropped");
+        return -1;
     }
+    client->cold->typeahead = buf;
+
+    memcpy(client->cold->typeahead + client->typeahead_len, data, len);
+    client->typeahead_len += (int)len;
+    return 0;
+}
+
+
+// 回显输入的字符，输入密码时不回显
+static int telnets_echo_input(telnet_client_t *client)
+{
+    return telnets_option_server_echo(client) && client->cold->authenticated != TELNET_AUTH_PASS;
+}
+
+
+// 处理一次接收到的数据，返回-1表示客户端已被移除
+// 单次遍历：可打印字符段整段拷贝和回显，只在特殊字节处运行协议状态机和行编辑；
+// 本函数只做协议解析和行编辑，输出留在输出队列，不读写socket，微基准直接调用
+int telnets_recv_process(telnet_server_t *server, int client_index, char *buffer, int bytes_received) 
+{
+    telnet_client_t *client = telnets_get_client(server, client_index);
+    const unsigned char *data = (const unsigned char *)buffer;
+    size_t len = (size_t)bytes_received;
+    size_t i = 0;
     
     // 更新最后活动时间
     client->last_active = get_current_time();
     
-    // 处理Telnet命令
-    telnets_handle_commands(client, buffer, bytes_received);
-    
-    // 处理实际数据
-    for (int i = 0; i < bytes_received; i++) 
+    while (i < len) 
     {
-        // 忽略Telnet命令序列
-        if (client->telnet_state != 0) 
+        // 普通状态下先找出连续的可打印字符
+        if (client->telnet_state == 0) 
         {
-            continue;
+            size_t run = telnets_scan_printable(data + i, len - i);
+            if (run > 0) 
+            {
+                size_t room = (size_t)server->config->line_max - client->buffer_len;
+                size_t n = run < room ? run : room;
+                
+                // 超过最大行长度的字符丢弃，不回显
+                if (n > 0 && telnets_line_reserve(client, client->buffer_len + n) < 0) 
+                {
+                    n = 0;
+                }
+                if (n > 0) 
+                {
+                    memcpy(client->cold->line + client->buffer_len, data + i, n);
+                    client->buffer_len += n;
+                    if (telnets_echo_input(client)) 
+                    {
+                        telnets_output(client, (const char *)data + i, n);
+                    }
+                }
+                
+                i += run;
+                continue;
+            }
         }
         
-        char c = buffer[i];
+        unsigned char c = data[i++];
+        
+        // 处理Telnet命令序列
+        if (!telnets_telnet_byte(client, c)) 
+        {
+            continue;
+        }
         
         // 处理回退键
         if (c == 127 || c == 8) 
@@ -235,11 +273,16 @@ void telnets_recv_data_proc(telnet_server_t *server, int client_index)
             // Backspace or Delete
             if (client->buffer_len > 0) 
             {
-                client->buffer_len--;
+                if (--client->buffer_len == 0) 
+                {
+                    telnets_line_release(client);
+                }
 
                 // 发送退格序列
-                const char *backspace = "\b \b";
-                send(client->sockfd, backspace, strlen(backspace), 0);
+                if (telnets_echo_input(client)) 
+                {
+                    telnets_output(client, "\b \b", 3);
+                }
             }
             continue;
         }
@@ -247,41 +290,239 @@ void telnets_recv_data_proc(telnet_server_t *server, int client_index)
         // 处理回车换行
         if (c == '\r' || c == '\n') 
         {
+            // 本轮命令预算或命令令牌用完，从行结束符开始留到以后处理
+            if (client->buffer_len > 0 && !telnets_sched_cmd_allow(client)) 
+            {
+                telnets_typeahead_save(client, buffer + i - 1, len - i + 1);
+                return 0;
+            }
+            
             if (client->buffer_len > 0) 
             {
-                client->buffer[client->buffer_len] = '\0';
-                
+                int secret = telnets_input_secret(client);   // 密码行处理中可能登录完成，按处理前的状态清零
+
                 // 回显命令
-                send(client->sockfd, "\r\n", 2, 0);
+                if (telnets_option_server_echo(client)) 
+                {
+                    telnets_output(client, "\r\n", 2);
+                }
                 
-                // 处理命令
-                telnets_command_proc(client, client->buffer);
+                // 登录完成前的一行是用户名或密码，之后才是命令
+                if (secret) 
+                {
+                    telnets_auth_line(server, client, client->cold->line, client->buffer_len);
+                }
+                else 
+                {
+                    telnets_command_proc(server, client, client->cold->line, client->buffer_len);
+                }
                 
-                // 重置缓冲区
-                memset(client->buffer, 0, sizeof(client->buffer));
-                client->buffer_len = 0;
+                // 行已处理，归还缓冲区
+                telnets_line_free(client, secret);
             } 
-            else 
+            else if (client->cold->authenticated == TELNET_AUTH_OK) 
             {
-                // 空行，只发送新提示符
-                telnets_send_prompt(client->sockfd);
+                // 空行，只发送新提示符；登录阶段忽略空行，CR LF不会重复提示
+                telnets_send_prompt(client);
             }
 
             if(client->closed) {
                 telnets_remove_client(server, client_index);
-                return;
+                return -1;
+            }
+            
+            // 命令交给线程池后，之后的输入等命令完成再处理，保证输出顺序
+            if (client->cmd_pending) 
+            {
+                telnets_typeahead_save(client, buffer + i, len - i);
+                return 0;
             }
             continue;
         }
         
-        // 处理普通字符
-        if (client->buffer_len < (int)sizeof(client->buffer) - 1 && isprint(c)) 
+        // 其他控制字符忽略
+    }
+    
+    return 0;
+}
+
+
+// 处理收到的数据，epoll和io_uring后端共用
+// 返回0继续读取，1表示输出积压需暂停读取，-1表示客户端已被移除
+int telnets_recv_input(telnet_server_t *server, int client_index, char *buffer, int len) 
+{
+    telnet_client_t *client = telnets_get_client(server, client_index);
+    
+    TELNET_METRIC_ADD(server->metrics.bytes_in, len);
+    telnets_sched_charge(client, (size_t)len);
+    
+    if (client->cmd_pending || client->typeahead_len > 0) 
+    {
+        // 等待命令完成或还有留到以后处理的输入时只缓存，保证顺序；缓存过多时暂停读取
+        client->last_active = get_current_time();
+        telnets_typeahead_save(client, buffer, len);
+        if (client->typeahead_len >= TELNET_TYPEAHEAD_MAX) 
+        {
+            if (telnets_flush_client(server, client) < 0) 
+            {
+                telnets_log_errno("Send error");
+                telnets_remove_client(server, client_index);
+                return -1;
+            }
+            return client->read_paused ? 1 : 0;
+        }
+        return 0;
+    }
+    
+    if (telnets_recv_process(server, client_index, buffer, len) < 0) 
+    {
+        return -1;
+    }
+    
+    // 输出积压超过高水位时先尝试发送，仍然积压则停止读取，留在内核缓冲区形成TCP背压
+    if (client->outq.bytes >= (size_t)server->config->high_water) 
+    {
+        if (telnets_flush_client(server, client) < 0) 
+        {
+            telnets_log_errno("Send error");
+            telnets_remove_client(server, client_index);
+            return -1;
+        }
+        if (client->read_paused) 
+        {
+            return 1;
+        }
+    }
+    
+    return 0;
+}
+
+
+// 命令完成后处理等待期间缓存的输入，其中的命令可能再次交给线程池，
+// 剩余部分重新缓存；返回-1表示客户端已被移除
+int telnets_recv_typeahead(telnet_server_t *server, int client_index) 
+{
+    telnet_client_t *client = telnets_get_client(server, client_index);
+    char *data = client->cold->typeahead;
+    uint8_t cls = client->cold->typeahead_class;
+    int len = client->typeahead_len;
+    int paused = client->read_paused & TELNET_PAUSE_OUTPUT;
+    int secret = telnets_input_secret(client);   // 处理中可能登录完成，按处理前的状态判断
+    int ret = 0;
+    
+    if (len == 0) 
+    {
+        return 0;
+    }
+    
+    client->cold->typeahead = NULL;
+    client->typeahead_len = 0;
+    
+    if (telnets_recv_process(server, client_index, data, len) < 0) 
+    {
+        ret = -1;
+    }
+    else if (paused && client->typeahead_len < TELNET_TYPEAHEAD_MAX && client->outq.bytes == 0) 
+    {
+        // 因缓存过多暂停的读取在此恢复，有输出时由发送完成后恢复
+        if (telnets_flush_client(server, client) < 0) 
         {
-            client->buffer[client->buffer_len++] = c;
-            // 回显字符
-            send(client->sockfd, &c, 1, 0);
+            telnets_log_errno("Send error");
+            telnets_remove_client(server, client_index);
+            ret = -1;
         }
     }
+    
+    if (secret)
+    {
+        telnets_buf_wipe(server, data, cls);
+    }
+    else
+    {
+        telnets_buf_free(server, data, cls);
+    }
+    return ret;
 }
 
 
+// 连接被对端关闭(err为0)或接收出错
+void telnets_recv_closed(telnet_server_t *server, int client_index, int err) 
+{
+    telnet_client_t *client = telnets_get_client(server, client_index);
+    if (!client) 
+    {
+        return;
+    }
+    
+    // 对端关闭由telnets_remove_client记录断开事件
+    if (err != 0) 
+    {
+        telnets_log_error("Recv error", err);
+    }
+    
+    telnets_remove_client(server, client_index);
+}
+
+
+// 处理客户端数据：先处理上一轮留下的输入，再在本轮预算内读取新输入
+void telnets_recv_data_proc(telnet_server_t *server, int client_index) 
+{
+    telnet_client_t *client = telnets_get_client(server, client_index);
+    if (!client) 
+    {
+        return;
+    }
+    
+    // 读入工作线程的接收暂存区，数据按长度处理，无需清零
+    char *buffer = server->recv_buf;
+    size_t budget = TELNET_READ_BUDGET;
+    
+    telnets_sched_begin(server);
+    
+    if (client->typeahead_len > 0 && !client->cmd_pending && 
+        telnets_recv_typeahead(server, client_index) < 0) 
+    {
+        telnets_sched_end(server);
+        return;
+    }
+    
+    // 边缘触发模式下读到EAGAIN或预算用完为止，水平触发模式每次事件只读一次；
+    // 暂停读取（包括留在就绪队列中）时不再读取
+    while (!client->read_paused) 
+    {
+        size_t want = telnets_sched_read_len(client, budget);
+        if (want == 0) 
+        {
+            break;
+        }
+        
+        // 接收数据
+        int bytes_received = TELNET_TRANSPORT(client)->read(server, client->sockfd, buffer, want);
+        
+        if (bytes_received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) 
+        {
+            // 数据已读完
+            break;
+        }
+        
+        if (bytes_received < 0 && errno == EINTR) 
+        {
+            continue;
+        }
+        
+        if (bytes_received <= 0) 
+        {
+            // 连接关闭或错误
+            telnets_recv_closed(server, client_index, bytes_received == 0 ? 0 : errno);
+            break;
+        }
+        
+        budget -= (size_t)bytes_received;
+        if (telnets_recv_input(server, client_index, buffer, bytes_received) != 0 || !server->edge_triggered) 
+        {
+            break;
+        }
+    }
+    
+    telnets_sched_end(server);
+}
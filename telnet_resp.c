@@ -0,0 +1,357 @@
+/**
+ * @file telnet_resp.c
+ * @brief Telnet服务器响应缓存
+ * @date liuliang 2026-01-25
+ *
+ * 本文件包含固定响应和按秒缓存的时间响应
+ * 欢迎信息、帮助、提示符和未知命令提示在启动时生成，长度已知，工作线程直接发送；
+ * 固定响应可以由响应文件覆盖，文件按[welcome]、[help]、[prompt]、[unknown]、[login]、[password]分节，
+ * 每行内容发送时以\r\n结尾，行内支持\r \n \t \a \e \\转义，行末的\c表示不追加\r\n；
+ * 时间字符串每个工作线程每秒最多格式化一次，避免每次请求调用localtime
+ */
+
+#include "telnet_server.h"
+#include <strings.h>
+
+// 欢迎信息的标题，之后是按注册表生成的命令列表
+static const char telnet_default_banner[] =
+    "\r\n"
+    "========================================\r\n"
+    "   Welcome to WK Telnet Server\r\n"
+    "========================================\r\n";
+
+static const char telnet_default_prompt[] = "\rwktx:##>";
+
+static const char telnet_default_unknown[] = "Type 'help' for available commands.\r\n";
+
+static const char telnet_default_login[] = "\rlogin: ";
+
+static const char telnet_default_password[] = "Password: ";
+
+static const char *telnet_resp_names[TELNET_RESP_COUNT] = {
+    "welcome", "help", "prompt", "unknown", "login", "password"
+};
+
+// 内置响应，welcome和help在启动时按注册表生成
+static const telnet_resp_t telnet_resp_defaults[TELNET_RESP_COUNT] = {
+    [TELNET_RESP_WELCOME] = { telnet_default_banner, sizeof(telnet_default_banner) - 1 },
+    [TELNET_RESP_HELP]    = { "", 0 },
+    [TELNET_RESP_PROMPT]  = { telnet_default_prompt, sizeof(telnet_default_prompt) - 1 },
+    [TELNET_RESP_UNKNOWN] = { telnet_default_unknown, sizeof(telnet_default_unknown) - 1 },
+    [TELNET_RESP_LOGIN]   = { telnet_default_login, sizeof(telnet_default_login) - 1 },
+    [TELNET_RESP_PASSWORD] = { telnet_default_password, sizeof(telnet_default_password) - 1 },
+};
+
+// 启动时生成或从文件读取的响应，data为NULL时使用内置响应
+static telnet_resp_t telnet_resps[TELNET_RESP_COUNT];
+static char *telnet_resp_owned[TELNET_RESP_COUNT];
+
+// 响应文件中一节的内容
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+    int present;                    // 文件中出现过这一节
+} telnet_resp_buf_t;
+
+
+static int telnets_resp_buf_put(telnet_resp_buf_t *buf, const char *data, size_t len)
+{
+    if (buf->len + len > buf->cap)
+    {
+        size_t cap = buf->cap ? buf->cap : 256;
+        char *p;
+
+        while (cap < buf->len + len)
+        {
+            cap *= 2;
+        }
+
+        p = (char *)realloc(buf->data, cap);
+        if (!p)
+        {
+            return -1;
+        }
+        buf->data = p;
+        buf->cap = cap;
+    }
+
+    memcpy(buf->data + buf->len, data, len);
+    buf->len += len;
+    return 0;
+}
+
+// 追加一行内容，处理转义
+static int telnets_resp_put_line(telnet_resp_buf_t *buf, const char *line, size_t len)
+{
+    int newline = 1;
+
+    for (size_t i = 0; i < len; i++)
+    {
+        char c = line[i];
+
+        if (c == '\\' && i + 1 < len)
+        {
+            switch (line[++i])
+            {
+                case 'r':  c = '\r'; break;
+                case 'n':  c = '\n'; break;
+                case 't':  c = '\t'; break;
+                case 'a':  c = '\a'; break;
+                case 'e':  c = '\033'; break;
+                case '\\': c = '\\'; break;
+                case 'c':
+                    // 之后的内容忽略，不追加行尾
+                    newline = 0;
+                    i = len;
+                    continue;
+                default:
+                    // 未知转义原样保留
+                    i--;
+                    break;
+            }
+        }
+
+        if (telnets_resp_buf_put(buf, &c, 1) < 0)
+        {
+            return -1;
+        }
+    }
+
+    return newline ? telnets_resp_buf_put(buf, "\r\n", 2) : 0;
+}
+
+// 行是否为已知的节名，返回响应编号，否则返回-1
+static int telnets_resp_section(const char *line, size_t len)
+{
+    if (len < 3 || line[0] != '[' || line[len - 1] != ']')
+    {
+        return -1;
+    }
+
+    for (int i = 0; i < TELNET_RESP_COUNT; i++)
+    {
+        size_t name_len = strlen(telnet_resp_names[i]);
+        if (name_len == len - 2 && strncasecmp(line + 1, telnet_resp_names[i], name_len) == 0)
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+// 读取整个响应文件
+static char *telnets_resp_read(const char *path, size_t *out_len)
+{
+    FILE *fp = fopen(path, "rb");
+    char *data;
+    size_t len;
+
+    if (!fp)
+    {
+        telnets_log_msg(TELNET_LOG_ERROR, "Cannot open response file %s: %s", path, strerror(errno));
+        return NULL;
+    }
+
+    data = (char *)malloc(TELNET_RESP_FILE_MAX + 1);
+    if (!data)
+    {
+        telnets_log_errno("Failed to allocate response file buffer");
+        fclose(fp);
+        return NULL;
+    }
+
+    len = fread(data, 1, TELNET_RESP_FILE_MAX + 1, fp);
+    if (ferror(fp) || len > TELNET_RESP_FILE_MAX)
+    {
+        telnets_log_msg(TELNET_LOG_ERROR, "Cannot read response file %s (limit %d bytes)", path,
+                        TELNET_RESP_FILE_MAX);
+        free(data);
+        fclose(fp);
+        return NULL;
+    }
+
+    fclose(fp);
+    *out_len = len;
+    return data;
+}
+
+// 解析响应文件，各节内容写入bufs
+static int telnets_resp_parse(const char *path, telnet_resp_buf_t *bufs)
+{
+    char *data;
+    size_t len;
+    size_t pos = 0;
+    int current = -1;
+    int lineno = 0;
+    int ret = 0;
+
+    data = telnets_resp_read(path, &len);
+    if (!data)
+    {
+        return -1;
+    }
+
+    while (pos < len && ret == 0)
+    {
+        const char *line = data + pos;
+        const char *eol = (const char *)memchr(line, '\n', len - pos);
+        size_t line_len = eol ? (size_t)(eol - line) : len - pos;
+        int section;
+
+        pos += line_len + (eol ? 1 : 0);
+        lineno++;
+        if (line_len > 0 && line[line_len - 1] == '\r')
+        {
+            line_len--;
+        }
+
+        section = telnets_resp_section(line, line_len);
+        if (section >= 0)
+        {
+            // 重复的节以最后一次为准
+            current = section;
+            bufs[current].len = 0;
+            bufs[current].present = 1;
+            continue;
+        }
+
+        if (current < 0)
+        {
+            // 第一节之前只允许空行和注释
+            if (line_len > 0 && line[0] != '#')
+            {
+                telnets_log_msg(TELNET_LOG_ERROR,
+                                "%s:%d: expected [welcome], [help], [prompt], [unknown], [login] or [password]",
+                                path, lineno);
+                ret = -1;
+            }
+            continue;
+        }
+
+        if (telnets_resp_put_line(&bufs[current], line, line_len) < 0)
+        {
+            telnets_log_errno("Failed to allocate response");
+            ret = -1;
+        }
+    }
+
+    free(data);
+    return ret;
+}
+
+// 追加按注册表生成的命令列表
+static int telnets_resp_put_commands(telnet_resp_buf_t *buf)
+{
+    telnet_outq_t out = { NULL, NULL, 0 };
+    int ret = 0;
+
+    if (telnets_cmd_help_text(&out) < 0)
+    {
+        telnets_log_errno("Failed to build help text");
+        ret = -1;
+    }
+
+    for (telnet_outchunk_t *chunk = out.head; chunk && ret == 0; chunk = chunk->next)
+    {
+        ret = telnets_resp_buf_put(buf, TELNET_CHUNK_DATA(chunk) + chunk->off, chunk->len - chunk->off);
+    }
+    telnets_outq_clear(&out);
+
+    return ret;
+}
+
+// 生成固定响应，须在命令注册完成后、工作线程启动前调用
+int telnets_resp_init(const char *path)
+{
+    telnet_resp_buf_t bufs[TELNET_RESP_COUNT];
+    int ret = 0;
+
+    memset(bufs, 0, sizeof(bufs));
+
+    if (path && telnets_resp_parse(path, bufs) < 0)
+    {
+        ret = -1;
+    }
+
+    // 文件中没有help时按注册表生成
+    if (ret == 0 && !bufs[TELNET_RESP_HELP].present)
+    {
+        bufs[TELNET_RESP_HELP].present = 1;
+        ret = telnets_resp_put_commands(&bufs[TELNET_RESP_HELP]);
+    }
+
+    // 文件中没有welcome时由标题和注册表中的命令列表组成，与help列出的命令一致
+    if (ret == 0 && !bufs[TELNET_RESP_WELCOME].present)
+    {
+        telnet_resp_buf_t *welcome = &bufs[TELNET_RESP_WELCOME];
+
+        welcome->present = 1;
+        if (telnets_resp_buf_put(welcome, telnet_default_banner, sizeof(telnet_default_banner) - 1) < 0 ||
+            telnets_resp_put_commands(welcome) < 0 || telnets_resp_buf_put(welcome, "\r\n", 2) < 0)
+        {
+            ret = -1;
+        }
+    }
+
+    for (int i = 0; i < TELNET_RESP_COUNT; i++)
+    {
+        if (ret < 0 || !bufs[i].present)
+        {
+            free(bufs[i].data);
+            continue;
+        }
+
+        free(telnet_resp_owned[i]);
+        telnet_resp_owned[i] = bufs[i].data;
+        telnet_resps[i].data = bufs[i].data ? bufs[i].data : "";
+        telnet_resps[i].len = bufs[i].len;
+    }
+
+    if (ret == 0 && path)
+    {
+        telnets_log_msg(TELNET_LOG_INFO, "Loaded responses from %s", path);
+    }
+
+    return ret;
+}
+
+// 释放启动时分配的响应，恢复内置响应
+void telnets_resp_free(void)
+{
+    for (int i = 0; i < TELNET_RESP_COUNT; i++)
+    {
+        free(telnet_resp_owned[i]);
+        telnet_resp_owned[i] = NULL;
+        telnet_resps[i].data = NULL;
+        telnet_resps[i].len = 0;
+    }
+}
+
+const telnet_resp_t *telnets_resp_get(int id)
+{
+    return telnet_resps[id].data ? &telnet_resps[id] : &telnet_resp_defaults[id];
+}
+
+// 本工作线程的时间字符串，秒数变化时重新格式化，只能在事件循环中调用
+const telnet_timecache_t *telnets_resp_time(telnet_server_t *server)
+{
+    telnet_timecache_t *tc = &server->timecache;
+    time_t now = telnets_clock_now();
+    struct tm tm_info;
+    char date[24];
+
+    if (tc->sec == now)
+    {
+        return tc;
+    }
+
+    localtime_r(&now, &tm_info);
+    strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", &tm_info);
+    strftime(tc->clock, sizeof(tc->clock), "%H:%M:%S", &tm_info);
+    tc->time_resp_len = snprintf(tc->time_resp, sizeof(tc->time_resp), "\r\nCurrent time: %s\r\n", date);
+    tc->sec = now;
+
+    return tc;
+}
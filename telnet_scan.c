@@ -0,0 +1,127 @@
+/**
+ * @file telnet_scan.c
+ * @brief Telnet服务器输入扫描
+ * @date liuliang 2026-01-25
+ *
+ * 本文件包含输入数据中可打印字符连续段的快速扫描
+ * 可打印字符(0x20-0x7e)之外的字节(IAC、CR/LF、BS/DEL及其他控制字符)需要状态机处理，
+ * 其余字节可以整段拷贝到行缓冲区并整段回显；
+ * x86平台运行时选择AVX2/SSE2实现，其他平台使用标量实现
+ */
+
+#include "telnet_server.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define TELNET_SCAN_X86 1
+#endif
+
+
+// 标量实现
+static size_t telnets_scan_printable_scalar(const unsigned char *data, size_t len)
+{
+    size_t i = 0;
+
+    while (i < len && (unsigned char)(data[i] - 0x20) < 0x5f)
+    {
+        i++;
+    }
+
+    return i;
+}
+
+#ifdef TELNET_SCAN_X86
+
+// SSE2实现，每次检查16字节
+__attribute__((target("sse2")))
+static size_t telnets_scan_printable_sse2(const unsigned char *data, size_t len)
+{
+    // 异或0x80后可用有符号比较判断无符号范围[0x20, 0x7e]
+    const __m128i bias = _mm_set1_epi8((char)0x80);
+    const __m128i low = _mm_set1_epi8((char)(0x20 ^ 0x80));
+    const __m128i high = _mm_set1_epi8((char)(0x7e ^ 0x80));
+    size_t i = 0;
+
+    for (; i + 16 <= len; i += 16)
+    {
+        __m128i v = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(data + i)), bias);
+        __m128i special = _mm_or_si128(_mm_cmplt_epi8(v, low), _mm_cmpgt_epi8(v, high));
+        int mask = _mm_movemask_epi8(special);
+
+        if (mask)
+        {
+            return i + __builtin_ctz((unsigned int)mask);
+        }
+    }
+
+    return i + telnets_scan_printable_scalar(data + i, len - i);
+}
+
+// AVX2实现，每次检查32字节
+__attribute__((target("avx2")))
+static size_t telnets_scan_printable_avx2(const unsigned char *data, size_t len)
+{
+    const __m256i bias = _mm256_set1_epi8((char)0x80);
+    const __m256i low = _mm256_set1_epi8((char)(0x20 ^ 0x80));
+    const __m256i high = _mm256_set1_epi8((char)(0x7e ^ 0x80));
+    size_t i = 0;
+
+    for (; i + 32 <= len; i += 32)
+    {
+        __m256i v = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(data + i)), bias);
+        __m256i special = _mm256_or_si256(_mm256_cmpgt_epi8(low, v), _mm256_cmpgt_epi8(v, high));
+        unsigned int mask = (unsigned int)_mm256_movemask_epi8(special);
+
+        if (mask)
+        {
+            return i + __builtin_ctz(mask);
+        }
+    }
+
+    return i + telnets_scan_printable_sse2(data + i, len - i);
+}
+
+#endif
+
+typedef size_t (*telnet_scan_fn_t)(const unsigned char *data, size_t len);
+
+static telnet_scan_fn_t telnets_scan_impl = NULL;
+static const char *telnets_scan_impl_name = "scalar";
+
+// 根据CPU特性选择实现，启动时在主线程调用一次
+void telnets_scan_init(void)
+{
+    telnets_scan_impl = telnets_scan_printable_scalar;
+    telnets_scan_impl_name = "scalar";
+
+#ifdef TELNET_SCAN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        telnets_scan_impl = telnets_scan_printable_avx2;
+        telnets_scan_impl_name = "avx2";
+    }
+    else if (__builtin_cpu_supports("sse2"))
+    {
+        telnets_scan_impl = telnets_scan_printable_sse2;
+        telnets_scan_impl_name = "sse2";
+    }
+#endif
+}
+
+// 当前使用的实现名称
+const char *telnets_scan_name(void)
+{
+    return telnets_scan_impl_name;
+}
+
+// 返回data开头连续可打印字符的长度
+size_t telnets_scan_printable(const unsigned char *data, size_t len)
+{
+    if (!telnets_scan_impl)
+    {
+        telnets_scan_init();
+    }
+
+    return telnets_scan_impl(data, len);
+}
@@ -0,0 +1,331 @@
+/**
+ * @file telnet_sched.c
+ * @brief Telnet服务器会话调度
+ * @date liuliang 2026-01-25
+ *
+ * 本文件包含事件循环中各会话之间的公平调度
+ * 每个会话每轮事件循环最多读取TELNET_READ_BUDGET字节、执行TELNET_CMD_BUDGET条命令，
+ * 预算用完时剩余输入留在内核缓冲区或预输入缓冲区，会话加入就绪队列，
+ * 下一轮按加入顺序轮流继续，一个大量输入的会话不会占住整轮事件循环；
+ * 可选的每会话令牌桶限制输入字节速率和命令速率，超过时从事件后端去掉可读事件，
+ * 不断开连接，由TCP背压让客户端慢下来；令牌由工作线程的一个定时器每个tick检查并恢复读取
+ */
+
+#include "telnet_server.h"
+
+// 会话的令牌桶，单位为千分之一字节/条，输入令牌可以透支（io_uring收到的数据已经读出）
+typedef struct telnet_sched_bucket {
+    int64_t input;                  // 剩余输入令牌
+    int64_t cmds;                   // 剩余命令令牌
+    uint64_t stamp_ms;              // 上次补充令牌的时间
+} telnet_sched_bucket_t;
+
+
+// 配置了限速时创建按槽位索引的令牌桶表
+int telnets_sched_init(telnet_server_t *server)
+{
+    const telnet_config_t *config = server->config;
+
+    server->cmd_budget = -1;
+    telnets_timer_init(&server->throttle_timer, TELNET_TIMER_THROTTLE, server);
+
+    if (config->input_rate <= 0 && config->cmd_rate <= 0)
+    {
+        return 0;
+    }
+
+    server->buckets = (telnet_sched_bucket_t *)calloc(server->capacity, sizeof(telnet_sched_bucket_t));
+    if (!server->buckets)
+    {
+        telnets_log_errno("Failed to allocate session rate limits");
+        return -1;
+    }
+    return 0;
+}
+
+void telnets_sched_destroy(telnet_server_t *server)
+{
+    free(server->ready_list);
+    free(server->throttle_list);
+    free(server->buckets);
+    server->ready_list = NULL;
+    server->throttle_list = NULL;
+    server->buckets = NULL;
+    server->ready_count = 0;
+    server->throttle_count = 0;
+}
+
+// 新会话的令牌桶是满的
+void telnets_sched_reset(telnet_client_t *client)
+{
+    telnet_server_t *server = client->server;
+    telnet_sched_bucket_t *b;
+
+    if (!server->buckets)
+    {
+        return;
+    }
+
+    b = &server->buckets[client->slot];
+    b->input = (int64_t)server->config->input_burst * 1000;
+    b->cmds = (int64_t)server->config->cmd_burst * 1000;
+    b->stamp_ms = server->now_ms;
+}
+
+// 按经过的时间补充令牌，毫秒数乘以每秒速率即为千分之一令牌数
+static telnet_sched_bucket_t *telnets_sched_refill(telnet_client_t *client)
+{
+    telnet_server_t *server = client->server;
+    const telnet_config_t *config = server->config;
+    telnet_sched_bucket_t *b = &server->buckets[client->slot];
+    uint64_t elapsed = server->now_ms - b->stamp_ms;
+
+    if (elapsed > 0)
+    {
+        int64_t input_max = (int64_t)config->input_burst * 1000;
+        int64_t cmds_max = (int64_t)config->cmd_burst * 1000;
+
+        b->input += (int64_t)(elapsed * (uint64_t)config->input_rate);
+        b->cmds += (int64_t)(elapsed * (uint64_t)config->cmd_rate);
+        b->input = b->input < input_max ? b->input : input_max;
+        b->cmds = b->cmds < cmds_max ? b->cmds : cmds_max;
+        b->stamp_ms = server->now_ms;
+    }
+    return b;
+}
+
+// 追加一个事件标识到列表，按需倍增
+static int telnets_sched_push(uint64_t **list, int *count, int *cap, uint64_t token)
+{
+    if (*count == *cap)
+    {
+        int new_cap = *cap ? *cap * 2 : TELNET_TABLE_INIT_SIZE;
+        uint64_t *p = (uint64_t *)realloc(*list, new_cap * sizeof(uint64_t));
+        if (!p)
+        {
+            telnets_log_errno("Failed to grow scheduler queue");
+            return -1;
+        }
+        *list = p;
+        *cap = new_cap;
+    }
+
+    (*list)[(*count)++] = token;
+    return 0;
+}
+
+// 加入就绪队列，已在队列中时不重复加入
+static void telnets_sched_queue(telnet_client_t *client)
+{
+    telnet_server_t *server = client->server;
+
+    if (client->read_paused & TELNET_PAUSE_QUEUED)
+    {
+        return;
+    }
+
+    if (telnets_sched_push(&server->ready_list, &server->ready_count, &server->ready_cap,
+                           TELNET_TOKEN(client->slot, client->generation)) == 0)
+    {
+        client->read_paused |= TELNET_PAUSE_QUEUED;
+    }
+}
+
+// 本轮预算用完，留到下一轮继续
+void telnets_sched_defer(telnet_client_t *client)
+{
+    if (!(client->read_paused & TELNET_PAUSE_QUEUED))
+    {
+        TELNET_METRIC_ADD(client->server->metrics.sched_deferred, 1);
+        telnets_sched_queue(client);
+    }
+}
+
+// 超过速率限制，暂停读取直到令牌补充
+static void telnets_sched_throttle(telnet_client_t *client)
+{
+    telnet_server_t *server = client->server;
+
+    if (client->read_paused & TELNET_PAUSE_THROTTLE)
+    {
+        return;
+    }
+
+    if (telnets_sched_push(&server->throttle_list, &server->throttle_count, &server->throttle_cap,
+                           TELNET_TOKEN(client->slot, client->generation)) < 0)
+    {
+        return;
+    }
+
+    client->read_paused |= TELNET_PAUSE_THROTTLE;
+    TELNET_METRIC_ADD(server->metrics.sched_throttled, 1);
+    telnets_event_mod(server, client, client->events & ~(uint32_t)(EPOLLIN | EPOLLRDHUP));
+
+    if (!telnets_timer_pending(&server->throttle_timer))
+    {
+        telnets_timer_arm(&server->timers, &server->throttle_timer, server->now_ms, TELNET_TW_TICK_MS);
+    }
+}
+
+// 开始处理一个会话，命令预算重新计算；不经过调度直接处理输入时（微基准）不限制
+void telnets_sched_begin(telnet_server_t *server)
+{
+    server->cmd_budget = TELNET_CMD_BUDGET;
+}
+
+void telnets_sched_end(telnet_server_t *server)
+{
+    server->cmd_budget = -1;
+}
+
+// 本次最多读取的字节数，返回0时不再读取：本轮预算用完已加入就绪队列，或输入令牌用完已暂停读取
+size_t telnets_sched_read_len(telnet_client_t *client, size_t budget)
+{
+    size_t len = budget < TELNET_RECV_BUFFER_SIZE ? budget : TELNET_RECV_BUFFER_SIZE;
+    telnet_sched_bucket_t *b;
+
+    if (budget == 0)
+    {
+        telnets_sched_defer(client);
+        return 0;
+    }
+
+    if (!client->server->buckets || client->server->config->input_rate <= 0)
+    {
+        return len;
+    }
+
+    b = telnets_sched_refill(client);
+    if (b->input < 1000)
+    {
+        telnets_sched_throttle(client);
+        return 0;
+    }
+
+    return (size_t)(b->input / 1000) < len ? (size_t)(b->input / 1000) : len;
+}
+
+// 扣除收到的输入字节，令牌用完时暂停读取
+void telnets_sched_charge(telnet_client_t *client, size_t len)
+{
+    telnet_sched_bucket_t *b;
+
+    if (!client->server->buckets || client->server->config->input_rate <= 0)
+    {
+        return;
+    }
+
+    b = telnets_sched_refill(client);
+    b->input -= (int64_t)len * 1000;
+    if (b->input < 1000)
+    {
+        telnets_sched_throttle(client);
+    }
+}
+
+// 执行一条命令前检查预算和命令令牌，返回0时命令留到以后执行：已加入就绪队列或已暂停读取
+int telnets_sched_cmd_allow(telnet_client_t *client)
+{
+    telnet_server_t *server = client->server;
+
+    if (server->cmd_budget == 0)
+    {
+        telnets_sched_defer(client);
+        return 0;
+    }
+
+    if (server->buckets && server->config->cmd_rate > 0)
+    {
+        telnet_sched_bucket_t *b = telnets_sched_refill(client);
+
+        if (b->cmds < 1000)
+        {
+            telnets_sched_throttle(client);
+            return 0;
+        }
+        b->cmds -= 1000;
+    }
+
+    if (server->cmd_budget > 0)
+    {
+        server->cmd_budget--;
+    }
+    return 1;
+}
+
+// 处理就绪队列中前count个会话，即本轮开始前加入的会话；本轮新加入的留到下一轮
+void telnets_sched_run(telnet_server_t *server, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        telnet_client_t *client = telnets_lookup_token(server, server->ready_list[i]);
+
+        if (!client)
+        {
+            continue;
+        }
+
+        client->read_paused &= ~TELNET_PAUSE_QUEUED;
+        if (server->io_backend == TELNET_IO_URING)
+        {
+            // io_uring的数据由完成事件送达，这里只处理缓存的输入
+            if (client->typeahead_len > 0 && !client->cmd_pending)
+            {
+                telnets_sched_begin(server);
+                telnets_recv_typeahead(server, client->slot);
+                telnets_sched_end(server);
+            }
+            continue;
+        }
+        telnets_recv_data_proc(server, client->slot);
+    }
+
+    if (count == 0)
+    {
+        return;
+    }
+
+    server->ready_count -= count;
+    memmove(server->ready_list, server->ready_list + count, server->ready_count * sizeof(uint64_t));
+}
+
+// 限速定时器到期：令牌已补充的会话恢复读取，加入就绪队列处理缓存的输入
+void telnets_sched_throttle_expired(telnet_server_t *server)
+{
+    const telnet_config_t *config = server->config;
+    int kept = 0;
+
+    for (int i = 0; i < server->throttle_count; i++)
+    {
+        uint64_t token = server->throttle_list[i];
+        telnet_client_t *client = telnets_lookup_token(server, token);
+        telnet_sched_bucket_t *b;
+
+        if (!client || !(client->read_paused & TELNET_PAUSE_THROTTLE))
+        {
+            continue;
+        }
+
+        b = telnets_sched_refill(client);
+        if ((config->input_rate > 0 && b->input < 1000) || (config->cmd_rate > 0 && b->cmds < 1000))
+        {
+            server->throttle_list[kept++] = token;
+            continue;
+        }
+
+        client->read_paused &= ~TELNET_PAUSE_THROTTLE;
+        if (telnets_flush_client(server, client) < 0)
+        {
+            telnets_log_errno("Send error");
+            telnets_remove_client(server, client->slot);
+            continue;
+        }
+        telnets_sched_queue(client);
+    }
+
+    server->throttle_count = kept;
+    if (kept > 0)
+    {
+        telnets_timer_arm(&server->timers, &server->throttle_timer, server->now_ms, TELNET_TW_TICK_MS);
+    }
+}
@@ -9,28 +9,82 @@
 #include "telnet_server.h"
 
 
-// 创建服务器实例
-telnet_server_t *telnet_server_init(int port) 
+// 创建服务器实例（每个工作线程一个）
+telnet_server_t *telnet_server_init(const telnet_config_t *config, int worker_id) 
 {
     telnet_server_t *server = (telnet_server_t *)malloc(sizeof(telnet_server_t));
     if (!server) 
     {
-        perror("Failed to allocate server memory");
+        telnets_log_errno("Failed to allocate server memory");
         return NULL;
     }
     
     // 初始化服务器结构
     memset(server, 0, sizeof(telnet_server_t));
-    server->port = port;
-    server->max_clients = TELNET_MAX_CLIENTS;
+    server->worker_id = worker_id;
+    server->config = config;
+    server->port = config->port;
+    // 总连接数平均分配到各工作线程，余数由编号靠前的线程各多分一个，合计正好等于配置值
+    server->max_clients = config->max_clients / config->threads +
+                          (worker_id < config->max_clients % config->threads ? 1 : 0);
+    server->client_count = 0;
     server->running = 1;
     server->listen_sockfd = -1;
-    server->max_fd = 0;
+    server->tls_listen_sockfd = -1;
+    server->epoll_fd = -1;
+    server->wake_fd = -1;
+    server->edge_triggered = config->edge_triggered;
+    server->transport = config->transport;
+    server->now_ms = telnets_now_ms();
+    telnets_timer_wheel_init(&server->timers, server->now_ms);
     
-    // 初始化客户端数组
-    for (int i = 0; i < TELNET_MAX_CLIENTS; i++) 
+    // 初始化客户端表
+    if (telnets_table_init(server) < 0) 
     {
-        server->clients[i] = NULL;
+        free(server);
+        return NULL;
+    }
+    
+    if (telnets_ratelimit_init(server) < 0) 
+    {
+        telnets_table_destroy(server);
+        free(server);
+        return NULL;
+    }
+    
+    // 接收暂存区，所有客户端共用
+    server->recv_buf = (char *)malloc(TELNET_RECV_BUFFER_SIZE);
+    if (!server->recv_buf) 
+    {
+        telnets_log_errno("Failed to allocate receive buffer");
+        telnets_ratelimit_free(server);
+        telnets_table_destroy(server);
+        free(server);
+        return NULL;
+    }
+    
+    // stats命令的合并暂存区，事件循环中执行命令时不再分配
+    server->stats_merged = (telnet_metrics_t *)malloc(sizeof(telnet_metrics_t));
+    if (!server->stats_merged) 
+    {
+        telnets_log_errno("Failed to allocate metrics buffer");
+        free(server->recv_buf);
+        telnets_ratelimit_free(server);
+        telnets_table_destroy(server);
+        free(server);
+        return NULL;
+    }
+    
+    if (telnets_mccp_init(server) < 0 || telnets_sched_init(server) < 0 || telnets_auth_init(server) < 0) 
+    {
+        telnets_sched_destroy(server);
+        telnets_mccp_destroy(server);
+        free(server->stats_merged);
+        free(server->recv_buf);
+        telnets_ratelimit_free(server);
+        telnets_table_destroy(server);
+        free(server);
+        return NULL;
     }
     
     // 设置信号处理
@@ -40,33 +94,35 @@ telnet_server_t *telnet_server_init(int port)
     return server;
 }
 
-// 启动服务器
-int telnet_server_start(telnet_server_t *server) 
+// 创建绑定到port的非阻塞监听socket，返回描述符，失败返回-1
+static int telnet_server_listen_socket(telnet_server_t *server, int port) 
 {
     struct sockaddr_in server_addr;
     int opt = 1;
+    int sockfd;
     
-    // 创建socket
-    server->listen_sockfd = socket(AF_INET, SOCK_STREAM, 0);
-    if (server->listen_sockfd < 0) 
+    // 创建非阻塞监听socket
+    sockfd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (sockfd < 0) 
     {
-        perror("Socket creation failed");
+        telnets_log_errno("Socket creation failed");
         return -1;
     }
 
-    // 设置监听 socket 为非阻塞模式
-    if (set_tcp_nonblocking(server->listen_sockfd) < 0) 
+    // 设置socket选项，允许地址重用
+    if (setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) 
     {
-        perror("Failed to set non-blocking on listening socket");
-        close(server->listen_sockfd);
+        telnets_log_errno("Setsockopt failed");
+        close(sockfd);
         return -1;
     }
-
-    // 设置socket选项，允许地址重用
-    if (setsockopt(server->listen_sockfd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) 
+    
+    // 多个工作线程各自绑定同一端口，由内核在监听socket之间分配连接
+    if (server->config->threads > 1 &&
+        setsockopt(sockfd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0) 
     {
-        perror("Setsockopt failed");
-        close(server->listen_sockfd);
+        telnets_log_errno("Setsockopt SO_REUSEPORT failed");
+        close(sockfd);
         return -1;
     }
     
@@ -74,95 +130,319 @@ int telnet_server_start(telnet_server_t *server)
     memset(&server_addr, 0, sizeof(server_addr));
     server_addr.sin_family = AF_INET;
     server_addr.sin_addr.s_addr = INADDR_ANY;
-    server_addr.sin_port = htons(server->port);
+    server_addr.sin_port = htons(port);
     
     // 绑定socket
-    if (bind(server->listen_sockfd, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0) 
+    if (bind(sockfd, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0) 
     {
-        perror("Bind failed");
-        close(server->listen_sockfd);
+        telnets_log_errno("Bind failed");
+        close(sockfd);
         return -1;
     }
     
-    // 开始监听
-    if (listen(server->listen_sockfd, 5) < 0) 
+    // 开始监听，队列过短时连接风暴中的SYN会被丢弃，客户端要等重传
+    if (listen(sockfd, server->config->backlog) < 0) 
+    {
+        telnets_log_errno("Listen failed");
+        close(sockfd);
+        return -1;
+    }
+    
+    return sockfd;
+}
+
+// 关闭监听socket
+static void telnet_server_listen_close(telnet_server_t *server) 
+{
+    if (server->listen_sockfd >= 0) 
     {
-        perror("Listen failed");
         close(server->listen_sockfd);
+        server->listen_sockfd = -1;
+    }
+    if (server->tls_listen_sockfd >= 0) 
+    {
+        close(server->tls_listen_sockfd);
+        server->tls_listen_sockfd = -1;
+    }
+}
+
+// 创建事件后端并注册监听socket
+static int telnet_server_listen_register(telnet_server_t *server) 
+{
+    // 创建epoll实例并注册监听socket
+    if (telnets_event_init(server) < 0) 
+    {
+        telnet_server_listen_close(server);
+        return -1;
+    }
+    
+    if (telnets_event_add(server, server->listen_sockfd, TELNET_LISTEN_TOKEN) < 0 ||
+        (server->tls_listen_sockfd >= 0 &&
+         telnets_event_add(server, server->tls_listen_sockfd, TELNET_TLS_LISTEN_TOKEN) < 0)) 
+    {
+        telnets_event_close(server);
+        telnet_server_listen_close(server);
         return -1;
     }
     
-    printf("Telnet server started on port %d\n", server->port);
-    printf("Max clients: %d\n", server->max_clients);
-    printf("Idle timeout: %d seconds\n", TELNET_IDLE_TIMEOUT);
+    return 0;
+}
+
+// 创建监听socket并注册到epoll，配置了TLS端口时同时监听TLS端口
+int telnet_server_listen(telnet_server_t *server) 
+{
+    // 内存传输没有监听socket，只创建事件后端，用于唤醒和跨线程通知
+    if (server->transport == TELNET_TRANSPORT_MEM) 
+    {
+        return telnets_event_init(server);
+    }
     
-    // 设置最大文件描述符
-    server->max_fd = server->listen_sockfd;
+    server->listen_sockfd = telnet_server_listen_socket(server, server->port);
+    if (server->listen_sockfd < 0) 
+    {
+        return -1;
+    }
     
-    // 主服务器循环
-    while (server->running) 
+    if (server->config->tls_port > 0) 
     {
-        struct timeval timeout;
-        fd_set read_fds;
-        int activity;
-        
-        // 清空描述符集
-        FD_ZERO(&read_fds);
-        
-        // 添加监听socket到描述符集
-        FD_SET(server->listen_sockfd, &read_fds);
+        server->tls_listen_sockfd = telnet_server_listen_socket(server, server->config->tls_port);
+        if (server->tls_listen_sockfd < 0 || telnets_tls_init(server) < 0) 
+        {
+            telnet_server_listen_close(server);
+            return -1;
+        }
+    }
+    
+    return telnet_server_listen_register(server);
+}
+
+// 热重启：使用旧进程交来的监听socket，代替绑定端口
+int telnet_server_inherit(telnet_server_t *server, int listen_fd, int tls_listen_fd) 
+{
+    server->listen_sockfd = listen_fd;
+    
+    // 新配置不再启用TLS时关闭旧的TLS监听socket
+    if (tls_listen_fd >= 0 && server->config->tls_port <= 0) 
+    {
+        close(tls_listen_fd);
+        tls_listen_fd = -1;
+    }
+    server->tls_listen_sockfd = tls_listen_fd;
+    
+    if (tls_listen_fd >= 0 && telnets_tls_init(server) < 0) 
+    {
+        telnet_server_listen_close(server);
+        return -1;
+    }
+    
+    return telnet_server_listen_register(server);
+}
+
+// 处理epoll返回的就绪事件
+static void telnets_epoll_dispatch(telnet_server_t *server, struct epoll_event *events, int nready) 
+{
+    // 只处理就绪的描述符
+    for (int i = 0; i < nready; i++) 
+    {
+        uint64_t token = events[i].data.u64;
         
-        // 添加所有客户端socket到描述符集
-        for (int i = 0; i < server->max_clients; i++) 
+        if (token == TELNET_WAKE_TOKEN) 
         {
-            if (server->clients[i] != NULL) 
+            // 读空唤醒计数，running等状态在循环条件中检查
+            uint64_t count;
+            TELNET_METRIC_ADD(server->metrics.syscalls, 1);
+            if (read(server->wake_fd, &count, sizeof(count)) < 0 && errno != EAGAIN) 
             {
-                int sockfd = server->clients[i]->sockfd;
-                FD_SET(sockfd, &read_fds);
-                
-                // 更新最大描述符值
-                if (sockfd > server->max_fd) 
-                {
-                    server->max_fd = sockfd;
-                }
+                telnets_log_errno("eventfd read failed");
             }
         }
-        
-        // 设置select超时时间为1秒
-        timeout.tv_sec = 1;
-        timeout.tv_usec = 0;
-        
-        // 使用select监视socket活动
-        activity = select(server->max_fd + 1, &read_fds, NULL, NULL, &timeout);
-        
-        if (activity < 0 && errno != EINTR) 
+        else if (token == TELNET_LISTEN_TOKEN) 
         {
-            perror("Select error");
-            continue;
+            // 检查是否有新连接
+            telnets_handle_new_connection(server);
         }
-        
-        // 检查是否有新连接
-        if (FD_ISSET(server->listen_sockfd, &read_fds)) 
+        else if (token == TELNET_TLS_LISTEN_TOKEN) 
         {
-            telnets_handle_new_connection(server);
+            telnets_handle_tls_connection(server);
         }
-        
-        // 检查客户端socket活动
-        for (int i = 0; i < server->max_clients; i++) 
+        else 
         {
-            if (server->clients[i] != NULL) 
+            telnet_client_t *client = telnets_lookup_token(server, token);
+            if (client == NULL) 
             {
-                int sockfd = server->clients[i]->sockfd;
-                
-                if (FD_ISSET(sockfd, &read_fds)) 
+                continue;
+            }
+            
+            // 内核缓冲区可写，继续发送积压的输出
+            if (events[i].events & EPOLLOUT) 
+            {
+                if (telnets_flush_client(server, client) < 0) 
                 {
-                    telnets_recv_data_proc(server, i);
+                    telnets_log_errno("Send error");
+                    telnets_remove_client(server, client->slot);
+                    continue;
                 }
             }
+            
+            // 检查客户端socket活动，暂停读取或留在就绪队列中时只处理连接错误
+            if (!client->read_paused && 
+                (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))) 
+            {
+                telnets_recv_data_proc(server, client->slot);
+            }
+            else if (events[i].events & (EPOLLHUP | EPOLLERR)) 
+            {
+                telnets_remove_client(server, client->slot);
+            }
+        }
+    }
+}
+
+// 运行一轮事件循环：最多等待max_wait_ms毫秒（-1表示等到下一个定时器到期），
+// 处理就绪事件、线程池完成的命令、广播和到期的定时器，最后合并发送本轮的输出；
+// 返回就绪事件数，出错返回-1
+int telnet_server_poll(telnet_server_t *server, int max_wait_ms) 
+{
+    struct epoll_event events[TELNET_EPOLL_MAX_EVENTS];
+    uint64_t loop_start;
+    int timeout_ms;
+    int nready;
+    int ready;
+    
+    // 睡眠到下一个定时器到期，没有定时器时一直等待事件；
+    // 监听队列还有未接受的连接、内存连接有输入或就绪队列不空时不等待
+    if (server->accept_pending || telnets_mem_pending(server) || server->ready_count > 0) 
+    {
+        timeout_ms = 0;
+    }
+    else 
+    {
+        timeout_ms = telnets_timer_next_timeout(&server->timers, server->now_ms);
+    }
+    if (max_wait_ms >= 0 && (timeout_ms < 0 || timeout_ms > max_wait_ms)) 
+    {
+        timeout_ms = max_wait_ms;
+    }
+    
+    if (server->io_backend == TELNET_IO_URING) 
+    {
+        // 上一轮产生的发送请求和本次等待合并为一次系统调用
+        nready = telnets_uring_wait(server, timeout_ms);
+    }
+    else 
+    {
+        nready = epoll_wait(server->epoll_fd, events, TELNET_EPOLL_MAX_EVENTS, timeout_ms);
+        TELNET_METRIC_ADD(server->metrics.syscalls, 1);
+    }
+    
+    if (nready < 0) 
+    {
+        if (errno == EINTR) 
+        {
+            return 0;
         }
+        telnets_log_errno(server->io_backend == TELNET_IO_URING ? "io_uring_enter error" : "epoll_wait error");
+        return -1;
+    }
+    
+    // 本轮耗时从等待返回开始计算；模拟时钟只由驱动程序推进
+    loop_start = telnets_now_ns();
+    ready = server->ready_count;
+    if (!server->sim_clock) 
+    {
+        server->now_ms = loop_start / 1000000;
+        telnets_clock_update();
+    }
+    
+    if (server->io_backend == TELNET_IO_URING) 
+    {
+        telnets_uring_dispatch(server);
+    }
+    else 
+    {
+        telnets_epoll_dispatch(server, events, nready);
+    }
+    
+    // 内存传输的新连接和输入
+    telnets_mem_dispatch(server);
+    
+    // 命令线程池完成的命令
+    telnets_pool_complete(server);
+    
+    // 校验线程池完成的登录
+    telnets_auth_complete(server);
+    
+    // 上一轮预算用完的会话按顺序继续，排在本轮新事件之后
+    telnets_sched_run(server, ready);
+    
+    // 其他线程发来的广播
+    telnets_broadcast_deliver(server);
+    
+    // 上一轮达到接受上限，边缘触发不会再次通知
+    if (server->accept_pending) 
+    {
+        server->accept_pending = 0;
+        telnets_handle_new_connection(server);
+        if (server->tls_listen_sockfd >= 0) 
+        {
+            telnets_handle_tls_connection(server);
+        }
+    }
+    
+    // 处理到期的定时器
+    telnets_cleanup_clients(server);
+    
+    // 本轮产生的输出合并发送
+    telnets_flush_pending(server);
+    
+    TELNET_METRIC_ADD(server->metrics.loops, 1);
+    telnets_hist_record(&server->metrics.loop_ns, telnets_now_ns() - loop_start);
+    return nready;
+}
+
+// 启动服务器，运行事件循环直到被停止
+int telnet_server_start(telnet_server_t *server) 
+{
+    // 事件后端尚未创建时先监听
+    if (server->wake_fd < 0 && telnet_server_listen(server) < 0) 
+    {
+        return -1;
+    }
+    
+    telnets_log_msg(TELNET_LOG_INFO, "telnet server started on port %d", server->port);
+    if (server->tls_listen_sockfd >= 0) 
+    {
+        telnets_log_msg(TELNET_LOG_INFO, "TLS listener on port %d", server->config->tls_port);
+    }
+    telnets_log_msg(TELNET_LOG_INFO, "max clients: %d", server->max_clients);
+    telnets_log_msg(TELNET_LOG_INFO, "idle timeout: %d seconds", server->config->idle_timeout);
+    if (server->io_backend == TELNET_IO_URING) 
+    {
+        telnets_log_msg(TELNET_LOG_INFO, "event mode: io_uring");
+    }
+    else 
+    {
+        telnets_log_msg(TELNET_LOG_INFO, "event mode: epoll %s",
+                        server->edge_triggered ? "edge-triggered" : "level-triggered");
+    }
+    telnets_log_msg(TELNET_LOG_INFO, "transport: %s", telnet_transports[server->transport]->name);
+    telnets_log_msg(TELNET_LOG_INFO, "input scanner: %s", telnets_scan_name());
+    
+    if (!server->sim_clock) 
+    {
+        server->now_ms = telnets_now_ms();
+    }
+    
+    // 主服务器循环
+    while (server->running) 
+    {
+        telnet_server_poll(server, -1);
         
-        // 清理超时客户端
-        telnets_cleanup_clients(server);
+        // 热重启期间停在此处，由主线程交接会话
+        if (server->master && server->master->upgrade_park) 
+        {
+            telnets_upgrade_park(server);
+        }
     }
     
     return 0;
@@ -172,6 +452,9 @@ int telnet_server_start(telnet_server_t *server)
 void telnet_server_stop(telnet_server_t *server) 
 {
     server->running = 0;
+    
+    // 事件循环可能阻塞在epoll_wait中，需要唤醒
+    telnets_event_wake(server);
 }
 
 // 销毁服务器资源
@@ -181,94 +464,83 @@ void telnet_server_destroy(telnet_server_t *server)
         return;
     
     // 关闭所有客户端连接
-    for (int i = 0; i < server->max_clients; i++) 
+    for (int i = 0; i < server->capacity; i++) 
     {
-        if (server->clients[i] != NULL) 
+        telnet_client_t *client = telnets_get_client(server, i);
+        if (client != NULL) 
         {
-            close(server->clients[i]->sockfd);
-            free(server->clients[i]);
-            server->clients[i] = NULL;
+            TELNET_TRANSPORT(client)->close(server, client->sockfd);
+            telnets_outq_clear(&client->outq);
+            telnets_session_release(server, client);
+            client->in_use = 0;
         }
     }
+    server->client_count = 0;
+    telnets_pool_discard(server);
+    telnets_auth_discard(server);
+    telnets_broadcast_discard(server);
+    telnets_table_destroy(server);
+    telnets_ratelimit_free(server);
+    telnets_buf_pool_destroy(server);
+    telnets_mccp_destroy(server);
+    telnets_sched_destroy(server);
+    telnets_auth_destroy(server);
+    free(server->recv_buf);
+    free(server->stats_merged);
+    free(server->flush_list);
+    
+    // 关闭epoll实例
+    telnets_event_close(server);
+    telnets_mem_detach(server);
     
     // 关闭监听socket
-    if (server->listen_sockfd >= 0) 
-    {
-        close(server->listen_sockfd);
-    }
+    telnet_server_listen_close(server);
+    telnets_tls_destroy(server);
     
     free(server);
 }
 
 
 // 发送欢迎消息
-void telnets_welcome(int sockfd) 
+void telnets_welcome(telnet_client_t *client) 
 {
-    const char *welcome = 
-        "\r\n"
-        "========================================\r\n"
-        "   Welcome to WK Telnet Server\r\n"
-        "========================================\r\n"
-        "\r\n"
-        "Available commands:\r\n"
-        "  help     - Show this help message\r\n"
-        "  time     - Show current time\r\n"
-        "  echo <msg> - Echo back the message\r\n"
-        "  clear    - Clear the screen\r\n"
-        "  quit     - Disconnect\r\n"
-        "\r\n";
-    
-    send(sockfd, welcome, strlen(welcome), 0);
+    const telnet_resp_t *welcome = telnets_resp_get(TELNET_RESP_WELCOME);
+    telnets_output(client, welcome->data, welcome->len);
 }
 
 // 发送提示符
-void telnets_send_prompt(int sockfd) 
+void telnets_send_prompt(telnet_client_t *client) 
 {
-    const char *prompt = "\rwktx:##>";
-    send(sockfd, prompt, strlen(prompt), 0);
+    const telnet_resp_t *prompt = telnets_resp_get(TELNET_RESP_PROMPT);
+    
+    // 登录完成前提示输入用户名或密码
+    if (client->cold->authenticated != TELNET_AUTH_OK) 
+    {
+        telnets_auth_prompt(client);
+        return;
+    }
+    telnets_output(client, prompt->data, prompt->len);
 }
 
 
 
 // 工具函数
 
-// 查找客户端索引
-int telnets_find_client_index(telnet_server_t *server, int sockfd) {
-    for (int i = 0; i < server->max_clients; i++) {
-        if (server->clients[i] != NULL && server->clients[i]->sockfd == sockfd) {
-            return i;
-        }
-    }
-    return -1;
-}
-
-// 查找可用槽位
-int telnets_find_available_slot(telnet_server_t *server) 
-{
-    for (int i = 0; i < server->max_clients; i++) 
-    {
-        if (server->clients[i] == NULL) {
-            return i;
-        }
-    }
-    return -1;
-}
-
-// 获取当前时间
+// 获取当前时间，读取事件循环缓存的墙钟秒数
 time_t get_current_time(void) 
 {
-    return time(NULL);
+    return telnets_clock_now();
 }
 
 // 检查客户端是否超时
-int is_telnet_client_timeout(telnet_client_t *client) 
+int is_telnet_client_timeout(telnet_client_t *client, int idle_timeout) 
 {
     if (!client) return 1;
     
     time_t current_time = get_current_time();
     time_t idle_time = current_time - client->last_active;
     
-    return (idle_time >= TELNET_IDLE_TIMEOUT);
+    return (idle_time >= idle_timeout);
 }
 
 // 去除换行符
@@ -22,17 +22,214 @@
 #include <netdb.h>
 #include <sys/time.h>
 #include <sys/select.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/uio.h>
+#include <stdarg.h>
+#include <stdint.h>
 #include <errno.h>
 #include <ctype.h>
 #include <pthread.h>
+#include <zlib.h>
+#include <openssl/ssl.h>
+#include <crypt.h>
 
 #include <fcntl.h>  // 需要添加这个头文件
 
 // 常量定义
-#define TELNET_MAX_CLIENTS 5           // 最大客户端数量
-#define TELNET_BUFFER_SIZE 1024         // 缓冲区大小
-#define TELNET_IDLE_TIMEOUT 600         // 空闲超时时间（秒）- 10分钟
+#define TELNET_MAX_CLIENTS 1024         // 默认最大客户端数量（所有工作线程合计）
+#define TELNET_TABLE_INIT_SIZE 16       // 描述符映射表、待发送列表的初始容量，按需倍增
+#define TELNET_BUFFER_SIZE 1024         // 格式化输出的缓冲区大小
+#define TELNET_LINE_MAX 1023            // 默认最大行长度，超出部分丢弃
+#define TELNET_LINE_MAX_LIMIT 65535     // 可配置的最大行长度上限，须小于最大一级缓冲区
+#define TELNET_RECV_BUFFER_SIZE 16384   // 每个工作线程的接收暂存区大小
+#define TELNET_BUF_MIN_SHIFT 6          // 最小一级缓冲区64字节
+#define TELNET_BUF_CLASSES 6            // 缓冲区级别数：64、256、1K、4K、16K、64K，每级4倍
+#define TELNET_BUF_CACHE_BYTES 262144   // 每级空闲缓冲区最多缓存的字节数
+#define TELNET_BUF_SIZE(cls) ((size_t)1 << (TELNET_BUF_MIN_SHIFT + 2 * (cls)))
+#define TELNET_IDLE_TIMEOUT 600         // 默认空闲超时时间（秒）- 10分钟
 #define TELNET_DEFAULT_PORT 9000          // 默认端口号
+#define TELNET_EPOLL_MAX_EVENTS 256     // 单次epoll_wait最多返回的事件数
+#define TELNET_DEFAULT_THREADS 1        // 默认工作线程数
+#define TELNET_MAX_THREADS 256          // 最大工作线程数
+#define TELNET_OUTCHUNK_SIZE 2048       // 输出队列块大小
+#define TELNET_OUTCHUNK_CACHE 256       // 每个线程缓存的空闲输出块数
+#define TELNET_OUTREF_CACHE 65536       // 每个线程缓存的空闲引用块（只有块头）数，覆盖一次大规模广播
+#define TELNET_OUTQ_IOV_MAX 64          // 单次writev最多的块数
+#define TELNET_OUTQ_HIGH_WATER 65536    // 默认输出队列高水位（字节），超过后暂停读取
+#define TELNET_NEGOTIATION_TIMEOUT 5    // 选项协商超时时间（秒）
+#define TELNET_SB_MAX 64                // 子协商内容最大长度，超出部分丢弃
+#define TELNET_CMD_MAX 128              // 最多可注册的命令数
+#define TELNET_CMD_HASH_SIZE 256        // 命令哈希表大小，2的幂且大于TELNET_CMD_MAX
+#define TELNET_CMD_NAME_MAX 32          // 命令名最大长度（含结束符）
+#define TELNET_CMD_MAX_ARGS 16          // 切分的参数个数上限
+#define TELNET_METRICS_BACKLOG 16       // 指标端口监听队列长度
+#define TELNET_URING_ENTRIES 256        // io_uring提交队列长度
+#define TELNET_URING_CQ_ENTRIES 4096    // io_uring完成队列长度
+#define TELNET_URING_BUF_COUNT 256      // 共享接收缓冲区个数，2的幂
+#define TELNET_URING_BUF_SIZE 2048      // 每个接收缓冲区大小
+#define TELNET_URING_SEND_IOV 16        // 单次发送最多的块数
+#define TELNET_LISTEN_BACKLOG 1024      // 默认监听队列长度，实际受net.core.somaxconn限制
+#define TELNET_ACCEPT_BATCH 64          // 每轮事件循环最多接受的连接数
+#define TELNET_ACCEPT_BURST 20          // 启用限速时默认的每个来源IP突发连接数
+#define TELNET_RATELIMIT_BITS 12        // 每个工作线程限速表大小的位数
+#define TELNET_RATELIMIT_SIZE (1 << TELNET_RATELIMIT_BITS)
+#define TELNET_RATELIMIT_PROBE 8        // 限速表线性探测的最大长度
+#define TELNET_POOL_THREADS 2           // 默认命令线程池大小
+#define TELNET_POOL_MAX_THREADS 64      // 命令线程池最大线程数
+#define TELNET_POOL_QUEUE 256           // 命令线程池最多排队的任务数
+#define TELNET_TYPEAHEAD_MAX 4096       // 等待命令完成期间缓存的输入上限，超过后暂停读取
+#define TELNET_WALL_MAX 512             // wall消息正文最大长度
+#define TELNET_BCAST_TRUNCATE_LEN 128   // 截断策略下发给积压客户端的最大长度
+#define TELNET_RESP_FILE_MAX 65536      // 响应文件最大长度
+#define TELNET_MCCP_LEVEL 6             // 只给出会话上限时使用的压缩级别
+#define TELNET_MCCP_WBITS 15            // 压缩窗口位数，每个会话约260KB压缩状态
+#define TELNET_MCCP_MEMLEVEL 8
+#define TELNET_MCCP_SMALL_WBITS 10      // 限制内存模式的窗口位数，每个会话约18KB压缩状态
+#define TELNET_MCCP_SMALL_MEMLEVEL 4
+#define TELNET_TLS_RECORD 16384         // TLS记录最大明文长度，发送时按记录合并输出块
+#define TELNET_TLS_SESSION_CACHE 20480  // TLS 1.2会话缓存条数，TLS 1.3使用无状态票据
+#define TELNET_UPGRADE_TIMEOUT 10       // 热重启每一步等待对方的最长时间（秒）
+#define TELNET_READ_BUDGET 16384        // 每个会话每轮事件循环最多读取的字节数
+#define TELNET_CMD_BUDGET 16            // 每个会话每轮事件循环最多执行的命令数
+#define TELNET_AUTH_NAME_MAX 32         // 用户名最大长度（含结束符）
+#define TELNET_AUTH_THREADS 2           // 默认密码校验线程数
+#define TELNET_AUTH_MAX_THREADS 64      // 密码校验线程最大数
+#define TELNET_AUTH_QUEUE 1024          // 密码校验最多排队的任务数（所有工作线程合计）
+#define TELNET_AUTH_NICE 10             // 校验线程降低的调度优先级，登录风暴时事件循环优先
+#define TELNET_AUTH_CACHE_SIZE 256      // 每个工作线程缓存的最近校验通过的凭据数，2的幂
+#define TELNET_AUTH_CACHE_PROBE 4       // 凭据缓存线性探测的最大长度
+#define TELNET_AUTH_CACHE_TTL 300       // 默认凭据缓存有效期（秒）
+#define TELNET_AUTH_TIMEOUT 60          // 登录阶段的空闲超时（秒）
+#define TELNET_AUTH_MAX_TRIES 3         // 每个连接允许的登录失败次数，超过后断开
+#define TELNET_AUTH_FAIL_BURST 5        // 每个来源IP允许的连续登录失败次数
+#define TELNET_AUTH_FAIL_PERIOD 60      // 来源IP的登录失败次数每这么多秒恢复TELNET_AUTH_FAIL_BURST次
+
+// 暂停读取的原因，可以同时存在；前两种从事件后端去掉可读事件，数据留在内核缓冲区形成TCP背压
+#define TELNET_PAUSE_OUTPUT 0x01        // 输出积压超过高水位或预输入过多
+#define TELNET_PAUSE_THROTTLE 0x02      // 输入或命令速率超过限制，等令牌补充
+#define TELNET_PAUSE_QUEUED 0x04        // 本轮预算用完，在就绪队列中等下一轮继续
+#define TELNET_PAUSE_UNWATCH (TELNET_PAUSE_OUTPUT | TELNET_PAUSE_THROTTLE)
+
+// 会话的登录状态，未启用认证时为TELNET_AUTH_OK；不经过telnets_add_client建立的会话（微基准）同样视为已登录
+enum {
+    TELNET_AUTH_OK = 0,             // 已登录
+    TELNET_AUTH_USER,               // 等待输入用户名
+    TELNET_AUTH_PASS,               // 等待输入密码，不回显
+    TELNET_AUTH_VERIFY              // 密码在校验线程池中校验，期间的输入缓存
+};
+
+// 会话的MCCP2压缩状态
+enum {
+    TELNET_MCCP_OFF = 0,            // 不压缩
+    TELNET_MCCP_OFFERED,            // 已发送WILL COMPRESS2，等待客户端应答
+    TELNET_MCCP_ON                  // 已开始压缩，之后的输出都经过压缩流
+};
+
+// 广播时输出积压超过高水位的客户端的处理方式
+enum {
+    TELNET_BCAST_DROP = 0,          // 丢弃本条广播
+    TELNET_BCAST_TRUNCATE,          // 只发送开头TELNET_BCAST_TRUNCATE_LEN字节
+    TELNET_BCAST_DISCONNECT         // 断开连接
+};
+
+#define TELNET_LOG_RING_SIZE 1024       // 每个线程的日志环记录数，2的幂
+// 最多可写日志的线程数：工作线程、命令线程池、密码校验线程，另加主线程、指标、日志等少量线程
+#define TELNET_LOG_MAX_RINGS (TELNET_MAX_THREADS + TELNET_POOL_MAX_THREADS + TELNET_AUTH_MAX_THREADS + 8)
+#define TELNET_LOG_TEXT_MAX 80          // 日志记录中文本的最大长度（含结束符）
+#define TELNET_LOG_RATE_BURST 20        // 每个线程每种事件每秒最多记录的条数
+#define TELNET_LOG_FLUSH_MS 10          // 后台日志线程有记录期间的轮询间隔（毫秒），空闲后阻塞等待唤醒
+#define TELNET_LOG_BATCH_SIZE 65536     // 后台日志线程批量写入的缓冲区大小
+
+// 日志级别
+enum {
+    TELNET_LOG_DEBUG = 0,
+    TELNET_LOG_INFO,
+    TELNET_LOG_WARN,
+    TELNET_LOG_ERROR
+};
+
+// 日志事件，连接类事件只记录地址和槽位，由后台线程格式化
+enum {
+    TELNET_EV_MESSAGE = 0,          // 文本消息
+    TELNET_EV_CONNECT,              // 客户端连接
+    TELNET_EV_DISCONNECT,           // 客户端断开
+    TELNET_EV_TIMEOUT,              // 客户端超时
+    TELNET_EV_REJECT,               // 拒绝连接
+    TELNET_EV_ERROR,                // 系统调用错误，arg为errno
+    TELNET_EV_LOGIN,                // 登录成功，text为用户名
+    TELNET_EV_LOGIN_FAILED,         // 登录失败，text为用户名
+    TELNET_EV_SUPPRESSED,           // 限流汇总，slot为事件，arg为被丢弃的条数
+    TELNET_EV_COUNT
+};
+
+// 启动时生成的固定响应
+enum {
+    TELNET_RESP_WELCOME = 0,        // 欢迎信息
+    TELNET_RESP_HELP,               // help命令输出
+    TELNET_RESP_PROMPT,             // 提示符
+    TELNET_RESP_UNKNOWN,            // 未知命令之后的提示
+    TELNET_RESP_LOGIN,              // 用户名提示符
+    TELNET_RESP_PASSWORD,           // 密码提示符
+    TELNET_RESP_COUNT
+};
+
+// 事件后端
+enum {
+    TELNET_IO_EPOLL = 0,            // epoll就绪通知 + recv/writev
+    TELNET_IO_URING                 // io_uring完成通知
+};
+
+// 会话传输层
+enum {
+    TELNET_TRANSPORT_TCP = 0,       // TCP socket
+    TELNET_TRANSPORT_MEM,           // 进程内内存连接，用于模拟大量会话
+    TELNET_TRANSPORT_TLS,           // TLS监听端口接受的连接，握手完成后才开始Telnet会话
+    TELNET_TRANSPORT_COUNT
+};
+
+// epoll事件标识，客户端事件使用槽位索引
+#define TELNET_LISTEN_TOKEN UINT64_MAX  // 监听socket的事件标识
+#define TELNET_WAKE_TOKEN (UINT64_MAX - 1) // 唤醒eventfd的事件标识
+#define TELNET_TLS_LISTEN_TOKEN (UINT64_MAX - 2) // TLS监听socket的事件标识
+
+// 时间轮参数：每层64个槽位，共4层，tick为100毫秒，最远约19天
+#define TELNET_TW_BITS 6
+#define TELNET_TW_SIZE (1 << TELNET_TW_BITS)
+#define TELNET_TW_MASK (TELNET_TW_SIZE - 1)
+#define TELNET_TW_LEVELS 4
+#define TELNET_TW_TICK_MS 100
+
+// 延迟直方图参数：对数线性分桶，每个2的幂区间再等分为4个桶，
+// 首个桶为[0, 1024)纳秒，超过2^36纳秒（约69秒）的计入最后一个桶
+#define TELNET_HIST_SUB_BITS 2
+#define TELNET_HIST_MIN_SHIFT 10
+#define TELNET_HIST_MAX_SHIFT 36
+#define TELNET_HIST_BUCKETS (((TELNET_HIST_MAX_SHIFT - TELNET_HIST_MIN_SHIFT) << TELNET_HIST_SUB_BITS) + 1)
+
+// 指标计数器只由所属工作线程写入，其他线程读取时合并，
+// 单写者无需原子加法，用relaxed存储避免读到撕裂的值
+#define TELNET_METRIC_ADD(field, n) \
+    __atomic_store_n(&(field), (field) + (uint64_t)(n), __ATOMIC_RELAXED)
+#define TELNET_METRIC_READ(field) __atomic_load_n(&(field), __ATOMIC_RELAXED)
+
+// 定长日志记录，生产者只做复制
+typedef struct {
+    uint64_t ts_ns;                 // 墙钟时间（纳秒）
+    uint8_t level;                  // 日志级别
+    uint8_t event;                  // 日志事件
+    int16_t worker;                 // 工作线程编号，-1表示其他线程
+    int32_t slot;                   // 客户端槽位
+    uint32_t addr;                  // 客户端地址（网络字节序）
+    uint16_t port;                  // 客户端端口
+    int64_t arg;                    // 事件参数
+    char text[TELNET_LOG_TEXT_MAX]; // 文本或原因
+} telnet_log_rec_t;
+
+// 客户端事件标识：高32位为槽位代数，低32位为槽位索引
+#define TELNET_TOKEN(slot, gen)  (((uint64_t)(gen) << 32) | (uint32_t)(slot))
+#define TELNET_TOKEN_SLOT(token) ((int)((token) & 0xffffffffu))
+#define TELNET_TOKEN_GEN(token)  ((uint32_t)((token) >> 32))
 
 // Telnet命令定义
 #define TELNET_IAC  255          // 解释为命令
@@ -43,59 +240,664 @@
 #define TELNET_SB   250          // 子协商开始
 #define TELNET_SE   240          // 子协商结束
 #define TELNET_ECHO 1            // 回显选项
+#define TELNET_SGA  3            // 抑制继续进行选项
+#define TELNET_NAWS 31           // 窗口大小选项
+#define TELNET_LINEMODE 34       // 行模式选项
+#define TELNET_COMPRESS2 86      // MCCP2输出压缩选项
+
+// LINEMODE子协商定义(RFC 1184)
+#define TELNET_LM_MODE 1         // MODE子命令
+#define TELNET_LM_MODE_EDIT 1    // 客户端本地编辑
+#define TELNET_LM_MODE_TRAPSIG 2 // 客户端捕获信号
+#define TELNET_LM_MODE_ACK 4     // 确认
 
-// 客户端状态结构体
+// 选项协商状态(RFC 1143 Q方法)
+#define TELNET_Q_NO      0
+#define TELNET_Q_YES     1
+#define TELNET_Q_WANTNO  2
+#define TELNET_Q_WANTYES 3
+#define TELNET_Q_EMPTY    0      // 无排队请求
+#define TELNET_Q_OPPOSITE 1      // 排队了相反的请求
+
+// 支持协商的选项索引
+enum {
+    TELNET_OPT_ECHO = 0,
+    TELNET_OPT_SGA,
+    TELNET_OPT_NAWS,
+    TELNET_OPT_LINEMODE,
+    TELNET_OPT_COUNT
+};
+
+// 单个选项的协商状态
+typedef struct {
+    unsigned char us;               // 本端状态
+    unsigned char usq;              // 本端排队请求
+    unsigned char him;              // 对端状态
+    unsigned char himq;             // 对端排队请求
+} telnet_opt_t;
+
+// 客户端定时器类型，每个客户端每种类型一个定时器
+typedef enum {
+    TELNET_TIMER_IDLE = 0,          // 空闲超时
+    TELNET_TIMER_NEGOTIATION,       // 选项协商超时
+    TELNET_TIMER_MAX,
+    TELNET_TIMER_THROTTLE = TELNET_TIMER_MAX // 工作线程的限速恢复定时器，不属于某个客户端
+} telnet_timer_type_t;
+
+// 定时器，挂在时间轮的双向链表上
+typedef struct telnet_timer {
+    struct telnet_timer *prev;
+    struct telnet_timer *next;      // 未启动时为NULL
+    uint64_t expires_tick;          // 到期tick
+    int type;                       // 定时器类型
+    void *data;                     // 所属对象
+} telnet_timer_t;
+
+typedef void (*telnet_timer_cb_t)(telnet_timer_t *timer, void *arg);
+
+// 分层时间轮
+typedef struct {
+    telnet_timer_t slots[TELNET_TW_LEVELS][TELNET_TW_SIZE]; // 各层槽位链表头
+    uint64_t current_tick;          // 当前tick
+    int count;                      // 已启动的定时器数量
+} telnet_timer_wheel_t;
+
+// 共享输出缓冲区，内容创建后不再修改，按引用计数释放
+typedef struct telnet_shared {
+    uint32_t refs;                  // 引用计数，跨工作线程原子增减
+    uint32_t len;                   // 数据长度
+    char data[];
+} telnet_shared_t;
+
+// 输出队列块
+typedef struct telnet_outchunk {
+    struct telnet_outchunk *next;
+    uint32_t off;                   // 已发送的偏移
+    uint32_t len;                   // 已写入的数据长度
+    uint32_t cap;                   // 块容量，引用共享缓冲区时为0
+    telnet_shared_t *shared;        // 引用的共享缓冲区，NULL表示数据在本块中
+    char data[];
+} telnet_outchunk_t;
+
+#define TELNET_CHUNK_DATA(chunk) ((chunk)->shared ? (chunk)->shared->data : (chunk)->data)
+
+// 输出队列，处理一批输入期间产生的输出先在这里合并，再由writev一次发出
+typedef struct {
+    telnet_outchunk_t *head;
+    telnet_outchunk_t *tail;
+    size_t bytes;                   // 排队未发送的字节数
+} telnet_outq_t;
+
+// 内存输出接收端，替代socket接收输出，用于微基准
+typedef void (*telnet_sink_fn)(void *arg, const char *data, size_t len);
+
+// 固定响应，启动后只读
+typedef struct {
+    const char *data;
+    size_t len;
+} telnet_resp_t;
+
+// 每个工作线程按秒缓存的时间字符串
+typedef struct {
+    time_t sec;                     // 缓存对应的墙钟秒数，0表示未生成
+    char clock[12];                 // "HH:MM:SS"
+    char time_resp[48];             // time命令的完整输出
+    int time_resp_len;
+} telnet_timecache_t;
+
+// 分级缓冲池，每个工作线程一个，空闲缓冲区按级别挂在链表上
+typedef struct {
+    void *free[TELNET_BUF_CLASSES]; // 各级空闲链表，链表指针存放在缓冲区开头
+    int cached[TELNET_BUF_CLASSES]; // 各级空闲缓冲区个数
+} telnet_bufpool_t;
+
+// 延迟直方图（纳秒）
+typedef struct {
+    uint64_t buckets[TELNET_HIST_BUCKETS];
+    uint64_t count;                 // 样本数
+    uint64_t sum;                   // 样本总和
+} telnet_hist_t;
+
+// 工作线程指标
+typedef struct {
+    uint64_t accepts;               // 接受的连接数
+    uint64_t rejects_full;          // 客户端表已满被拒绝的连接数
+    uint64_t rejects_rate;          // 超过来源IP速率限制被拒绝的连接数
+    uint64_t accept_pauses;         // 连接数已满暂停监听的次数
+    uint64_t timeouts;              // 空闲超时断开的连接数
+    uint64_t bytes_in;              // 接收字节数
+    uint64_t bytes_out;             // 发送字节数
+    uint64_t syscalls;              // 事件循环中的系统调用次数
+    uint64_t loops;                 // 事件循环轮数
+    uint64_t commands[TELNET_CMD_MAX]; // 按命令编号统计的执行次数
+    uint64_t unknown_commands;      // 未知命令次数
+    uint64_t offloaded;             // 交给命令线程池执行的命令数
+    uint64_t offload_rejects;       // 线程池队列已满被拒绝的命令数
+    uint64_t broadcasts;            // 收到的广播消息数
+    uint64_t bcast_dropped;         // 因输出积压丢弃的广播份数
+    uint64_t bcast_truncated;       // 因输出积压截断的广播份数
+    uint64_t bcast_disconnects;     // 因输出积压断开的客户端数
+    uint64_t buf_bytes;             // 会话借用的缓冲区字节数（当前值）
+    uint64_t compress_sessions;     // 正在压缩的会话数（当前值）
+    uint64_t compress_bytes;        // 压缩流占用的字节数（当前值）
+    uint64_t compress_in;           // 压缩前的输出字节数
+    uint64_t compress_out;          // 压缩后的输出字节数
+    uint64_t compress_refused;      // 达到会话上限而未启用压缩的次数
+    uint64_t tls_handshakes;        // 完成的TLS握手数
+    uint64_t tls_resumed;           // 其中恢复会话（票据或会话缓存）的握手数
+    uint64_t tls_failures;          // 失败的TLS握手数
+    uint64_t tls_ktls;              // 发送方向交给内核TLS的会话数
+    uint64_t sched_deferred;        // 预算用完留到下一轮继续的次数
+    uint64_t sched_throttled;       // 超过输入或命令速率被暂停读取的次数
+    uint64_t auth_logins;           // 登录成功次数
+    uint64_t auth_cached;           // 其中由凭据缓存直接通过的次数
+    uint64_t auth_failures;         // 登录失败次数
+    uint64_t auth_busy;             // 校验队列已满被拒绝的登录次数
+    uint64_t auth_blocked;          // 来源IP失败次数过多被拒绝的登录次数
+    telnet_hist_t loop_ns;          // 每轮事件处理耗时（不含epoll_wait等待）
+    telnet_hist_t cmd_ns;           // 命令处理函数耗时
+    telnet_hist_t auth_ns;          // 密码校验耗时（含排队）
+} telnet_metrics_t;
+
+struct telnet_server;
+struct telnet_uring;
+struct telnet_uring_send;
+
+// 客户端冷数据：连接信息和按需分配的缓冲区，只在连接建立、行编辑、子协商和列出客户端时访问；
+// 行缓冲区、子协商缓冲区和预输入缓冲区从工作线程的分级缓冲池借用，空闲会话不占用
 typedef struct {
-    int sockfd;                     // 客户端socket描述符
     struct sockaddr_in addr;        // 客户端地址信息
-    char buffer[TELNET_BUFFER_SIZE];       // 数据缓冲区
-    int buffer_len;                 // 缓冲区数据长度
-    time_t last_active;             // 最后活动时间
-    int authenticated;              // 认证状态（简单示例）
-    char username[32];              // 用户名
-    int telnet_state;               // Telnet协议状态机状态
+    time_t connected_at;            // 连接建立时间
+    char *line;                     // 行缓冲区，有未完成的行时才分配，有效长度见buffer_len
+    unsigned char *sb_buf;          // 子协商内容，子协商期间才分配
+    char *typeahead;                // 命令执行期间收到的原始输入，完成后按序处理
+    unsigned short win_width;       // 客户端窗口宽度(NAWS)
+    unsigned short win_height;      // 客户端窗口高度(NAWS)
+    uint8_t line_class;             // 行缓冲区级别
+    uint8_t typeahead_class;        // 预输入缓冲区级别
+    uint8_t sb_len;                 // 子协商内容长度
+    uint8_t sb_class;               // 子协商缓冲区级别
+    uint8_t authenticated;          // 登录状态(TELNET_AUTH_*)，用户名等登录过程状态见server->auth_login
+} telnet_client_cold_t;
 
-    int closed;                     // 连接关闭标志
-} telnet_client_t;
+// 客户端热数据，每个工作线程启动时按max_clients预分配成数组，槽位索引即数组下标；
+// 事件分发和输入处理每次都要读的字段集中在第一个缓存行
+typedef struct {
+    int sockfd;                     // 客户端socket描述符
+    int slot;                       // 所在客户端表槽位
+    uint32_t generation;            // 槽位代数，槽位释放后递增，用于识别过期的事件标识
+    uint32_t events;                // 当前注册的epoll事件
+    uint8_t in_use;                 // 槽位上有客户端
+    uint8_t closed;                 // 连接关闭标志
+    uint8_t read_paused;            // 暂停读取的原因(TELNET_PAUSE_*)，0表示正常读取
+    uint8_t flush_queued;           // 已加入待发送列表
+    uint8_t telnet_state;           // Telnet协议状态机状态
+    uint8_t telnet_verb;            // 正在读取选项的命令(WILL/WONT/DO/DONT)
+    uint8_t cmd_pending;            // 有命令在线程池中执行
+    uint8_t recv_armed;             // io_uring: 已提交multishot接收
+    time_t last_active;             // 最后活动时间，更新时无需重置定时器
+    telnet_outq_t outq;             // 输出队列
+    struct telnet_server *server;   // 所属的工作线程
+
+    telnet_client_cold_t *cold;     // 冷数据
+    int buffer_len;                 // 行缓冲区数据长度
+    int typeahead_len;              // 缓存的输入长度
+    telnet_opt_t opts[TELNET_OPT_COUNT]; // 选项协商状态
+    int next_free;                  // 空闲时为空闲链表中的下一个槽位
+    uint8_t linemode_edit;          // 客户端处于LINEMODE本地编辑
+    uint8_t bcast_policy;           // 输出积压时广播的处理方式(TELNET_BCAST_*)
+    uint8_t transport;              // 会话的传输层(TELNET_TRANSPORT_*)
+    uint8_t compress;               // MCCP2压缩状态(TELNET_MCCP_*)，压缩流在server->mccp中
+    struct telnet_uring_send *send_req; // io_uring: 发送中的请求，NULL表示没有
+    telnet_timer_t timers[TELNET_TIMER_MAX]; // 客户端定时器
+} __attribute__((aligned(64))) telnet_client_t;
 
-// 服务器状态结构体
+// 服务器配置，由主线程解析命令行后填写，工作线程只读
 typedef struct {
+    int port;                       // 监听端口
+    int threads;                    // 工作线程（reactor）数量
+    int max_clients;                // 最大客户端数（所有工作线程合计）
+    int edge_triggered;             // 1: 边缘触发(EPOLLET), 0: 水平触发
+    int idle_timeout;               // 空闲超时时间（秒）
+    int high_water;                 // 输出队列高水位（字节）
+    int line_max;                   // 最大行长度
+    int metrics_port;               // 指标端口（仅本机），0表示不启用
+    int io_backend;                 // 请求的事件后端(TELNET_IO_*)
+    int transport;                  // 接受连接使用的传输层(TELNET_TRANSPORT_*)
+    int backlog;                    // 监听队列长度
+    int accept_rate;                // 每个来源IP每秒允许的新连接数，0表示不限制
+    int accept_burst;               // 每个来源IP允许的突发连接数
+    int pool_threads;               // 命令线程池大小，0表示所有命令在事件循环中执行
+    int bcast_policy;               // 新连接默认的广播积压处理方式(TELNET_BCAST_*)
+    int compress_level;             // MCCP2压缩级别1-9，0表示不提供压缩
+    int compress_max;               // 同时压缩的会话上限（所有工作线程合计），非0时使用小窗口
+    int log_level;                  // 日志级别(TELNET_LOG_*)
+    const char *log_target;         // 日志输出：NULL或"stderr"、"syslog"、文件路径
+    const char *resp_file;          // 覆盖固定响应的文件，NULL表示使用内置响应
+    int tls_port;                   // TLS监听端口，0表示不启用
+    const char *tls_cert;           // 证书链文件(PEM)
+    const char *tls_key;            // 私钥文件(PEM)，NULL表示与证书在同一文件
+    char **argv;                    // 启动命令行，热重启时用它启动新进程
+    int upgrade_fd;                 // 热重启：从该socket接收旧进程的监听socket和会话，-1表示正常启动
+    int input_rate;                 // 每个会话每秒允许输入的字节数，0表示不限制
+    int input_burst;                // 输入突发字节数
+    int cmd_rate;                   // 每个会话每秒允许执行的命令数，0表示不限制
+    int cmd_burst;                  // 命令突发条数
+    const char *auth_file;          // 密码文件，NULL表示不需要登录
+    int auth_threads;               // 密码校验线程数
+    int auth_cache_ttl;             // 凭据缓存有效期（秒），0表示不缓存
+} telnet_config_t;
+
+struct telnet_master;
+
+// 服务器状态结构体，每个工作线程一个实例，互不共享
+typedef struct telnet_server {
+    int worker_id;                  // 工作线程编号
+    struct telnet_master *master;   // 所属的主控对象
+    const telnet_config_t *config;  // 全局只读配置
     int listen_sockfd;              // 监听socket描述符
+    int tls_listen_sockfd;          // TLS监听socket描述符，-1表示未启用
     int port;                       // 监听端口
-    telnet_client_t *clients[TELNET_MAX_CLIENTS]; // 客户端数组
-    int max_clients;                // 最大客户端数
-    int running;                    // 服务器运行标志
-    fd_set read_fds;                // 用于select的读描述符集
-    int max_fd;                     // 最大描述符值
+    telnet_client_t *clients;       // 客户端表，启动时按max_clients预分配
+    telnet_client_cold_t *colds;    // 客户端冷数据，与clients一一对应
+    int capacity;                   // 客户端表容量，等于max_clients
+    int free_head;                  // 空闲槽位链表头，-1表示无空闲
+    int *fd_map;                    // 描述符到槽位的映射，-1表示无
+    int fd_map_size;                // 描述符映射表大小
+    int max_clients;                // 本工作线程最大客户端数
+    int client_count;               // 当前客户端数
+    volatile int running;           // 服务器运行标志
+    int epoll_fd;                   // epoll实例描述符
+    int wake_fd;                    // 跨线程唤醒用的eventfd
+    int edge_triggered;             // 1: 边缘触发(EPOLLET), 0: 水平触发
+    int io_backend;                 // 实际使用的事件后端，io_uring不可用时回退到epoll
+    struct telnet_uring *uring;     // io_uring实例，epoll后端时为NULL
+    struct telnet_ratelimit *ratelimit; // 来源IP限速表，未启用时为NULL
+    int transport;                  // 接受连接使用的传输层(TELNET_TRANSPORT_*)
+    struct telnet_memnet *memnet;   // 内存传输的连接表，未使用时为NULL
+    struct telnet_tls *tls;         // TLS连接表，未启用时为NULL
+    int sim_clock;                  // 使用模拟时钟，时间只由telnets_sim_clock_advance推进
+    uint64_t sim_base_ms;           // 模拟时钟起点的单调时钟
+    time_t sim_base_sec;            // 模拟时钟起点的墙钟秒数
+    int accept_paused;              // 连接数已满，暂停监听socket
+    int accept_pending;             // 上一轮接受达到上限，监听队列可能还有连接
+    pthread_mutex_t table_lock;     // 保护客户端表的增删，供其他线程读取客户端列表
+    struct telnet_job *pool_done;   // 命令线程池完成的任务（无锁栈，多生产者单消费者）
+    struct telnet_bcast *bcast_inbox; // 待投递的广播（无锁栈，多生产者单消费者）
+    telnet_timer_wheel_t timers;    // 客户端定时器时间轮
+    uint64_t now_ms;                // 本轮事件循环的单调时钟
+    telnet_timecache_t timecache;   // 按秒缓存的时间字符串
+    char *recv_buf;                 // 接收暂存区，各客户端轮流使用，不清零
+    telnet_bufpool_t bufpool;       // 会话缓冲区的分级缓冲池
+    z_stream **mccp;                // 按槽位索引的压缩流，未压缩的会话为NULL；未启用压缩时整表为NULL
+    int mccp_count;                 // 正在压缩的会话数
+    int mccp_max;                   // 本工作线程同时压缩的会话上限
+    uint64_t *flush_list;           // 本轮有待发送输出的客户端事件标识
+    int flush_count;                // 待发送列表长度
+    int flush_cap;                  // 待发送列表容量
+    uint64_t *ready_list;           // 就绪队列：预算用完还有工作的会话的事件标识，按加入顺序轮流处理
+    int ready_count;
+    int ready_cap;
+    uint64_t *throttle_list;        // 因限速暂停读取的会话的事件标识
+    int throttle_count;
+    int throttle_cap;
+    telnet_timer_t throttle_timer;  // 有会话被限速时每个tick检查一次令牌
+    struct telnet_sched_bucket *buckets; // 按槽位索引的会话令牌桶，未配置限速时为NULL
+    int cmd_budget;                 // 当前处理的会话本轮剩余的命令数，-1表示不限制
+    struct telnet_auth_job *auth_done; // 密码校验完成的任务（无锁栈，多生产者单消费者）
+    struct telnet_auth_cache *auth_cache; // 最近校验通过的凭据，未启用认证时为NULL
+    struct telnet_auth_login **auth_login; // 按槽位索引的登录过程状态，登录完成后归还缓冲池；未启用认证时整表为NULL
+    const char **auth_user;         // 按槽位索引的已登录用户名，指向只读的密码表；未启用认证时整表为NULL
+    telnet_metrics_t metrics;       // 本工作线程的指标
+    telnet_metrics_t *stats_merged; // stats命令合并各工作线程指标的暂存区，启动时分配
 } telnet_server_t;
 
+// 传输层接口，会话按client->transport选择；描述符由传输层解释，TCP为socket，内存传输为连接编号
+typedef struct {
+    const char *name;
+    // 接受一个连接，返回描述符，没有待接受的连接时返回-1并设置errno
+    int (*accept)(telnet_server_t *server, struct sockaddr_in *addr);
+    // 与recv/writev语义相同，没有数据或缓冲区满时返回-1，errno为EAGAIN
+    ssize_t (*read)(telnet_server_t *server, int fd, void *buf, size_t len);
+    ssize_t (*writev)(telnet_server_t *server, int fd, const struct iovec *iov, int iovcnt);
+    // 修改会话关注的事件，NULL表示描述符由事件后端(epoll/io_uring)监视
+    int (*watch)(telnet_server_t *server, telnet_client_t *client, uint32_t events);
+    void (*close)(telnet_server_t *server, int fd);
+} telnet_transport_t;
+
+extern const telnet_transport_t *const telnet_transports[TELNET_TRANSPORT_COUNT];
+#define TELNET_TRANSPORT(client) (telnet_transports[(client)->transport])
+
+// 内存连接的输出回调，data为NULL表示服务器关闭了连接
+typedef void (*telnet_mem_output_fn)(void *arg, int conn, const char *data, size_t len);
+
+// 指向行缓冲区的字符串切片，不以'\0'结尾
+typedef struct {
+    const char *ptr;
+    int len;
+} telnet_slice_t;
+
+// 解析后的命令行
+typedef struct {
+    telnet_slice_t name;            // 命令名
+    telnet_slice_t rest;            // 命令名之后的原始内容
+    telnet_slice_t argv[TELNET_CMD_MAX_ARGS]; // 按空白切分的参数
+    int argc;                       // 参数个数
+} telnet_args_t;
+
+// 命令执行上下文，命令通过telnets_cmd_write等函数输出
+typedef struct {
+    telnet_server_t *server;        // 所在工作线程
+    telnet_client_t *client;        // 发出命令的客户端，在线程池中执行时为NULL
+    telnet_outq_t *sink;            // 输出目标，NULL时直接写入客户端输出队列
+    int slot;                       // 发出命令的客户端槽位
+} telnet_cmd_ctx_t;
+
+typedef void (*telnet_cmd_fn_t)(telnet_cmd_ctx_t *ctx, const telnet_args_t *args);
+
+#define TELNET_CMD_HIDDEN 0x01          // 不在help中列出（别名等）
+#define TELNET_CMD_OFFLOAD 0x02         // 在命令线程池中执行，处理函数不能访问ctx->client
+
+// 供其他线程使用的客户端信息副本
+typedef struct {
+    int worker;                     // 所在工作线程
+    int slot;                       // 槽位
+    struct sockaddr_in addr;        // 客户端地址
+    time_t connected_at;            // 连接建立时间
+    time_t last_active;             // 最后活动时间
+    char username[TELNET_AUTH_NAME_MAX]; // 登录的用户名，未登录或未启用认证时为空
+} telnet_client_info_t;
+
+// 命令定义
+typedef struct {
+    const char *name;               // 命令名，小写
+    const char *usage;              // help中显示的用法，NULL时显示命令名
+    const char *help;               // 说明
+    telnet_cmd_fn_t handler;        // 处理函数
+    int flags;                      // TELNET_CMD_*标志
+    int id;                         // 注册后分配的编号
+} telnet_cmd_t;
+
+// 主控结构体，只负责启动、停止工作线程，不参与数据处理
+typedef struct telnet_master {
+    telnet_config_t config;         // 服务器配置
+    int nworkers;                   // 工作线程数量
+    telnet_server_t **workers;      // 每个工作线程的服务器实例
+    pthread_t *threads;             // 工作线程句柄
+    int started;                    // 已启动的工作线程数
+    int metrics_fd;                 // 指标端口监听socket，-1表示未启用
+    pthread_t metrics_thread;       // 指标端口线程
+    int metrics_started;            // 指标端口线程已启动
+    struct telnet_pool *pool;       // 命令线程池，未启用时为NULL
+    struct telnet_auth *auth;       // 密码表和校验线程池，未启用认证时为NULL
+    SSL_CTX *tls_ctx;               // 所有工作线程共用的TLS上下文，票据密钥和会话缓存随之共享
+    pthread_mutex_t upgrade_lock;   // 热重启时工作线程停下和恢复
+    pthread_cond_t upgrade_cond;
+    volatile int upgrade_park;      // 主线程要求工作线程停在事件循环之外
+    int upgrade_parked;             // 已停下的工作线程数
+} telnet_master_t;
+
 // 函数声明
 
+// 主控管理函数
+void telnet_config_default(telnet_config_t *config);
+telnet_master_t *telnet_master_init(const telnet_config_t *config);
+int telnet_master_start(telnet_master_t *master);
+void telnet_master_wait(telnet_master_t *master);
+void telnet_master_stop(telnet_master_t *master);
+void telnet_master_destroy(telnet_master_t *master);
+
 // 服务器管理函数
-telnet_server_t *telnet_server_init(int port);
+telnet_server_t *telnet_server_init(const telnet_config_t *config, int worker_id);
+int telnet_server_listen(telnet_server_t *server);
+int telnet_server_inherit(telnet_server_t *server, int listen_fd, int tls_listen_fd);
 int telnet_server_start(telnet_server_t *server);
+int telnet_server_poll(telnet_server_t *server, int max_wait_ms);
 void telnet_server_stop(telnet_server_t *server);
 void telnet_server_destroy(telnet_server_t *server);
 
 // 客户端管理函数
-int telnets_add_client(telnet_server_t *server, int sockfd, struct sockaddr_in *addr);
+int telnets_accept_client(telnet_server_t *server, int sockfd, struct sockaddr_in *addr, int transport);
+int telnets_add_client(telnet_server_t *server, int sockfd, struct sockaddr_in *addr, int transport);
+int telnets_idle_timeout(const telnet_server_t *server, const telnet_client_t *client);
+void telnets_session_start(telnet_server_t *server, telnet_client_t *client);
 void telnets_remove_client(telnet_server_t *server, int client_index);
+void telnets_session_release(telnet_server_t *server, telnet_client_t *client);
 void telnets_cleanup_clients(telnet_server_t *server);
 
 // 网络处理函数
 void telnets_handle_new_connection(telnet_server_t *server);
+void telnets_handle_tls_connection(telnet_server_t *server);
 void telnets_recv_data_proc(telnet_server_t *server, int client_index);
+int telnets_recv_input(telnet_server_t *server, int client_index, char *buffer, int len);
+int telnets_recv_process(telnet_server_t *server, int client_index, char *buffer, int bytes_received);
+void telnets_recv_closed(telnet_server_t *server, int client_index, int err);
+int telnets_recv_typeahead(telnet_server_t *server, int client_index);
 void telnets_handle_commands(telnet_client_t *client, const char *data, int len);
-void telnets_welcome(int sockfd);
-void telnets_send_prompt(int sockfd);
+int telnets_telnet_byte(telnet_client_t *client, unsigned char c);
+void telnets_line_release(telnet_client_t *client);
+void telnets_sb_release(telnet_client_t *client);
+void telnets_welcome(telnet_client_t *client);
+void telnets_send_prompt(telnet_client_t *client);
+
+// 输出函数
+int telnets_output(telnet_client_t *client, const char *data, size_t len);
+int telnets_output_str(telnet_client_t *client, const char *str);
+int telnets_output_splice(telnet_client_t *client, telnet_outq_t *src);
+int telnets_outq_append(telnet_outq_t *outq, const char *data, size_t len);
+int telnets_printf(telnet_client_t *client, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+int telnets_flush_client(telnet_server_t *server, telnet_client_t *client);
+void telnets_flush_pending(telnet_server_t *server);
+size_t telnets_flush_pending_sink(telnet_server_t *server, telnet_sink_fn sink, void *arg);
+void telnets_outq_clear(telnet_outq_t *outq);
+void telnets_outchunk_free(telnet_outchunk_t *chunk);
+void telnets_outchunk_cache_release(void);
+telnet_shared_t *telnets_shared_create(const char *data, size_t len);
+void telnets_shared_ref(telnet_shared_t *shared, uint32_t n);
+void telnets_shared_unref(telnet_shared_t *shared);
+int telnets_output_shared(telnet_client_t *client, telnet_shared_t *shared, uint32_t len);
+
+// 分级缓冲池函数
+char *telnets_buf_alloc(telnet_server_t *server, size_t size, uint8_t *cls);
+char *telnets_buf_grow(telnet_server_t *server, char *buf, uint8_t *cls, size_t used, size_t size, int wipe);
+void telnets_buf_free(telnet_server_t *server, char *buf, uint8_t cls);
+void telnets_buf_wipe(telnet_server_t *server, char *buf, uint8_t cls);
+void telnets_buf_pool_destroy(telnet_server_t *server);
+
+// 事件处理函数
+int telnets_event_init(telnet_server_t *server);
+void telnets_event_wake(telnet_server_t *server);
+int telnets_event_add(telnet_server_t *server, int sockfd, uint64_t token);
+int telnets_event_mod(telnet_server_t *server, telnet_client_t *client, uint32_t events);
+void telnets_event_del(telnet_server_t *server, int sockfd);
+void telnets_event_close(telnet_server_t *server);
+
+// io_uring后端函数
+int telnets_uring_init(telnet_server_t *server);
+void telnets_uring_destroy(telnet_server_t *server);
+int telnets_uring_add(telnet_server_t *server, int sockfd, uint64_t token);
+int telnets_uring_mod(telnet_server_t *server, telnet_client_t *client, uint32_t events);
+void telnets_uring_del(telnet_server_t *server, telnet_client_t *client);
+void telnets_uring_del_accept(telnet_server_t *server);
+int telnets_uring_send(telnet_server_t *server, telnet_client_t *client);
+int telnets_uring_defer_close(telnet_server_t *server, telnet_client_t *client);
+int telnets_uring_wait(telnet_server_t *server, int timeout_ms);
+void telnets_uring_dispatch(telnet_server_t *server);
+
+// 内存传输函数
+int telnets_mem_attach(telnet_server_t *server, telnet_mem_output_fn output, void *arg);
+void telnets_mem_detach(telnet_server_t *server);
+int telnets_mem_connect(telnet_server_t *server, const struct sockaddr_in *addr);
+int telnets_mem_write(telnet_server_t *server, int conn, const char *data, size_t len);
+void telnets_mem_shutdown(telnet_server_t *server, int conn);
+int telnets_mem_pending(const telnet_server_t *server);
+void telnets_mem_dispatch(telnet_server_t *server);
+
+// TLS传输函数
+int telnets_tls_start(telnet_master_t *master);
+void telnets_tls_free(telnet_master_t *master);
+int telnets_tls_init(telnet_server_t *server);
+void telnets_tls_destroy(telnet_server_t *server);
+
+// 客户端表函数
+int telnets_table_init(telnet_server_t *server);
+void telnets_table_destroy(telnet_server_t *server);
+telnet_client_t *telnets_table_alloc(telnet_server_t *server, int sockfd);
+void telnets_table_free(telnet_server_t *server, int client_index);
+int telnets_table_snapshot(telnet_server_t *server, telnet_client_info_t *out, int max);
+telnet_client_t *telnets_get_client(telnet_server_t *server, int client_index);
+telnet_client_t *telnets_lookup_token(telnet_server_t *server, uint64_t token);
+
+// 定时器函数
+uint64_t telnets_now_ns(void);
+uint64_t telnets_now_ms(void);
+time_t telnets_clock_update(void);
+time_t telnets_clock_now(void);
+void telnets_clock_set(time_t sec);
+void telnets_sim_clock_start(telnet_server_t *server);
+void telnets_sim_clock_advance(telnet_server_t *server, uint64_t ms);
+void telnets_timer_wheel_init(telnet_timer_wheel_t *wheel, uint64_t now_ms);
+void telnets_timer_init(telnet_timer_t *timer, int type, void *data);
+int telnets_timer_pending(const telnet_timer_t *timer);
+void telnets_timer_arm(telnet_timer_wheel_t *wheel, telnet_timer_t *timer, uint64_t now_ms, uint64_t delay_ms);
+void telnets_timer_cancel(telnet_timer_wheel_t *wheel, telnet_timer_t *timer);
+void telnets_timer_advance(telnet_timer_wheel_t *wheel, uint64_t now_ms,
+                           telnet_timer_cb_t callback, void *arg);
+int telnets_timer_next_timeout(const telnet_timer_wheel_t *wheel, uint64_t now_ms);
+
+// 选项协商函数
+void telnets_option_start(telnet_client_t *client);
+void telnets_option_enable(telnet_client_t *client, unsigned char code, int remote);
+void telnets_option_disable(telnet_client_t *client, unsigned char code, int remote);
+void telnets_option_recv(telnet_client_t *client, unsigned char verb, unsigned char code);
+void telnets_option_subneg(telnet_client_t *client, const unsigned char *data, int len);
+void telnets_option_timeout(telnet_client_t *client);
+int telnets_option_server_echo(const telnet_client_t *client);
+
+// MCCP2输出压缩函数
+int telnets_mccp_init(telnet_server_t *server);
+void telnets_mccp_destroy(telnet_server_t *server);
+void telnets_mccp_offer(telnet_client_t *client);
+void telnets_mccp_recv(telnet_client_t *client, unsigned char verb);
+void telnets_mccp_timeout(telnet_client_t *client);
+int telnets_mccp_write(telnet_client_t *client, const char *data, size_t len);
+int telnets_mccp_flush(telnet_client_t *client);
+void telnets_mccp_end(telnet_client_t *client, int finish);
+void telnets_mccp_resume(telnet_client_t *client);
+
+// 调度函数
+int telnets_sched_init(telnet_server_t *server);
+void telnets_sched_destroy(telnet_server_t *server);
+void telnets_sched_reset(telnet_client_t *client);
+void telnets_sched_begin(telnet_server_t *server);
+void telnets_sched_end(telnet_server_t *server);
+size_t telnets_sched_read_len(telnet_client_t *client, size_t budget);
+void telnets_sched_charge(telnet_client_t *client, size_t len);
+int telnets_sched_cmd_allow(telnet_client_t *client);
+void telnets_sched_defer(telnet_client_t *client);
+void telnets_sched_run(telnet_server_t *server, int count);
+void telnets_sched_throttle_expired(telnet_server_t *server);
+
+// 热重启函数
+int telnets_upgrade_start(telnet_master_t *master);
+void telnets_upgrade_park(telnet_server_t *server);
+int telnets_upgrade_receive(telnet_master_t *master);
+
+// 输入扫描函数
+void telnets_scan_init(void);
+const char *telnets_scan_name(void);
+size_t telnets_scan_printable(const unsigned char *data, size_t len);
+
+// 指标函数
+void telnets_hist_record(telnet_hist_t *hist, uint64_t value);
+uint64_t telnets_hist_bucket_upper(int index);
+uint64_t telnets_hist_percentile(const telnet_hist_t *hist, double pct);
+int telnets_metrics_collect(telnet_master_t *master, telnet_metrics_t *out);
+int telnets_metrics_format(telnet_master_t *master, char **out, size_t *out_len);
+int telnets_metrics_start(telnet_master_t *master);
+void telnets_metrics_stop(telnet_master_t *master);
+
+// 命令线程池函数
+int telnets_pool_start(telnet_master_t *master);
+void telnets_pool_stop(telnet_master_t *master);
+int telnets_pool_submit(telnet_server_t *server, telnet_client_t *client, const telnet_cmd_t *cmd,
+                        const char *line, int len);
+void telnets_pool_complete(telnet_server_t *server);
+void telnets_pool_discard(telnet_server_t *server);
+
+// 认证函数
+int telnets_auth_load(telnet_master_t *master);
+int telnets_auth_start(telnet_master_t *master);
+void telnets_auth_stop(telnet_master_t *master);
+void telnets_auth_free(telnet_master_t *master);
+int telnets_auth_init(telnet_server_t *server);
+void telnets_auth_destroy(telnet_server_t *server);
+int telnets_auth_enabled(const telnet_server_t *server);
+int telnets_auth_begin(telnet_server_t *server, telnet_client_t *client);
+void telnets_auth_release(telnet_server_t *server, telnet_client_t *client);
+const char *telnets_auth_user(const telnet_server_t *server, const telnet_client_t *client);
+void telnets_auth_save(const telnet_server_t *server, const telnet_client_t *client,
+                       uint8_t *failures, char *username);
+void telnets_auth_restore(telnet_server_t *server, telnet_client_t *client, int state,
+                          int failures, const char *username);
+void telnets_auth_prompt(telnet_client_t *client);
+void telnets_auth_line(telnet_server_t *server, telnet_client_t *client, char *line, int len);
+void telnets_auth_complete(telnet_server_t *server);
+void telnets_auth_discard(telnet_server_t *server);
+
+// 广播函数
+int telnets_broadcast(telnet_master_t *master, const char *data, size_t len);
+void telnets_broadcast_deliver(telnet_server_t *server);
+void telnets_broadcast_discard(telnet_server_t *server);
+int telnets_broadcast_parse_policy(const char *name);
+const char *telnets_broadcast_policy_name(int policy);
+
+// 响应缓存函数
+int telnets_resp_init(const char *path);
+void telnets_resp_free(void);
+const telnet_resp_t *telnets_resp_get(int id);
+const telnet_timecache_t *telnets_resp_time(telnet_server_t *server);
+
+// 限速函数
+struct telnet_ratelimit *telnets_ratelimit_create(uint32_t rate, uint32_t period_ms, uint32_t burst);
+int telnets_ratelimit_take(struct telnet_ratelimit *rl, uint32_t addr, uint64_t now_ms);
+void telnets_ratelimit_refund(struct telnet_ratelimit *rl, uint32_t addr, uint64_t now_ms);
+int telnets_ratelimit_init(telnet_server_t *server);
+void telnets_ratelimit_free(telnet_server_t *server);
+int telnets_ratelimit_allow(telnet_server_t *server, const struct sockaddr_in *addr);
+
+// 日志函数
+int telnets_log_init(int level, const char *target);
+void telnets_log_shutdown(void);
+void telnets_log_set_worker(int worker_id);
+int telnets_log_parse_level(const char *name);
+int telnets_log_enabled(int level);
+void telnets_log_write(int level, int event, const struct sockaddr_in *addr, int slot, int64_t arg, const char *text);
+void telnets_log_msg(int level, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+void telnets_log_error(const char *what, int err);
+void telnets_log_errno(const char *what);
+uint64_t telnets_log_dropped(void);
 
 // 工具函数
 int telnets_find_client_index(telnet_server_t *server, int sockfd);
-int telnets_find_available_slot(telnet_server_t *server);
 time_t get_current_time(void);
-int is_telnet_client_timeout(telnet_client_t *client);
+int is_telnet_client_timeout(telnet_client_t *client, int idle_timeout);
 void telnets_trim_newline(char *str);
-void telnets_command_proc(telnet_client_t *client, const char *command);
+
+// 命令函数
+int telnets_cmd_init(void);
+int telnets_cmd_register(const telnet_cmd_t *cmd);
+int telnets_cmd_register_table(const telnet_cmd_t *cmds);
+void telnets_cmd_freeze(void);
+const telnet_cmd_t *telnets_cmd_lookup(const char *name, int len);
+int telnets_cmd_count(void);
+const telnet_cmd_t *telnets_cmd_get(int id);
+void telnets_cmd_parse(const char *line, int len, telnet_args_t *args);
+int telnets_cmd_write(telnet_cmd_ctx_t *ctx, const char *data, size_t len);
+int telnets_cmd_puts(telnet_cmd_ctx_t *ctx, const char *str);
+int telnets_cmd_printf(telnet_cmd_ctx_t *ctx, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+int telnets_cmd_help_text(telnet_outq_t *out);
+void telnets_command_proc(telnet_server_t *server, telnet_client_t *client, const char *line, int len);
 int set_tcp_nonblocking(int sockfd);
 
 
@@ -0,0 +1,253 @@
+/**
+ * @file telnet_table.c
+ * @brief Telnet服务器客户端表
+ * @date liuliang 2026-01-25
+ *
+ * 本文件包含预分配的客户端表实现
+ * 客户端结构在启动时按max_clients一次分配，热数据和冷数据分成两个数组，连接和断开不调用系统分配器；
+ * 空闲槽位用链表管理，分配和释放都是O(1)；
+ * 描述符到槽位有直接映射；槽位释放后代数递增，过期的事件标识无法命中新客户端；
+ * 只有所属工作线程修改客户端表，增删时持有table_lock，其他线程持锁复制客户端列表
+ */
+
+#include "telnet_server.h"
+
+
+// 扩大描述符映射表使其能容纳sockfd
+static int telnets_fd_map_reserve(telnet_server_t *server, int sockfd)
+{
+    int new_size;
+    int *fd_map;
+
+    if (sockfd < server->fd_map_size)
+    {
+        return 0;
+    }
+
+    new_size = server->fd_map_size ? server->fd_map_size : TELNET_TABLE_INIT_SIZE;
+    while (new_size <= sockfd)
+    {
+        new_size *= 2;
+    }
+
+    fd_map = (int *)realloc(server->fd_map, new_size * sizeof(int));
+    if (!fd_map)
+    {
+        telnets_log_errno("Failed to grow fd map");
+        return -1;
+    }
+
+    for (int i = server->fd_map_size; i < new_size; i++)
+    {
+        fd_map[i] = -1;
+    }
+
+    server->fd_map = fd_map;
+    server->fd_map_size = new_size;
+    return 0;
+}
+
+// 初始化客户端表，预分配所有客户端结构
+int telnets_table_init(telnet_server_t *server)
+{
+    void *clients = NULL;
+
+    server->capacity = server->max_clients;
+    server->free_head = -1;
+    server->fd_map = NULL;
+    server->fd_map_size = 0;
+
+    // 热数据按缓存行对齐；冷数据用calloc，大块分配的页面在首次使用时才占用物理内存
+    if (posix_memalign(&clients, 64, (size_t)server->capacity * sizeof(telnet_client_t)) != 0)
+    {
+        telnets_log_msg(TELNET_LOG_ERROR, "Failed to allocate client table");
+        return -1;
+    }
+    server->clients = (telnet_client_t *)clients;
+    server->colds = (telnet_client_cold_t *)calloc(server->capacity, sizeof(telnet_client_cold_t));
+    if (!server->colds)
+    {
+        telnets_log_errno("Failed to allocate client table");
+        free(server->clients);
+        server->clients = NULL;
+        return -1;
+    }
+
+    memset(server->clients, 0, (size_t)server->capacity * sizeof(telnet_client_t));
+
+    // 按索引顺序挂到空闲链表
+    for (int i = server->capacity - 1; i >= 0; i--)
+    {
+        telnet_client_t *client = &server->clients[i];
+
+        client->slot = i;
+        client->cold = &server->colds[i];
+        client->next_free = server->free_head;
+        server->free_head = i;
+    }
+
+    pthread_mutex_init(&server->table_lock, NULL);
+    return 0;
+}
+
+// 释放客户端表（不关闭客户端）
+void telnets_table_destroy(telnet_server_t *server)
+{
+    if (!server->clients)
+    {
+        return;
+    }
+
+    free(server->clients);
+    free(server->colds);
+    free(server->fd_map);
+    server->clients = NULL;
+    server->colds = NULL;
+    server->fd_map = NULL;
+    server->capacity = 0;
+    server->fd_map_size = 0;
+    server->free_head = -1;
+    pthread_mutex_destroy(&server->table_lock);
+}
+
+// 从空闲链表取一个客户端结构并重置热数据，冷数据由调用者填写，表满返回NULL
+// sockfd为-1时是不绑定描述符的会话（微基准），不进入描述符映射
+telnet_client_t *telnets_table_alloc(telnet_server_t *server, int sockfd)
+{
+    telnet_client_t *client;
+    telnet_client_cold_t *cold;
+    uint32_t generation;
+    int index;
+
+    pthread_mutex_lock(&server->table_lock);
+    index = server->free_head;
+    if (index < 0 || telnets_fd_map_reserve(server, sockfd) < 0)
+    {
+        pthread_mutex_unlock(&server->table_lock);
+        return NULL;
+    }
+
+    client = &server->clients[index];
+    server->free_head = client->next_free;
+
+    // 槽位代数和冷数据指针跨连接保留
+    generation = client->generation;
+    cold = client->cold;
+    memset(client, 0, sizeof(telnet_client_t));
+    client->server = server;
+    client->cold = cold;
+    client->slot = index;
+    client->generation = generation;
+    client->sockfd = sockfd;
+    client->next_free = -1;
+    client->in_use = 1;
+    for (int i = 0; i < TELNET_TIMER_MAX; i++)
+    {
+        telnets_timer_init(&client->timers[i], i, client);
+    }
+
+    if (sockfd >= 0)
+    {
+        server->fd_map[sockfd] = index;
+    }
+    server->client_count++;
+    pthread_mutex_unlock(&server->table_lock);
+
+    return client;
+}
+
+// 释放槽位，代数递增使旧的事件标识失效；客户端结构仍可访问，直到槽位被重新分配
+void telnets_table_free(telnet_server_t *server, int client_index)
+{
+    telnet_client_t *client = &server->clients[client_index];
+
+    pthread_mutex_lock(&server->table_lock);
+    if (client->sockfd >= 0 && client->sockfd < server->fd_map_size)
+    {
+        server->fd_map[client->sockfd] = -1;
+    }
+
+    client->in_use = 0;
+    client->generation++;
+    client->next_free = server->free_head;
+    server->free_head = client_index;
+    server->client_count--;
+    pthread_mutex_unlock(&server->table_lock);
+}
+
+// 复制客户端信息，可在其他线程调用，返回复制的个数
+int telnets_table_snapshot(telnet_server_t *server, telnet_client_info_t *out, int max)
+{
+    int count = 0;
+
+    pthread_mutex_lock(&server->table_lock);
+    for (int i = 0; i < server->capacity && count < max; i++)
+    {
+        const telnet_client_t *client = &server->clients[i];
+        const char *user;
+
+        if (!client->in_use)
+        {
+            continue;
+        }
+
+        out[count].worker = server->worker_id;
+        out[count].slot = i;
+        out[count].addr = client->cold->addr;
+        out[count].connected_at = client->cold->connected_at;
+        // 最后活动时间由工作线程不加锁更新，读到旧值不影响列表
+        out[count].last_active = client->last_active;
+        // 已登录的用户名指向只读的密码表，登录完成后才设置
+        user = telnets_auth_user(server, client);
+        out[count].username[0] = '\0';
+        if (user)
+        {
+            strcpy(out[count].username, user);
+        }
+        count++;
+    }
+    pthread_mutex_unlock(&server->table_lock);
+
+    return count;
+}
+
+// 按槽位索引获取客户端
+telnet_client_t *telnets_get_client(telnet_server_t *server, int client_index)
+{
+    if (client_index < 0 || client_index >= server->capacity)
+    {
+        return NULL;
+    }
+
+    return server->clients[client_index].in_use ? &server->clients[client_index] : NULL;
+}
+
+// 按事件标识获取客户端，槽位已被重用时返回NULL
+telnet_client_t *telnets_lookup_token(telnet_server_t *server, uint64_t token)
+{
+    int index = TELNET_TOKEN_SLOT(token);
+
+    if (index < 0 || index >= server->capacity)
+    {
+        return NULL;
+    }
+
+    // 代数和使用标志在同一缓存行，查找只访问客户端结构
+    if (!server->clients[index].in_use || server->clients[index].generation != TELNET_TOKEN_GEN(token))
+    {
+        return NULL;
+    }
+
+    return &server->clients[index];
+}
+
+// 查找客户端索引
+int telnets_find_client_index(telnet_server_t *server, int sockfd)
+{
+    if (sockfd < 0 || sockfd >= server->fd_map_size)
+    {
+        return -1;
+    }
+
+    return server->fd_map[sockfd];
+}
@@ -0,0 +1,315 @@
+/**
+ * @file telnet_timer.c
+ * @brief Telnet服务器分层时间轮
+ * @date liuliang 2026-01-25
+ *
+ * 本文件包含分层时间轮定时器的实现
+ * 每层64个槽位，第0层每个槽位一个tick，上层槽位到期时逐层下放；
+ * 插入、删除O(1)，推进时只处理到期槽位，事件循环可以睡眠到下一个到期点
+ */
+
+#include "telnet_server.h"
+
+// 缓存的墙钟秒数，各工作线程每轮事件循环更新，其他线程只读
+static time_t telnet_clock_sec = 0;
+
+// 链表操作
+static void telnets_timer_list_init(telnet_timer_t *head)
+{
+    head->prev = head;
+    head->next = head;
+}
+
+static int telnets_timer_list_empty(const telnet_timer_t *head)
+{
+    return head->next == head;
+}
+
+static void telnets_timer_list_add(telnet_timer_t *head, telnet_timer_t *timer)
+{
+    timer->prev = head->prev;
+    timer->next = head;
+    head->prev->next = timer;
+    head->prev = timer;
+}
+
+static void telnets_timer_list_del(telnet_timer_t *timer)
+{
+    timer->prev->next = timer->next;
+    timer->next->prev = timer->prev;
+    timer->prev = NULL;
+    timer->next = NULL;
+}
+
+// 获取单调时钟纳秒数
+uint64_t telnets_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// 获取单调时钟毫秒数
+uint64_t telnets_now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// 更新缓存的墙钟秒数，秒数变化时才写入，避免各工作线程反复写同一缓存行
+time_t telnets_clock_update(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+    if (__atomic_load_n(&telnet_clock_sec, __ATOMIC_RELAXED) != ts.tv_sec)
+    {
+        __atomic_store_n(&telnet_clock_sec, ts.tv_sec, __ATOMIC_RELAXED);
+    }
+
+    return ts.tv_sec;
+}
+
+// 读取缓存的墙钟秒数，精度为一轮事件循环
+time_t telnets_clock_now(void)
+{
+    time_t sec = __atomic_load_n(&telnet_clock_sec, __ATOMIC_RELAXED);
+
+    return sec ? sec : telnets_clock_update();
+}
+
+// 直接设置缓存的墙钟秒数，供模拟时钟使用
+void telnets_clock_set(time_t sec)
+{
+    __atomic_store_n(&telnet_clock_sec, sec, __ATOMIC_RELAXED);
+}
+
+// 切换到模拟时钟，之后事件循环不再读取系统时钟，墙钟也由模拟时钟推算；
+// 只用于单工作线程的模拟，墙钟是进程全局的
+void telnets_sim_clock_start(telnet_server_t *server)
+{
+    server->sim_clock = 1;
+    server->sim_base_ms = server->now_ms;
+    server->sim_base_sec = telnets_clock_update();
+}
+
+// 推进模拟时钟，到期的定时器在下一轮事件循环中处理
+void telnets_sim_clock_advance(telnet_server_t *server, uint64_t ms)
+{
+    server->now_ms += ms;
+    telnets_clock_set(server->sim_base_sec + (time_t)((server->now_ms - server->sim_base_ms) / 1000));
+}
+
+// 按到期tick把定时器挂到对应层的槽位
+static void telnets_timer_place(telnet_timer_wheel_t *wheel, telnet_timer_t *timer)
+{
+    uint64_t expires = timer->expires_tick;
+    uint64_t delta;
+    int level;
+
+    // 已过期的定时器放到下一个tick处理
+    if (expires <= wheel->current_tick)
+    {
+        expires = wheel->current_tick + 1;
+    }
+
+    delta = expires - wheel->current_tick;
+    for (level = 0; level < TELNET_TW_LEVELS - 1; level++)
+    {
+        if (delta < ((uint64_t)1 << (TELNET_TW_BITS * (level + 1))))
+        {
+            break;
+        }
+    }
+
+    // 超出最高层范围时放在最高层最远的槽位，到时再重新下放
+    if (level == TELNET_TW_LEVELS - 1 &&
+        delta >= ((uint64_t)1 << (TELNET_TW_BITS * TELNET_TW_LEVELS)))
+    {
+        expires = wheel->current_tick + ((uint64_t)1 << (TELNET_TW_BITS * TELNET_TW_LEVELS)) - 1;
+    }
+
+    int index = (int)((expires >> (TELNET_TW_BITS * level)) & TELNET_TW_MASK);
+    telnets_timer_list_add(&wheel->slots[level][index], timer);
+}
+
+// 初始化时间轮
+void telnets_timer_wheel_init(telnet_timer_wheel_t *wheel, uint64_t now_ms)
+{
+    for (int level = 0; level < TELNET_TW_LEVELS; level++)
+    {
+        for (int i = 0; i < TELNET_TW_SIZE; i++)
+        {
+            telnets_timer_list_init(&wheel->slots[level][i]);
+        }
+    }
+
+    wheel->current_tick = now_ms / TELNET_TW_TICK_MS;
+    wheel->count = 0;
+}
+
+// 初始化定时器
+void telnets_timer_init(telnet_timer_t *timer, int type, void *data)
+{
+    timer->prev = NULL;
+    timer->next = NULL;
+    timer->expires_tick = 0;
+    timer->type = type;
+    timer->data = data;
+}
+
+// 定时器是否已启动
+int telnets_timer_pending(const telnet_timer_t *timer)
+{
+    return timer->next != NULL;
+}
+
+// 启动或重置定时器，delay_ms毫秒后到期
+void telnets_timer_arm(telnet_timer_wheel_t *wheel, telnet_timer_t *timer, uint64_t now_ms, uint64_t delay_ms)
+{
+    if (telnets_timer_pending(timer))
+    {
+        telnets_timer_list_del(timer);
+        wheel->count--;
+    }
+
+    // 向上取整，保证不早于指定时间到期
+    timer->expires_tick = (now_ms + delay_ms + TELNET_TW_TICK_MS - 1) / TELNET_TW_TICK_MS;
+    telnets_timer_place(wheel, timer);
+    wheel->count++;
+}
+
+// 取消定时器
+void telnets_timer_cancel(telnet_timer_wheel_t *wheel, telnet_timer_t *timer)
+{
+    if (telnets_timer_pending(timer))
+    {
+        telnets_timer_list_del(timer);
+        wheel->count--;
+    }
+}
+
+// 把上层某个槽位的定时器重新下放
+static void telnets_timer_cascade(telnet_timer_wheel_t *wheel, int level, int index)
+{
+    telnet_timer_t list;
+    telnet_timer_t *head = &wheel->slots[level][index];
+
+    if (telnets_timer_list_empty(head))
+    {
+        return;
+    }
+
+    // 先整体摘下，避免重新插入到同一槽位时死循环
+    list.next = head->next;
+    list.prev = head->prev;
+    list.next->prev = &list;
+    list.prev->next = &list;
+    telnets_timer_list_init(head);
+
+    while (!telnets_timer_list_empty(&list))
+    {
+        telnet_timer_t *timer = list.next;
+        telnets_timer_list_del(timer);
+        telnets_timer_place(wheel, timer);
+    }
+}
+
+// 推进时间轮到now_ms，对每个到期定时器调用callback
+void telnets_timer_advance(telnet_timer_wheel_t *wheel, uint64_t now_ms,
+                           telnet_timer_cb_t callback, void *arg)
+{
+    uint64_t target = now_ms / TELNET_TW_TICK_MS;
+
+    while (wheel->current_tick < target)
+    {
+        telnet_timer_t list;
+        telnet_timer_t *head;
+        int index;
+
+        wheel->current_tick++;
+        index = (int)(wheel->current_tick & TELNET_TW_MASK);
+
+        // 低层转完一圈时，从上层下放下一批定时器
+        for (int level = 1; level < TELNET_TW_LEVELS; level++)
+        {
+            if (((wheel->current_tick >> (TELNET_TW_BITS * (level - 1))) & TELNET_TW_MASK) != 0)
+            {
+                break;
+            }
+            telnets_timer_cascade(wheel, level,
+                                  (int)((wheel->current_tick >> (TELNET_TW_BITS * level)) & TELNET_TW_MASK));
+        }
+
+        head = &wheel->slots[0][index];
+        if (telnets_timer_list_empty(head))
+        {
+            // 时间轮为空时直接跳到目标tick
+            if (wheel->count == 0)
+            {
+                wheel->current_tick = target;
+            }
+            continue;
+        }
+
+        // 摘下到期链表，回调中可以安全地重新启动或取消任意定时器
+        list.next = head->next;
+        list.prev = head->prev;
+        list.next->prev = &list;
+        list.prev->next = &list;
+        telnets_timer_list_init(head);
+
+        while (!telnets_timer_list_empty(&list))
+        {
+            telnet_timer_t *timer = list.next;
+            telnets_timer_list_del(timer);
+            wheel->count--;
+            callback(timer, arg);
+        }
+    }
+}
+
+// 计算距离下一次需要推进时间轮的毫秒数，没有定时器时返回-1
+int telnets_timer_next_timeout(const telnet_timer_wheel_t *wheel, uint64_t now_ms)
+{
+    uint64_t next_tick;
+    uint64_t next_ms;
+
+    if (wheel->count == 0)
+    {
+        return -1;
+    }
+
+    // 第0层最多扫描一圈
+    next_tick = 0;
+    for (uint64_t tick = wheel->current_tick + 1; tick <= wheel->current_tick + TELNET_TW_SIZE; tick++)
+    {
+        if ((tick & TELNET_TW_MASK) == 0)
+        {
+            // 到达上层下放点，需要在此醒来
+            next_tick = tick;
+            break;
+        }
+        if (!telnets_timer_list_empty(&wheel->slots[0][tick & TELNET_TW_MASK]))
+        {
+            next_tick = tick;
+            break;
+        }
+    }
+
+    next_ms = next_tick * TELNET_TW_TICK_MS;
+    if (next_ms <= now_ms)
+    {
+        return 0;
+    }
+
+    if (next_ms - now_ms > INT32_MAX)
+    {
+        return INT32_MAX;
+    }
+
+    return (int)(next_ms - now_ms);
+}
@@ -0,0 +1,400 @@
+/**
+ * @file telnet_tls.c
+ * @brief Telnet服务器TLS传输
+ * @date liuliang 2026-01-25
+ *
+ * 本文件包含TLS监听端口使用的传输层
+ * 所有工作线程共用一个SSL_CTX，TLS 1.3无状态票据的密钥和TLS 1.2会话缓存随之共享，
+ * 重连的客户端无论被分到哪个工作线程都能恢复会话，不做完整握手；
+ * 握手不阻塞事件循环：连接接受后由读写调用逐步推进，未完成时按EAGAIN处理，
+ * 完成后才开始Telnet会话（选项协商、欢迎信息）；
+ * 握手后内核支持kTLS时发送方向交给内核，之后直接writev明文，不再经过用户态加密；
+ * 接收始终经过SSL_read，启用kTLS接收时它也只是一次recvmsg
+ */
+
+#define _GNU_SOURCE             // accept4
+#include "telnet_server.h"
+#include <openssl/err.h>
+
+// 一个TLS连接，按描述符索引
+typedef struct {
+    SSL *ssl;                       // NULL表示该描述符不是TLS连接
+    uint8_t established;            // 握手已完成
+    uint8_t ktls_send;              // 发送方向由内核加密，直接writev
+} telnet_tls_conn_t;
+
+typedef struct telnet_tls {
+    telnet_tls_conn_t *conns;       // 按描述符索引，按需扩大
+    int size;
+    char wbuf[TELNET_TLS_RECORD];   // 发送时把输出块合并成整条记录
+} telnet_tls_t;
+
+
+// 记录OpenSSL错误队列中的第一个错误
+static void telnets_tls_log(int level, const char *what)
+{
+    char reason[256];
+    unsigned long err = ERR_get_error();
+
+    ERR_error_string_n(err, reason, sizeof(reason));
+    telnets_log_msg(level, "%s: %s", what, err ? reason : "unknown error");
+    ERR_clear_error();
+}
+
+// 创建所有工作线程共用的TLS上下文，证书和私钥有误时返回-1
+int telnets_tls_start(telnet_master_t *master)
+{
+    const telnet_config_t *config = &master->config;
+    SSL_CTX *ctx = SSL_CTX_new(TLS_server_method());
+
+    if (!ctx)
+    {
+        telnets_tls_log(TELNET_LOG_ERROR, "Failed to create TLS context");
+        return -1;
+    }
+
+    SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+    if (SSL_CTX_use_certificate_chain_file(ctx, config->tls_cert) != 1 ||
+        SSL_CTX_use_PrivateKey_file(ctx, config->tls_key ? config->tls_key : config->tls_cert,
+                                    SSL_FILETYPE_PEM) != 1 ||
+        SSL_CTX_check_private_key(ctx) != 1)
+    {
+        telnets_tls_log(TELNET_LOG_ERROR, "Failed to load TLS certificate");
+        SSL_CTX_free(ctx);
+        return -1;
+    }
+
+    // 重试写入时数据仍在输出队列中，但合并缓冲区之外的地址可能变化；
+    // 空闲会话不保留读写缓冲区
+    SSL_CTX_set_mode(ctx, SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER | SSL_MODE_RELEASE_BUFFERS);
+    SSL_CTX_set_options(ctx, SSL_OP_ENABLE_KTLS | SSL_OP_NO_RENEGOTIATION | SSL_OP_IGNORE_UNEXPECTED_EOF);
+
+    // 会话恢复：TLS 1.3发一张无状态票据，TLS 1.2同时支持票据和服务器端会话缓存
+    SSL_CTX_set_session_id_context(ctx, (const unsigned char *)"telnet", 6);
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+    SSL_CTX_sess_set_cache_size(ctx, TELNET_TLS_SESSION_CACHE);
+    SSL_CTX_set_num_tickets(ctx, 1);
+
+    master->tls_ctx = ctx;
+    return 0;
+}
+
+void telnets_tls_free(telnet_master_t *master)
+{
+    SSL_CTX_free(master->tls_ctx);
+    master->tls_ctx = NULL;
+}
+
+// 创建工作线程的TLS连接表
+int telnets_tls_init(telnet_server_t *server)
+{
+    if (!server->master || !server->master->tls_ctx)
+    {
+        telnets_log_msg(TELNET_LOG_ERROR, "TLS listener requires a TLS context");
+        return -1;
+    }
+
+    server->tls = (telnet_tls_t *)calloc(1, sizeof(telnet_tls_t));
+    if (!server->tls)
+    {
+        telnets_log_errno("Failed to allocate TLS table");
+        return -1;
+    }
+
+    return 0;
+}
+
+void telnets_tls_destroy(telnet_server_t *server)
+{
+    telnet_tls_t *tls = server->tls;
+
+    if (!tls)
+    {
+        return;
+    }
+
+    for (int i = 0; i < tls->size; i++)
+    {
+        SSL_free(tls->conns[i].ssl);
+    }
+    free(tls->conns);
+    free(tls);
+    server->tls = NULL;
+}
+
+static telnet_tls_conn_t *telnets_tls_conn(telnet_server_t *server, int fd)
+{
+    telnet_tls_t *tls = server->tls;
+
+    if (!tls || fd < 0 || fd >= tls->size || !tls->conns[fd].ssl)
+    {
+        return NULL;
+    }
+
+    return &tls->conns[fd];
+}
+
+// 扩大连接表以容纳描述符fd
+static int telnets_tls_reserve(telnet_tls_t *tls, int fd)
+{
+    int new_size = tls->size ? tls->size : TELNET_TABLE_INIT_SIZE;
+    telnet_tls_conn_t *conns;
+
+    if (fd < tls->size)
+    {
+        return 0;
+    }
+
+    while (new_size <= fd)
+    {
+        new_size *= 2;
+    }
+
+    conns = (telnet_tls_conn_t *)realloc(tls->conns, new_size * sizeof(telnet_tls_conn_t));
+    if (!conns)
+    {
+        telnets_log_errno("Failed to grow TLS table");
+        return -1;
+    }
+
+    memset(conns + tls->size, 0, (new_size - tls->size) * sizeof(telnet_tls_conn_t));
+    tls->conns = conns;
+    tls->size = new_size;
+    return 0;
+}
+
+// 把失败的SSL_read/SSL_write转换为recv/writev的返回值和errno
+static ssize_t telnets_tls_result(SSL *ssl, int ret)
+{
+    switch (SSL_get_error(ssl, ret))
+    {
+        case SSL_ERROR_WANT_READ:
+        case SSL_ERROR_WANT_WRITE:
+            errno = EAGAIN;
+            return -1;
+        case SSL_ERROR_ZERO_RETURN:
+            // 对端发送了close_notify或直接关闭了连接
+            return 0;
+        case SSL_ERROR_SYSCALL:
+            ERR_clear_error();
+            if (errno == 0)
+            {
+                errno = ECONNRESET;
+            }
+            return -1;
+        default:
+            telnets_tls_log(TELNET_LOG_DEBUG, "TLS error");
+            errno = ECONNRESET;
+            return -1;
+    }
+}
+
+// 推进握手，返回1表示已完成，0表示等待对端（errno为EAGAIN），-1表示失败；
+// 完成时开始Telnet会话，握手期间产生的输出随后一起发出
+static int telnets_tls_handshake(telnet_server_t *server, int fd, telnet_tls_conn_t *c)
+{
+    telnet_client_t *client;
+    int ret;
+
+    ERR_clear_error();
+    TELNET_METRIC_ADD(server->metrics.syscalls, 1);
+    ret = SSL_do_handshake(c->ssl);
+    if (ret != 1)
+    {
+        int err = SSL_get_error(c->ssl, ret);
+
+        if (err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE)
+        {
+            errno = EAGAIN;
+            return 0;
+        }
+
+        TELNET_METRIC_ADD(server->metrics.tls_failures, 1);
+        telnets_tls_log(TELNET_LOG_DEBUG, "TLS handshake failed");
+        errno = ECONNRESET;
+        return -1;
+    }
+
+    c->established = 1;
+    c->ktls_send = BIO_get_ktls_send(SSL_get_wbio(c->ssl)) ? 1 : 0;
+    TELNET_METRIC_ADD(server->metrics.tls_handshakes, 1);
+    if (SSL_session_reused(c->ssl))
+    {
+        TELNET_METRIC_ADD(server->metrics.tls_resumed, 1);
+    }
+    if (c->ktls_send)
+    {
+        TELNET_METRIC_ADD(server->metrics.tls_ktls, 1);
+    }
+
+    client = telnets_get_client(server, telnets_find_client_index(server, fd));
+    if (client)
+    {
+        telnets_session_start(server, client);
+    }
+    return 1;
+}
+
+// 从TLS监听socket接受连接并创建SSL对象，握手留给之后的读写
+static int telnets_tls_accept(telnet_server_t *server, struct sockaddr_in *addr)
+{
+    socklen_t addr_len = sizeof(struct sockaddr_in);
+    telnet_tls_t *tls = server->tls;
+    SSL *ssl = NULL;
+    int fd;
+
+    TELNET_METRIC_ADD(server->metrics.syscalls, 1);
+    fd = accept4(server->tls_listen_sockfd, (struct sockaddr *)addr, &addr_len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0)
+    {
+        return -1;
+    }
+
+    if (telnets_tls_reserve(tls, fd) < 0 || !(ssl = SSL_new(server->master->tls_ctx)) || SSL_set_fd(ssl, fd) != 1)
+    {
+        telnets_tls_log(TELNET_LOG_WARN, "Failed to create TLS session");
+        SSL_free(ssl);
+        close(fd);
+        // 按连接被中止处理，继续接受下一个
+        errno = ECONNABORTED;
+        return -1;
+    }
+
+    SSL_set_accept_state(ssl);
+    tls->conns[fd].ssl = ssl;
+    tls->conns[fd].established = 0;
+    tls->conns[fd].ktls_send = 0;
+    return fd;
+}
+
+static ssize_t telnets_tls_read(telnet_server_t *server, int fd, void *buf, size_t len)
+{
+    telnet_tls_conn_t *c = telnets_tls_conn(server, fd);
+    int n;
+
+    if (!c)
+    {
+        errno = EBADF;
+        return -1;
+    }
+
+    if (!c->established && telnets_tls_handshake(server, fd, c) <= 0)
+    {
+        return -1;
+    }
+
+    ERR_clear_error();
+    TELNET_METRIC_ADD(server->metrics.syscalls, 1);
+    n = SSL_read(c->ssl, buf, len > INT32_MAX ? INT32_MAX : (int)len);
+    if (n > 0)
+    {
+        return n;
+    }
+
+    return telnets_tls_result(c->ssl, n);
+}
+
+// 未启用kTLS时把输出块合并成整条记录再加密，避免每个小块单独成为一条记录；
+// 返回已写入的明文字节数，写入一部分后阻塞时返回已写入的部分
+static ssize_t telnets_tls_writev(telnet_server_t *server, int fd, const struct iovec *iov, int iovcnt)
+{
+    telnet_tls_conn_t *c = telnets_tls_conn(server, fd);
+    char *wbuf = server->tls->wbuf;
+    ssize_t total = 0;
+    size_t off = 0;
+    int i = 0;
+
+    if (!c)
+    {
+        errno = EBADF;
+        return -1;
+    }
+
+    if (!c->established && telnets_tls_handshake(server, fd, c) <= 0)
+    {
+        return -1;
+    }
+
+    if (c->ktls_send)
+    {
+        TELNET_METRIC_ADD(server->metrics.syscalls, 1);
+        return writev(fd, iov, iovcnt);
+    }
+
+    while (i < iovcnt)
+    {
+        size_t n = 0;
+        int ret;
+
+        while (i < iovcnt && n < TELNET_TLS_RECORD)
+        {
+            size_t avail = iov[i].iov_len - off;
+            size_t take = avail < TELNET_TLS_RECORD - n ? avail : TELNET_TLS_RECORD - n;
+
+            memcpy(wbuf + n, (const char *)iov[i].iov_base + off, take);
+            n += take;
+            off += take;
+            if (off == iov[i].iov_len)
+            {
+                i++;
+                off = 0;
+            }
+        }
+
+        if (n == 0)
+        {
+            continue;
+        }
+
+        // 写入阻塞时OpenSSL保留已加密的记录，下次必须以相同的数据重试，
+        // 这些数据仍在输出队列的开头
+        ERR_clear_error();
+        TELNET_METRIC_ADD(server->metrics.syscalls, 1);
+        ret = SSL_write(c->ssl, wbuf, (int)n);
+        if (ret <= 0)
+        {
+            if (total > 0)
+            {
+                ERR_clear_error();
+                return total;
+            }
+            if (telnets_tls_result(c->ssl, ret) == 0)
+            {
+                errno = EPIPE;
+            }
+            return -1;
+        }
+        total += ret;
+    }
+
+    return total;
+}
+
+// 尽力发送close_notify后关闭
+static void telnets_tls_close(telnet_server_t *server, int fd)
+{
+    telnet_tls_conn_t *c = telnets_tls_conn(server, fd);
+
+    if (c)
+    {
+        if (c->established)
+        {
+            SSL_shutdown(c->ssl);
+        }
+        ERR_clear_error();
+        SSL_free(c->ssl);
+        c->ssl = NULL;
+    }
+
+    TELNET_METRIC_ADD(server->metrics.syscalls, 1);
+    close(fd);
+}
+
+const telnet_transport_t telnet_transport_tls = {
+    "tls",
+    telnets_tls_accept,
+    telnets_tls_read,
+    telnets_tls_writev,
+    NULL,
+    telnets_tls_close,
+};
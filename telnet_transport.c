@@ -0,0 +1,58 @@
+/**
+ * @file telnet_transport.c
+ * @brief Telnet服务器传输层
+ * @date liuliang 2026-01-25
+ *
+ * 本文件包含传输层注册表和TCP传输
+ * 会话的接受、读取、发送和关闭都通过传输层接口，协议处理不直接调用socket函数；
+ * TCP传输由epoll或io_uring监视描述符，io_uring后端自己提交收发请求，只支持TCP传输
+ */
+
+#define _GNU_SOURCE             // accept4
+#include "telnet_server.h"
+
+extern const telnet_transport_t telnet_transport_mem;
+extern const telnet_transport_t telnet_transport_tls;
+
+
+// 从监听socket接受连接，接受时直接设置非阻塞，省去两次fcntl
+static int telnets_tcp_accept(telnet_server_t *server, struct sockaddr_in *addr)
+{
+    socklen_t addr_len = sizeof(struct sockaddr_in);
+
+    TELNET_METRIC_ADD(server->metrics.syscalls, 1);
+    return accept4(server->listen_sockfd, (struct sockaddr *)addr, &addr_len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+}
+
+static ssize_t telnets_tcp_read(telnet_server_t *server, int fd, void *buf, size_t len)
+{
+    TELNET_METRIC_ADD(server->metrics.syscalls, 1);
+    return recv(fd, buf, len, 0);
+}
+
+static ssize_t telnets_tcp_writev(telnet_server_t *server, int fd, const struct iovec *iov, int iovcnt)
+{
+    TELNET_METRIC_ADD(server->metrics.syscalls, 1);
+    return writev(fd, iov, iovcnt);
+}
+
+static void telnets_tcp_close(telnet_server_t *server, int fd)
+{
+    TELNET_METRIC_ADD(server->metrics.syscalls, 1);
+    close(fd);
+}
+
+static const telnet_transport_t telnet_transport_tcp = {
+    "tcp",
+    telnets_tcp_accept,
+    telnets_tcp_read,
+    telnets_tcp_writev,
+    NULL,
+    telnets_tcp_close,
+};
+
+const telnet_transport_t *const telnet_transports[TELNET_TRANSPORT_COUNT] = {
+    [TELNET_TRANSPORT_TCP] = &telnet_transport_tcp,
+    [TELNET_TRANSPORT_MEM] = &telnet_transport_mem,
+    [TELNET_TRANSPORT_TLS] = &telnet_transport_tls,
+};
@@ -0,0 +1,958 @@
+/**
+ * @file telnet_upgrade.c
+ * @brief Telnet服务器热重启
+ * @date liuliang 2026-01-25
+ *
+ * 本文件包含不断开会话的热重启
+ * 主线程收到SIGUSR2后用原来的命令行启动新进程，两者之间是一对Unix socket：
+ *   1. 新进程完成初始化（证书、响应、客户端表）后发送READY，此时旧进程仍在正常服务
+ *   2. 旧进程让所有工作线程停在事件循环之外（等线程池中的命令和密码校验完成），之后由主线程访问各工作线程的状态
+ *   3. 旧进程用SCM_RIGHTS发送每个工作线程的监听socket，再逐个发送TCP会话的描述符和状态：
+ *      地址、连接时间、最后活动时间、选项协商状态、登录状态和用户名、未完成的行、子协商内容、
+ *      留到下一轮处理的输入、未发送的输出和协商定时器
+ *   4. 新进程接纳全部会话后回复ACK，旧进程静默关闭自己的描述符副本并退出，连接本身不受影响
+ * 监听socket在交接期间一直打开，新连接留在内核监听队列中；任何一步失败都回到第2步之前，
+ * 旧进程恢复服务，新进程退出；
+ * 压缩会话在交接前结束压缩流，新进程重新开始一个压缩流；TLS会话的加密状态在OpenSSL中，
+ * 无法交接，通知后关闭；io_uring后端可能有接收中的请求，不支持热重启
+ */
+
+#include "telnet_server.h"
+#include <poll.h>
+#include <sys/wait.h>
+
+#define TELNET_UPGRADE_MAGIC 0x554e4c54u    // "TLNU"
+#define TELNET_UPGRADE_VERSION 3
+
+// 消息类型
+enum {
+    TELNET_UPGRADE_READY = 1,       // 新进程：初始化完成，可以开始交接
+    TELNET_UPGRADE_LISTENER,        // 旧进程：一个工作线程的监听socket，TLS监听socket随后（如有）
+    TELNET_UPGRADE_SESSION,         // 旧进程：一个会话的描述符和状态
+    TELNET_UPGRADE_END,             // 旧进程：发送完毕
+    TELNET_UPGRADE_ACK              // 新进程：已接纳全部会话
+};
+
+// 消息头，描述符随消息头发送
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t type;
+    uint32_t worker;                // 旧进程中的工作线程编号
+    uint32_t len;                   // 之后的数据长度
+} telnet_upgrade_hdr_t;
+
+// 会话状态，之后依次是行缓冲区、子协商内容、缓存的输入和未发送的输出
+typedef struct {
+    struct sockaddr_in addr;
+    int64_t connected_at;
+    int64_t last_active;
+    uint32_t negotiation_ms;        // 协商定时器剩余时间，0表示未启动
+    uint32_t line_len;
+    uint32_t typeahead_len;
+    uint32_t out_len;
+    uint16_t win_width;
+    uint16_t win_height;
+    telnet_opt_t opts[TELNET_OPT_COUNT];
+    uint8_t telnet_state;
+    uint8_t telnet_verb;
+    uint8_t linemode_edit;
+    uint8_t bcast_policy;
+    uint8_t compress;               // 旧进程中的压缩状态，ON表示需要重新开始压缩
+    uint8_t authenticated;          // 登录状态，校验中的会话在第2步已等到结果
+    uint8_t auth_failures;
+    uint8_t sb_len;
+    char username[TELNET_AUTH_NAME_MAX];
+} telnet_upgrade_session_t;
+
+
+// 发送一条消息，fds中的描述符随消息头发送
+static int telnets_upgrade_send(int sock, int type, int worker, const int *fds, int nfds,
+                                const void *data, size_t len, const void *data2, size_t len2)
+{
+    telnet_upgrade_hdr_t hdr;
+    struct iovec iov[3];
+    struct msghdr msg;
+    union {
+        struct cmsghdr align;
+        char buf[CMSG_SPACE(2 * sizeof(int))];
+    } ctrl;
+    size_t total = sizeof(hdr) + len + len2;
+    size_t sent = 0;
+
+    hdr.magic = TELNET_UPGRADE_MAGIC;
+    hdr.version = TELNET_UPGRADE_VERSION;
+    hdr.type = (uint16_t)type;
+    hdr.worker = (uint32_t)worker;
+    hdr.len = (uint32_t)(len + len2);
+
+    iov[0].iov_base = &hdr;
+    iov[0].iov_len = sizeof(hdr);
+    iov[1].iov_base = (void *)data;
+    iov[1].iov_len = len;
+    iov[2].iov_base = (void *)data2;
+    iov[2].iov_len = len2;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = 3;
+    if (nfds > 0)
+    {
+        struct cmsghdr *cmsg;
+
+        memset(&ctrl, 0, sizeof(ctrl));
+        msg.msg_control = ctrl.buf;
+        msg.msg_controllen = CMSG_SPACE(nfds * sizeof(int));
+        cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(nfds * sizeof(int));
+        memcpy(CMSG_DATA(cmsg), fds, nfds * sizeof(int));
+    }
+
+    // 描述符随第一段数据送达，余下部分普通发送
+    while (sent < total)
+    {
+        ssize_t n = sendmsg(sock, &msg, MSG_NOSIGNAL);
+
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return -1;
+        }
+
+        sent += (size_t)n;
+        msg.msg_control = NULL;
+        msg.msg_controllen = 0;
+        while (n > 0 && msg.msg_iovlen > 0)
+        {
+            size_t step = (size_t)n < msg.msg_iov->iov_len ? (size_t)n : msg.msg_iov->iov_len;
+
+            msg.msg_iov->iov_base = (char *)msg.msg_iov->iov_base + step;
+            msg.msg_iov->iov_len -= step;
+            n -= (ssize_t)step;
+            if (msg.msg_iov->iov_len == 0)
+            {
+                msg.msg_iov++;
+                msg.msg_iovlen--;
+            }
+        }
+    }
+
+    return 0;
+}
+
+// 接收消息头和随之而来的描述符，返回描述符个数，对端关闭或出错返回-1
+static int telnets_upgrade_recv_hdr(int sock, telnet_upgrade_hdr_t *hdr, int *fds, int max_fds)
+{
+    union {
+        struct cmsghdr align;
+        char buf[CMSG_SPACE(2 * sizeof(int))];
+    } ctrl;
+    size_t got = 0;
+    int nfds = 0;
+
+    while (got < sizeof(*hdr))
+    {
+        struct iovec iov;
+        struct msghdr msg;
+        struct cmsghdr *cmsg;
+        ssize_t n;
+
+        iov.iov_base = (char *)hdr + got;
+        iov.iov_len = sizeof(*hdr) - got;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = ctrl.buf;
+        msg.msg_controllen = sizeof(ctrl.buf);
+
+        n = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return -1;
+        }
+
+        for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+        {
+            if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+            {
+                int count = (int)((cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+
+                for (int i = 0; i < count; i++)
+                {
+                    int fd;
+
+                    memcpy(&fd, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+                    if (nfds < max_fds)
+                    {
+                        fds[nfds++] = fd;
+                    }
+                    else
+                    {
+                        close(fd);
+                    }
+                }
+            }
+        }
+        got += (size_t)n;
+    }
+
+    if (hdr->magic != TELNET_UPGRADE_MAGIC || hdr->version != TELNET_UPGRADE_VERSION)
+    {
+        telnets_log_msg(TELNET_LOG_ERROR, "Hot restart: protocol mismatch");
+        for (int i = 0; i < nfds; i++)
+        {
+            close(fds[i]);
+        }
+        return -1;
+    }
+
+    return nfds;
+}
+
+static int telnets_upgrade_recv_all(int sock, void *buf, size_t len)
+{
+    size_t got = 0;
+
+    while (got < len)
+    {
+        ssize_t n = recv(sock, (char *)buf + got, len - got, 0);
+
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return -1;
+        }
+        got += (size_t)n;
+    }
+
+    return 0;
+}
+
+// 等待对端发来指定类型的消息，超时或对端退出时返回-1
+static int telnets_upgrade_expect(int sock, int type, int timeout_ms, uint32_t *value)
+{
+    struct pollfd pfd;
+    telnet_upgrade_hdr_t hdr;
+    int fds[2];
+    int ret;
+
+    pfd.fd = sock;
+    pfd.events = POLLIN;
+    do
+    {
+        ret = poll(&pfd, 1, timeout_ms);
+    } while (ret < 0 && errno == EINTR);
+
+    if (ret <= 0 || telnets_upgrade_recv_hdr(sock, &hdr, fds, 2) != 0 || hdr.type != type || hdr.len != 0)
+    {
+        return -1;
+    }
+
+    if (value)
+    {
+        *value = hdr.worker;
+    }
+    return 0;
+}
+
+// 收发都有超时，对端停止响应时不会一直阻塞
+static void telnets_upgrade_timeouts(int sock)
+{
+    struct timeval tv;
+
+    tv.tv_sec = TELNET_UPGRADE_TIMEOUT;
+    tv.tv_usec = 0;
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+}
+
+
+// 旧进程
+
+// 可以交接的会话：TCP连接，且没有在关闭中
+static int telnets_upgrade_portable(const telnet_client_t *client)
+{
+    return client->in_use && !client->closed && client->transport == TELNET_TRANSPORT_TCP;
+}
+
+// 工作线程在事件循环之间调用：线程池中没有本线程的命令时停下，直到主线程完成交接
+void telnets_upgrade_park(telnet_server_t *server)
+{
+    telnet_master_t *master = server->master;
+
+    // 命令完成后会唤醒事件循环，届时再停下
+    for (int i = 0; i < server->capacity; i++)
+    {
+        if (server->clients[i].in_use && server->clients[i].cmd_pending)
+        {
+            return;
+        }
+    }
+
+    pthread_mutex_lock(&master->upgrade_lock);
+    master->upgrade_parked++;
+    pthread_cond_broadcast(&master->upgrade_cond);
+    while (master->upgrade_park)
+    {
+        pthread_cond_wait(&master->upgrade_cond, &master->upgrade_lock);
+    }
+    master->upgrade_parked--;
+    pthread_mutex_unlock(&master->upgrade_lock);
+}
+
+// 让所有工作线程停下，超时返回-1
+static int telnets_upgrade_stop_workers(telnet_master_t *master)
+{
+    struct timespec deadline;
+    int ret = 0;
+
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += TELNET_UPGRADE_TIMEOUT;
+
+    pthread_mutex_lock(&master->upgrade_lock);
+    master->upgrade_park = 1;
+    pthread_mutex_unlock(&master->upgrade_lock);
+
+    for (int i = 0; i < master->started; i++)
+    {
+        telnets_event_wake(master->workers[i]);
+    }
+
+    pthread_mutex_lock(&master->upgrade_lock);
+    while (master->upgrade_parked < master->started && ret == 0)
+    {
+        ret = pthread_cond_timedwait(&master->upgrade_cond, &master->upgrade_lock, &deadline);
+    }
+    ret = master->upgrade_parked < master->started ? -1 : 0;
+    pthread_mutex_unlock(&master->upgrade_lock);
+
+    return ret;
+}
+
+static void telnets_upgrade_resume_workers(telnet_master_t *master)
+{
+    pthread_mutex_lock(&master->upgrade_lock);
+    master->upgrade_park = 0;
+    pthread_cond_broadcast(&master->upgrade_cond);
+    pthread_mutex_unlock(&master->upgrade_lock);
+}
+
+// 发送一个会话，压缩中的会话先结束压缩流，结束标记随未发送的输出一起交接
+static int telnets_upgrade_send_session(telnet_server_t *server, telnet_client_t *client, int sock)
+{
+    telnet_client_cold_t *cold = client->cold;
+    telnet_upgrade_session_t sess;
+    telnet_timer_t *neg = &client->timers[TELNET_TIMER_NEGOTIATION];
+    char *data;
+    size_t len;
+    int ret;
+
+    memset(&sess, 0, sizeof(sess));
+    sess.compress = client->compress;
+    if (client->compress == TELNET_MCCP_ON)
+    {
+        telnets_mccp_end(client, 1);
+    }
+
+    sess.addr = cold->addr;
+    sess.connected_at = (int64_t)cold->connected_at;
+    sess.last_active = (int64_t)client->last_active;
+    if (telnets_timer_pending(neg))
+    {
+        uint64_t expires = neg->expires_tick * TELNET_TW_TICK_MS;
+        uint64_t now = telnets_now_ms();
+
+        sess.negotiation_ms = expires > now ? (uint32_t)(expires - now) : 1;
+    }
+    sess.line_len = (uint32_t)client->buffer_len;
+    sess.typeahead_len = (uint32_t)client->typeahead_len;
+    sess.out_len = (uint32_t)client->outq.bytes;
+    sess.win_width = cold->win_width;
+    sess.win_height = cold->win_height;
+    memcpy(sess.opts, client->opts, sizeof(sess.opts));
+    sess.telnet_state = client->telnet_state;
+    sess.telnet_verb = client->telnet_verb;
+    sess.linemode_edit = client->linemode_edit;
+    sess.bcast_policy = client->bcast_policy;
+    sess.authenticated = cold->authenticated;
+    telnets_auth_save(server, client, &sess.auth_failures, sess.username);
+    sess.sb_len = cold->sb_buf ? cold->sb_len : 0;
+
+    len = sess.line_len + sess.sb_len + sess.typeahead_len + sess.out_len;
+    data = (char *)malloc(len ? len : 1);
+    if (!data)
+    {
+        telnets_log_errno("Failed to allocate session state");
+        return -1;
+    }
+
+    {
+        char *p = data;
+
+        if (sess.line_len > 0)
+        {
+            memcpy(p, cold->line, sess.line_len);
+            p += sess.line_len;
+        }
+        if (sess.sb_len > 0)
+        {
+            memcpy(p, cold->sb_buf, sess.sb_len);
+            p += sess.sb_len;
+        }
+        if (sess.typeahead_len > 0)
+        {
+            memcpy(p, cold->typeahead, sess.typeahead_len);
+            p += sess.typeahead_len;
+        }
+        for (telnet_outchunk_t *chunk = client->outq.head; chunk; chunk = chunk->next)
+        {
+            memcpy(p, TELNET_CHUNK_DATA(chunk) + chunk->off, chunk->len - chunk->off);
+            p += chunk->len - chunk->off;
+        }
+    }
+
+    ret = telnets_upgrade_send(sock, TELNET_UPGRADE_SESSION, server->worker_id, &client->sockfd, 1,
+                               &sess, sizeof(sess), data, len);
+    free(data);
+    return ret;
+}
+
+// 先发送全部监听socket，再发送会话，返回发送的会话数
+static int telnets_upgrade_send_state(telnet_master_t *master, int sock)
+{
+    int sessions = 0;
+
+    for (int w = 0; w < master->nworkers; w++)
+    {
+        telnet_server_t *server = master->workers[w];
+        int fds[2];
+        int nfds = 0;
+
+        fds[nfds++] = server->listen_sockfd;
+        if (server->tls_listen_sockfd >= 0)
+        {
+            fds[nfds++] = server->tls_listen_sockfd;
+        }
+        if (telnets_upgrade_send(sock, TELNET_UPGRADE_LISTENER, w, fds, nfds, NULL, 0, NULL, 0) < 0)
+        {
+            return -1;
+        }
+    }
+
+    for (int w = 0; w < master->nworkers; w++)
+    {
+        telnet_server_t *server = master->workers[w];
+
+        // 已发给本线程、尚未投递的广播先放进输出队列
+        telnets_broadcast_deliver(server);
+
+        for (int i = 0; i < server->capacity; i++)
+        {
+            telnet_client_t *client = &server->clients[i];
+
+            if (!telnets_upgrade_portable(client))
+            {
+                continue;
+            }
+            if (telnets_upgrade_send_session(server, client, sock) < 0)
+            {
+                return -1;
+            }
+            sessions++;
+        }
+    }
+
+    if (telnets_upgrade_send(sock, TELNET_UPGRADE_END, 0, NULL, 0, NULL, 0, NULL, 0) < 0)
+    {
+        return -1;
+    }
+
+    return sessions;
+}
+
+// 新进程已接管：静默关闭已交接会话的描述符副本，连接由新进程继续服务；
+// 无法交接的会话通知后关闭
+static void telnets_upgrade_release(telnet_master_t *master)
+{
+    static const char notice[] = "\r\nServer restarting, please reconnect.\r\n";
+
+    for (int w = 0; w < master->nworkers; w++)
+    {
+        telnet_server_t *server = master->workers[w];
+
+        for (int i = 0; i < server->capacity; i++)
+        {
+            telnet_client_t *client = &server->clients[i];
+
+            if (!client->in_use)
+            {
+                continue;
+            }
+
+            if (!telnets_upgrade_portable(client))
+            {
+                telnets_output(client, notice, sizeof(notice) - 1);
+                telnets_remove_client(server, i);
+                continue;
+            }
+
+            // 连接还被新进程持有，关闭副本不会发送FIN；先从本进程的epoll注销
+            for (int t = 0; t < TELNET_TIMER_MAX; t++)
+            {
+                telnets_timer_cancel(&server->timers, &client->timers[t]);
+            }
+            telnets_event_del(server, client->sockfd);
+            TELNET_TRANSPORT(client)->close(server, client->sockfd);
+            telnets_table_free(server, i);
+            telnets_outq_clear(&client->outq);
+            telnets_session_release(server, client);
+        }
+    }
+}
+
+// 构造新进程的命令行：原样保留参数，去掉之前的-U，再追加-U FD
+static char **telnets_upgrade_argv(char **argv, char *fd_arg)
+{
+    char **out;
+    int argc = 0;
+    int n = 0;
+
+    while (argv[argc])
+    {
+        argc++;
+    }
+
+    out = (char **)malloc((argc + 3) * sizeof(char *));
+    if (!out)
+    {
+        return NULL;
+    }
+
+    for (int i = 0; i < argc; i++)
+    {
+        if (i > 0 && strncmp(argv[i], "-U", 2) == 0)
+        {
+            if (argv[i][2] == '\0' && i + 1 < argc)
+            {
+                i++;
+            }
+            continue;
+        }
+        out[n++] = argv[i];
+    }
+    out[n++] = (char *)"-U";
+    out[n++] = fd_arg;
+    out[n] = NULL;
+    return out;
+}
+
+// 用原来的命令行启动新进程，sock是留给新进程的一端
+static pid_t telnets_upgrade_spawn(telnet_master_t *master, int sock)
+{
+    char fd_arg[16];
+    char **argv;
+    pid_t pid;
+
+    snprintf(fd_arg, sizeof(fd_arg), "%d", sock);
+    argv = telnets_upgrade_argv(master->config.argv, fd_arg);
+    if (!argv)
+    {
+        telnets_log_errno("Failed to build command line");
+        return -1;
+    }
+
+    pid = fork();
+    if (pid == 0)
+    {
+        sigset_t set;
+
+        // 子进程只调用exec前必要的函数：交接socket跨exec保留，恢复信号屏蔽
+        fcntl(sock, F_SETFD, 0);
+        sigemptyset(&set);
+        sigprocmask(SIG_SETMASK, &set, NULL);
+        execvp(argv[0], argv);
+        _exit(127);
+    }
+
+    if (pid < 0)
+    {
+        telnets_log_errno("fork failed");
+    }
+    free(argv);
+    return pid;
+}
+
+// 把监听socket和会话交给新进程，成功后工作线程退出；失败时恢复服务，返回-1
+int telnets_upgrade_start(telnet_master_t *master)
+{
+    uint32_t adopted = 0;
+    int metrics = master->metrics_fd >= 0;
+    int sessions;
+    int sv[2];
+    pid_t pid;
+
+    for (int i = 0; i < master->nworkers; i++)
+    {
+        if (master->workers[i]->io_backend != TELNET_IO_EPOLL ||
+            master->workers[i]->transport != TELNET_TRANSPORT_TCP)
+        {
+            telnets_log_msg(TELNET_LOG_ERROR, "Hot restart requires the epoll backend and TCP transport");
+            return -1;
+        }
+    }
+
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) < 0)
+    {
+        telnets_log_errno("socketpair failed");
+        return -1;
+    }
+    telnets_upgrade_timeouts(sv[0]);
+
+    pid = telnets_upgrade_spawn(master, sv[1]);
+    close(sv[1]);
+    if (pid < 0)
+    {
+        close(sv[0]);
+        return -1;
+    }
+
+    // 新进程初始化期间照常服务
+    if (telnets_upgrade_expect(sv[0], TELNET_UPGRADE_READY, TELNET_UPGRADE_TIMEOUT * 1000, NULL) < 0)
+    {
+        telnets_log_msg(TELNET_LOG_ERROR, "Hot restart: new process %d did not start", (int)pid);
+        goto fail;
+    }
+
+    // 指标端口由新进程重新绑定
+    telnets_metrics_stop(master);
+
+    if (telnets_upgrade_stop_workers(master) < 0)
+    {
+        telnets_log_msg(TELNET_LOG_ERROR, "Hot restart: workers did not stop in time");
+        goto fail_resume;
+    }
+
+    sessions = telnets_upgrade_send_state(master, sv[0]);
+    if (sessions < 0)
+    {
+        telnets_log_errno("Hot restart: handoff failed");
+        goto fail_resume;
+    }
+
+    if (telnets_upgrade_expect(sv[0], TELNET_UPGRADE_ACK, TELNET_UPGRADE_TIMEOUT * 1000, &adopted) < 0)
+    {
+        telnets_log_msg(TELNET_LOG_ERROR, "Hot restart: new process %d did not take over", (int)pid);
+        goto fail_resume;
+    }
+
+    telnets_upgrade_release(master);
+    for (int i = 0; i < master->started; i++)
+    {
+        master->workers[i]->running = 0;
+    }
+    telnets_upgrade_resume_workers(master);
+    close(sv[0]);
+
+    telnets_log_msg(TELNET_LOG_INFO, "Handed off %d session(s) to process %d (%u adopted)",
+                    sessions, (int)pid, adopted);
+    return 0;
+
+fail_resume:
+    // 已结束压缩流的会话之后不再压缩
+    telnets_upgrade_resume_workers(master);
+fail:
+    kill(pid, SIGKILL);
+    waitpid(pid, NULL, 0);
+    close(sv[0]);
+    if (metrics && master->metrics_fd < 0)
+    {
+        telnets_metrics_start(master);
+    }
+    return -1;
+}
+
+
+// 新进程
+
+// 按保存的状态恢复一个会话，返回0成功；失败时描述符已关闭
+static int telnets_upgrade_adopt(telnet_server_t *server, int fd, const telnet_upgrade_session_t *sess,
+                                 const char *data)
+{
+    struct sockaddr_in addr = sess->addr;
+    telnet_client_cold_t *cold;
+    telnet_client_t *client;
+    time_t remaining;
+    int index;
+
+    index = telnets_add_client(server, fd, &addr, TELNET_TRANSPORT_TCP);
+    if (index < 0)
+    {
+        close(fd);
+        return -1;
+    }
+    client = telnets_get_client(server, index);
+    cold = client->cold;
+
+    cold->connected_at = (time_t)sess->connected_at;
+    cold->win_width = sess->win_width;
+    cold->win_height = sess->win_height;
+    telnets_auth_restore(server, client, sess->authenticated, sess->auth_failures, sess->username);
+    client->last_active = (time_t)sess->last_active;
+    client->telnet_state = sess->telnet_state;
+    client->telnet_verb = sess->telnet_verb;
+    client->linemode_edit = sess->linemode_edit;
+    client->bcast_policy = sess->bcast_policy;
+    memcpy(client->opts, sess->opts, sizeof(client->opts));
+
+    // 未完成的行和子协商内容
+    if (sess->line_len > 0 && (int)sess->line_len <= server->config->line_max)
+    {
+        cold->line = telnets_buf_alloc(server, sess->line_len, &cold->line_class);
+        if (cold->line)
+        {
+            memcpy(cold->line, data, sess->line_len);
+            client->buffer_len = (int)sess->line_len;
+        }
+    }
+    data += sess->line_len;
+    if (sess->sb_len > 0 && sess->sb_len <= TELNET_SB_MAX)
+    {
+        cold->sb_buf = (unsigned char *)telnets_buf_alloc(server, TELNET_SB_MAX, &cold->sb_class);
+        if (cold->sb_buf)
+        {
+            memcpy(cold->sb_buf, data, sess->sb_len);
+            cold->sb_len = sess->sb_len;
+        }
+    }
+    data += sess->sb_len;
+
+    // 旧进程中因预算或限速留到以后处理的输入，由就绪队列在第一轮处理
+    if (sess->typeahead_len > 0)
+    {
+        cold->typeahead = telnets_buf_alloc(server, sess->typeahead_len, &cold->typeahead_class);
+        if (cold->typeahead)
+        {
+            memcpy(cold->typeahead, data, sess->typeahead_len);
+            client->typeahead_len = (int)sess->typeahead_len;
+            telnets_sched_defer(client);
+        }
+    }
+    data += sess->typeahead_len;
+
+    // 旧进程没发完的输出先发，其中可能有压缩流的结束标记
+    if (sess->out_len > 0)
+    {
+        telnets_output(client, data, sess->out_len);
+    }
+
+    if (sess->compress == TELNET_MCCP_ON)
+    {
+        telnets_mccp_resume(client);
+    }
+    else if (sess->compress == TELNET_MCCP_OFFERED && server->mccp)
+    {
+        client->compress = TELNET_MCCP_OFFERED;
+    }
+
+    // 定时器按剩余时间重新启动
+    remaining = client->last_active + telnets_idle_timeout(server, client) - get_current_time();
+    telnets_timer_arm(&server->timers, &client->timers[TELNET_TIMER_IDLE], server->now_ms,
+                      remaining > 0 ? (uint64_t)remaining * 1000 : 0);
+    if (sess->negotiation_ms > 0)
+    {
+        telnets_timer_arm(&server->timers, &client->timers[TELNET_TIMER_NEGOTIATION], server->now_ms,
+                          sess->negotiation_ms);
+    }
+
+    return 0;
+}
+
+// 选一个有空位的工作线程，优先与旧进程相同编号的线程
+static telnet_server_t *telnets_upgrade_pick(telnet_master_t *master, uint32_t worker)
+{
+    for (int i = 0; i < master->nworkers; i++)
+    {
+        telnet_server_t *server = master->workers[(worker + i) % master->nworkers];
+
+        if (server->client_count < server->max_clients)
+        {
+            return server;
+        }
+    }
+
+    return NULL;
+}
+
+// 没有从旧进程得到监听socket的工作线程自己绑定（工作线程数比旧进程多时）
+static int telnets_upgrade_listen_rest(telnet_master_t *master)
+{
+    for (int i = 0; i < master->nworkers; i++)
+    {
+        if (master->workers[i]->wake_fd < 0 && telnet_server_listen(master->workers[i]) < 0)
+        {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+// 新进程启动时调用：从旧进程接收监听socket和会话，代替绑定端口
+int telnets_upgrade_receive(telnet_master_t *master)
+{
+    int sock = master->config.upgrade_fd;
+    int listening = 0;
+    int sessions = 0;
+    int dropped = 0;
+    char *data = NULL;
+    size_t data_cap = 0;
+    int ret = -1;
+
+    telnets_upgrade_timeouts(sock);
+    if (telnets_upgrade_send(sock, TELNET_UPGRADE_READY, 0, NULL, 0, NULL, 0, NULL, 0) < 0)
+    {
+        telnets_log_errno("Hot restart: previous process is gone");
+        close(sock);
+        return -1;
+    }
+
+    for (;;)
+    {
+        telnet_upgrade_hdr_t hdr;
+        int fds[2];
+        int nfds = telnets_upgrade_recv_hdr(sock, &hdr, fds, 2);
+
+        if (nfds < 0)
+        {
+            telnets_log_msg(TELNET_LOG_ERROR, "Hot restart: state transfer interrupted");
+            goto out;
+        }
+
+        if (hdr.type == TELNET_UPGRADE_LISTENER && nfds > 0)
+        {
+            telnet_server_t *server = (int)hdr.worker < master->nworkers ? master->workers[hdr.worker] : NULL;
+
+            if (!server || server->wake_fd >= 0)
+            {
+                // 旧进程工作线程更多，多出的监听socket队列中的连接会被重置
+                telnets_log_msg(TELNET_LOG_WARN, "Hot restart: no worker for listener %u, closing it", hdr.worker);
+                for (int i = 0; i < nfds; i++)
+                {
+                    close(fds[i]);
+                }
+                continue;
+            }
+            if (telnet_server_inherit(server, fds[0], nfds > 1 ? fds[1] : -1) < 0)
+            {
+                goto out;
+            }
+            continue;
+        }
+
+        for (int i = 0; i < nfds; i++)
+        {
+            if (hdr.type != TELNET_UPGRADE_SESSION || i > 0)
+            {
+                close(fds[i]);
+            }
+        }
+
+        if (!listening)
+        {
+            if (telnets_upgrade_listen_rest(master) < 0)
+            {
+                goto out;
+            }
+            listening = 1;
+        }
+
+        if (hdr.type == TELNET_UPGRADE_END)
+        {
+            break;
+        }
+
+        if (hdr.type != TELNET_UPGRADE_SESSION || nfds != 1 || hdr.len < sizeof(telnet_upgrade_session_t))
+        {
+            telnets_log_msg(TELNET_LOG_ERROR, "Hot restart: unexpected message %u", hdr.type);
+            if (nfds > 0 && hdr.type == TELNET_UPGRADE_SESSION)
+            {
+                close(fds[0]);
+            }
+            goto out;
+        }
+
+        if (hdr.len > data_cap)
+        {
+            char *p = (char *)realloc(data, hdr.len);
+
+            if (!p)
+            {
+                telnets_log_errno("Failed to allocate session state");
+                close(fds[0]);
+                goto out;
+            }
+            data = p;
+            data_cap = hdr.len;
+        }
+        if (telnets_upgrade_recv_all(sock, data, hdr.len) < 0)
+        {
+            close(fds[0]);
+            telnets_log_msg(TELNET_LOG_ERROR, "Hot restart: state transfer interrupted");
+            goto out;
+        }
+
+        {
+            telnet_upgrade_session_t sess;
+            telnet_server_t *server = telnets_upgrade_pick(master, hdr.worker);
+
+            memcpy(&sess, data, sizeof(sess));
+            if (sizeof(sess) + (size_t)sess.line_len + sess.sb_len + sess.typeahead_len + sess.out_len != hdr.len)
+            {
+                telnets_log_msg(TELNET_LOG_ERROR, "Hot restart: malformed session state");
+                close(fds[0]);
+                goto out;
+            }
+            if (!server || telnets_upgrade_adopt(server, fds[0], &sess, data + sizeof(sess)) < 0)
+            {
+                if (!server)
+                {
+                    close(fds[0]);
+                }
+                dropped++;
+                continue;
+            }
+            sessions++;
+        }
+    }
+
+    if (telnets_upgrade_send(sock, TELNET_UPGRADE_ACK, sessions, NULL, 0, NULL, 0, NULL, 0) < 0)
+    {
+        telnets_log_errno("Hot restart: previous process is gone");
+        goto out;
+    }
+
+    telnets_log_msg(TELNET_LOG_INFO, "Took over %d session(s) from the previous process", sessions);
+    if (dropped > 0)
+    {
+        telnets_log_msg(TELNET_LOG_WARN, "Hot restart: %d session(s) could not be adopted", dropped);
+    }
+    ret = 0;
+
+out:
+    free(data);
+    close(sock);
+    master->config.upgrade_fd = -1;
+    return ret;
+}
@@ -0,0 +1,956 @@
+/**
+ * @file telnet_uring.c
+ * @brief Telnet服务器io_uring事件后端
+ * @date liuliang 2026-01-25
+ *
+ * 本文件包含基于io_uring的accept、recv和send，直接使用系统调用，不依赖liburing
+ * 监听socket使用multishot accept，客户端使用multishot recv，
+ * 接收缓冲区来自本工作线程所有客户端共享的provided buffer环，处理完立即归还；
+ * 一轮事件循环中产生的发送请求和下一次等待合并为一次io_uring_enter；
+ * 内核不支持时telnets_event_init回退到epoll，上层处理函数两种后端共用
+ */
+
+#include "telnet_server.h"
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+// 完成事件标识：高8位为操作类型，其余位含义由类型决定
+#define TELNET_UD_ACCEPT 1ull           // 监听socket的accept
+#define TELNET_UD_RECV   2ull           // 客户端接收，低56位为24位代数和32位槽位
+#define TELNET_UD_SEND   3ull           // 客户端发送，低56位为发送请求指针
+#define TELNET_UD_WAKE   4ull           // 唤醒eventfd
+#define TELNET_UD_CANCEL 5ull           // 取消请求，完成事件忽略
+
+#define TELNET_UD(type, value)   (((uint64_t)(type) << 56) | ((uint64_t)(value) & 0xffffffffffffffull))
+#define TELNET_UD_TYPE(ud)       ((ud) >> 56)
+#define TELNET_UD_VALUE(ud)      ((ud) & 0xffffffffffffffull)
+#define TELNET_UD_RECV_TOKEN(slot, gen) \
+    TELNET_UD(TELNET_UD_RECV, ((uint64_t)((gen) & 0xffffff) << 32) | (uint32_t)(slot))
+
+#define TELNET_URING_BGID 0             // 接收缓冲区组编号
+
+// 发送请求，持有从输出队列摘下的块，发送完成后释放
+typedef struct telnet_uring_send {
+    struct telnet_uring_send *prev;
+    struct telnet_uring_send *next;
+    uint64_t token;                 // 所属客户端事件标识
+    int fd;                         // 客户端socket
+    int close_fd;                   // 客户端已移除，发完后关闭socket
+    telnet_outchunk_t *head;        // 未发完的块
+    telnet_outchunk_t *tail;
+    struct msghdr msg;
+    struct iovec iov[TELNET_URING_SEND_IOV];
+} telnet_uring_send_t;
+
+// io_uring实例
+typedef struct telnet_uring {
+    int ring_fd;
+    void *sq_ring;                  // 提交队列映射
+    size_t sq_ring_size;
+    void *cq_ring;                  // 完成队列映射，内核支持时与提交队列共用
+    size_t cq_ring_size;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned sq_mask;
+    unsigned sq_entries;
+    unsigned sq_local_tail;         // 已填写但未发布给内核的尾部
+    unsigned sq_submitted;          // 已提交给内核的尾部
+
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned cq_mask;
+    struct io_uring_cqe *cqes;
+
+    struct io_uring_buf_ring *buf_ring; // 共享接收缓冲区环
+    size_t buf_ring_size;
+    char *bufs;                     // 缓冲区内存
+    unsigned short buf_tail;
+
+    int accept_multishot;           // 内核支持multishot accept
+    int accept_armed;               // 有未结束的accept请求
+    int recv_multishot;             // 内核支持multishot recv
+    telnet_uring_send_t *sends;     // 发送中的请求，销毁时释放
+    telnet_uring_send_t *free_sends; // 空闲的发送请求，数量不超过同时发送的峰值
+} telnet_uring_t;
+
+
+static int telnets_uring_setup(unsigned entries, struct io_uring_params *p)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int telnets_uring_enter(int fd, unsigned to_submit, unsigned min_complete,
+                               unsigned flags, void *arg, size_t argsz)
+{
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, argsz);
+}
+
+static int telnets_uring_register(int fd, unsigned opcode, void *arg, unsigned nr_args)
+{
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+// 提交已填写的请求，不等待完成
+static int telnets_uring_submit(telnet_server_t *server)
+{
+    telnet_uring_t *u = server->uring;
+    unsigned to_submit = u->sq_local_tail - u->sq_submitted;
+    int ret;
+
+    if (to_submit == 0)
+    {
+        return 0;
+    }
+
+    __atomic_store_n(u->sq_tail, u->sq_local_tail, __ATOMIC_RELEASE);
+    TELNET_METRIC_ADD(server->metrics.syscalls, 1);
+    ret = telnets_uring_enter(u->ring_fd, to_submit, 0, 0, NULL, 0);
+    if (ret < 0)
+    {
+        return -1;
+    }
+
+    u->sq_submitted += (unsigned)ret;
+    return 0;
+}
+
+// 取一个空闲的提交项，队列满时先提交
+static struct io_uring_sqe *telnets_uring_get_sqe(telnet_server_t *server)
+{
+    telnet_uring_t *u = server->uring;
+    struct io_uring_sqe *sqe;
+
+    if (u->sq_local_tail - __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE) >= u->sq_entries)
+    {
+        if (telnets_uring_submit(server) < 0 ||
+            u->sq_local_tail - __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE) >= u->sq_entries)
+        {
+            telnets_log_errno("io_uring submission queue full");
+            return NULL;
+        }
+    }
+
+    sqe = &u->sqes[u->sq_local_tail & u->sq_mask];
+    memset(sqe, 0, sizeof(*sqe));
+    u->sq_local_tail++;
+    return sqe;
+}
+
+// 提交accept，支持时为multishot；上一个accept仍未结束（包括取消中）时不重复提交
+static int telnets_uring_arm_accept(telnet_server_t *server)
+{
+    struct io_uring_sqe *sqe;
+
+    if (server->uring->accept_armed)
+    {
+        return 0;
+    }
+
+    sqe = telnets_uring_get_sqe(server);
+    if (!sqe)
+    {
+        return -1;
+    }
+
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = server->listen_sockfd;
+    sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    sqe->ioprio = server->uring->accept_multishot ? IORING_ACCEPT_MULTISHOT : 0;
+    sqe->user_data = TELNET_UD(TELNET_UD_ACCEPT, 0);
+    server->uring->accept_armed = 1;
+    return 0;
+}
+
+// 提交客户端接收，数据放入共享缓冲区环中的缓冲区
+static int telnets_uring_arm_recv(telnet_server_t *server, telnet_client_t *client)
+{
+    struct io_uring_sqe *sqe = telnets_uring_get_sqe(server);
+    if (!sqe)
+    {
+        return -1;
+    }
+
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = client->sockfd;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = TELNET_URING_BGID;
+    // 配置了会话限速时使用单次recv：multishot在取消生效前会继续送达数据，
+    // 单次recv每次完成后再提交，暂停读取后最多多收一个缓冲区
+    sqe->ioprio = server->uring->recv_multishot && !server->buckets ? IORING_RECV_MULTISHOT : 0;
+    sqe->user_data = TELNET_UD_RECV_TOKEN(client->slot, client->generation);
+    client->recv_armed = 1;
+    return 0;
+}
+
+// 监听唤醒eventfd
+static int telnets_uring_arm_wake(telnet_server_t *server)
+{
+    struct io_uring_sqe *sqe = telnets_uring_get_sqe(server);
+    if (!sqe)
+    {
+        return -1;
+    }
+
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = server->wake_fd;
+    sqe->poll32_events = POLLIN;
+    sqe->len = IORING_POLL_ADD_MULTI;
+    sqe->user_data = TELNET_UD(TELNET_UD_WAKE, 0);
+    return 0;
+}
+
+// 按完成事件标识取消请求
+static int telnets_uring_cancel(telnet_server_t *server, uint64_t user_data)
+{
+    struct io_uring_sqe *sqe = telnets_uring_get_sqe(server);
+    if (!sqe)
+    {
+        return -1;
+    }
+
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = user_data;
+    sqe->user_data = TELNET_UD(TELNET_UD_CANCEL, 0);
+    return 0;
+}
+
+// 把缓冲区放回共享环
+static void telnets_uring_recycle(telnet_uring_t *u, unsigned short bid)
+{
+    struct io_uring_buf *buf = &u->buf_ring->bufs[u->buf_tail & (TELNET_URING_BUF_COUNT - 1)];
+
+    buf->addr = (uint64_t)(uintptr_t)(u->bufs + (size_t)bid * TELNET_URING_BUF_SIZE);
+    buf->len = TELNET_URING_BUF_SIZE;
+    buf->bid = bid;
+    u->buf_tail++;
+    __atomic_store_n(&u->buf_ring->tail, u->buf_tail, __ATOMIC_RELEASE);
+}
+
+// 创建共享接收缓冲区环并注册
+static int telnets_uring_setup_bufs(telnet_uring_t *u)
+{
+    struct io_uring_buf_reg reg;
+
+    u->buf_ring_size = TELNET_URING_BUF_COUNT * sizeof(struct io_uring_buf);
+    u->buf_ring = (struct io_uring_buf_ring *)mmap(NULL, u->buf_ring_size, PROT_READ | PROT_WRITE,
+                                                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (u->buf_ring == MAP_FAILED)
+    {
+        u->buf_ring = NULL;
+        return -1;
+    }
+
+    u->bufs = (char *)malloc((size_t)TELNET_URING_BUF_COUNT * TELNET_URING_BUF_SIZE);
+    if (!u->bufs)
+    {
+        return -1;
+    }
+
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)u->buf_ring;
+    reg.ring_entries = TELNET_URING_BUF_COUNT;
+    reg.bgid = TELNET_URING_BGID;
+    if (telnets_uring_register(u->ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+    {
+        return -1;
+    }
+
+    u->buf_tail = 0;
+    for (int i = 0; i < TELNET_URING_BUF_COUNT; i++)
+    {
+        telnets_uring_recycle(u, (unsigned short)i);
+    }
+
+    return 0;
+}
+
+// 映射提交队列和完成队列
+static int telnets_uring_map(telnet_uring_t *u, const struct io_uring_params *p)
+{
+    u->sq_ring_size = p->sq_off.array + p->sq_entries * sizeof(unsigned);
+    u->cq_ring_size = p->cq_off.cqes + p->cq_entries * sizeof(struct io_uring_cqe);
+    if (p->features & IORING_FEAT_SINGLE_MMAP)
+    {
+        if (u->cq_ring_size > u->sq_ring_size)
+        {
+            u->sq_ring_size = u->cq_ring_size;
+        }
+        u->cq_ring_size = u->sq_ring_size;
+    }
+
+    u->sq_ring = mmap(NULL, u->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      u->ring_fd, IORING_OFF_SQ_RING);
+    if (u->sq_ring == MAP_FAILED)
+    {
+        u->sq_ring = NULL;
+        return -1;
+    }
+
+    if (p->features & IORING_FEAT_SINGLE_MMAP)
+    {
+        u->cq_ring = u->sq_ring;
+    }
+    else
+    {
+        u->cq_ring = mmap(NULL, u->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                          u->ring_fd, IORING_OFF_CQ_RING);
+        if (u->cq_ring == MAP_FAILED)
+        {
+            u->cq_ring = NULL;
+            return -1;
+        }
+    }
+
+    u->sqes_size = p->sq_entries * sizeof(struct io_uring_sqe);
+    u->sqes = (struct io_uring_sqe *)mmap(NULL, u->sqes_size, PROT_READ | PROT_WRITE,
+                                          MAP_SHARED | MAP_POPULATE, u->ring_fd, IORING_OFF_SQES);
+    if (u->sqes == MAP_FAILED)
+    {
+        u->sqes = NULL;
+        return -1;
+    }
+
+    u->sq_head = (unsigned *)((char *)u->sq_ring + p->sq_off.head);
+    u->sq_tail = (unsigned *)((char *)u->sq_ring + p->sq_off.tail);
+    u->sq_mask = *(unsigned *)((char *)u->sq_ring + p->sq_off.ring_mask);
+    u->sq_entries = p->sq_entries;
+    u->sq_local_tail = *u->sq_tail;
+    u->sq_submitted = u->sq_local_tail;
+
+    // 提交项下标固定一一对应，之后只需推进尾部
+    unsigned *array = (unsigned *)((char *)u->sq_ring + p->sq_off.array);
+    for (unsigned i = 0; i < p->sq_entries; i++)
+    {
+        array[i] = i;
+    }
+
+    u->cq_head = (unsigned *)((char *)u->cq_ring + p->cq_off.head);
+    u->cq_tail = (unsigned *)((char *)u->cq_ring + p->cq_off.tail);
+    u->cq_mask = *(unsigned *)((char *)u->cq_ring + p->cq_off.ring_mask);
+    u->cqes = (struct io_uring_cqe *)((char *)u->cq_ring + p->cq_off.cqes);
+
+    return 0;
+}
+
+// 创建io_uring实例，内核不支持所需特性时返回-1，由调用方回退到epoll
+int telnets_uring_init(telnet_server_t *server)
+{
+    struct io_uring_params p;
+    telnet_uring_t *u;
+
+    u = (telnet_uring_t *)calloc(1, sizeof(telnet_uring_t));
+    if (!u)
+    {
+        return -1;
+    }
+    u->ring_fd = -1;
+    server->uring = u;
+
+    memset(&p, 0, sizeof(p));
+    p.flags = IORING_SETUP_CQSIZE | IORING_SETUP_COOP_TASKRUN;
+    p.cq_entries = TELNET_URING_CQ_ENTRIES;
+    u->ring_fd = telnets_uring_setup(TELNET_URING_ENTRIES, &p);
+    if (u->ring_fd < 0 && errno == EINVAL)
+    {
+        // 旧内核不认识COOP_TASKRUN
+        memset(&p, 0, sizeof(p));
+        p.flags = IORING_SETUP_CQSIZE;
+        p.cq_entries = TELNET_URING_CQ_ENTRIES;
+        u->ring_fd = telnets_uring_setup(TELNET_URING_ENTRIES, &p);
+    }
+    if (u->ring_fd < 0)
+    {
+        telnets_log_errno("io_uring_setup failed");
+        telnets_uring_destroy(server);
+        return -1;
+    }
+
+    // 等待超时依赖EXT_ARG(5.11)，完成队列溢出不丢事件依赖NODROP
+    if (!(p.features & IORING_FEAT_EXT_ARG) || !(p.features & IORING_FEAT_NODROP))
+    {
+        telnets_log_msg(TELNET_LOG_WARN, "io_uring: kernel lacks required features");
+        telnets_uring_destroy(server);
+        return -1;
+    }
+
+    if (telnets_uring_map(u, &p) < 0)
+    {
+        telnets_log_errno("io_uring mmap failed");
+        telnets_uring_destroy(server);
+        return -1;
+    }
+
+    // 共享缓冲区环依赖5.19
+    if (telnets_uring_setup_bufs(u) < 0)
+    {
+        telnets_log_errno("io_uring provided buffer ring failed");
+        telnets_uring_destroy(server);
+        return -1;
+    }
+
+    // multishot先假定可用，内核返回EINVAL时降级为单次请求
+    u->accept_multishot = 1;
+    u->recv_multishot = 1;
+
+    if (telnets_uring_arm_wake(server) < 0)
+    {
+        telnets_uring_destroy(server);
+        return -1;
+    }
+
+    return 0;
+}
+
+static void telnets_uring_send_free(telnet_uring_t *u, telnet_uring_send_t *req)
+{
+    telnet_outchunk_t *chunk = req->head;
+
+    while (chunk)
+    {
+        telnet_outchunk_t *next = chunk->next;
+        telnets_outchunk_free(chunk);
+        chunk = next;
+    }
+
+    if (req->prev)
+    {
+        req->prev->next = req->next;
+    }
+    else
+    {
+        u->sends = req->next;
+    }
+    if (req->next)
+    {
+        req->next->prev = req->prev;
+    }
+
+    // 留待下次发送复用
+    req->next = u->free_sends;
+    u->free_sends = req;
+}
+
+// 销毁io_uring实例，关闭ring_fd会取消所有未完成的请求
+void telnets_uring_destroy(telnet_server_t *server)
+{
+    telnet_uring_t *u = server->uring;
+
+    if (!u)
+    {
+        return;
+    }
+
+    if (u->ring_fd >= 0)
+    {
+        close(u->ring_fd);
+    }
+
+    while (u->sends)
+    {
+        telnet_uring_send_t *req = u->sends;
+        if (req->close_fd)
+        {
+            close(req->fd);
+        }
+        telnets_uring_send_free(u, req);
+    }
+
+    while (u->free_sends)
+    {
+        telnet_uring_send_t *req = u->free_sends;
+        u->free_sends = req->next;
+        free(req);
+    }
+
+    if (u->sqes)
+    {
+        munmap(u->sqes, u->sqes_size);
+    }
+    if (u->cq_ring && u->cq_ring != u->sq_ring)
+    {
+        munmap(u->cq_ring, u->cq_ring_size);
+    }
+    if (u->sq_ring)
+    {
+        munmap(u->sq_ring, u->sq_ring_size);
+    }
+    if (u->buf_ring)
+    {
+        munmap(u->buf_ring, u->buf_ring_size);
+    }
+    free(u->bufs);
+    free(u);
+    server->uring = NULL;
+}
+
+// 注册socket：监听socket提交accept，客户端socket提交recv
+int telnets_uring_add(telnet_server_t *server, int sockfd, uint64_t token)
+{
+    telnet_client_t *client;
+
+    if (token == TELNET_LISTEN_TOKEN)
+    {
+        return telnets_uring_arm_accept(server);
+    }
+
+    client = telnets_lookup_token(server, token);
+    if (!client || client->sockfd != sockfd)
+    {
+        return -1;
+    }
+
+    return telnets_uring_arm_recv(server, client);
+}
+
+// 修改关注的事件：只需处理读取的暂停和恢复，发送由完成事件驱动
+int telnets_uring_mod(telnet_server_t *server, telnet_client_t *client, uint32_t events)
+{
+    if ((events & EPOLLIN) && !client->recv_armed)
+    {
+        if (telnets_uring_arm_recv(server, client) < 0)
+        {
+            return -1;
+        }
+    }
+    else if (!(events & EPOLLIN) && client->recv_armed)
+    {
+        // 取消后recv_armed在完成事件中清除，期间已到达的数据照常处理
+        if (telnets_uring_cancel(server, TELNET_UD_RECV_TOKEN(client->slot, client->generation)) < 0)
+        {
+            return -1;
+        }
+    }
+
+    client->events = events;
+    return 0;
+}
+
+// 注销客户端：取消接收，否则请求持有的文件引用会让socket在close后仍不关闭
+void telnets_uring_del(telnet_server_t *server, telnet_client_t *client)
+{
+    if (client->recv_armed)
+    {
+        telnets_uring_cancel(server, TELNET_UD_RECV_TOKEN(client->slot, client->generation));
+        client->recv_armed = 0;
+    }
+}
+
+// 暂停接受：取消accept，取消完成前已接受的连接照常经过telnets_accept_client
+void telnets_uring_del_accept(telnet_server_t *server)
+{
+    if (server->uring->accept_armed)
+    {
+        telnets_uring_cancel(server, TELNET_UD(TELNET_UD_ACCEPT, 0));
+    }
+}
+
+// 提交发送请求，每次最多TELNET_URING_SEND_IOV个块
+static int telnets_uring_submit_send(telnet_server_t *server, telnet_uring_send_t *req)
+{
+    struct io_uring_sqe *sqe;
+    int iovcnt = 0;
+
+    for (telnet_outchunk_t *chunk = req->head; chunk && iovcnt < TELNET_URING_SEND_IOV; chunk = chunk->next)
+    {
+        req->iov[iovcnt].iov_base = TELNET_CHUNK_DATA(chunk) + chunk->off;
+        req->iov[iovcnt].iov_len = chunk->len - chunk->off;
+        iovcnt++;
+    }
+
+    memset(&req->msg, 0, sizeof(req->msg));
+    req->msg.msg_iov = req->iov;
+    req->msg.msg_iovlen = iovcnt;
+
+    sqe = telnets_uring_get_sqe(server);
+    if (!sqe)
+    {
+        return -1;
+    }
+
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = req->fd;
+    sqe->addr = (uint64_t)(uintptr_t)&req->msg;
+    sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = TELNET_UD(TELNET_UD_SEND, (uintptr_t)req);
+    return 0;
+}
+
+// 发送输出队列：没有发送中的请求时把队列中的块全部摘下交给新请求，
+// 发送中的字节仍计入outq.bytes，完成后才扣除，高水位判断不受影响
+int telnets_uring_send(telnet_server_t *server, telnet_client_t *client)
+{
+    telnet_uring_t *u = server->uring;
+    telnet_uring_send_t *req;
+
+    if (client->send_req || !client->outq.head)
+    {
+        return 0;
+    }
+
+    req = u->free_sends;
+    if (req)
+    {
+        u->free_sends = req->next;
+    }
+    else
+    {
+        req = (telnet_uring_send_t *)malloc(sizeof(telnet_uring_send_t));
+        if (!req)
+        {
+            telnets_log_errno("Failed to allocate send request");
+            return -1;
+        }
+    }
+
+    req->token = TELNET_TOKEN(client->slot, client->generation);
+    req->fd = client->sockfd;
+    req->close_fd = 0;
+    req->head = client->outq.head;
+    req->tail = client->outq.tail;
+    client->outq.head = NULL;
+    client->outq.tail = NULL;
+
+    req->prev = NULL;
+    req->next = u->sends;
+    if (u->sends)
+    {
+        u->sends->prev = req;
+    }
+    u->sends = req;
+
+    if (telnets_uring_submit_send(server, req) < 0)
+    {
+        telnets_uring_send_free(u, req);
+        return -1;
+    }
+
+    client->send_req = req;
+    return 0;
+}
+
+// 移除客户端时还有发送中的请求：剩余输出交给该请求，发完后由请求关闭socket
+// 返回1表示socket由请求负责关闭
+int telnets_uring_defer_close(telnet_server_t *server, telnet_client_t *client)
+{
+    telnet_uring_send_t *req = client->send_req;
+
+    if (!server->uring || !req)
+    {
+        return 0;
+    }
+
+    if (client->outq.head)
+    {
+        req->tail->next = client->outq.head;
+        req->tail = client->outq.tail;
+        client->outq.head = NULL;
+        client->outq.tail = NULL;
+        client->outq.bytes = 0;
+    }
+
+    req->close_fd = 1;
+    client->send_req = NULL;
+    return 1;
+}
+
+// 提交本轮的请求并等待完成事件，返回可处理的完成事件数
+int telnets_uring_wait(telnet_server_t *server, int timeout_ms)
+{
+    telnet_uring_t *u = server->uring;
+    struct io_uring_getevents_arg arg;
+    struct __kernel_timespec ts;
+    unsigned to_submit = u->sq_local_tail - u->sq_submitted;
+    unsigned wait_nr = 1;
+    int ret;
+
+    // 上一轮未处理完的完成事件直接返回
+    if (*u->cq_head != __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE))
+    {
+        wait_nr = 0;
+    }
+
+    memset(&arg, 0, sizeof(arg));
+    if (timeout_ms >= 0 && wait_nr)
+    {
+        ts.tv_sec = timeout_ms / 1000;
+        ts.tv_nsec = (long long)(timeout_ms % 1000) * 1000000;
+        arg.ts = (uint64_t)(uintptr_t)&ts;
+    }
+
+    if (to_submit == 0 && wait_nr == 0)
+    {
+        return (int)(__atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE) - *u->cq_head);
+    }
+
+    __atomic_store_n(u->sq_tail, u->sq_local_tail, __ATOMIC_RELEASE);
+    TELNET_METRIC_ADD(server->metrics.syscalls, 1);
+    ret = telnets_uring_enter(u->ring_fd, to_submit, wait_nr,
+                              IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+    if (ret < 0)
+    {
+        if (errno != ETIME && errno != EINTR && errno != EBUSY)
+        {
+            return -1;
+        }
+    }
+    else
+    {
+        u->sq_submitted += (unsigned)ret;
+    }
+
+    return (int)(__atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE) - *u->cq_head);
+}
+
+// accept完成
+static void telnets_uring_on_accept(telnet_server_t *server, struct io_uring_cqe *cqe)
+{
+    if (cqe->res >= 0)
+    {
+        struct sockaddr_in addr;
+        socklen_t addr_len = sizeof(addr);
+
+        // multishot accept不逐个返回对端地址
+        TELNET_METRIC_ADD(server->metrics.syscalls, 1);
+        if (getpeername(cqe->res, (struct sockaddr *)&addr, &addr_len) < 0)
+        {
+            memset(&addr, 0, sizeof(addr));
+        }
+        telnets_accept_client(server, cqe->res, &addr, TELNET_TRANSPORT_TCP);
+    }
+    else if (cqe->res == -EINVAL && server->uring->accept_multishot)
+    {
+        telnets_log_msg(TELNET_LOG_WARN, "io_uring multishot accept unsupported, using single-shot");
+        server->uring->accept_multishot = 0;
+    }
+    else if (cqe->res != -EAGAIN && cqe->res != -EINTR && cqe->res != -ECANCELED)
+    {
+        telnets_log_error("Accept failed", -cqe->res);
+    }
+
+    // 暂停接受期间不再提交，恢复时由telnets_uring_add提交
+    if (!(cqe->flags & IORING_CQE_F_MORE))
+    {
+        server->uring->accept_armed = 0;
+        if (server->running && !server->accept_paused)
+        {
+            telnets_uring_arm_accept(server);
+        }
+    }
+}
+
+// recv完成，缓冲区处理后立即放回共享环
+static void telnets_uring_on_recv(telnet_server_t *server, struct io_uring_cqe *cqe)
+{
+    telnet_uring_t *u = server->uring;
+    uint64_t value = TELNET_UD_VALUE(cqe->user_data);
+    int slot = (int)(value & 0xffffffffu);
+    uint32_t gen = (uint32_t)(value >> 32);
+    telnet_client_t *client = telnets_get_client(server, slot);
+    int has_buf = (cqe->flags & IORING_CQE_F_BUFFER) != 0;
+    unsigned short bid = (unsigned short)(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+
+    if (client && (client->generation & 0xffffff) != gen)
+    {
+        client = NULL;
+    }
+
+    if (client && !(cqe->flags & IORING_CQE_F_MORE))
+    {
+        client->recv_armed = 0;
+    }
+
+    if (cqe->res > 0 && has_buf)
+    {
+        if (client && telnets_recv_input(server, slot, u->bufs + (size_t)bid * TELNET_URING_BUF_SIZE, cqe->res) < 0)
+        {
+            client = NULL;
+        }
+    }
+    else if (cqe->res == 0)
+    {
+        if (client)
+        {
+            telnets_recv_closed(server, slot, 0);
+            client = NULL;
+        }
+    }
+    else if (cqe->res == -EINVAL && u->recv_multishot)
+    {
+        telnets_log_msg(TELNET_LOG_WARN, "io_uring multishot recv unsupported, using single-shot");
+        u->recv_multishot = 0;
+    }
+    else if (cqe->res < 0 && cqe->res != -ENOBUFS && cqe->res != -ECANCELED && cqe->res != -EINTR)
+    {
+        if (client)
+        {
+            telnets_recv_closed(server, slot, -cqe->res);
+            client = NULL;
+        }
+    }
+
+    if (has_buf)
+    {
+        telnets_uring_recycle(u, bid);
+    }
+
+    // multishot因缓冲区耗尽等原因结束时重新提交，暂停读取时等输出发空或令牌补充后再提交
+    if (client && !client->recv_armed && !(client->read_paused & TELNET_PAUSE_UNWATCH) && (client->events & EPOLLIN))
+    {
+        telnets_uring_arm_recv(server, client);
+    }
+}
+
+// 丢弃已发送的n字节
+static void telnets_uring_send_consume(telnet_uring_send_t *req, size_t n)
+{
+    while (n > 0 && req->head)
+    {
+        telnet_outchunk_t *chunk = req->head;
+        size_t avail = chunk->len - chunk->off;
+
+        if (n < avail)
+        {
+            chunk->off += n;
+            return;
+        }
+
+        n -= avail;
+        req->head = chunk->next;
+        telnets_outchunk_free(chunk);
+    }
+
+    if (!req->head)
+    {
+        req->tail = NULL;
+    }
+}
+
+// send完成
+static void telnets_uring_on_send(telnet_server_t *server, struct io_uring_cqe *cqe)
+{
+    telnet_uring_t *u = server->uring;
+    telnet_uring_send_t *req = (telnet_uring_send_t *)(uintptr_t)TELNET_UD_VALUE(cqe->user_data);
+    telnet_client_t *client = NULL;
+    int failed = cqe->res <= 0;
+
+    if (!req->close_fd)
+    {
+        client = telnets_lookup_token(server, req->token);
+        if (client && client->send_req != req)
+        {
+            client = NULL;
+        }
+    }
+
+    if (cqe->res > 0)
+    {
+        TELNET_METRIC_ADD(server->metrics.bytes_out, cqe->res);
+        telnets_uring_send_consume(req, (size_t)cqe->res);
+        if (client)
+        {
+            client->outq.bytes -= (size_t)cqe->res;
+        }
+    }
+
+    // 部分发送时继续发送剩余部分
+    if (!failed && req->head && (client || req->close_fd))
+    {
+        if (telnets_uring_submit_send(server, req) == 0)
+        {
+            return;
+        }
+        failed = 1;
+    }
+
+    if (req->close_fd)
+    {
+        close(req->fd);
+        TELNET_METRIC_ADD(server->metrics.syscalls, 1);
+    }
+    telnets_uring_send_free(u, req);
+
+    if (!client)
+    {
+        return;
+    }
+
+    client->send_req = NULL;
+    if (failed)
+    {
+        if (cqe->res < 0)
+        {
+            telnets_log_error("Send error", -cqe->res);
+        }
+        else
+        {
+            telnets_log_msg(TELNET_LOG_WARN, "Send error: short send");
+        }
+        telnets_remove_client(server, client->slot);
+        return;
+    }
+
+    // 发送期间追加的输出继续发送，并重新计算是否暂停读取
+    if (telnets_flush_client(server, client) < 0)
+    {
+        telnets_log_errno("Send error");
+        telnets_remove_client(server, client->slot);
+    }
+}
+
+// 处理所有完成事件
+void telnets_uring_dispatch(telnet_server_t *server)
+{
+    telnet_uring_t *u = server->uring;
+    unsigned head = *u->cq_head;
+    unsigned tail = __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE);
+
+    while (head != tail)
+    {
+        struct io_uring_cqe cqe = u->cqes[head & u->cq_mask];
+
+        // 先归还完成队列项，处理过程中可能提交新请求
+        head++;
+        __atomic_store_n(u->cq_head, head, __ATOMIC_RELEASE);
+
+        switch (TELNET_UD_TYPE(cqe.user_data))
+        {
+            case TELNET_UD_ACCEPT:
+                telnets_uring_on_accept(server, &cqe);
+                break;
+
+            case TELNET_UD_RECV:
+                telnets_uring_on_recv(server, &cqe);
+                break;
+
+            case TELNET_UD_SEND:
+                telnets_uring_on_send(server, &cqe);
+                break;
+
+            case TELNET_UD_WAKE:
+            {
+                // 读空唤醒计数，running等状态在循环条件中检查
+                uint64_t count;
+                TELNET_METRIC_ADD(server->metrics.syscalls, 1);
+                if (read(server->wake_fd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+                {
+                    telnets_log_errno("eventfd read failed");
+                }
+                if (!(cqe.flags & IORING_CQE_F_MORE))
+                {
+                    telnets_uring_arm_wake(server);
+                }
+                break;
+            }
+
+            default:
+                break;
+        }
+    }
+}